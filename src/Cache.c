@@ -0,0 +1,283 @@
+#include "Cache.h"
+#include "DynamicArray.h"
+#include "DynamicArrayAlgorithms.h"
+#include "DynamicArrayIO.h"
+#include "HashMap.h"
+#include "Strings.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#define mkdir(path, mode) _mkdir(path)
+#define utime _utime
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+// One entry in the cache directory, as found while looking for entries to remove
+typedef struct CacheEntry {
+    string path;
+    uint64_t size;
+    // When the entry was last used, which is the modification time of its file. Only ever compared with each other,
+    // so the unit depends on the platform
+    long long used;
+} CacheEntry;
+
+static int cache_entry_deallocator(void* entry) {
+    string_free(&((CacheEntry*)entry)->path);
+    return 0;
+}
+
+// Builds the path of a file in the cache directory
+static void cache_path(Cache* cache, string* path, const char* name) {
+    size_t len = strlen(name);
+    string_init(path);
+    string_resize(path, cache->dir.len + 1 + len);
+    memcpy(path->str, cache->dir.str, cache->dir.len);
+    path->str[cache->dir.len] = '/';
+    memcpy(path->str + cache->dir.len + 1, name, len);
+}
+
+static void cache_entry_path(Cache* cache, string* path, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx" CACHE_FILE_EXTENSION, (unsigned long long)key);
+    cache_path(cache, path, name);
+}
+
+int cache_open(Cache* cache, string* dir, uint64_t limit) {
+    dynamic_array_registry_type_append(&STRING("CacheEntry"), cache_entry_deallocator, sizeof(CacheEntry));
+    string_init(&cache->dir);
+    string_copy(&cache->dir, dir);
+    cache->limit = limit;
+    memset(&cache->run, 0, sizeof(cache->run));
+    memset(&cache->total, 0, sizeof(cache->total));
+
+    if (mkdir(cache->dir.str, 0755) != 0 && errno != EEXIST) {
+        string_free(&cache->dir);
+        return -1;
+    }
+
+    string path;
+    cache_path(cache, &path, CACHE_STATS_FILE);
+    MappedFile stats;
+    if (mapped_file_open(&stats, &path) == 0) {
+        if (stats.size == sizeof(CacheStats)) {
+            memcpy(&cache->total, stats.data, sizeof(CacheStats));
+        }
+        mapped_file_close(&stats);
+    }
+    string_free(&path);
+    return 0;
+}
+
+int cache_close(Cache* cache) {
+    // Another process could have saved its counters since this one opened the cache, so they are read again right before
+    // writing. The two can still race, but the counters are only there to give an idea of how well the cache works
+    string path;
+    cache_path(cache, &path, CACHE_STATS_FILE);
+    CacheStats total = {0};
+    MappedFile stats;
+    if (mapped_file_open(&stats, &path) == 0) {
+        if (stats.size == sizeof(CacheStats)) {
+            memcpy(&total, stats.data, sizeof(CacheStats));
+        }
+        mapped_file_close(&stats);
+    }
+    total.hits += cache->run.hits;
+    total.misses += cache->run.misses;
+    total.stores += cache->run.stores;
+    total.evictions += cache->run.evictions;
+    file_write_atomic(&path, &total, sizeof(total));
+    string_free(&path);
+    string_free(&cache->dir);
+    return 0;
+}
+
+uint64_t cache_key(const void* source, size_t size, const char* kind) {
+    uint64_t key = hash_map_hash_bytes(source, size);
+    key ^= hash_map_hash_int(hash_map_hash_bytes(CACHE_COMPILER_VERSION, strlen(CACHE_COMPILER_VERSION)));
+    key = hash_map_hash_int(key ^ hash_map_hash_bytes(kind, strlen(kind)));
+    // The size is mixed in separately so that a collision would also need the two sources to be the same length
+    return key ^ hash_map_hash_int((uint64_t)size);
+}
+
+int cache_lookup(Cache* cache, uint64_t key, MappedFile* entry, const void** payload, size_t* size) {
+    string path;
+    cache_entry_path(cache, &path, key);
+    if (mapped_file_open(entry, &path) != 0) {
+        string_free(&path);
+        cache->run.misses++;
+        return -1;
+    }
+
+    const CacheFileHeader* header = (const CacheFileHeader*)entry->data;
+    bool valid = entry->size >= sizeof(CacheFileHeader) && memcmp(header->magic, CACHE_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+                 header->byte_order == CACHE_FILE_BYTE_ORDER && header->key == key &&
+                 header->payload_size == entry->size - sizeof(CacheFileHeader) &&
+                 header->checksum == hash_map_hash_bytes((const char*)entry->data + sizeof(CacheFileHeader), header->payload_size);
+    if (!valid) {
+        // Whatever is there is no good to anyone, so it is removed to make room
+        mapped_file_close(entry);
+        remove(path.str);
+        string_free(&path);
+        cache->run.misses++;
+        return -1;
+    }
+
+    // The modification time of an entry is when it was last used, which is what eviction goes by
+    utime(path.str, NULL);
+    string_free(&path);
+    *payload = (const char*)entry->data + sizeof(CacheFileHeader);
+    *size = header->payload_size;
+    return 0;
+}
+
+int cache_loaded(Cache* cache, uint64_t key, bool loaded) {
+    if (loaded) {
+        cache->run.hits++;
+        return 0;
+    }
+
+    string path;
+    cache_entry_path(cache, &path, key);
+    remove(path.str);
+    string_free(&path);
+    cache->run.misses++;
+    return 0;
+}
+
+// Adds every entry in the cache directory to entries (an array of CacheEntry), and returns how many bytes they add up to
+static uint64_t cache_list_entries(Cache* cache, DynamicArray* entries) {
+    uint64_t total = 0;
+    size_t extension = strlen(CACHE_FILE_EXTENSION);
+
+#if defined(_WIN32)
+    string pattern;
+    cache_path(cache, &pattern, "*" CACHE_FILE_EXTENSION);
+    struct _finddata_t found;
+    intptr_t handle = _findfirst(pattern.str, &found);
+    string_free(&pattern);
+    if (handle == -1) {
+        return 0;
+    }
+    do {
+        CacheEntry entry = {.size = found.size, .used = (long long)found.time_write};
+        cache_path(cache, &entry.path, found.name);
+        dynamic_array_append(entries, &entry);
+        total += entry.size;
+    } while (_findnext(handle, &found) == 0);
+    _findclose(handle);
+#else
+    DIR* dir = opendir(cache->dir.str);
+    if (dir == NULL) {
+        return 0;
+    }
+    struct dirent* found;
+    while ((found = readdir(dir)) != NULL) {
+        size_t len = strlen(found->d_name);
+        if (len <= extension || strcmp(found->d_name + len - extension, CACHE_FILE_EXTENSION) != 0) {
+            continue;
+        }
+        CacheEntry entry;
+        cache_path(cache, &entry.path, found->d_name);
+        struct stat info;
+        if (stat(entry.path.str, &info) != 0) {
+            // Another process removed it in the meantime
+            string_free(&entry.path);
+            continue;
+        }
+        entry.size = info.st_size;
+        // Entries are often used within the same second, so the nanoseconds are needed to tell which came first
+#if defined(__APPLE__)
+        entry.used = (long long)info.st_mtimespec.tv_sec * 1000000000ll + info.st_mtimespec.tv_nsec;
+#else
+        entry.used = (long long)info.st_mtim.tv_sec * 1000000000ll + info.st_mtim.tv_nsec;
+#endif
+        dynamic_array_append(entries, &entry);
+        total += entry.size;
+    }
+    closedir(dir);
+#endif
+
+    return total;
+}
+
+static int cache_compare_used(const void* a, const void* b) {
+    long long x = ((const CacheEntry*)a)->used;
+    long long y = ((const CacheEntry*)b)->used;
+    return x < y ? -1 : x > y;
+}
+
+// Removes the least recently used entries until the directory fits in the size limit again
+static void cache_evict(Cache* cache) {
+    DynamicArray entries;
+    dynamic_array_init(&entries, &STRING("CacheEntry"));
+    uint64_t total = cache_list_entries(cache, &entries);
+    if (total > cache->limit) {
+        dynamic_array_sort(&entries, cache_compare_used, NULL);
+        for (unsigned int i = 0; i < entries.len && total > cache->limit; i++) {
+            CacheEntry* entry = &((CacheEntry*)entries.buf)[i];
+            if (remove(entry->path.str) == 0) {
+                cache->run.evictions++;
+            }
+            // Even if it couldn't be removed (like if another process got to it first), it no longer takes up space
+            total -= entry->size;
+        }
+    }
+    dynamic_array_free(&entries);
+}
+
+int cache_store(Cache* cache, uint64_t key, const void* payload, size_t size) {
+    size_t total = sizeof(CacheFileHeader) + size;
+    char* data = (char*)malloc(total);
+    if (data == NULL) {
+        printf("Failed to allocate memory in cache_store\n");
+        exit(-1);
+    }
+
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(header.magic));
+    header.byte_order = CACHE_FILE_BYTE_ORDER;
+    header.key = key;
+    header.payload_size = size;
+    header.checksum = hash_map_hash_bytes(payload, size);
+    memcpy(data, &header, sizeof(header));
+    if (size > 0) {
+        memcpy(data + sizeof(header), payload, size);
+    }
+
+    string path;
+    cache_entry_path(cache, &path, key);
+    int result = file_write_atomic(&path, data, total);
+    string_free(&path);
+    free(data);
+    if (result != 0) {
+        return -1;
+    }
+    cache->run.stores++;
+    cache_evict(cache);
+    return 0;
+}
+
+int cache_print_stats(Cache* cache) {
+    CacheStats total = cache->total;
+    total.hits += cache->run.hits;
+    total.misses += cache->run.misses;
+    total.stores += cache->run.stores;
+    total.evictions += cache->run.evictions;
+    printf("cache: %llu hits, %llu misses, %llu stores, %llu evictions (all runs: %llu hits, %llu misses, %llu stores, %llu evictions)\n",
+           (unsigned long long)cache->run.hits, (unsigned long long)cache->run.misses, (unsigned long long)cache->run.stores,
+           (unsigned long long)cache->run.evictions, (unsigned long long)total.hits, (unsigned long long)total.misses,
+           (unsigned long long)total.stores, (unsigned long long)total.evictions);
+    return 0;
+}
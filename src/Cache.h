@@ -0,0 +1,89 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "DynamicArrayIO.h"
+#include "Strings.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A directory of compiler outputs that persists between runs. Every entry is one file named after its key, which is
+// a hash of the source it was made from along with the version of the compiler, so an entry can never be used for
+// a different input or by a compiler that would have made something else. The directory is kept under a size limit by
+// removing the entries that were used the longest time ago
+
+// Changing anything about what gets stored in the cache (like the layout of the AST) has to change this, so that
+// the entries from older compilers stop matching
+#define CACHE_COMPILER_VERSION "0.1.2"
+
+#define CACHE_FILE_MAGIC "CMPCACHE"
+// Used to detect entries that were written on a machine with a different byte order
+#define CACHE_FILE_BYTE_ORDER 0x01020304u
+#define CACHE_FILE_EXTENSION ".cache"
+// The name of the file in the cache directory that keeps the counters from every run
+#define CACHE_STATS_FILE "stats"
+
+// The size limit used when none is given
+#define CACHE_DEFAULT_LIMIT (64ull * 1024 * 1024)
+
+// Every entry starts with this, followed by the payload. The header is 64 bytes so that the payload is aligned
+// for any type that gets stored in it
+typedef struct CacheFileHeader {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t __padding;
+    uint64_t key;
+    uint64_t payload_size;
+    // A hash of the payload, so that an entry that was damaged on disk is treated as a miss instead of being loaded
+    uint64_t checksum;
+    uint64_t __reserved[3];
+} CacheFileHeader;
+
+typedef struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+} CacheStats;
+
+typedef struct Cache {
+    string dir;
+    // The most bytes the entries in the directory can add up to
+    uint64_t limit;
+    // What happened during this run
+    CacheStats run;
+    // What happened during every earlier run that used this directory. Read from the stats file when the cache is opened,
+    // and the counters of this run are added to the file when it is closed
+    CacheStats total;
+} Cache;
+
+// Opens the cache in the given directory, making the directory if it doesn't exist yet. Returns -1 if it couldn't be made
+int cache_open(Cache* cache, string* dir, uint64_t limit);
+
+// Saves the counters to the stats file and frees the cache
+int cache_close(Cache* cache);
+
+// Returns the key for the source that an entry is made from. kind tells apart different things made from the same
+// source (like "ast" and "bytecode")
+uint64_t cache_key(const void* source, size_t size, const char* kind);
+
+// Looks for the entry with the given key. On a hit, the entry is mapped into entry, payload and size are set to the
+// part of it after the header, and the entry is marked as the most recently used one. The payload is only valid until
+// mapped_file_close is called on entry. Returns -1 on a miss.
+// Every successful lookup has to be followed by cache_loaded once the payload has been read, since the lookup isn't
+// counted as a hit until then
+int cache_lookup(Cache* cache, uint64_t key, MappedFile* entry, const void** payload, size_t* size);
+
+// Tells the cache whether the payload of the entry that cache_lookup found could actually be loaded. If it couldn't (say it
+// was written in a format that has changed since), the entry is removed and the lookup counts as a miss, so that the entry is
+// made again from scratch. The entry still has to be closed by the caller either way
+int cache_loaded(Cache* cache, uint64_t key, bool loaded);
+
+// Writes the entry with the given key, replacing any that was already there, then removes the least recently used entries
+// until the directory is back under the size limit. Other processes only ever see the old entry or the complete new one
+int cache_store(Cache* cache, uint64_t key, const void* payload, size_t size);
+
+// Prints the counters for this run and for every run so far
+int cache_print_stats(Cache* cache);
+
+#endif
@@ -0,0 +1,85 @@
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "DynamicArrayAlgorithms.h"
+#include "Strings.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int diagnostics_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("Diagnostic"), diagnostic_deallocator, sizeof(Diagnostic));
+    return 0;
+}
+
+int diagnostic_deallocator(void* diagnostic) {
+    string_free(&((Diagnostic*)diagnostic)->message);
+    return 0;
+}
+
+int diagnostics_add(DynamicArray* diagnostics, unsigned int severity, unsigned int offset, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) {
+        return -1;
+    }
+
+    Diagnostic diagnostic = {.offset = offset, .severity = severity};
+    string_init(&diagnostic.message);
+    string_resize(&diagnostic.message, len);
+
+    va_start(args, format);
+    vsnprintf(diagnostic.message.str, len + 1, format, args);
+    va_end(args);
+    diagnostic.message.len = len;
+
+    dynamic_array_append(diagnostics, &diagnostic);
+    return 0;
+}
+
+unsigned int diagnostics_count(DynamicArray* diagnostics, unsigned int severity) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < diagnostics->len; i++) {
+        count += ((Diagnostic*)diagnostics->buf)[i].severity == severity;
+    }
+    return count;
+}
+
+static const char* DIAGNOSTIC_SEVERITY_NAMES[] = {
+    [DIAG_ERROR] = "error",
+    [DIAG_WARNING] = "warning",
+    [DIAG_NOTE] = "note",
+};
+
+int diagnostics_print(DynamicArray* diagnostics, string* file, const char* path) {
+    // Later passes can add diagnostics for earlier parts of the file, so they are put back in order first.
+    // The sort is stable, so diagnostics at the same spot stay in the order they were found
+    dynamic_array_radix_sort(diagnostics, offsetof(Diagnostic, offset), DA_TYPE_UNSIGNED_INT, NULL);
+
+    // Since the diagnostics are in order, the line and column of all of them can be found in one pass over the file
+    unsigned int pos = 0;
+    unsigned int line = 1;
+    unsigned int lineStart = 0;
+    for (unsigned int i = 0; i < diagnostics->len; i++) {
+        Diagnostic* diagnostic = &((Diagnostic*)diagnostics->buf)[i];
+        unsigned int offset = diagnostic->offset < file->len ? diagnostic->offset : file->len;
+        for (; pos < offset; pos++) {
+            if (file->str[pos] == '\n') {
+                line++;
+                lineStart = pos + 1;
+            }
+        }
+
+        unsigned int lineEnd = lineStart;
+        while (lineEnd < file->len && file->str[lineEnd] != '\n') {
+            lineEnd++;
+        }
+
+        printf("%s:%u:%u: %s: %s\n", path, line, offset - lineStart + 1, DIAGNOSTIC_SEVERITY_NAMES[diagnostic->severity],
+               diagnostic->message.str);
+        printf("    %.*s\n", (int)(lineEnd - lineStart), file->str + lineStart);
+    }
+    return 0;
+}
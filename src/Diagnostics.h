@@ -0,0 +1,42 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <stdbool.h>
+
+// Errors (and warnings) are collected into a DynamicArray of Diagnostics instead of being printed as they are found,
+// so that one run of the compiler can keep going after a problem and report everything that is wrong with a file at once
+
+enum DiagnosticSeverities {
+    DIAG_ERROR,
+    DIAG_WARNING,
+    // Not a problem, just information about a spot in the file (like what the optimizer did there)
+    DIAG_NOTE
+};
+
+typedef struct Diagnostic {
+    // Where the problem is, as a byte offset into the source file. The line and column are only worked out
+    // when the diagnostics are printed, since most of the time there are none to print
+    unsigned int offset;
+    unsigned int severity;
+    string message;
+} Diagnostic;
+
+// Registers the Diagnostic type. Should be called once before any other function in this module
+int diagnostics_module_init(void);
+
+// For use with the type registry
+int diagnostic_deallocator(void* diagnostic);
+
+// Adds a diagnostic to the array (which should be an array of Diagnostics). The message is formatted like printf
+int diagnostics_add(DynamicArray* diagnostics, unsigned int severity, unsigned int offset, const char* format, ...);
+
+// Returns the number of diagnostics in the array with the given severity
+unsigned int diagnostics_count(DynamicArray* diagnostics, unsigned int severity);
+
+// Prints every diagnostic in the order they appear in the file, as path:line:column: error: message (or warning, or note),
+// followed by the line of the file the problem is on
+int diagnostics_print(DynamicArray* diagnostics, string* file, const char* path);
+
+#endif
@@ -3,13 +3,25 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
 
+extern DynamicArrayType* dynamic_array_registry_get(unsigned int typeID);
+
 // There is no need to free this memory because it is intended to last for the
 // entire lifetime of the program
-unsigned int typeRegistryLen = 0;
-unsigned int typeRegistryMemsize = 1;
-DynamicArrayType* typeRegistry = NULL;
+DynamicArrayType* typeRegistryChunks[TYPE_REGISTRY_MAX_CHUNKS] = {NULL};
+// The number of types that are fully written and visible to other threads. It is only ever increased
+// after the entry itself has been filled in, which is what allows readers to go without a lock
+atomic_uint typeRegistryLen = 0;
+// Only one thread can be adding a type at a time. Readers never touch this
+pthread_mutex_t typeRegistryLock = PTHREAD_MUTEX_INITIALIZER;
+// How many calls to dynamic_array_registry_init haven't been matched by a dynamic_array_registry_terminate yet. The lock
+// is held for the whole of an init or terminate, so a thread that calls init while another one is setting the registry
+// up (or tearing it down) waits until it's done instead of seeing half of it
+static unsigned int typeRegistryUsers = 0;
+static pthread_mutex_t typeRegistryUsersLock = PTHREAD_MUTEX_INITIALIZER;
 
 int string_deallocator(void* str) {
     string_free((string*)str);
@@ -17,28 +29,56 @@ int string_deallocator(void* str) {
 }
 
 int dynamic_array_registry_type_append(string* type, int (*deallocator)(void*), unsigned int size) {
-    if (typeRegistryLen + 1 >= typeRegistryMemsize) {
-        // The typeRegistryMemsize will increase by 5 each time since I only expect the number of times to grow roughly linearly
-        typeRegistryMemsize += 5;
-        typeRegistry = (DynamicArrayType*)realloc(typeRegistry, typeRegistryMemsize * sizeof(DynamicArrayType));
-        if (typeRegistry == NULL) {
+    pthread_mutex_lock(&typeRegistryLock);
+
+    // Another thread might have registered the same type already
+    if (dynamic_array_registry_get_typeID(type) != (unsigned int)-1) {
+        pthread_mutex_unlock(&typeRegistryLock);
+        return 0;
+    }
+
+    // Only this thread can change the length while the lock is held, so a relaxed load is fine here
+    unsigned int len = atomic_load_explicit(&typeRegistryLen, memory_order_relaxed);
+    unsigned int chunk = len / TYPE_REGISTRY_CHUNK_SIZE;
+    if (chunk >= TYPE_REGISTRY_MAX_CHUNKS) {
+        printf("Too many types have been added to the type registry for DynamicArray\n");
+        exit(-1);
+    }
+
+    // A new chunk is only needed every TYPE_REGISTRY_CHUNK_SIZE types, and the old chunks are never touched,
+    // which is why there is no realloc here anymore
+    if (typeRegistryChunks[chunk] == NULL) {
+        typeRegistryChunks[chunk] = (DynamicArrayType*)calloc(TYPE_REGISTRY_CHUNK_SIZE, sizeof(DynamicArrayType));
+        if (typeRegistryChunks[chunk] == NULL) {
             printf("Failed to initialize/append type registry for DynamicArray type.");
             exit(-1);
         }
     }
 
+    DynamicArrayType* entry = dynamic_array_registry_get(len);
+
     // Can't forget to register string before using it with other functions
-    string_init(&typeRegistry[typeRegistryLen].type);
-    typeRegistry[typeRegistryLen].typeID = typeRegistryLen;
-    string_copy(&typeRegistry[typeRegistryLen].type, type);
-    typeRegistry[typeRegistryLen].deallocator = deallocator;
-    typeRegistry[typeRegistryLen].size = size;
+    string_init(&entry->type);
+    entry->typeID = len;
+    string_copy(&entry->type, type);
+    entry->deallocator = deallocator;
+    entry->size = size;
+
+    // The release makes sure that the entry above is completely written before any other thread
+    // can see the new length (and therefore the new type)
+    atomic_store_explicit(&typeRegistryLen, len + 1, memory_order_release);
 
-    typeRegistryLen++;
+    pthread_mutex_unlock(&typeRegistryLock);
     return 0;
 }
 
 int dynamic_array_registry_init(void) {
+    pthread_mutex_lock(&typeRegistryUsersLock);
+    if (typeRegistryUsers++ > 0) {
+        pthread_mutex_unlock(&typeRegistryUsersLock);
+        return 0;
+    }
+
     dynamic_array_registry_type_append(&STRING("char"), NULL, sizeof(char));
     dynamic_array_registry_type_append(&STRING("unsigned char"), NULL, sizeof(unsigned char));
     dynamic_array_registry_type_append(&STRING("short"), NULL, sizeof(short));
@@ -60,19 +100,32 @@ int dynamic_array_registry_init(void) {
     // just be NULL here
     dynamic_array_registry_type_append(&STRING("DynamicArray"), dynamic_array_deallocator, sizeof(DynamicArray));
     dynamic_array_registry_type_append(&STRING("string"), string_deallocator, sizeof(string));
+    dynamic_array_registry_type_append(&STRING("FlatArray"), flat_array_deallocator, sizeof(FlatArray));
 
+    pthread_mutex_unlock(&typeRegistryUsersLock);
     return 0;
 }
 
 int dynamic_array_registry_terminate(void) {
-    for (int i = 0; i < typeRegistryLen; i++) {
-        string_free(&typeRegistry[i].type);
-        typeRegistry[i].deallocator = NULL;
+    pthread_mutex_lock(&typeRegistryUsersLock);
+    if (typeRegistryUsers == 0 || --typeRegistryUsers > 0) {
+        pthread_mutex_unlock(&typeRegistryUsersLock);
+        return 0;
+    }
+
+    unsigned int len = atomic_load_explicit(&typeRegistryLen, memory_order_acquire);
+    for (int i = 0; i < len; i++) {
+        string_free(&dynamic_array_registry_get(i)->type);
+        dynamic_array_registry_get(i)->deallocator = NULL;
+    }
+
+    for (int i = 0; i < TYPE_REGISTRY_MAX_CHUNKS; i++) {
+        free(typeRegistryChunks[i]);
+        typeRegistryChunks[i] = NULL;
     }
 
-    free(typeRegistry);
-    typeRegistry = NULL;
-    typeRegistryLen = 0;
+    atomic_store_explicit(&typeRegistryLen, 0, memory_order_release);
+    pthread_mutex_unlock(&typeRegistryUsersLock);
     return 0;
 }
 
@@ -88,9 +141,12 @@ int dynamic_array_init(DynamicArray* arr, string* type) {
 unsigned int dynamic_array_registry_get_typeID(string* type) {
     // Linear search should be just fine since I can't imagine their being enough types added to the registry
     // that linear search becomes significantly inefficient
-    for (int i = 0; i < typeRegistryLen; i++) {
-        if (string_compare(&typeRegistry[i].type, type) == true) {
-            return typeRegistry[i].typeID;
+    // The acquire pairs with the release in dynamic_array_registry_type_append, so every entry below len is fully written
+    unsigned int len = atomic_load_explicit(&typeRegistryLen, memory_order_acquire);
+    for (int i = 0; i < len; i++) {
+        DynamicArrayType* entry = dynamic_array_registry_get(i);
+        if (string_compare(&entry->type, type) == true) {
+            return entry->typeID;
         }
     }
 
@@ -103,15 +159,15 @@ unsigned int dynamic_array_registry_get_typeID(string* type) {
 // dynamic_array to search for potential sublists, and free those first and then work its way back up the chain
 // it also accounts for the possibility of strings, which are a special case
 int dynamic_array_free(DynamicArray* arr) {
-    if (arr->type == dynamic_array_registry_get_typeID(&STRING("DynamicArray"))) {
+    if (arr->type == DA_TYPE_DYNAMIC_ARRAY) {
         for (int i = 0; i < arr->len; i++) {
             dynamic_array_free(&((DynamicArray*)arr->buf)[i]);
         }
-    } else if (typeRegistry[arr->type].deallocator != NULL) {
+    } else if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
         // This will only run if the type requires a special deallocation function on each element, mainly if each
         // type has a pointer within itself that needs to be handled
         for (int i = 0; i < arr->len; i++) {
-            typeRegistry[arr->type].deallocator((void*)((char*)arr->buf + (i * arr->element_size)));
+            DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)((void*)((char*)arr->buf + (i * arr->element_size)));
         }
     }
 
@@ -162,8 +218,8 @@ int dynamic_array_pop(DynamicArray* arr) {
 
         // Arrays of arrays or arrays of structs with pointers may require special deallocation functions.
         // This is here to account for that possibility
-        if (typeRegistry[arr->type].deallocator != NULL) {
-            typeRegistry[arr->type].deallocator((void*)((char*)arr->buf + ((arr->len - 1) * arr->element_size)));
+        if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
+            DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)((void*)((char*)arr->buf + ((arr->len - 1) * arr->element_size)));
         }
 
         arr->len--;
@@ -187,7 +243,7 @@ int dynamic_array_insert(DynamicArray* arr, void* data, unsigned int index) {
         }
 
         DynamicArray end;
-        dynamic_array_init(&end, &typeRegistry[arr->type].type);
+        dynamic_array_init(&end, &DYNAMIC_ARRAY_TYPE(arr->type));
         dynamic_array_subset(&end, arr, index, arr->len);
 
         // Cast the void* to a char* in order to get around pointer arithmetic being disallowed with void*
@@ -223,8 +279,8 @@ int dynamic_array_remove(DynamicArray* arr, unsigned int index) {
 
             // Arrays of arrays or arrays of structs with pointers may require special deallocation functions.
             // This is here to account for that possibility
-            if (typeRegistry[arr->type].deallocator != NULL) {
-                typeRegistry[arr->type].deallocator((void*)((char*)arr->buf + (index * arr->element_size)));
+            if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
+                DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)((void*)((char*)arr->buf + (index * arr->element_size)));
             }
 
             // If the index is the last index in the list, then simply decrement the length of the array
@@ -234,7 +290,7 @@ int dynamic_array_remove(DynamicArray* arr, unsigned int index) {
             }
 
             DynamicArray end;
-            dynamic_array_init(&end, &typeRegistry[arr->type].type);
+            dynamic_array_init(&end, &DYNAMIC_ARRAY_TYPE(arr->type));
             dynamic_array_subset(&end, arr, index + 1, arr->len);
 
             // Cast the void* to a char* in order to get around pointer arithmetic being disallowed with void*
@@ -325,11 +381,11 @@ int dynamic_array_remove_selection(DynamicArray* arr, unsigned int from, unsigne
         // First, we have to make sure that all of the data being removed is safely deallocated if the special
         // deallocation function is required
 
-        if (typeRegistry[arr->type].deallocator != NULL) {
+        if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
             // Arrays of arrays or arrays of structs with pointers may require special deallocation functions.
             // This is here to account for that possibility
             for (int i = from; i < to; i++) {
-                typeRegistry[arr->type].deallocator((void*)((char*)arr->buf + (i * arr->element_size)));
+                DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)((void*)((char*)arr->buf + (i * arr->element_size)));
             }
         }
 
@@ -369,7 +425,9 @@ int dynamic_array_remove_selection(DynamicArray* arr, unsigned int from, unsigne
 }
 
 void* dynamic_array_get(DynamicArray* arr, DynamicArray* indices) {
-    unsigned int dynamic_array_type = dynamic_array_registry_get_typeID(&STRING("DynamicArray"));
+    // The builtin id is used here instead of searching the registry by name, since this function is called
+    // for pretty much every element access
+    unsigned int dynamic_array_type = DA_TYPE_DYNAMIC_ARRAY;
 
     DynamicArray* temp = arr;
     for (int i = 0; i < indices->len - 1; i++) {
@@ -400,7 +458,9 @@ void* dynamic_array_get(DynamicArray* arr, DynamicArray* indices) {
 }
 
 int dynamic_array_set(DynamicArray* arr, DynamicArray* indices, void* data) {
-    unsigned int dynamic_array_type = dynamic_array_registry_get_typeID(&STRING("DynamicArray"));
+    // The builtin id is used here instead of searching the registry by name, since this function is called
+    // for pretty much every element access
+    unsigned int dynamic_array_type = DA_TYPE_DYNAMIC_ARRAY;
 
     DynamicArray* temp = arr;
     for (int i = 0; i < indices->len - 1; i++) {
@@ -492,3 +552,157 @@ int dynamic_array_resize(DynamicArray* arr, unsigned int size, bool updateLen) {
 
     return 0;
 }
+
+int flat_array_init(FlatArray* arr, string* type, DynamicArray* dimensions) {
+    if (dimensions->len == 0 || dimensions->len > FLAT_ARRAY_MAX_DIMENSIONS) {
+        printf("flat_array_init only supports between 1 and %d dimensions\n", FLAT_ARRAY_MAX_DIMENSIONS);
+        return -1;
+    }
+
+    arr->type = dynamic_array_registry_get_typeID(type);
+    arr->element_size = DYNAMIC_ARRAY_TYPE_SIZE(arr->type);
+    arr->dimensions = dimensions->len;
+
+    // The strides are computed from the last dimension backwards, since the last dimension is the one
+    // whose elements sit right next to each other in memory (row-major order)
+    size_t total = 1;
+    for (int i = dimensions->len - 1; i >= 0; i--) {
+        int dim = ((int*)dimensions->buf)[i];
+        if (dim < 0) {
+            printf("flat_array_init was given a negative dimension\n");
+            return -1;
+        }
+        arr->shape[i] = dim;
+        arr->strides[i] = total;
+        total *= dim;
+    }
+
+    // calloc is used so that every element starts out zeroed, which is a valid empty value for the fundamental
+    // types and is safe to pass to string_free for strings
+    arr->__base = calloc(total > 0 ? total : 1, arr->element_size);
+    if (arr->__base == NULL) {
+        printf("Failed to allocate memory in flat_array_init\n");
+        exit(-1);
+    }
+    arr->buf = arr->__base;
+
+    return 0;
+}
+
+int flat_array_free(FlatArray* arr) {
+    // Views don't own any memory, so there is nothing to do for them
+    if (arr->__base != NULL) {
+        if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
+            size_t len = flat_array_len(arr);
+            for (size_t i = 0; i < len; i++) {
+                DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)((void*)((char*)arr->__base + (i * arr->element_size)));
+            }
+        }
+
+        free(arr->__base);
+    }
+
+    arr->buf = NULL;
+    arr->__base = NULL;
+    arr->dimensions = 0;
+    return 0;
+}
+
+int flat_array_deallocator(void* arr) {
+    flat_array_free((FlatArray*)arr);
+    return 0;
+}
+
+size_t flat_array_len(FlatArray* arr) {
+    if (arr->dimensions == 0) {
+        return 0;
+    }
+
+    size_t total = 1;
+    for (int i = 0; i < arr->dimensions; i++) {
+        total *= arr->shape[i];
+    }
+    return total;
+}
+
+void* flat_array_get(FlatArray* arr, DynamicArray* indices) {
+    if (indices->len != arr->dimensions) {
+        printf("Number of indices given to flat_array_get does not match the number of dimensions\n");
+        return NULL;
+    }
+
+    // This is the whole point of the flat array: the location of any element is just one dot product away
+    size_t offset = 0;
+    for (int i = 0; i < indices->len; i++) {
+        int index = ((int*)indices->buf)[i];
+        if (index < 0 || index >= arr->shape[i]) {
+            printf("Index Out of Bounds error in flat_array_get\n");
+            return NULL;
+        }
+        offset += (size_t)index * arr->strides[i];
+    }
+
+    return (void*)((char*)arr->buf + (offset * arr->element_size));
+}
+
+int flat_array_set(FlatArray* arr, DynamicArray* indices, void* data) {
+    void* elem = flat_array_get(arr, indices);
+    if (elem == NULL) {
+        return -1;
+    }
+
+    memcpy(elem, data, arr->element_size);
+    return 0;
+}
+
+int flat_array_slice(FlatArray* view, FlatArray* src, unsigned int dimension, unsigned int from, unsigned int to) {
+    if (dimension >= src->dimensions || from > to || to > src->shape[dimension]) {
+        printf("flat_array_slice range error\n");
+        return -1;
+    }
+
+    // Copy first so that src and view are allowed to be the same array
+    FlatArray result = *src;
+    result.__base = NULL;
+    result.shape[dimension] = to - from;
+    result.buf = (void*)((char*)src->buf + (from * src->strides[dimension] * src->element_size));
+
+    *view = result;
+    return 0;
+}
+
+int flat_array_index_view(FlatArray* view, FlatArray* src, unsigned int index) {
+    if (src->dimensions < 2) {
+        printf("flat_array_index_view needs an array with at least 2 dimensions\n");
+        return -1;
+    } else if (index >= src->shape[0]) {
+        printf("Index Out of Bounds error in flat_array_index_view\n");
+        return -1;
+    }
+
+    FlatArray result;
+    result.__base = NULL;
+    result.type = src->type;
+    result.element_size = src->element_size;
+    result.dimensions = src->dimensions - 1;
+    result.buf = (void*)((char*)src->buf + (index * src->strides[0] * src->element_size));
+    for (int i = 1; i < src->dimensions; i++) {
+        result.shape[i - 1] = src->shape[i];
+        result.strides[i - 1] = src->strides[i];
+    }
+
+    *view = result;
+    return 0;
+}
+
+bool flat_array_is_contiguous(FlatArray* arr) {
+    size_t expected = 1;
+    for (int i = arr->dimensions - 1; i >= 0; i--) {
+        // Dimensions of length 1 can have any stride since it is never actually used to step anywhere
+        if (arr->shape[i] != 1 && arr->strides[i] != expected) {
+            return false;
+        }
+        expected *= arr->shape[i];
+    }
+    return true;
+}
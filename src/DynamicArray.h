@@ -74,6 +74,8 @@ int dynamic_array_set(DynamicArray* arr, DynamicArray* indices, void* data);
 
 // This will create an n dimensional array with the specified number of dimensions
 // Note: the INDEX macro can be used to make passing in dimensions easier
+// Note: every row of the resulting array is its own heap block, so for dense tables the FlatArray
+// below should be preferred since it only needs one allocation and no pointer chasing
 int dynamic_array_init_nDimensions(DynamicArray* arr, string* type, DynamicArray* dimensions);
 
 // Resizes the array to the specified size in memory, and also updating the length of the dynamic_array
@@ -140,29 +142,142 @@ typedef union FundamentalType {
 #define LONG_DOUBLE(x) \
     (FundamentalType) { .ld = x }
 
+// The type registry is stored as a list of fixed size chunks instead of one array that gets realloced.
+// This means that once a type is in the registry, its entry never moves, so other threads can keep reading
+// entries while new types are being registered without ever being left with a dangling pointer
+#define TYPE_REGISTRY_CHUNK_SIZE 64
+#define TYPE_REGISTRY_MAX_CHUNKS 1024
+
+// Should only be accessed through dynamic_array_registry_get or the DYNAMIC_ARRAY_TYPE macros below
+extern DynamicArrayType* typeRegistryChunks[TYPE_REGISTRY_MAX_CHUNKS];
+
+// Returns the registry entry for the given type id. This never takes a lock, so it is safe (and cheap) to call
+// from any thread, as long as the type id came from the registry in the first place
+inline DynamicArrayType* dynamic_array_registry_get(unsigned int typeID) {
+    return &typeRegistryChunks[typeID / TYPE_REGISTRY_CHUNK_SIZE][typeID % TYPE_REGISTRY_CHUNK_SIZE];
+}
+
 // This macro takes in a DynamicArray typeID (unsigned int) and allows
 // you to get the string version for potential use in print debugging
 #define DYNAMIC_ARRAY_TYPE(x) \
-    typeRegistry[x].type
+    dynamic_array_registry_get(x)->type
 
 #define DYNAMIC_ARRAY_TYPE_SIZE(x) \
-    typeRegistry[x].size
+    dynamic_array_registry_get(x)->size
 
-// This is only called once at startup to initialize the type registry that is
-// necessary for the dynamic_array functions to work
+#define DYNAMIC_ARRAY_TYPE_DEALLOCATOR(x) \
+    dynamic_array_registry_get(x)->deallocator
+
+// Initializes the type registry that is necessary for the dynamic_array functions to work. Anything that uses
+// DynamicArrays (a program, a library, or a thread that runs on its own) can call this without knowing whether
+// something else already has. Only the first call sets the registry up, and every call has to be matched by a call to
+// dynamic_array_registry_terminate
 int dynamic_array_registry_init(void);
 
-// Frees the type registry. Should be used at the very end of the life cycle of a program
+// Frees the type registry once every dynamic_array_registry_init has been matched by a call to this, so a user of the
+// registry that is done with it can't pull it out from under the others. This is safe to call from multiple threads at
+// once, but nothing should be using DynamicArrays anymore after the last call
 int dynamic_array_registry_terminate(void);
 
 // If the type being appended is a basic type, then you can simply pass in NULL for
 // function pointer
+// This is safe to call from multiple threads at once. If a type with the same name is already in the registry,
+// then nothing is changed, so threads can register the types they need without coordinating with each other
 int dynamic_array_registry_type_append(string* type, int (*deallocator)(void*), unsigned int size);
 
 // Pass in a string of the types name, and it returns the id of that type, if it finds it
+// This never blocks, even while another thread is registering a type
 unsigned int dynamic_array_registry_get_typeID(string* type);
 
 // The string deallocation function that will be passed to dynamic_array_registry_type_append
 int string_deallocator(void* str);
 
+// The types registered by dynamic_array_registry_init always get the same ids since they are registered
+// in a fixed order. This lets hot paths check for these types without having to search the registry by name
+enum DynamicArrayBuiltinTypes {
+    DA_TYPE_CHAR,
+    DA_TYPE_UNSIGNED_CHAR,
+    DA_TYPE_SHORT,
+    DA_TYPE_UNSIGNED_SHORT,
+    DA_TYPE_INT,
+    DA_TYPE_UNSIGNED_INT,
+    DA_TYPE_LONG,
+    DA_TYPE_UNSIGNED_LONG,
+    DA_TYPE_LONG_LONG,
+    DA_TYPE_UNSIGNED_LONG_LONG,
+    DA_TYPE_BOOL,
+    DA_TYPE_FLOAT,
+    DA_TYPE_DOUBLE,
+    DA_TYPE_LONG_DOUBLE,
+    DA_TYPE_DYNAMIC_ARRAY,
+    DA_TYPE_STRING,
+    DA_TYPE_FLAT_ARRAY
+};
+
+// The maximum number of dimensions a FlatArray can have. Keeping it fixed means the shape and strides
+// can live inside of the struct itself instead of needing their own allocations
+#define FLAT_ARRAY_MAX_DIMENSIONS 8
+
+// A dense n dimensional array that lives in one contiguous allocation in row-major order.
+// Indexing is just a dot product of the indices with the strides, so there is no pointer chasing
+// per dimension like with the nested arrays from dynamic_array_init_nDimensions
+typedef struct FlatArray {
+    // Points at the first element of the array (or view) within the allocation
+    void* buf;
+    // The allocation that actually owns the memory. Views have this set to NULL, which is how
+    // flat_array_free knows not to free memory that belongs to another array
+    void* __base;
+    // The number of dimensions that are in use in the shape and strides arrays
+    unsigned int dimensions;
+    // The length of each dimension
+    unsigned int shape[FLAT_ARRAY_MAX_DIMENSIONS];
+    // The distance (in elements, not bytes) between consecutive indices of each dimension
+    size_t strides[FLAT_ARRAY_MAX_DIMENSIONS];
+    size_t element_size;
+    // The type registry id of the elements
+    unsigned int type;
+} FlatArray;
+
+// Allows for direct access to the elements of a 1, 2, or 3 dimensional flat array without any bounds checks
+// or INDEX arrays needing to be built. These are intended for hot loops over tables where the indices are already known to be valid
+#define FLAT_ARRAY_AT1(arr, T, i) \
+    (((T*)(arr)->buf)[(size_t)(i) * (arr)->strides[0]])
+#define FLAT_ARRAY_AT2(arr, T, i, j) \
+    (((T*)(arr)->buf)[(size_t)(i) * (arr)->strides[0] + (size_t)(j) * (arr)->strides[1]])
+#define FLAT_ARRAY_AT3(arr, T, i, j, k) \
+    (((T*)(arr)->buf)[(size_t)(i) * (arr)->strides[0] + (size_t)(j) * (arr)->strides[1] + (size_t)(k) * (arr)->strides[2]])
+
+// Creates a zero initialized flat array with the given dimensions. Like with dynamic_array_init_nDimensions, the INDEX
+// macro can be used to pass in the dimensions: flat_array_init(&table, &STRING("int"), &INDEX(rows, cols));
+int flat_array_init(FlatArray* arr, string* type, DynamicArray* dimensions);
+
+// Frees the allocation owned by the array, calling the deallocator of the type on each element if it has one.
+// Calling this on a view does nothing to the underlying memory
+int flat_array_free(FlatArray* arr);
+
+// For use with the type registry so that arrays of flat arrays are freed properly
+int flat_array_deallocator(void* arr);
+
+// The total number of elements in the array (or view)
+size_t flat_array_len(FlatArray* arr);
+
+// Returns a pointer to the element at the given indices, or NULL if the indices are out of bounds.
+// The number of indices has to match the number of dimensions of the array
+void* flat_array_get(FlatArray* arr, DynamicArray* indices);
+
+// Copies the data pointed to by data into the element at the given indices
+int flat_array_set(FlatArray* arr, DynamicArray* indices, void* data);
+
+// Makes view refer to the elements of src where the given dimension is restricted to the range from (inclusive)
+// to to (exclusive). No memory is copied, so the view is only valid for as long as the src array is alive
+int flat_array_slice(FlatArray* view, FlatArray* src, unsigned int dimension, unsigned int from, unsigned int to);
+
+// Makes view refer to the sub array at the given index of the first dimension of src, which removes
+// that dimension. For example, using this on a 2d table gives a 1d view of one of its rows
+int flat_array_index_view(FlatArray* view, FlatArray* src, unsigned int index);
+
+// Returns true if the elements of the array (or view) are laid out without any gaps, meaning it can be
+// treated as a plain buffer of flat_array_len elements
+bool flat_array_is_contiguous(FlatArray* arr);
+
 #endif
@@ -0,0 +1,609 @@
+#include "DynamicArrayAlgorithms.h"
+#include "DynamicArray.h"
+#include "ThreadPool.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Gets a pointer to the element at index i of a raw buffer of elements of the given size
+#define ELEMENT(buf, i, size) ((char*)(buf) + (size_t)(i) * (size))
+
+// Runs shorter than this are sorted with insertion sort before the merging begins, since insertion sort is
+// faster than merging for tiny runs
+#define MERGE_SORT_RUN 32
+
+#define RADIX_BUCKETS 256
+
+static void* algorithms_alloc(size_t bytes) {
+    void* mem = malloc(bytes > 0 ? bytes : 1);
+    if (mem == NULL) {
+        printf("Failed to allocate memory in DynamicArrayAlgorithms\n");
+        exit(-1);
+    }
+    return mem;
+}
+
+// Decides how many pieces the work on an array of the given length should be split into. Each piece
+// is kept large enough that the cost of scheduling it is negligible
+static unsigned int algorithms_chunk_count(size_t len, ThreadPool* pool) {
+    if (pool == NULL || len < DYNAMIC_ARRAY_PARALLEL_THRESHOLD) {
+        return 1;
+    }
+
+    // The thread that submits the work helps out while it waits, so it counts as one more thread
+    size_t chunks = pool->thread_count + 1;
+    size_t maxChunks = len / (DYNAMIC_ARRAY_PARALLEL_THRESHOLD / 8);
+    if (chunks > maxChunks) {
+        chunks = maxChunks;
+    }
+    return chunks > 0 ? (unsigned int)chunks : 1;
+}
+
+static inline size_t chunk_start(size_t len, unsigned int chunks, unsigned int chunk) {
+    return (len * chunk) / chunks;
+}
+
+// -------------------------------------------- Merge sort --------------------------------------------
+
+// Merges the sorted runs a and b into out. When elements are equal, the one from a is taken first, which keeps the sort stable
+static void merge_runs(char* out, char* a, size_t na, char* b, size_t nb, size_t size, dynamic_array_comparator compare) {
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) {
+        if (compare(ELEMENT(b, j, size), ELEMENT(a, i, size)) < 0) {
+            memcpy(out, ELEMENT(b, j, size), size);
+            j++;
+        } else {
+            memcpy(out, ELEMENT(a, i, size), size);
+            i++;
+        }
+        out += size;
+    }
+
+    memcpy(out, ELEMENT(a, i, size), (na - i) * size);
+    out += (na - i) * size;
+    memcpy(out, ELEMENT(b, j, size), (nb - j) * size);
+}
+
+static void insertion_sort(char* buf, size_t n, size_t size, dynamic_array_comparator compare, char* held) {
+    for (size_t i = 1; i < n; i++) {
+        if (compare(ELEMENT(buf, i - 1, size), ELEMENT(buf, i, size)) <= 0) {
+            continue;
+        }
+
+        memcpy(held, ELEMENT(buf, i, size), size);
+        size_t j = i;
+        while (j > 0 && compare(ELEMENT(buf, j - 1, size), held) > 0) {
+            j--;
+        }
+        memmove(ELEMENT(buf, j + 1, size), ELEMENT(buf, j, size), (i - j) * size);
+        memcpy(ELEMENT(buf, j, size), held, size);
+    }
+}
+
+// Sorts n elements of buf on the calling thread, using the same amount of space in tmp as scratch space
+static void merge_sort_sequential(char* buf, char* tmp, size_t n, size_t size, dynamic_array_comparator compare) {
+    if (n == 0) {
+        return;
+    }
+
+    // The scratch buffer isn't being used for anything yet, so its first element can hold the element
+    // being inserted during the insertion sorts
+    for (size_t lo = 0; lo < n; lo += MERGE_SORT_RUN) {
+        size_t len = n - lo < MERGE_SORT_RUN ? n - lo : MERGE_SORT_RUN;
+        insertion_sort(ELEMENT(buf, lo, size), len, size, compare, tmp);
+    }
+
+    // Bottom up merging that ping pongs between the two buffers, so that nothing has to be copied back after each pass
+    char* src = buf;
+    char* dst = tmp;
+    for (size_t width = MERGE_SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            merge_runs(ELEMENT(dst, lo, size), ELEMENT(src, lo, size), mid - lo, ELEMENT(src, mid, size), hi - mid, size, compare);
+        }
+        char* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != buf) {
+        memcpy(buf, src, n * size);
+    }
+}
+
+// Figures out how many elements of a are in the first k elements of the merged output of a and b.
+// This is what lets one merge be split across several threads: each thread can work out where its
+// part of the output comes from with a binary search, without needing to know what the others are doing
+static size_t merge_co_rank(size_t k, char* a, size_t na, char* b, size_t nb, size_t size, dynamic_array_comparator compare) {
+    size_t lo = k > nb ? k - nb : 0;
+    size_t hi = k < na ? k : na;
+
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        size_t j = k - i;
+        // If a[i] would be output before b[j - 1], then more than i elements of a have to be in the output
+        if (j > 0 && i < na && compare(ELEMENT(a, i, size), ELEMENT(b, j - 1, size)) <= 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+typedef struct SortChunkTask {
+    char* buf;
+    char* tmp;
+    size_t n;
+    size_t size;
+    dynamic_array_comparator compare;
+} SortChunkTask;
+
+static void sort_chunk_task(void* arg) {
+    SortChunkTask* task = (SortChunkTask*)arg;
+    merge_sort_sequential(task->buf, task->tmp, task->n, task->size, task->compare);
+}
+
+typedef struct MergeTask {
+    // The runs being merged, which sit right next to each other in src
+    char* a;
+    size_t na;
+    char* b;
+    size_t nb;
+    // Where the merged output of the two runs starts
+    char* out;
+    // The part of the merged output that this task is responsible for
+    size_t from;
+    size_t to;
+    size_t size;
+    dynamic_array_comparator compare;
+} MergeTask;
+
+static void merge_task(void* arg) {
+    MergeTask* task = (MergeTask*)arg;
+    size_t i0 = merge_co_rank(task->from, task->a, task->na, task->b, task->nb, task->size, task->compare);
+    size_t i1 = merge_co_rank(task->to, task->a, task->na, task->b, task->nb, task->size, task->compare);
+    size_t j0 = task->from - i0;
+    size_t j1 = task->to - i1;
+
+    merge_runs(ELEMENT(task->out, task->from, task->size), ELEMENT(task->a, i0, task->size), i1 - i0, ELEMENT(task->b, j0, task->size), j1 - j0, task->size, task->compare);
+}
+
+int dynamic_array_sort(DynamicArray* arr, dynamic_array_comparator compare, ThreadPool* pool) {
+    size_t n = arr->len;
+    size_t size = arr->element_size;
+    if (n < 2) {
+        return 0;
+    }
+
+    char* tmp = (char*)algorithms_alloc(n * size);
+    unsigned int chunks = algorithms_chunk_count(n, pool);
+
+    if (chunks == 1) {
+        merge_sort_sequential((char*)arr->buf, tmp, n, size, compare);
+        free(tmp);
+        return 0;
+    }
+
+    // First every chunk is sorted on its own
+    SortChunkTask* sortTasks = (SortChunkTask*)algorithms_alloc(chunks * sizeof(SortChunkTask));
+    size_t* runs = (size_t*)algorithms_alloc((chunks + 1) * sizeof(size_t));
+    for (unsigned int c = 0; c < chunks; c++) {
+        size_t from = chunk_start(n, chunks, c);
+        size_t to = chunk_start(n, chunks, c + 1);
+        runs[c] = from;
+        sortTasks[c] = (SortChunkTask){.buf = ELEMENT(arr->buf, from, size), .tmp = ELEMENT(tmp, from, size), .n = to - from, .size = size, .compare = compare};
+        thread_pool_submit(pool, sort_chunk_task, &sortTasks[c]);
+    }
+    runs[chunks] = n;
+    thread_pool_wait(pool);
+    free(sortTasks);
+
+    // Then the sorted runs are merged in pairs until only one is left. Each merge is split into pieces of
+    // roughly equal size so that the last few rounds (which only have a couple of huge merges) still use every thread
+    size_t grain = n / chunks + 1;
+    MergeTask* mergeTasks = (MergeTask*)algorithms_alloc((chunks + n / grain + 2) * sizeof(MergeTask));
+    unsigned int runCount = chunks;
+    char* src = (char*)arr->buf;
+    char* dst = tmp;
+
+    while (runCount > 1) {
+        unsigned int taskCount = 0;
+        unsigned int newRunCount = 0;
+
+        for (unsigned int r = 0; r < runCount; r += 2) {
+            size_t lo = runs[r];
+            size_t mid = runs[r + 1];
+            // A run without a partner is just copied over, which is the same as merging it with an empty run
+            size_t hi = r + 1 < runCount ? runs[r + 2] : mid;
+
+            for (size_t from = 0; from < hi - lo; from += grain) {
+                size_t to = from + grain < hi - lo ? from + grain : hi - lo;
+                mergeTasks[taskCount++] = (MergeTask){.a = ELEMENT(src, lo, size), .na = mid - lo, .b = ELEMENT(src, mid, size), .nb = hi - mid, .out = ELEMENT(dst, lo, size), .from = from, .to = to, .size = size, .compare = compare};
+                thread_pool_submit(pool, merge_task, &mergeTasks[taskCount - 1]);
+            }
+
+            runs[newRunCount++] = lo;
+        }
+        runs[newRunCount] = n;
+        thread_pool_wait(pool);
+
+        runCount = newRunCount;
+        char* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != (char*)arr->buf) {
+        memcpy(arr->buf, src, n * size);
+    }
+
+    free(mergeTasks);
+    free(runs);
+    free(tmp);
+    return 0;
+}
+
+// -------------------------------------------- Radix sort --------------------------------------------
+
+// Reads the key of an element as an unsigned integer whose order matches the order of the actual key.
+// For signed types, flipping the sign bit moves the negative numbers below the positive ones
+static inline uint64_t radix_key(char* elem, size_t keySize, bool isSigned) {
+    uint64_t key;
+    switch (keySize) {
+        case 1: {
+            uint8_t v;
+            memcpy(&v, elem, 1);
+            key = v;
+            break;
+        }
+        case 2: {
+            uint16_t v;
+            memcpy(&v, elem, 2);
+            key = v;
+            break;
+        }
+        case 4: {
+            uint32_t v;
+            memcpy(&v, elem, 4);
+            key = v;
+            break;
+        }
+        default: {
+            uint64_t v;
+            memcpy(&v, elem, 8);
+            key = v;
+            break;
+        }
+    }
+
+    if (isSigned) {
+        key ^= 1ULL << (keySize * 8 - 1);
+    }
+    return key;
+}
+
+typedef struct RadixTask {
+    char* src;
+    char* dst;
+    size_t from;
+    size_t to;
+    size_t size;
+    size_t keyOffset;
+    size_t keySize;
+    bool isSigned;
+    unsigned int shift;
+    // The number of elements of this chunk that have each digit, and then later the position
+    // in dst that the next element of this chunk with each digit goes to
+    size_t counts[RADIX_BUCKETS];
+} RadixTask;
+
+static void radix_histogram_task(void* arg) {
+    RadixTask* task = (RadixTask*)arg;
+    memset(task->counts, 0, sizeof(task->counts));
+    for (size_t i = task->from; i < task->to; i++) {
+        uint64_t key = radix_key(ELEMENT(task->src, i, task->size) + task->keyOffset, task->keySize, task->isSigned);
+        task->counts[(key >> task->shift) & (RADIX_BUCKETS - 1)]++;
+    }
+}
+
+static void radix_scatter_task(void* arg) {
+    RadixTask* task = (RadixTask*)arg;
+    for (size_t i = task->from; i < task->to; i++) {
+        char* elem = ELEMENT(task->src, i, task->size);
+        uint64_t key = radix_key(elem + task->keyOffset, task->keySize, task->isSigned);
+        size_t digit = (key >> task->shift) & (RADIX_BUCKETS - 1);
+        memcpy(ELEMENT(task->dst, task->counts[digit], task->size), elem, task->size);
+        task->counts[digit]++;
+    }
+}
+
+int dynamic_array_radix_sort(DynamicArray* arr, size_t key_offset, unsigned int key_type, ThreadPool* pool) {
+    if (key_type > DA_TYPE_BOOL) {
+        printf("dynamic_array_radix_sort only supports integer keys\n");
+        return -1;
+    }
+
+    size_t keySize = DYNAMIC_ARRAY_TYPE_SIZE(key_type);
+    if (keySize != 1 && keySize != 2 && keySize != 4 && keySize != 8) {
+        printf("dynamic_array_radix_sort does not support keys of size %zu\n", keySize);
+        return -1;
+    } else if (key_offset + keySize > arr->element_size) {
+        printf("dynamic_array_radix_sort was given a key that is outside of the element\n");
+        return -1;
+    }
+
+    bool isSigned = key_type == DA_TYPE_CHAR || key_type == DA_TYPE_SHORT || key_type == DA_TYPE_INT || key_type == DA_TYPE_LONG || key_type == DA_TYPE_LONG_LONG;
+    size_t n = arr->len;
+    size_t size = arr->element_size;
+    if (n < 2) {
+        return 0;
+    }
+
+    unsigned int chunks = algorithms_chunk_count(n, pool);
+    RadixTask* tasks = (RadixTask*)algorithms_alloc(chunks * sizeof(RadixTask));
+    char* tmp = (char*)algorithms_alloc(n * size);
+    char* src = (char*)arr->buf;
+    char* dst = tmp;
+
+    // One pass per byte of the key, starting from the least significant byte. Each pass is stable,
+    // which is what makes the earlier passes still count once the later ones are done
+    for (unsigned int shift = 0; shift < keySize * 8; shift += 8) {
+        for (unsigned int c = 0; c < chunks; c++) {
+            tasks[c] = (RadixTask){.src = src, .dst = dst, .from = chunk_start(n, chunks, c), .to = chunk_start(n, chunks, c + 1), .size = size, .keyOffset = key_offset, .keySize = keySize, .isSigned = isSigned, .shift = shift};
+            if (chunks > 1) {
+                thread_pool_submit(pool, radix_histogram_task, &tasks[c]);
+            } else {
+                radix_histogram_task(&tasks[c]);
+            }
+        }
+        if (chunks > 1) {
+            thread_pool_wait(pool);
+        }
+
+        // If every element has the same digit, this pass wouldn't change anything. This is very common for
+        // the upper bytes of keys that are small numbers, so skipping it saves a lot of copying
+        bool trivial = false;
+        for (unsigned int d = 0; d < RADIX_BUCKETS; d++) {
+            size_t total = 0;
+            for (unsigned int c = 0; c < chunks; c++) {
+                total += tasks[c].counts[d];
+            }
+            if (total == n) {
+                trivial = true;
+                break;
+            } else if (total > 0) {
+                break;
+            }
+        }
+        if (trivial) {
+            continue;
+        }
+
+        // Turns the counts into starting positions. Every chunk gets its own range within each digit's range,
+        // ordered by chunk, so the chunks can all scatter at the same time without the result becoming unstable
+        size_t pos = 0;
+        for (unsigned int d = 0; d < RADIX_BUCKETS; d++) {
+            for (unsigned int c = 0; c < chunks; c++) {
+                size_t count = tasks[c].counts[d];
+                tasks[c].counts[d] = pos;
+                pos += count;
+            }
+        }
+
+        for (unsigned int c = 0; c < chunks; c++) {
+            if (chunks > 1) {
+                thread_pool_submit(pool, radix_scatter_task, &tasks[c]);
+            } else {
+                radix_scatter_task(&tasks[c]);
+            }
+        }
+        if (chunks > 1) {
+            thread_pool_wait(pool);
+        }
+
+        char* swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != (char*)arr->buf) {
+        memcpy(arr->buf, src, n * size);
+    }
+
+    free(tmp);
+    free(tasks);
+    return 0;
+}
+
+// ------------------------------------------ Searching ------------------------------------------
+
+unsigned int dynamic_array_lower_bound(DynamicArray* arr, void* key, dynamic_array_comparator compare) {
+    unsigned int lo = 0;
+    unsigned int hi = arr->len;
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (compare(ELEMENT(arr->buf, mid, arr->element_size), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int dynamic_array_binary_search(DynamicArray* arr, void* key, dynamic_array_comparator compare) {
+    unsigned int index = dynamic_array_lower_bound(arr, key, compare);
+    if (index < arr->len && compare(ELEMENT(arr->buf, index, arr->element_size), key) == 0) {
+        return index;
+    }
+    return -1;
+}
+
+int dynamic_array_unique(DynamicArray* arr, dynamic_array_comparator compare) {
+    if (arr->len < 2) {
+        return 0;
+    }
+
+    size_t size = arr->element_size;
+    int (*deallocator)(void*) = DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type);
+    unsigned int kept = 1;
+
+    for (unsigned int i = 1; i < arr->len; i++) {
+        char* elem = ELEMENT(arr->buf, i, size);
+        if (compare(ELEMENT(arr->buf, kept - 1, size), elem) != 0) {
+            if (kept != i) {
+                memcpy(ELEMENT(arr->buf, kept, size), elem, size);
+            }
+            kept++;
+        } else if (deallocator != NULL) {
+            deallocator(elem);
+        }
+    }
+
+    arr->len = kept;
+    return 0;
+}
+
+// ----------------------------------------- Map and filter -----------------------------------------
+
+typedef struct MapTask {
+    char* out;
+    char* in;
+    size_t from;
+    size_t to;
+    size_t outSize;
+    size_t inSize;
+    void (*function)(void*, void*, void*);
+    void* ctx;
+} MapTask;
+
+static void map_task(void* arg) {
+    MapTask* task = (MapTask*)arg;
+    for (size_t i = task->from; i < task->to; i++) {
+        task->function(ELEMENT(task->out, i, task->outSize), ELEMENT(task->in, i, task->inSize), task->ctx);
+    }
+}
+
+int dynamic_array_map(DynamicArray* dest, DynamicArray* src, void (*function)(void* out, void* in, void* ctx), void* ctx, ThreadPool* pool) {
+    if (src->len == 0) {
+        dest->len = 0;
+        return 0;
+    }
+
+    dynamic_array_resize(dest, src->len + 1, false);
+    dest->len = src->len;
+
+    unsigned int chunks = algorithms_chunk_count(src->len, pool);
+    MapTask* tasks = (MapTask*)algorithms_alloc(chunks * sizeof(MapTask));
+    for (unsigned int c = 0; c < chunks; c++) {
+        tasks[c] = (MapTask){.out = (char*)dest->buf, .in = (char*)src->buf, .from = chunk_start(src->len, chunks, c), .to = chunk_start(src->len, chunks, c + 1), .outSize = dest->element_size, .inSize = src->element_size, .function = function, .ctx = ctx};
+        if (chunks > 1) {
+            thread_pool_submit(pool, map_task, &tasks[c]);
+        } else {
+            map_task(&tasks[c]);
+        }
+    }
+    if (chunks > 1) {
+        thread_pool_wait(pool);
+    }
+
+    free(tasks);
+    return 0;
+}
+
+typedef struct FilterTask {
+    char* src;
+    char* dst;
+    bool* flags;
+    size_t from;
+    size_t to;
+    size_t size;
+    // How many elements of this chunk are kept, and then later where the first of them goes in dst
+    size_t kept;
+    bool (*keep)(void*, void*);
+    void* ctx;
+    int (*deallocator)(void*);
+} FilterTask;
+
+static void filter_flag_task(void* arg) {
+    FilterTask* task = (FilterTask*)arg;
+    task->kept = 0;
+    for (size_t i = task->from; i < task->to; i++) {
+        task->flags[i] = task->keep(ELEMENT(task->src, i, task->size), task->ctx);
+        task->kept += task->flags[i];
+    }
+}
+
+static void filter_scatter_task(void* arg) {
+    FilterTask* task = (FilterTask*)arg;
+    size_t pos = task->kept;
+    for (size_t i = task->from; i < task->to; i++) {
+        char* elem = ELEMENT(task->src, i, task->size);
+        if (task->flags[i]) {
+            memcpy(ELEMENT(task->dst, pos, task->size), elem, task->size);
+            pos++;
+        } else if (task->deallocator != NULL) {
+            task->deallocator(elem);
+        }
+    }
+}
+
+int dynamic_array_filter(DynamicArray* arr, bool (*keep)(void* elem, void* ctx), void* ctx, ThreadPool* pool) {
+    size_t n = arr->len;
+    size_t size = arr->element_size;
+    if (n == 0) {
+        return 0;
+    }
+
+    unsigned int chunks = algorithms_chunk_count(n, pool);
+    FilterTask* tasks = (FilterTask*)algorithms_alloc(chunks * sizeof(FilterTask));
+    bool* flags = (bool*)algorithms_alloc(n * sizeof(bool));
+
+    for (unsigned int c = 0; c < chunks; c++) {
+        tasks[c] = (FilterTask){.src = (char*)arr->buf, .flags = flags, .from = chunk_start(n, chunks, c), .to = chunk_start(n, chunks, c + 1), .size = size, .keep = keep, .ctx = ctx, .deallocator = DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type)};
+        if (chunks > 1) {
+            thread_pool_submit(pool, filter_flag_task, &tasks[c]);
+        } else {
+            filter_flag_task(&tasks[c]);
+        }
+    }
+    if (chunks > 1) {
+        thread_pool_wait(pool);
+    }
+
+    // Each chunk's kept elements start right after the kept elements of all of the chunks before it
+    size_t total = 0;
+    for (unsigned int c = 0; c < chunks; c++) {
+        size_t kept = tasks[c].kept;
+        tasks[c].kept = total;
+        total += kept;
+    }
+
+    // The kept elements are copied into a new buffer (with one spare element, like dynamic_array_append expects),
+    // which lets every chunk write its part at the same time
+    char* dst = (char*)algorithms_alloc((total + 1) * size);
+    for (unsigned int c = 0; c < chunks; c++) {
+        tasks[c].dst = dst;
+        if (chunks > 1) {
+            thread_pool_submit(pool, filter_scatter_task, &tasks[c]);
+        } else {
+            filter_scatter_task(&tasks[c]);
+        }
+    }
+    if (chunks > 1) {
+        thread_pool_wait(pool);
+    }
+
+    free(arr->buf);
+    arr->buf = dst;
+    arr->len = total;
+    arr->__memsize = total + 1;
+
+    free(flags);
+    free(tasks);
+    return 0;
+}
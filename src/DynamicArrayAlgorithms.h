@@ -0,0 +1,52 @@
+#ifndef DYNAMICARRAYALGORITHMS_H
+#define DYNAMICARRAYALGORITHMS_H
+
+#include "DynamicArray.h"
+#include "ThreadPool.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Generic algorithms that work on a DynamicArray of any registered type, since they only ever move elements
+// around as blocks of element_size bytes. Every function that takes a ThreadPool splits the work across the pool
+// when the array is large enough to make it worth it. Passing NULL for the pool runs everything on the calling thread
+
+// Arrays with fewer elements than this are always handled on the calling thread, since the overhead of handing
+// the work off to other threads would be larger than the work itself
+#define DYNAMIC_ARRAY_PARALLEL_THRESHOLD 8192
+
+// Compares two elements of an array in the same way as the comparison function for qsort: negative if a comes
+// before b, 0 if they are equal, and positive if a comes after b
+typedef int (*dynamic_array_comparator)(const void* a, const void* b);
+
+// Sorts the array with a stable merge sort. Elements that compare as equal keep their original order
+int dynamic_array_sort(DynamicArray* arr, dynamic_array_comparator compare, ThreadPool* pool);
+
+// Sorts the array by an integer key stored key_offset bytes into each element, using an LSD radix sort.
+// key_type should be the registry id of one of the integer types (DA_TYPE_CHAR through DA_TYPE_BOOL).
+// For an array of plain integers, key_offset is 0 and key_type is just the type of the array.
+// This is stable, and runs in linear time no matter how the keys are distributed
+int dynamic_array_radix_sort(DynamicArray* arr, size_t key_offset, unsigned int key_type, ThreadPool* pool);
+
+// Returns the index of the first element in the sorted array that does not come before the key,
+// which is arr->len if every element comes before it
+unsigned int dynamic_array_lower_bound(DynamicArray* arr, void* key, dynamic_array_comparator compare);
+
+// Returns the index of an element in the sorted array that is equal to the key, or -1 if there isn't one
+int dynamic_array_binary_search(DynamicArray* arr, void* key, dynamic_array_comparator compare);
+
+// Removes every element that is equal to the element right before it, so on a sorted array this leaves
+// only one of each element. Removed elements are deallocated if their type has a deallocator
+int dynamic_array_unique(DynamicArray* arr, dynamic_array_comparator compare);
+
+// Calls the function on every element of src, with out pointing at the matching element of dest. dest needs to
+// be initialized with the type the function produces, and it is resized to the length of src.
+// ctx is passed through to every call so the function can have extra state without globals.
+// Note: the function may be called from several threads at the same time
+int dynamic_array_map(DynamicArray* dest, DynamicArray* src, void (*function)(void* out, void* in, void* ctx), void* ctx, ThreadPool* pool);
+
+// Keeps only the elements of the array that the keep function returns true for, preserving their order.
+// Elements that are removed are deallocated if their type has a deallocator.
+// Note: the keep function may be called from several threads at the same time
+int dynamic_array_filter(DynamicArray* arr, bool (*keep)(void* elem, void* ctx), void* ctx, ThreadPool* pool);
+
+#endif
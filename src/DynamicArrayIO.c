@@ -0,0 +1,313 @@
+#include "DynamicArrayIO.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int mapped_file_open(MappedFile* file, string* path) {
+    file->data = NULL;
+    file->size = 0;
+    file->__mapped = false;
+
+#if defined(_WIN32)
+    FILE* fptr = fopen(path->str, "rb");
+    if (fptr == NULL) {
+        return -1;
+    }
+
+    fseek(fptr, 0, SEEK_END);
+    file->size = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+
+    file->data = malloc(file->size > 0 ? file->size : 1);
+    if (file->data == NULL) {
+        printf("Failed to allocate memory in mapped_file_open\n");
+        exit(-1);
+    }
+    if (fread(file->data, 1, file->size, fptr) != file->size) {
+        free(file->data);
+        file->data = NULL;
+        fclose(fptr);
+        return -1;
+    }
+    fclose(fptr);
+#else
+    int fd = open(path->str, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+    file->size = info.st_size;
+
+    // mmap doesn't allow mapping 0 bytes, and there would be nothing to read anyways
+    if (file->size > 0) {
+        file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file->data == MAP_FAILED) {
+            file->data = NULL;
+            close(fd);
+            return -1;
+        }
+        file->__mapped = true;
+    }
+
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+#endif
+
+    return 0;
+}
+
+int mapped_file_close(MappedFile* file) {
+#if !defined(_WIN32)
+    if (file->__mapped) {
+        munmap(file->data, file->size);
+        file->data = NULL;
+    }
+#endif
+    free(file->data);
+    file->data = NULL;
+    file->size = 0;
+    file->__mapped = false;
+    return 0;
+}
+
+bool file_section_fits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t alignment, size_t size) {
+    return offset <= size && (elementSize == 0 || count <= (size - offset) / elementSize) && offset % alignment == 0;
+}
+
+// Builds the name of the temporary file that a file is written to before being renamed into place.
+// The process id is included so that two processes writing the same file at once don't clobber each other's temporary file
+static void temp_path(string* tmp, string* path) {
+    char suffix[32];
+    int len = snprintf(suffix, sizeof(suffix), ".tmp%d", (int)getpid());
+    string_concat(tmp, path, &(string){.str = suffix, .len = len, .__memsize = 0});
+}
+
+static int finish_atomic_write(FILE* fptr, string* tmp, string* path, bool ok) {
+    if (fflush(fptr) != 0) {
+        ok = false;
+    }
+#if !defined(_WIN32)
+    // Makes sure the contents are actually on disk before the rename makes the file visible
+    if (ok && fsync(fileno(fptr)) != 0) {
+        ok = false;
+    }
+#endif
+    fclose(fptr);
+
+#if defined(_WIN32)
+    // rename on Windows refuses to replace an existing file
+    if (ok) {
+        remove(path->str);
+    }
+#endif
+    if (!ok || rename(tmp->str, path->str) != 0) {
+        remove(tmp->str);
+        return -1;
+    }
+    return 0;
+}
+
+int file_write_atomic(string* path, void* data, size_t size) {
+    string tmp;
+    string_init(&tmp);
+    temp_path(&tmp, path);
+
+    FILE* fptr = fopen(tmp.str, "wb");
+    if (fptr == NULL) {
+        string_free(&tmp);
+        return -1;
+    }
+
+    bool ok = fwrite(data, 1, size, fptr) == size;
+    int result = finish_atomic_write(fptr, &tmp, path, ok);
+    string_free(&tmp);
+    return result;
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static bool write_padding(FILE* fptr, uint64_t from, uint64_t to) {
+    static const char zeros[DYNAMIC_ARRAY_FILE_ALIGNMENT] = {0};
+    return fwrite(zeros, 1, to - from, fptr) == to - from;
+}
+
+int dynamic_array_save(DynamicArray* arr, string* path) {
+    bool strings = arr->type == DA_TYPE_STRING;
+    if (!strings && DYNAMIC_ARRAY_TYPE_DEALLOCATOR(arr->type) != NULL) {
+        printf("dynamic_array_save can't save arrays of type %s since they contain pointers\n", DYNAMIC_ARRAY_TYPE(arr->type).str);
+        return -1;
+    } else if (DYNAMIC_ARRAY_TYPE(arr->type).len >= DYNAMIC_ARRAY_FILE_TYPE_NAME_LEN) {
+        printf("dynamic_array_save can't save arrays of type %s since the type name is too long\n", DYNAMIC_ARRAY_TYPE(arr->type).str);
+        return -1;
+    }
+
+    DynamicArrayFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DYNAMIC_ARRAY_FILE_MAGIC, sizeof(header.magic));
+    header.version = DYNAMIC_ARRAY_FILE_VERSION;
+    header.byte_order = DYNAMIC_ARRAY_FILE_BYTE_ORDER;
+    header.flags = strings ? DA_FILE_STRINGS : 0;
+    memcpy(header.type, DYNAMIC_ARRAY_TYPE(arr->type).str, DYNAMIC_ARRAY_TYPE(arr->type).len);
+    header.element_size = arr->element_size;
+    header.len = arr->len;
+    header.data_offset = align_up(sizeof(header), DYNAMIC_ARRAY_FILE_ALIGNMENT);
+
+    if (strings) {
+        header.data_size = arr->len * sizeof(DynamicArrayFileString);
+        for (unsigned int i = 0; i < arr->len; i++) {
+            header.data_size += ((string*)arr->buf)[i].len + 1;
+        }
+    } else {
+        header.data_size = (uint64_t)arr->len * arr->element_size;
+    }
+
+    string tmp;
+    string_init(&tmp);
+    temp_path(&tmp, path);
+    FILE* fptr = fopen(tmp.str, "wb");
+    if (fptr == NULL) {
+        printf("dynamic_array_save could not open %s for writing\n", tmp.str);
+        string_free(&tmp);
+        return -1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fptr) == 1;
+    ok = ok && write_padding(fptr, sizeof(header), header.data_offset);
+
+    if (strings) {
+        // First the offset table, then the characters. Since the position of every string is known up front,
+        // both can be written in one pass each without seeking back
+        uint64_t offset = header.data_offset + arr->len * sizeof(DynamicArrayFileString);
+        for (unsigned int i = 0; i < arr->len && ok; i++) {
+            string* str = &((string*)arr->buf)[i];
+            DynamicArrayFileString entry = {.offset = offset, .len = str->len};
+            ok = fwrite(&entry, sizeof(entry), 1, fptr) == 1;
+            offset += str->len + 1;
+        }
+        for (unsigned int i = 0; i < arr->len && ok; i++) {
+            string* str = &((string*)arr->buf)[i];
+            // Empty strings may not have a buffer at all, so there is nothing to hand to fwrite
+            ok = (str->len == 0 || fwrite(str->str, 1, str->len, fptr) == str->len) && fputc('\0', fptr) != EOF;
+        }
+    } else if (header.data_size > 0) {
+        ok = ok && fwrite(arr->buf, 1, header.data_size, fptr) == header.data_size;
+    }
+
+    int result = finish_atomic_write(fptr, &tmp, path, ok);
+    if (result != 0) {
+        printf("dynamic_array_save failed to write %s\n", path->str);
+    }
+    string_free(&tmp);
+    return result;
+}
+
+int mapped_array_open(MappedArray* mapped, string* path) {
+    mapped->__strings = NULL;
+    if (mapped_file_open(&mapped->file, path) != 0) {
+        printf("mapped_array_open could not open %s\n", path->str);
+        return -1;
+    }
+
+    DynamicArrayFileHeader* header = (DynamicArrayFileHeader*)mapped->file.data;
+    if (mapped->file.size < sizeof(DynamicArrayFileHeader) || memcmp(header->magic, DYNAMIC_ARRAY_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        printf("%s is not a saved DynamicArray\n", path->str);
+        mapped_file_close(&mapped->file);
+        return -1;
+    } else if (header->version != DYNAMIC_ARRAY_FILE_VERSION || header->byte_order != DYNAMIC_ARRAY_FILE_BYTE_ORDER) {
+        printf("%s was saved by an incompatible version or on a machine with a different byte order\n", path->str);
+        mapped_file_close(&mapped->file);
+        return -1;
+    } else if (!file_section_fits(header->data_offset, header->data_size, 1, DYNAMIC_ARRAY_FILE_ALIGNMENT, mapped->file.size) || header->len > UINT_MAX) {
+        printf("%s is truncated\n", path->str);
+        mapped_file_close(&mapped->file);
+        return -1;
+    }
+
+    // The type name isn't guaranteed to have a null terminator if it takes up the whole field
+    string type = {.str = header->type, .len = strnlen(header->type, DYNAMIC_ARRAY_FILE_TYPE_NAME_LEN), .__memsize = 0};
+    unsigned int typeID = dynamic_array_registry_get_typeID(&type);
+    if (typeID == (unsigned int)-1 || DYNAMIC_ARRAY_TYPE_SIZE(typeID) != header->element_size) {
+        printf("%s holds elements of type %.*s, which is not registered with the same size\n", path->str, (int)type.len, type.str);
+        mapped_file_close(&mapped->file);
+        return -1;
+    }
+
+    // The elements (or the offset table for strings) have to fit inside the data section, not just inside the file
+    bool strings = header->flags & DA_FILE_STRINGS;
+    uint64_t elementSize = strings ? sizeof(DynamicArrayFileString) : header->element_size;
+    if (!file_section_fits(header->data_offset, header->len, elementSize, 1, header->data_offset + header->data_size)) {
+        printf("%s is truncated\n", path->str);
+        mapped_file_close(&mapped->file);
+        return -1;
+    }
+
+    // Every string is checked once here, so that mapped_array_get_string can hand out strings without looking at them again.
+    // Each one has to be inside the file and end in the null terminator that dynamic_array_save puts after it
+    if (strings) {
+        const DynamicArrayFileString* entries = (const DynamicArrayFileString*)((char*)mapped->file.data + header->data_offset);
+        for (uint64_t i = 0; i < header->len; i++) {
+            if (entries[i].len == UINT64_MAX || !file_section_fits(entries[i].offset, entries[i].len + 1, 1, 1, mapped->file.size) ||
+                ((char*)mapped->file.data)[entries[i].offset + entries[i].len] != '\0') {
+                printf("%s has a string that runs past the end of the file\n", path->str);
+                mapped_file_close(&mapped->file);
+                return -1;
+            }
+        }
+    }
+
+    char* data = (char*)mapped->file.data + header->data_offset;
+    mapped->array.len = header->len;
+    mapped->array.type = typeID;
+    mapped->array.element_size = header->element_size;
+    // A memsize of 0 makes it clear that this array doesn't own its buffer
+    mapped->array.__memsize = 0;
+
+    if (strings) {
+        mapped->array.buf = NULL;
+        mapped->__strings = (const DynamicArrayFileString*)data;
+    } else {
+        mapped->array.buf = data;
+    }
+
+    return 0;
+}
+
+int mapped_array_close(MappedArray* mapped) {
+    mapped_file_close(&mapped->file);
+    mapped->array.buf = NULL;
+    mapped->array.len = 0;
+    mapped->__strings = NULL;
+    return 0;
+}
+
+string mapped_array_get_string(MappedArray* mapped, unsigned int index) {
+    if (mapped->__strings == NULL || index >= mapped->array.len) {
+        printf("Index Out of Bounds error in mapped_array_get_string\n");
+        return (string){.str = NULL, .len = 0, .__memsize = -1};
+    }
+
+    const DynamicArrayFileString* entry = &mapped->__strings[index];
+    return (string){.str = (char*)mapped->file.data + entry->offset, .len = entry->len, .__memsize = -1};
+}
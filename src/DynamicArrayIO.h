@@ -0,0 +1,95 @@
+#ifndef DYNAMICARRAYIO_H
+#define DYNAMICARRAYIO_H
+
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// A whole file mapped into memory as read only. On platforms without mmap the file is just read into a buffer,
+// which behaves the same way, just without the laziness
+typedef struct MappedFile {
+    void* data;
+    size_t size;
+    // Whether data came from mmap (and needs munmap) or from malloc (and needs free)
+    bool __mapped;
+} MappedFile;
+
+// Maps the file at the given path into memory. Returns -1 if the file couldn't be opened
+int mapped_file_open(MappedFile* file, string* path);
+
+int mapped_file_close(MappedFile* file);
+
+// Whether a section of count elements of the given size starting at offset fits in a file of the given size, and starts
+// on a multiple of alignment. None of the values are trusted, so this is written so that none of it can overflow
+bool file_section_fits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t alignment, size_t size);
+
+// Writes size bytes of data to the file at the given path. The data is written to a temporary file first
+// and then renamed over the destination, so other processes will only ever see the old file or the complete new one
+int file_write_atomic(string* path, void* data, size_t size);
+
+// The on disk format for a DynamicArray is a DynamicArrayFileHeader followed by the data section, which starts
+// at data_offset. For plain types, the data section is just the raw elements. For arrays of strings, the data section
+// is a table of DynamicArrayFileString entries (one per string) followed by the characters of every string, each with a null terminator
+#define DYNAMIC_ARRAY_FILE_MAGIC "DYNARRAY"
+#define DYNAMIC_ARRAY_FILE_VERSION 1
+#define DYNAMIC_ARRAY_FILE_TYPE_NAME_LEN 64
+// Used to detect files that were written on a machine with a different byte order
+#define DYNAMIC_ARRAY_FILE_BYTE_ORDER 0x01020304u
+// The data section is aligned to this many bytes, so that elements in the mapped file are properly aligned
+#define DYNAMIC_ARRAY_FILE_ALIGNMENT 64
+
+enum DynamicArrayFileFlags {
+    DA_FILE_STRINGS = 1
+};
+
+typedef struct DynamicArrayFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t flags;
+    uint32_t __padding;
+    // The name of the element type in the type registry, padded with null characters
+    char type[DYNAMIC_ARRAY_FILE_TYPE_NAME_LEN];
+    uint64_t element_size;
+    uint64_t len;
+    // Where the data section begins, counted from the start of the file
+    uint64_t data_offset;
+    uint64_t data_size;
+} DynamicArrayFileHeader;
+
+typedef struct DynamicArrayFileString {
+    // Where the characters of the string begin, counted from the start of the file
+    uint64_t offset;
+    uint64_t len;
+} DynamicArrayFileString;
+
+// A DynamicArray that was loaded from a file by mapping it into memory
+typedef struct MappedArray {
+    // For arrays of plain types, the buffer of this array points straight into the mapped file, so
+    // the elements can be used right away without any of them being read or converted. This array must be treated as
+    // read only, and must never be passed to dynamic_array_free or any function that resizes it
+    // For arrays of strings, buf is NULL and mapped_array_get_string has to be used to access the elements
+    DynamicArray array;
+    // The offset table of an array of strings, or NULL for arrays of plain types
+    const DynamicArrayFileString* __strings;
+    MappedFile file;
+} MappedArray;
+
+// Saves the array to the given path. Only arrays of strings and arrays of types without a deallocator
+// can be saved, since any other type would have pointers in it that mean nothing once the program exits
+int dynamic_array_save(DynamicArray* arr, string* path);
+
+// Loads an array that was saved with dynamic_array_save. The type of the array has to be in the type registry
+// with the same size as when the array was saved
+int mapped_array_open(MappedArray* mapped, string* path);
+
+int mapped_array_close(MappedArray* mapped);
+
+// Returns the string at the given index of a mapped array of strings. The returned string points into the mapped file,
+// so like the strings from the STRING macro it must not be modified or freed, and it is only valid until the array is closed
+string mapped_array_get_string(MappedArray* mapped, unsigned int index);
+
+#endif
@@ -0,0 +1,434 @@
+#include "HashMap.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Robin Hood probing keeps probe lengths short even when the table is quite full, so the table
+// only grows once it is 80% full
+#define HASH_MAP_MAX_LOAD_NUMERATOR 4
+#define HASH_MAP_MAX_LOAD_DENOMINATOR 5
+#define HASH_MAP_MIN_CAPACITY 8
+
+uint64_t hash_map_hash_int(uint64_t x) {
+    // This is the finalizer from MurmurHash3, which makes every bit of the input affect every bit of the output
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t hash_map_hash_bytes(const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = 0x9e3779b97f4a7c15ULL ^ (len * 0xc6a4a7935bd1e995ULL);
+
+    // Eight bytes are consumed at a time, which is a lot faster than the usual byte at a time hashes for long keys
+    // memcpy is used to read the words since the data is not guaranteed to be aligned
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ hash_map_hash_int(word)) * 0x9e3779b97f4a7c15ULL;
+        bytes += 8;
+        len -= 8;
+    }
+
+    if (len > 0) {
+        uint64_t word = 0;
+        memcpy(&word, bytes, len);
+        hash = (hash ^ hash_map_hash_int(word)) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    return hash_map_hash_int(hash);
+}
+
+static bool hash_map_is_integer_type(unsigned int type) {
+    return type <= DA_TYPE_BOOL;
+}
+
+static uint32_t hash_map_hash_key(HashMap* map, void* key) {
+    if (map->key_type == DA_TYPE_STRING) {
+        string* str = (string*)key;
+        return (uint32_t)hash_map_hash_bytes(str->str, str->len);
+    } else if (hash_map_is_integer_type(map->key_type)) {
+        // Integer keys skip the general byte hashing since a single mix is enough for them
+        uint64_t value = 0;
+        memcpy(&value, key, map->key_size);
+        return (uint32_t)hash_map_hash_int(value);
+    } else {
+        // Note: struct keys are hashed by their raw bytes, so any padding in them should be zeroed
+        return (uint32_t)hash_map_hash_bytes(key, map->key_size);
+    }
+}
+
+static bool hash_map_key_equal(HashMap* map, void* stored, void* key) {
+    if (map->key_type == DA_TYPE_STRING) {
+        return string_compare((string*)stored, (string*)key);
+    } else {
+        return memcmp(stored, key, map->key_size) == 0;
+    }
+}
+
+static inline char* hash_map_entry(HashMap* map, HashMapTable* table, unsigned int index) {
+    return table->entries + ((size_t)index * map->__entry_size);
+}
+
+static void hash_map_table_alloc(HashMap* map, HashMapTable* table, unsigned int capacity) {
+    table->capacity = capacity;
+    table->len = 0;
+    // calloc is used so that every slot starts out with a distance of 0, meaning empty
+    table->slots = (HashMapSlot*)calloc(capacity, sizeof(HashMapSlot));
+    table->entries = (char*)malloc((size_t)capacity * map->__entry_size);
+
+    if (table->slots == NULL || table->entries == NULL) {
+        printf("Failed to allocate memory in hash_map_table_alloc\n");
+        exit(-1);
+    }
+}
+
+static void hash_map_table_free(HashMap* map, HashMapTable* table, bool freeEntries) {
+    if (freeEntries) {
+        int (*keyDeallocator)(void*) = DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->key_type);
+        int (*valueDeallocator)(void*) = map->value_size > 0 ? DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->value_type) : NULL;
+
+        if (keyDeallocator != NULL || valueDeallocator != NULL) {
+            for (unsigned int i = 0; i < table->capacity; i++) {
+                if (table->slots[i].dist != 0) {
+                    char* entry = hash_map_entry(map, table, i);
+                    if (keyDeallocator != NULL) {
+                        keyDeallocator(entry);
+                    }
+                    if (valueDeallocator != NULL) {
+                        valueDeallocator(entry + map->__value_offset);
+                    }
+                }
+            }
+        }
+    }
+
+    free(table->slots);
+    free(table->entries);
+    *table = (HashMapTable){.slots = NULL, .entries = NULL, .capacity = 0, .len = 0};
+}
+
+// Places the entry currently held in the first half of the scratch buffer into the table. The entry must not already be in the table
+static void hash_map_table_place(HashMap* map, HashMapTable* table, uint32_t hash) {
+    char* carried = map->__scratch;
+    char* swap = map->__scratch + map->__entry_size;
+    unsigned int mask = table->capacity - 1;
+    unsigned int pos = hash & mask;
+    uint32_t dist = 1;
+
+    while (true) {
+        HashMapSlot* slot = &table->slots[pos];
+        if (slot->dist == 0) {
+            slot->hash = hash;
+            slot->dist = dist;
+            memcpy(hash_map_entry(map, table, pos), carried, map->__entry_size);
+            table->len++;
+            return;
+        }
+
+        // This is what makes it Robin Hood hashing: if the entry in the bucket is closer to its home than the one being
+        // carried, then the carried entry takes the bucket and the displaced entry is carried forward instead
+        if (slot->dist < dist) {
+            char* entry = hash_map_entry(map, table, pos);
+            memcpy(swap, entry, map->__entry_size);
+            memcpy(entry, carried, map->__entry_size);
+            memcpy(carried, swap, map->__entry_size);
+
+            uint32_t tempHash = slot->hash;
+            uint32_t tempDist = slot->dist;
+            slot->hash = hash;
+            slot->dist = dist;
+            hash = tempHash;
+            dist = tempDist;
+        }
+
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+}
+
+// Returns the bucket index of the key in the table, or -1 if it isn't there
+static int hash_map_table_find(HashMap* map, HashMapTable* table, void* key, uint32_t hash) {
+    if (table->len == 0) {
+        return -1;
+    }
+
+    unsigned int mask = table->capacity - 1;
+    unsigned int pos = hash & mask;
+    uint32_t dist = 1;
+
+    while (true) {
+        HashMapSlot* slot = &table->slots[pos];
+        // Because of the Robin Hood invariant, once an entry is found that is closer to its home than the key
+        // would be, the key can't be anywhere further along
+        if (slot->dist < dist) {
+            return -1;
+        }
+
+        if (slot->hash == hash && hash_map_key_equal(map, hash_map_entry(map, table, pos), key)) {
+            return pos;
+        }
+
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+}
+
+// Removes the entry at the given bucket without deallocating it, shifting the entries after it back by one
+// until one is found that is already in its home bucket. This is what avoids the need for tombstones
+static void hash_map_table_erase(HashMap* map, HashMapTable* table, unsigned int pos) {
+    unsigned int mask = table->capacity - 1;
+
+    while (true) {
+        unsigned int next = (pos + 1) & mask;
+        if (table->slots[next].dist <= 1) {
+            table->slots[pos].dist = 0;
+            break;
+        }
+
+        memcpy(hash_map_entry(map, table, pos), hash_map_entry(map, table, next), map->__entry_size);
+        table->slots[pos].hash = table->slots[next].hash;
+        table->slots[pos].dist = table->slots[next].dist - 1;
+        pos = next;
+    }
+
+    table->len--;
+}
+
+// Moves a bounded number of entries from the old table to the current one
+static void hash_map_migrate(HashMap* map, unsigned int maxMoves) {
+    unsigned int moves = 0;
+
+    while (map->old.capacity > 0 && moves < maxMoves) {
+        if (map->old.len == 0 || map->__migrate_index >= map->old.capacity) {
+            hash_map_table_free(map, &map->old, false);
+            map->__migrate_index = 0;
+            return;
+        }
+
+        HashMapSlot* slot = &map->old.slots[map->__migrate_index];
+        if (slot->dist == 0) {
+            map->__migrate_index++;
+            continue;
+        }
+
+        // Erasing the entry shifts the rest of its cluster back into this bucket, so the same index is looked at
+        // again until it is empty. Entries only ever shift backwards, so nothing can end up behind the migration index
+        uint32_t hash = slot->hash;
+        memcpy(map->__scratch, hash_map_entry(map, &map->old, map->__migrate_index), map->__entry_size);
+        hash_map_table_erase(map, &map->old, map->__migrate_index);
+        hash_map_table_place(map, &map->table, hash);
+        moves++;
+    }
+}
+
+static void hash_map_grow(HashMap* map, unsigned int capacity) {
+    // A new resize can't begin while the previous one is still going, so whatever is left of it is finished first
+    hash_map_migrate(map, UINT32_MAX);
+
+    if (map->table.len == 0) {
+        hash_map_table_free(map, &map->table, false);
+        hash_map_table_alloc(map, &map->table, capacity);
+        return;
+    }
+
+    map->old = map->table;
+    map->__migrate_index = 0;
+    hash_map_table_alloc(map, &map->table, capacity);
+}
+
+static size_t hash_map_align(size_t size) {
+    size_t alignment = size >= 16 ? 16 : 8;
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+int hash_map_init(HashMap* map, string* key_type, string* value_type) {
+    map->key_type = dynamic_array_registry_get_typeID(key_type);
+    if (map->key_type == (unsigned int)-1) {
+        printf("hash_map_init was given a key type that is not in the type registry\n");
+        return -1;
+    }
+    map->key_size = DYNAMIC_ARRAY_TYPE_SIZE(map->key_type);
+
+    if (value_type != NULL) {
+        map->value_type = dynamic_array_registry_get_typeID(value_type);
+        if (map->value_type == (unsigned int)-1) {
+            printf("hash_map_init was given a value type that is not in the type registry\n");
+            return -1;
+        }
+        map->value_size = DYNAMIC_ARRAY_TYPE_SIZE(map->value_type);
+    } else {
+        map->value_type = (unsigned int)-1;
+        map->value_size = 0;
+    }
+
+    map->__value_offset = hash_map_align(map->key_size);
+    map->__entry_size = hash_map_align(map->__value_offset + map->value_size);
+    map->__scratch = (char*)malloc(2 * map->__entry_size);
+    if (map->__scratch == NULL) {
+        printf("Failed to allocate memory in hash_map_init\n");
+        exit(-1);
+    }
+
+    map->table = (HashMapTable){.slots = NULL, .entries = NULL, .capacity = 0, .len = 0};
+    map->old = (HashMapTable){.slots = NULL, .entries = NULL, .capacity = 0, .len = 0};
+    map->__migrate_index = 0;
+    map->len = 0;
+    return 0;
+}
+
+int hash_map_free(HashMap* map) {
+    hash_map_table_free(map, &map->table, true);
+    hash_map_table_free(map, &map->old, true);
+    free(map->__scratch);
+    map->__scratch = NULL;
+    map->__migrate_index = 0;
+    map->len = 0;
+    return 0;
+}
+
+int hash_map_deallocator(void* map) {
+    hash_map_free((HashMap*)map);
+    return 0;
+}
+
+int hash_map_reserve(HashMap* map, unsigned int count) {
+    unsigned int capacity = map->table.capacity > 0 ? map->table.capacity : HASH_MAP_MIN_CAPACITY;
+    while ((uint64_t)count * HASH_MAP_MAX_LOAD_DENOMINATOR > (uint64_t)capacity * HASH_MAP_MAX_LOAD_NUMERATOR) {
+        capacity *= 2;
+    }
+
+    if (capacity > map->table.capacity) {
+        hash_map_grow(map, capacity);
+        // Reserving is done up front, so there is no latency to avoid by migrating incrementally
+        hash_map_migrate(map, UINT32_MAX);
+    }
+    return 0;
+}
+
+void* hash_map_get(HashMap* map, void* key) {
+    if (map->len == 0) {
+        return NULL;
+    }
+
+    uint32_t hash = hash_map_hash_key(map, key);
+    int pos = hash_map_table_find(map, &map->table, key, hash);
+    if (pos >= 0) {
+        return hash_map_entry(map, &map->table, pos) + map->__value_offset;
+    }
+
+    pos = hash_map_table_find(map, &map->old, key, hash);
+    if (pos >= 0) {
+        return hash_map_entry(map, &map->old, pos) + map->__value_offset;
+    }
+
+    return NULL;
+}
+
+bool hash_map_contains(HashMap* map, void* key) {
+    return hash_map_get(map, key) != NULL;
+}
+
+int hash_map_insert(HashMap* map, void* key, void* value) {
+    uint32_t hash = hash_map_hash_key(map, key);
+
+    // If the key is already in the map (in either table), the value is just replaced in place
+    HashMapTable* tables[2] = {&map->table, &map->old};
+    for (int i = 0; i < 2; i++) {
+        int pos = hash_map_table_find(map, tables[i], key, hash);
+        if (pos >= 0) {
+            if (map->value_size > 0) {
+                char* stored = hash_map_entry(map, tables[i], pos) + map->__value_offset;
+                if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->value_type) != NULL) {
+                    DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->value_type)(stored);
+                }
+                memcpy(stored, value, map->value_size);
+            }
+            return 0;
+        }
+    }
+
+    if (map->table.capacity == 0) {
+        hash_map_table_alloc(map, &map->table, HASH_MAP_MIN_CAPACITY);
+    } else if ((uint64_t)(map->table.len + 1) * HASH_MAP_MAX_LOAD_DENOMINATOR > (uint64_t)map->table.capacity * HASH_MAP_MAX_LOAD_NUMERATOR) {
+        hash_map_grow(map, map->table.capacity * 2);
+    }
+
+    // The entry is built in the scratch buffer, since placing it may carry it through several buckets
+    memset(map->__scratch, 0, map->__entry_size);
+    if (map->key_type == DA_TYPE_STRING) {
+        string copy;
+        string_init(&copy);
+        string_copy(&copy, (string*)key);
+        memcpy(map->__scratch, &copy, sizeof(string));
+    } else {
+        memcpy(map->__scratch, key, map->key_size);
+    }
+    if (map->value_size > 0) {
+        memcpy(map->__scratch + map->__value_offset, value, map->value_size);
+    }
+
+    hash_map_table_place(map, &map->table, hash);
+    map->len++;
+
+    hash_map_migrate(map, HASH_MAP_MIGRATION_STEP);
+    return 0;
+}
+
+int hash_map_remove(HashMap* map, void* key) {
+    if (map->len == 0) {
+        return -1;
+    }
+
+    uint32_t hash = hash_map_hash_key(map, key);
+    HashMapTable* tables[2] = {&map->table, &map->old};
+    for (int i = 0; i < 2; i++) {
+        int pos = hash_map_table_find(map, tables[i], key, hash);
+        if (pos >= 0) {
+            char* entry = hash_map_entry(map, tables[i], pos);
+            if (DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->key_type) != NULL) {
+                DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->key_type)(entry);
+            }
+            if (map->value_size > 0 && DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->value_type) != NULL) {
+                DYNAMIC_ARRAY_TYPE_DEALLOCATOR(map->value_type)(entry + map->__value_offset);
+            }
+
+            hash_map_table_erase(map, tables[i], pos);
+            map->len--;
+
+            hash_map_migrate(map, HASH_MAP_MIGRATION_STEP);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+bool hash_map_iterate(HashMap* map, unsigned int* iterator, void** key, void** value) {
+    // The iterator counts through the buckets of the old table first, and then the buckets of the current table
+    while (*iterator < map->old.capacity + map->table.capacity) {
+        HashMapTable* table = *iterator < map->old.capacity ? &map->old : &map->table;
+        unsigned int pos = *iterator < map->old.capacity ? *iterator : *iterator - map->old.capacity;
+        (*iterator)++;
+
+        if (table->slots[pos].dist != 0) {
+            char* entry = hash_map_entry(map, table, pos);
+            if (key != NULL) {
+                *key = entry;
+            }
+            if (value != NULL) {
+                *value = entry + map->__value_offset;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
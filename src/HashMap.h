@@ -0,0 +1,102 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Per bucket bookkeeping for the hash map. It is stored separately from the keys and values so that
+// probing only has to walk over a small, dense array
+typedef struct HashMapSlot {
+    // The hash of the key in the bucket, which is compared before the keys themselves so that
+    // most mismatches never have to touch the key
+    uint32_t hash;
+    // A value of 0 means the bucket is empty. Otherwise it is one more than the distance of the entry
+    // from the bucket its hash originally pointed at (its home bucket)
+    uint32_t dist;
+} HashMapSlot;
+
+typedef struct HashMapTable {
+    HashMapSlot* slots;
+    // The keys and values, entry_size bytes per bucket
+    char* entries;
+    // Always a power of two (or 0 when the table is not allocated) so that hashes can be masked instead of using modulo
+    unsigned int capacity;
+    unsigned int len;
+} HashMapTable;
+
+// An open addressing hash map that uses Robin Hood probing. Entries that are far from their home bucket
+// steal the buckets of entries that are closer to theirs, which keeps probe lengths short and lets lookups stop early.
+// Deletion shifts the following entries back instead of leaving tombstones, so the table never degrades over time.
+// Growing the table is done incrementally: the old table is kept around and a few of its entries are moved over
+// on every insert and remove, which avoids having one insert pay for rehashing the entire map.
+typedef struct HashMap {
+    // The table new entries are inserted into
+    HashMapTable table;
+    // The table that is being migrated from after a resize. Its capacity is 0 when no migration is going on
+    HashMapTable old;
+    // The bucket of the old table that the migration will continue from
+    unsigned int __migrate_index;
+    // The total number of entries in the map (across both tables)
+    unsigned int len;
+    // The type registry ids of the keys and values. Keys of type string are hashed and compared by their contents,
+    // everything else is hashed and compared by its raw bytes
+    unsigned int key_type;
+    unsigned int value_type;
+    size_t key_size;
+    size_t value_size;
+    // Where the value is located relative to the start of an entry
+    size_t __value_offset;
+    size_t __entry_size;
+    // Used for holding the entry being carried around during Robin Hood insertion
+    char* __scratch;
+} HashMap;
+
+// The maximum number of entries moved from the old table to the new one per insert or remove
+#define HASH_MAP_MIGRATION_STEP 16
+
+// A fast, general purpose 64 bit hash of a block of bytes
+uint64_t hash_map_hash_bytes(const void* data, size_t len);
+
+// Scrambles the bits of a 64 bit integer. Useful for hashing integer keys
+uint64_t hash_map_hash_int(uint64_t x);
+
+// Both types have to already be in the type registry. If the map is only needed as a set, value_type can be NULL.
+// Example: hash_map_init(&map, &STRING("string"), &STRING("int"));
+int hash_map_init(HashMap* map, string* key_type, string* value_type);
+
+// Frees the map, calling the deallocators of the key and value types on every entry that is still in it
+int hash_map_free(HashMap* map);
+
+// For use with the type registry
+int hash_map_deallocator(void* map);
+
+// Inserts the key and value into the map, or replaces the value if the key is already in it (the old value is deallocated).
+// The raw bytes of the value are copied into the map, so the map takes ownership of anything the value points to,
+// just like with dynamic_array_append. String keys are copied, so the caller still owns the key that is passed in
+int hash_map_insert(HashMap* map, void* key, void* value);
+
+// Returns a pointer to the value stored for the key, or NULL if the key isn't in the map.
+// The pointer is only valid until the next insert or remove, since those can move entries around
+void* hash_map_get(HashMap* map, void* key);
+
+// Returns true if the key is in the map
+bool hash_map_contains(HashMap* map, void* key);
+
+// Removes the key from the map, deallocating the key and value. Returns -1 if the key wasn't found
+int hash_map_remove(HashMap* map, void* key);
+
+// Makes sure the map can hold at least count entries without having to grow again
+int hash_map_reserve(HashMap* map, unsigned int count);
+
+// Allows for iterating over every entry of the map. The iterator should start out as 0, and the function returns
+// false once every entry has been visited. The map must not be modified while it is being iterated over
+// Example:
+// unsigned int it = 0; void* key; void* value;
+// while (hash_map_iterate(&map, &it, &key, &value)) { ... }
+bool hash_map_iterate(HashMap* map, unsigned int* iterator, void** key, void** value);
+
+#endif
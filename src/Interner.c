@@ -0,0 +1,44 @@
+#include "Interner.h"
+#include "DynamicArray.h"
+#include "HashMap.h"
+#include "Strings.h"
+
+extern string* interner_get(Interner* interner, unsigned int id);
+
+int interner_init(Interner* interner) {
+    hash_map_init(&interner->ids, &STRING("string"), &STRING("unsigned int"));
+    dynamic_array_init(&interner->names, &STRING("string"));
+    return 0;
+}
+
+int interner_free(Interner* interner) {
+    hash_map_free(&interner->ids);
+    dynamic_array_free(&interner->names);
+    return 0;
+}
+
+int interner_deallocator(void* interner) {
+    interner_free((Interner*)interner);
+    return 0;
+}
+
+unsigned int interner_intern(Interner* interner, string* str) {
+    unsigned int* existing = hash_map_get(&interner->ids, str);
+    if (existing != NULL) {
+        return *existing;
+    }
+
+    unsigned int id = interner->names.len;
+    hash_map_insert(&interner->ids, str, &id);
+
+    string copy;
+    string_init(&copy);
+    string_copy(&copy, str);
+    dynamic_array_append(&interner->names, &copy);
+    return id;
+}
+
+unsigned int interner_find(Interner* interner, string* str) {
+    unsigned int* existing = hash_map_get(&interner->ids, str);
+    return existing != NULL ? *existing : (unsigned int)-1;
+}
@@ -0,0 +1,36 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include "DynamicArray.h"
+#include "HashMap.h"
+#include "Strings.h"
+
+// Gives every distinct string a small integer id, so that names can be stored and compared as integers
+// instead of strings. The same string always gets the same id, and ids are handed out in order starting at 0
+typedef struct Interner {
+    // Maps each string to its id
+    HashMap ids;
+    // The string for each id (of type string)
+    DynamicArray names;
+} Interner;
+
+int interner_init(Interner* interner);
+
+int interner_free(Interner* interner);
+
+// For use with the type registry
+int interner_deallocator(void* interner);
+
+// Returns the id of the string, giving it a new id if it hasn't been seen before. The string is copied,
+// so the caller still owns the one that is passed in
+unsigned int interner_intern(Interner* interner, string* str);
+
+// Returns the id of the string, or -1 if it has never been interned
+unsigned int interner_find(Interner* interner, string* str);
+
+// Returns the string with the given id. It is owned by the interner, so it must not be modified or freed
+inline string* interner_get(Interner* interner, unsigned int id) {
+    return &((string*)interner->names.buf)[id];
+}
+
+#endif
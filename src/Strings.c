@@ -29,16 +29,23 @@ int string_resize(string* str, unsigned int size) {
     return 0;
 }
 
+// Empty strings can have a NULL pointer, which memcpy doesn't allow even when copying 0 bytes, hence the length checks
 int string_copy(string* dest, string* src) {
     string_resize(dest, src->len);
-    memcpy(dest->str, src->str, src->len);
+    if (src->len > 0) {
+        memcpy(dest->str, src->str, src->len);
+    }
     return 0;
 }
 
 int string_concat(string* dest, string* base, string* add) {
     string_resize(dest, base->len + add->len);
-    memcpy(dest->str, base->str, base->len);
-    memcpy(dest->str + base->len, add->str, add->len);
+    if (base->len > 0) {
+        memcpy(dest->str, base->str, base->len);
+    }
+    if (add->len > 0) {
+        memcpy(dest->str + base->len, add->str, add->len);
+    }
     return 0;
 }
 
@@ -89,9 +96,10 @@ int string_find_with_offset(string* src, string* find, unsigned int offset) {
     return -1;
 }
 
+// Two empty strings are equal without looking at their pointers, which can be NULL (see string_copy)
 int string_compare(string* str1, string* str2) {
     if (str1->len == str2->len) {
-        if (memcmp(str1->str, str2->str, str1->len) == 0) {
+        if (str1->len == 0 || memcmp(str1->str, str2->str, str1->len) == 0) {
             return true;
         } else {
             return false;
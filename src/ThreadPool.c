@@ -0,0 +1,144 @@
+#include "ThreadPool.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+unsigned int thread_pool_default_size(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (unsigned int)cores : 1;
+}
+
+// Takes the next task off of the queue. The lock must be held when this is called
+static bool thread_pool_take(ThreadPool* pool, ThreadPoolTask* task) {
+    if (pool->head >= pool->tasks.len) {
+        return false;
+    }
+
+    *task = ((ThreadPoolTask*)pool->tasks.buf)[pool->head];
+    pool->head++;
+
+    // Once every task in the queue has been taken, the queue can start over from the beginning instead of
+    // growing forever. The buffer itself is kept around so that the next batch of tasks doesn't need to reallocate
+    if (pool->head == pool->tasks.len) {
+        pool->head = 0;
+        pool->tasks.len = 0;
+    }
+    return true;
+}
+
+static void thread_pool_finish(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->pending--;
+    if (pool->pending == 0) {
+        pthread_cond_broadcast(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void* thread_pool_worker(void* arg) {
+    ThreadPool* pool = (ThreadPool*)arg;
+
+    while (true) {
+        ThreadPoolTask task;
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && !thread_pool_take(pool, &task)) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task.function(task.arg);
+        thread_pool_finish(pool);
+    }
+}
+
+int thread_pool_init(ThreadPool* pool, unsigned int thread_count) {
+    dynamic_array_registry_type_append(&STRING("ThreadPoolTask"), NULL, sizeof(ThreadPoolTask));
+
+    if (thread_count == 0) {
+        thread_count = thread_pool_default_size();
+    }
+
+    dynamic_array_init(&pool->tasks, &STRING("ThreadPoolTask"));
+    pool->head = 0;
+    pool->pending = 0;
+    pool->stopping = false;
+    pool->thread_count = thread_count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    pool->threads = (pthread_t*)malloc(thread_count * sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        printf("Failed to allocate memory in thread_pool_init\n");
+        exit(-1);
+    }
+
+    for (unsigned int i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) != 0) {
+            printf("Failed to create a thread in thread_pool_init\n");
+            exit(-1);
+        }
+    }
+
+    return 0;
+}
+
+int thread_pool_free(ThreadPool* pool) {
+    thread_pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+    dynamic_array_free(&pool->tasks);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+    pthread_cond_destroy(&pool->work_done);
+    return 0;
+}
+
+int thread_pool_submit(ThreadPool* pool, void (*function)(void*), void* arg) {
+    pthread_mutex_lock(&pool->lock);
+    dynamic_array_append(&pool->tasks, &(ThreadPoolTask){.function = function, .arg = arg});
+    pool->pending++;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int thread_pool_wait(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        // Rather than just sleeping, the waiting thread runs tasks itself until the queue is empty.
+        // This means a pool is never slower than doing the work directly on the calling thread
+        ThreadPoolTask task;
+        if (thread_pool_take(pool, &task)) {
+            pthread_mutex_unlock(&pool->lock);
+            task.function(task.arg);
+            thread_pool_finish(pool);
+            pthread_mutex_lock(&pool->lock);
+        } else {
+            pthread_cond_wait(&pool->work_done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "DynamicArray.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// A single unit of work for the thread pool: the function is called with arg as its only parameter
+typedef struct ThreadPoolTask {
+    void (*function)(void*);
+    void* arg;
+} ThreadPoolTask;
+
+typedef struct ThreadPool {
+    pthread_t* threads;
+    unsigned int thread_count;
+    // A DynamicArray of ThreadPoolTask. Tasks are taken from the front by advancing head, and the
+    // array is emptied out once head catches up to the end
+    DynamicArray tasks;
+    unsigned int head;
+    // The number of tasks that have been submitted but not finished yet
+    unsigned int pending;
+    bool stopping;
+    pthread_mutex_t lock;
+    // Signaled whenever a task is added to the queue (or the pool is stopping)
+    pthread_cond_t work_available;
+    // Signaled whenever pending drops to 0
+    pthread_cond_t work_done;
+} ThreadPool;
+
+// Returns the number of cores available, which is a good default for the number of threads in a pool
+unsigned int thread_pool_default_size(void);
+
+// Starts up the given number of worker threads. Passing 0 uses thread_pool_default_size()
+int thread_pool_init(ThreadPool* pool, unsigned int thread_count);
+
+// Waits for every task that was submitted to finish, and then stops all of the worker threads
+int thread_pool_free(ThreadPool* pool);
+
+// Adds a task to the queue. The task will be run on one of the worker threads at some point in the future
+int thread_pool_submit(ThreadPool* pool, void (*function)(void*), void* arg);
+
+// Blocks until every task that has been submitted has finished. The calling thread helps run tasks while it waits.
+// Note: this must not be called from inside of a task, since the task would end up waiting on itself
+int thread_pool_wait(ThreadPool* pool);
+
+#endif
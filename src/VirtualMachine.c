@@ -1,29 +1,2192 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include "Strings.h"
+#include "VirtualMachine.h"
 #include "DynamicArray.h"
+#include "DynamicArrayAlgorithms.h"
+#include "DynamicArrayIO.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "VirtualMachineJit.h"
+#include "VirtualMachineProfile.h"
+#include "ir.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern inline int32_t vm_jump_offset(instruction ins);
+extern inline VM_value vm_int_value(int32_t i);
+extern inline VM_value vm_float_value(double f);
+extern inline VM_value vm_string_value(VM_string* str);
+extern inline int32_t vm_int(VM_value value);
+extern inline VM_string* vm_string(VM_value value);
+extern inline bool vm_is_int(VM_value value);
+extern inline bool vm_is_string(VM_value value);
+extern inline bool vm_is_float(VM_value value);
+extern inline bool vm_is_short(VM_value value);
+extern inline uint32_t vm_short_length(VM_value value);
+extern inline char vm_short_char(VM_value value, uint32_t i);
+extern inline VM_value vm_short_value(const char* chars, uint32_t len);
+extern inline uint32_t vm_string_length(VM_value value);
+
+// GCC and clang can jump straight to the code of the next instruction through a table of label addresses (threaded
+// dispatch), which saves the bounds check of a switch and gives every instruction its own indirect jump for the branch
+// predictor to learn. Anything else uses the switch. Defining VM_SWITCH_DISPATCH forces the switch, to compare the two
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
+
+static const char* VM_OP_NAMES[VM_OP_COUNT] = {
+    [VM_MOVE] = "move",
+    [VM_LOAD_INT] = "load_int",
+    [VM_LOAD_CONST] = "load_const",
+    [VM_ADD_INT] = "add_int",
+    [VM_SUB_INT] = "sub_int",
+    [VM_MUL_INT] = "mul_int",
+    [VM_DIV_INT] = "div_int",
+    [VM_NEG_INT] = "neg_int",
+    [VM_ADD_FLOAT] = "add_float",
+    [VM_SUB_FLOAT] = "sub_float",
+    [VM_MUL_FLOAT] = "mul_float",
+    [VM_DIV_FLOAT] = "div_float",
+    [VM_NEG_FLOAT] = "neg_float",
+    [VM_CONCAT] = "concat",
+    [VM_CONCAT_LOCAL] = "concat_local",
+    [VM_LT_INT] = "lt_int",
+    [VM_LE_INT] = "le_int",
+    [VM_GT_INT] = "gt_int",
+    [VM_GE_INT] = "ge_int",
+    [VM_EQ_INT] = "eq_int",
+    [VM_NE_INT] = "ne_int",
+    [VM_LT_FLOAT] = "lt_float",
+    [VM_LE_FLOAT] = "le_float",
+    [VM_GT_FLOAT] = "gt_float",
+    [VM_GE_FLOAT] = "ge_float",
+    [VM_EQ_FLOAT] = "eq_float",
+    [VM_NE_FLOAT] = "ne_float",
+    [VM_EQ_STRING] = "eq_string",
+    [VM_NE_STRING] = "ne_string",
+    [VM_INT_TO_FLOAT] = "int_to_float",
+    [VM_FLOAT_TO_INT] = "float_to_int",
+    [VM_LOAD_GLOBAL] = "load_global",
+    [VM_STORE_GLOBAL] = "store_global",
+    [VM_CALL] = "call",
+    [VM_JUMP] = "jump",
+    [VM_JUMP_IF] = "jump_if",
+    [VM_JUMP_IF_NOT] = "jump_if_not",
+    [VM_RETURN] = "return",
+    [VM_RETURN_NONE] = "return_none",
+    [VM_ADD_INT_IMM] = "add_int_imm",
+    [VM_JUMP_IF_LT_INT] = "jump_if_lt_int",
+    [VM_JUMP_IF_LE_INT] = "jump_if_le_int",
+    [VM_JUMP_IF_GT_INT] = "jump_if_gt_int",
+    [VM_JUMP_IF_GE_INT] = "jump_if_ge_int",
+    [VM_JUMP_IF_EQ_INT] = "jump_if_eq_int",
+    [VM_JUMP_IF_NE_INT] = "jump_if_ne_int",
+    [VM_JUMP_IF_LT_INT_IMM] = "jump_if_lt_int_imm",
+    [VM_JUMP_IF_LE_INT_IMM] = "jump_if_le_int_imm",
+    [VM_JUMP_IF_GT_INT_IMM] = "jump_if_gt_int_imm",
+    [VM_JUMP_IF_GE_INT_IMM] = "jump_if_ge_int_imm",
+    [VM_JUMP_IF_EQ_INT_IMM] = "jump_if_eq_int_imm",
+    [VM_JUMP_IF_NE_INT_IMM] = "jump_if_ne_int_imm",
+    [VM_MOVE_JUMP] = "move_jump",
+};
+
+// How a value is kept, which is decided before registers are handed out (see vm_select_superinstructions)
+enum VM_value_kinds {
+    // In a register of its own
+    VM_VALUE_REGISTER,
+    // A small int constant that only ever shows up inside the instructions that use it, so it needs no register
+    VM_VALUE_IMMEDIATE,
+    // A comparison that is done by the branch that uses it, so it needs no register either
+    VM_VALUE_FUSED,
+};
+
+// The part of a function where a value has to stay in its register, from the position of the first instruction up to and
+// including the position of the last one. Positions count the instructions of the function in reverse postorder
+typedef struct VM_interval {
+    uint32_t start;
+    uint32_t end;
+    uint32_t value;
+} VM_interval;
+
+// A jump whose target is the start of a block, which is filled in once every block has its place in the code
+typedef struct VM_fixup {
+    uint32_t instr;
+    uint32_t block;
+} VM_fixup;
+
+// The moves for the phis of a block that have to happen on an edge that can't hold them itself (see vm_compile_branch).
+// They are put after the rest of the function
+typedef struct VM_stub {
+    uint32_t instr;
+    uint32_t from;
+    uint32_t to;
+} VM_stub;
 
-// Instructions will be one byte (8 bits long)
+typedef struct VM_move {
+    uint32_t dst;
+    uint32_t src;
+} VM_move;
 
-// This is helpful for easily accessing the 8 bits that define the operation, of which there are 256 possible operations
-// but not all of those possiblities will be used
-typedef union {
-    uint64_t full;
-    // The operation is specified by the instruction
-    uint8_t op;
-} instruction;
+// How often one pair of ops ran, for sorting the pairs by it
+typedef struct VM_pair_count {
+    uint64_t count;
+    uint32_t pair;
+    uint32_t __padding;
+} VM_pair_count;
 
-int main(void) {
-    dynamic_array_registry_init();
-    dynamic_array_registry_type_append(&STRING("uint64_t"), NULL, sizeof(uint64_t));
+typedef struct VM_compiler {
+    VM_program* program;
+    IR_module* module;
+    IR_function* fn;
+    VM_function* function;
+    // The register of every value (of type unsigned int)
+    DynamicArray registers;
+    // The interval of every value (of type VM_interval), with start IR_NONE for values that aren't in a block
+    DynamicArray intervals;
+    // The positions of the first and last instruction of every block (of type unsigned int)
+    DynamicArray blockStarts;
+    DynamicArray blockEnds;
+    // For every block, one more than the last value that was found to be alive at its start (of type unsigned int)
+    DynamicArray marks;
+    DynamicArray worklist;
+    // Where every block starts in the code (of type unsigned int)
+    DynamicArray offsets;
+    // Of type VM_fixup
+    DynamicArray fixups;
+    // Of type VM_stub
+    DynamicArray stubs;
+    // Of type VM_move
+    DynamicArray moves;
+    // The constant for every interned string, or IR_NONE if it hasn't been used yet (of type unsigned int)
+    DynamicArray stringConstants;
+    // One of the VM_value_kinds for every value (of type unsigned int)
+    DynamicArray kinds;
+    // How many times every value is used, and how many of those uses can take it as a 16 bit int (of type unsigned int)
+    DynamicArray uses;
+    DynamicArray immediateUses;
+    // For the stack maps: the string values of the function, the index of every value among them (IR_NONE for values that
+    // aren't strings), and where the registers of the strings that are alive across every call and concatenation start in
+    // the stack_map_registers of the program, along with how many there are (of type unsigned int)
+    DynamicArray stringValues;
+    DynamicArray stringIndices;
+    DynamicArray mapStarts;
+    DynamicArray mapCounts;
+    // One bit for every string value, for every block, which is set when the value is alive at the start of the block
+    // (of type unsigned long long)
+    DynamicArray liveIn;
+    // The same, while going through one block
+    DynamicArray live;
+    // The slot of every concatenation that keeps its result in the frame, and IR_NONE for every other value (of type
+    // unsigned int)
+    DynamicArray slots;
+    unsigned int scratch;
+} VM_compiler;
 
-    DynamicArray heap;
-    dynamic_array_init(&heap, &STRING("uint64_t"));
+static int vm_string_deallocator(void* str) {
+    free(*(VM_string**)str);
+    return 0;
+}
 
-    printf("Hello World\n");
+int vm_program_deallocator(void* program) {
+    return vm_program_free((VM_program*)program);
+}
 
-    dynamic_array_free(&heap);
-    dynamic_array_registry_terminate();
+int vm_deallocator(void* vm) {
+    return vm_free((VM*)vm);
+}
+
+int vm_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("instruction"), NULL, sizeof(instruction));
+    dynamic_array_registry_type_append(&STRING("VM_value"), NULL, sizeof(VM_value));
+    dynamic_array_registry_type_append(&STRING("VM_string*"), vm_string_deallocator, sizeof(VM_string*));
+    dynamic_array_registry_type_append(&STRING("VM_function"), NULL, sizeof(VM_function));
+    dynamic_array_registry_type_append(&STRING("VM_interval"), NULL, sizeof(VM_interval));
+    dynamic_array_registry_type_append(&STRING("VM_fixup"), NULL, sizeof(VM_fixup));
+    dynamic_array_registry_type_append(&STRING("VM_stub"), NULL, sizeof(VM_stub));
+    dynamic_array_registry_type_append(&STRING("VM_move"), NULL, sizeof(VM_move));
+    dynamic_array_registry_type_append(&STRING("VM_pair_count"), NULL, sizeof(VM_pair_count));
+    dynamic_array_registry_type_append(&STRING("VM_stack_map"), NULL, sizeof(VM_stack_map));
+    dynamic_array_registry_type_append(&STRING("VM_line"), NULL, sizeof(VM_line));
+    dynamic_array_registry_type_append(&STRING("VM_program"), vm_program_deallocator, sizeof(VM_program));
+    dynamic_array_registry_type_append(&STRING("VM"), vm_deallocator, sizeof(VM));
+    vm_jit_module_init();
+    vm_profile_module_init();
     return 0;
 }
+
+static VM_string* vm_string_new(const char* chars, size_t len) {
+    VM_string* str = (VM_string*)malloc(sizeof(VM_string) + len + 1);
+    if (str == NULL) {
+        printf("Failed to allocate memory in vm_string_new\n");
+        exit(-1);
+    }
+    str->len = (uint32_t)len;
+    str->gc = VM_GC_STATIC;
+    memcpy(str->chars, chars, len);
+    str->chars[len] = '\0';
+    return str;
+}
+
+static unsigned int* vm_u32(DynamicArray* arr) {
+    return (unsigned int*)arr->buf;
+}
+
+// Makes the array len long (without ever making it empty) and sets every entry to value
+static void vm_fill(DynamicArray* arr, unsigned int len, unsigned int value) {
+    dynamic_array_resize(arr, len > 0 ? len : 1, true);
+    arr->len = len;
+    for (unsigned int i = 0; i < len; i++) {
+        vm_u32(arr)[i] = value;
+    }
+}
+
+static unsigned int vm_add_constant(VM_program* program, VM_value value) {
+    dynamic_array_append(&program->constants, &value);
+    return program->constants.len - 1;
+}
+
+static unsigned int vm_emit(VM_compiler* c, unsigned int op, unsigned int a, unsigned int b, unsigned int cc) {
+    instruction ins = {.full = 0};
+    ins.r.op = (uint8_t)op;
+    ins.r.a = (uint16_t)a;
+    ins.r.b = (uint16_t)b;
+    ins.r.c = (uint16_t)cc;
+    dynamic_array_append(&c->program->code, &ins);
+    return c->program->code.len - 1;
+}
+
+static unsigned int vm_emit_imm(VM_compiler* c, unsigned int op, unsigned int a, int32_t imm) {
+    instruction ins = {.full = 0};
+    ins.i.op = (uint8_t)op;
+    ins.i.a = (uint16_t)a;
+    ins.i.imm = imm;
+    dynamic_array_append(&c->program->code, &ins);
+    return c->program->code.len - 1;
+}
+
+static instruction* vm_code(VM_compiler* c, unsigned int index) {
+    return &((instruction*)c->program->code.buf)[index];
+}
+
+static bool vm_is_relative_jump(unsigned int op) {
+    return op >= VM_JUMP_IF_LT_INT && op <= VM_MOVE_JUMP;
+}
+
+static unsigned int vm_emit_relative(VM_compiler* c, unsigned int op, unsigned int a, unsigned int b) {
+    instruction ins = {.full = 0};
+    ins.j.op = (uint8_t)op;
+    ins.j.a = (uint16_t)a;
+    ins.j.b = (uint16_t)b;
+    dynamic_array_append(&c->program->code, &ins);
+    return c->program->code.len - 1;
+}
+
+// Points the jump at index to the instruction at target
+static void vm_set_target(VM_compiler* c, unsigned int index, unsigned int target) {
+    instruction* ins = vm_code(c, index);
+    if (vm_is_relative_jump(ins->op)) {
+        int32_t offset = (int32_t)target - (int32_t)(index + 1);
+        ins->j.offset_high = (int8_t)(offset >> 16);
+        ins->j.offset_low = (uint16_t)(offset & 0xffff);
+    } else {
+        ins->i.imm = (int32_t)target;
+    }
+}
+
+// Fills in the target of the jump at index once the block has its place in the code
+static void vm_add_fixup(VM_compiler* c, unsigned int index, unsigned int block) {
+    VM_fixup fixup = {.instr = index, .block = block};
+    dynamic_array_append(&c->fixups, &fixup);
+}
+
+// Emits a jump to the start of a block
+static void vm_emit_jump(VM_compiler* c, unsigned int op, unsigned int a, unsigned int block) {
+    vm_add_fixup(c, vm_emit_imm(c, op, a, 0), block);
+}
+
+static unsigned int vm_register(VM_compiler* c, unsigned int value) {
+    return vm_u32(&c->registers)[value];
+}
+
+static VM_interval* vm_interval(VM_compiler* c, unsigned int value) {
+    return &((VM_interval*)c->intervals.buf)[value];
+}
+
+static void vm_extend(VM_compiler* c, unsigned int value, unsigned int position) {
+    VM_interval* interval = vm_interval(c, value);
+    if (position < interval->start) {
+        interval->start = position;
+    }
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+// Marks the value as alive from the start of a block that isn't the one it is defined in
+static void vm_live_in(VM_compiler* c, unsigned int value, unsigned int block) {
+    if (vm_u32(&c->marks)[block] == value + 1) {
+        return;
+    }
+    vm_u32(&c->marks)[block] = value + 1;
+    vm_extend(c, value, vm_u32(&c->blockStarts)[block]);
+    dynamic_array_append(&c->worklist, &block);
+}
+
+// Marks the value as alive on every path from its definition to a use. The use is either in block (atEnd is false),
+// or at the end of block, which is where a phi reads its operand for the edge that leaves the block
+static void vm_mark_alive(VM_compiler* c, unsigned int value, unsigned int block, bool atEnd) {
+    IR_function* fn = c->fn;
+    unsigned int def = ir_instr(fn, value)->block;
+    c->worklist.len = 0;
+    if (atEnd) {
+        vm_extend(c, value, vm_u32(&c->blockEnds)[block]);
+    }
+    if (block != def) {
+        vm_live_in(c, value, block);
+    }
+    while (c->worklist.len > 0) {
+        unsigned int b = vm_u32(&c->worklist)[--c->worklist.len];
+        IR_block* blk = ir_block(fn, b);
+        for (unsigned int p = 0; p < blk->preds.len; p++) {
+            unsigned int pred = vm_u32(&blk->preds)[p];
+            vm_extend(c, value, vm_u32(&c->blockEnds)[pred]);
+            if (pred != def) {
+                vm_live_in(c, value, pred);
+            }
+        }
+    }
+}
+
+static bool vm_defines_value(IR_instr* instr) {
+    return instr->type != SEM_TYPE_NONE && instr->op != IR_PARAM && instr->op != IR_NOP;
+}
+
+static unsigned int vm_kind(VM_compiler* c, unsigned int value) {
+    return vm_u32(&c->kinds)[value];
+}
+
+static unsigned int vm_terminator(IR_function* fn, unsigned int block) {
+    IR_block* blk = ir_block(fn, block);
+    return vm_u32(&blk->instrs)[blk->instrs.len - 1];
+}
+
+static bool vm_is_comparison(unsigned int op) {
+    return op >= IR_LT && op <= IR_NE;
+}
+
+// Whether the value is an int constant that fits in 16 bits (after being negated, if negate is set)
+static bool vm_small_int(IR_function* fn, unsigned int value, bool negate) {
+    IR_instr* instr = ir_instr(fn, value);
+    if (instr->op != IR_CONST_INT) {
+        return false;
+    }
+    int64_t i = negate ? -(int64_t)instr->imm.i : instr->imm.i;
+    return i >= INT16_MIN && i <= INT16_MAX;
+}
+
+// Returns which operand of the instruction goes into the instruction itself as a 16 bit int, or IR_NONE if neither
+// does. This is the second one when it can be, since the first one can only be moved over to the other side of
+// additions and of comparisons (by turning them around)
+static unsigned int vm_immediate_operand(VM_compiler* c, unsigned int value) {
+    IR_function* fn = c->fn;
+    IR_instr* instr = ir_instr(fn, value);
+    bool add = instr->type == SEM_TYPE_INT && (instr->op == IR_ADD || instr->op == IR_SUB);
+    if (!add && !(vm_is_comparison(instr->op) && vm_kind(c, value) == VM_VALUE_FUSED)) {
+        return IR_NONE;
+    }
+    if (vm_small_int(fn, *ir_operand(fn, value, 1), instr->op == IR_SUB)) {
+        return 1;
+    } else if (instr->op != IR_SUB && vm_small_int(fn, *ir_operand(fn, value, 0), false)) {
+        return 0;
+    }
+    return IR_NONE;
+}
+
+// Picks the values that superinstructions take care of. A comparison of ints is fused with the branch right after it
+// when nothing else uses it, and an int constant that fits in 16 bits is put straight into the instructions that use
+// it when all of them can take it that way (the only ones that can are additions, subtractions, and fused comparisons)
+static void vm_select_superinstructions(VM_compiler* c) {
+    IR_function* fn = c->fn;
+    unsigned int count = fn->instrs.len;
+    vm_fill(&c->kinds, count, VM_VALUE_REGISTER);
+    vm_fill(&c->uses, count, 0);
+    vm_fill(&c->immediateUses, count, 0);
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* blk = ir_block(fn, vm_u32(&fn->rpo)[r]);
+        for (unsigned int i = 0; i < blk->instrs.len; i++) {
+            unsigned int value = vm_u32(&blk->instrs)[i];
+            for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+                vm_u32(&c->uses)[*ir_operand(fn, value, o)]++;
+            }
+        }
+    }
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* blk = ir_block(fn, vm_u32(&fn->rpo)[r]);
+        unsigned int terminator = vm_u32(&blk->instrs)[blk->instrs.len - 1];
+        if (ir_instr(fn, terminator)->op != IR_BRANCH || blk->instrs.len < 2) {
+            continue;
+        }
+        unsigned int cond = *ir_operand(fn, terminator, 0);
+        IR_instr* instr = ir_instr(fn, cond);
+        if (vm_u32(&blk->instrs)[blk->instrs.len - 2] == cond && vm_is_comparison(instr->op) && vm_u32(&c->uses)[cond] == 1 &&
+            ir_instr(fn, *ir_operand(fn, cond, 0))->type == SEM_TYPE_INT) {
+            vm_u32(&c->kinds)[cond] = VM_VALUE_FUSED;
+        }
+    }
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* blk = ir_block(fn, vm_u32(&fn->rpo)[r]);
+        for (unsigned int i = 0; i < blk->instrs.len; i++) {
+            unsigned int value = vm_u32(&blk->instrs)[i];
+            unsigned int operand = vm_immediate_operand(c, value);
+            if (operand != IR_NONE) {
+                vm_u32(&c->immediateUses)[*ir_operand(fn, value, operand)]++;
+            }
+        }
+    }
+    for (unsigned int v = 0; v < count; v++) {
+        if (ir_instr(fn, v)->op == IR_CONST_INT && vm_u32(&c->uses)[v] > 0 && vm_u32(&c->immediateUses)[v] == vm_u32(&c->uses)[v]) {
+            vm_u32(&c->kinds)[v] = VM_VALUE_IMMEDIATE;
+        }
+    }
+}
+
+// Works out how long every value has to be kept, then hands out registers with linear scan (from "Linear Scan Register
+// Allocation" by Poletto and Sarkar). Each value gets one interval that covers everywhere it is alive, which can also
+// cover places where it isn't, but it means two values only share a register when they really never overlap. There are
+// always enough registers, so nothing is ever spilled. Returns the number of registers used
+static unsigned int vm_allocate_registers(VM_compiler* c) {
+    IR_function* fn = c->fn;
+    unsigned int count = fn->instrs.len;
+    vm_fill(&c->registers, count, IR_NONE);
+    vm_fill(&c->blockStarts, fn->blocks.len, 0);
+    vm_fill(&c->blockEnds, fn->blocks.len, 0);
+    vm_fill(&c->marks, fn->blocks.len, 0);
+    dynamic_array_resize(&c->intervals, count > 0 ? count : 1, true);
+    c->intervals.len = count;
+    for (unsigned int v = 0; v < count; v++) {
+        *vm_interval(c, v) = (VM_interval){.start = IR_NONE, .end = 0, .value = v};
+    }
+
+    unsigned int position = 0;
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = vm_u32(&fn->rpo)[r];
+        IR_block* blk = ir_block(fn, block);
+        vm_u32(&c->blockStarts)[block] = position;
+        for (unsigned int i = 0; i < blk->instrs.len; i++) {
+            unsigned int value = vm_u32(&blk->instrs)[i];
+            *vm_interval(c, value) = (VM_interval){.start = position, .end = position, .value = value};
+            position++;
+        }
+        vm_u32(&c->blockEnds)[block] = position - 1;
+    }
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = vm_u32(&fn->rpo)[r];
+        IR_block* blk = ir_block(fn, block);
+        for (unsigned int i = 0; i < blk->instrs.len; i++) {
+            unsigned int value = vm_u32(&blk->instrs)[i];
+            IR_instr* instr = ir_instr(fn, value);
+            for (unsigned int o = 0; o < instr->operand_count; o++) {
+                unsigned int operand = *ir_operand(fn, value, o);
+                if (ir_instr(fn, operand)->op == IR_PARAM || vm_kind(c, operand) == VM_VALUE_IMMEDIATE) {
+                    continue;
+                }
+                if (instr->op == IR_PHI) {
+                    // The phi is written on every edge into its block, so it is alive at the end of every predecessor too
+                    unsigned int pred = vm_u32(&blk->preds)[o];
+                    vm_extend(c, value, vm_u32(&c->blockEnds)[pred]);
+                    vm_mark_alive(c, operand, pred, true);
+                } else {
+                    // A fused comparison is done by the branch, so what it compares has to last until then
+                    unsigned int use = vm_kind(c, value) == VM_VALUE_FUSED ? vm_u32(&c->blockEnds)[block] : vm_interval(c, value)->start;
+                    vm_extend(c, operand, use);
+                    vm_mark_alive(c, operand, block, false);
+                }
+            }
+        }
+    }
+
+    DynamicArray order;
+    dynamic_array_init(&order, &STRING("VM_interval"));
+    for (unsigned int v = 0; v < count; v++) {
+        if (vm_interval(c, v)->start != IR_NONE && vm_defines_value(ir_instr(fn, v)) && vm_kind(c, v) == VM_VALUE_REGISTER) {
+            dynamic_array_append(&order, vm_interval(c, v));
+        } else if (ir_instr(fn, v)->op == IR_PARAM) {
+            vm_u32(&c->registers)[v] = ir_instr(fn, v)->imm.index;
+        }
+    }
+    if (order.len > 0) {
+        dynamic_array_radix_sort(&order, offsetof(VM_interval, start), DA_TYPE_UNSIGNED_INT, NULL);
+    }
+
+    // The parameters keep the registers the caller put them in for the whole function, and the register after them is
+    // kept free for breaking cycles of phi moves
+    c->scratch = fn->param_count;
+    unsigned int next = fn->param_count + 1;
+    DynamicArray active;
+    dynamic_array_init(&active, &STRING("VM_interval"));
+    DynamicArray freeRegisters;
+    dynamic_array_init(&freeRegisters, &STRING("unsigned int"));
+    for (unsigned int i = 0; i < order.len; i++) {
+        VM_interval* interval = &((VM_interval*)order.buf)[i];
+        for (unsigned int a = 0; a < active.len;) {
+            VM_interval* old = &((VM_interval*)active.buf)[a];
+            if (old->end < interval->start) {
+                dynamic_array_append(&freeRegisters, &vm_u32(&c->registers)[old->value]);
+                *old = ((VM_interval*)active.buf)[--active.len];
+            } else {
+                a++;
+            }
+        }
+        unsigned int reg = freeRegisters.len > 0 ? vm_u32(&freeRegisters)[--freeRegisters.len] : next++;
+        vm_u32(&c->registers)[interval->value] = reg;
+        dynamic_array_append(&active, interval);
+    }
+    dynamic_array_free(&order);
+    dynamic_array_free(&active);
+    dynamic_array_free(&freeRegisters);
+    return next;
+}
+
+// Emits the moves in c->moves as if they all happen at once. A move is only done once nothing else still needs to read
+// the register it writes, and when every move that is left is waiting on another one (a cycle, like two phis swapping
+// their values), one of the registers is saved in the scratch register to break it
+static void vm_emit_moves(VM_compiler* c) {
+    VM_move* moves = (VM_move*)c->moves.buf;
+    unsigned int left = c->moves.len;
+    while (left > 0) {
+        bool progress = false;
+        for (unsigned int i = 0; i < left;) {
+            bool read = false;
+            for (unsigned int j = 0; j < left && !read; j++) {
+                read = j != i && moves[j].src == moves[i].dst;
+            }
+            if (read) {
+                i++;
+                continue;
+            }
+            vm_emit(c, VM_MOVE, moves[i].dst, moves[i].src, 0);
+            moves[i] = moves[--left];
+            progress = true;
+        }
+        if (!progress) {
+            unsigned int saved = moves[0].dst;
+            vm_emit(c, VM_MOVE, c->scratch, saved, 0);
+            for (unsigned int j = 0; j < left; j++) {
+                if (moves[j].src == saved) {
+                    moves[j].src = c->scratch;
+                }
+            }
+        }
+    }
+    c->moves.len = 0;
+}
+
+// Fills c->moves with the moves the phis of to need on the edge from from, and returns whether there are any
+static bool vm_edge_moves(VM_compiler* c, unsigned int from, unsigned int to) {
+    IR_function* fn = c->fn;
+    IR_block* blk = ir_block(fn, to);
+    c->moves.len = 0;
+    unsigned int pred = 0;
+    while (pred < blk->preds.len && vm_u32(&blk->preds)[pred] != from) {
+        pred++;
+    }
+    for (unsigned int i = 0; i < blk->instrs.len; i++) {
+        unsigned int value = vm_u32(&blk->instrs)[i];
+        if (ir_instr(fn, value)->op != IR_PHI) {
+            break;
+        }
+        VM_move move = {.dst = vm_register(c, value), .src = vm_register(c, *ir_operand(fn, value, pred))};
+        if (move.dst != move.src) {
+            dynamic_array_append(&c->moves, &move);
+        }
+    }
+    return c->moves.len > 0;
+}
+
+static unsigned long long* vm_map_live_in(VM_compiler* c, unsigned int block) {
+    unsigned int words = (c->stringValues.len + 63) / 64;
+    return (unsigned long long*)c->liveIn.buf + (size_t)block * words;
+}
+
+static void vm_map_set(VM_compiler* c, unsigned long long* live, unsigned int value) {
+    unsigned int index = vm_u32(&c->stringIndices)[value];
+    if (index != IR_NONE) {
+        live[index / 64] |= 1ull << (index % 64);
+    }
+}
+
+static void vm_map_clear(VM_compiler* c, unsigned long long* live, unsigned int value) {
+    unsigned int index = vm_u32(&c->stringIndices)[value];
+    if (index != IR_NONE) {
+        live[index / 64] &= ~(1ull << (index % 64));
+    }
+}
+
+// Finds the strings that are alive at the end of the block: the ones alive at the start of the blocks after it, and the
+// ones that the phis there get from this block
+static void vm_map_live_out(VM_compiler* c, unsigned int block, unsigned long long* live) {
+    IR_function* fn = c->fn;
+    unsigned int words = (c->stringValues.len + 63) / 64;
+    memset(live, 0, words * sizeof(unsigned long long));
+    IR_block* blk = ir_block(fn, block);
+    for (unsigned int s = 0; s < 2; s++) {
+        if (blk->succs[s] == IR_NONE) {
+            continue;
+        }
+        unsigned long long* in = vm_map_live_in(c, blk->succs[s]);
+        for (unsigned int w = 0; w < words; w++) {
+            live[w] |= in[w];
+        }
+        IR_block* succ = ir_block(fn, blk->succs[s]);
+        for (unsigned int i = 0; i < succ->instrs.len && ir_instr(fn, vm_u32(&succ->instrs)[i])->op == IR_PHI; i++) {
+            for (unsigned int o = 0; o < succ->preds.len; o++) {
+                if (vm_u32(&succ->preds)[o] == block) {
+                    vm_map_set(c, live, *ir_operand(fn, vm_u32(&succ->instrs)[i], o));
+                }
+            }
+        }
+    }
+}
+
+// Goes back over one instruction: what it makes isn't alive before it, and what it uses is
+static void vm_map_step(VM_compiler* c, unsigned long long* live, unsigned int value) {
+    IR_function* fn = c->fn;
+    vm_map_clear(c, live, value);
+    if (ir_instr(fn, value)->op == IR_PHI) {
+        return;
+    }
+    for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+        vm_map_set(c, live, *ir_operand(fn, value, o));
+    }
+}
+
+// Finds the strings that are alive during every call and concatenation, which are the roots the collector gets from
+// their frames (see VM_stack_map). Their registers are added to the program right away, and the maps themselves once
+// the instructions have their place in the code. The intervals of the register allocator can't be used for this, since
+// they can cover places where the value isn't in its register yet, so this is a liveness analysis of its own, over just
+// the string values
+static void vm_find_stack_maps(VM_compiler* c) {
+    IR_function* fn = c->fn;
+    unsigned int count = fn->instrs.len;
+    vm_fill(&c->stringIndices, count, IR_NONE);
+    vm_fill(&c->mapStarts, count, IR_NONE);
+    vm_fill(&c->mapCounts, count, 0);
+    c->stringValues.len = 0;
+    for (unsigned int v = 0; v < count; v++) {
+        if (ir_instr(fn, v)->type == SEM_TYPE_STRING && vm_kind(c, v) == VM_VALUE_REGISTER && vm_u32(&c->registers)[v] != IR_NONE) {
+            vm_u32(&c->stringIndices)[v] = c->stringValues.len;
+            dynamic_array_append(&c->stringValues, &v);
+        }
+    }
+    if (c->stringValues.len == 0) {
+        return;
+    }
+
+    unsigned int words = (c->stringValues.len + 63) / 64;
+    dynamic_array_resize(&c->liveIn, fn->blocks.len * words, true);
+    memset(c->liveIn.buf, 0, (size_t)fn->blocks.len * words * sizeof(unsigned long long));
+    dynamic_array_resize(&c->live, words, true);
+    unsigned long long* live = (unsigned long long*)c->live.buf;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int r = fn->rpo.len; r-- > 0;) {
+            unsigned int block = vm_u32(&fn->rpo)[r];
+            IR_block* blk = ir_block(fn, block);
+            vm_map_live_out(c, block, live);
+            for (unsigned int i = blk->instrs.len; i-- > 0;) {
+                vm_map_step(c, live, vm_u32(&blk->instrs)[i]);
+            }
+            if (memcmp(live, vm_map_live_in(c, block), words * sizeof(unsigned long long)) != 0) {
+                memcpy(vm_map_live_in(c, block), live, words * sizeof(unsigned long long));
+                changed = true;
+            }
+        }
+    }
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = vm_u32(&fn->rpo)[r];
+        IR_block* blk = ir_block(fn, block);
+        vm_map_live_out(c, block, live);
+        for (unsigned int i = blk->instrs.len; i-- > 0;) {
+            unsigned int value = vm_u32(&blk->instrs)[i];
+            vm_map_step(c, live, value);
+            unsigned int op = ir_instr(fn, value)->op;
+            if (op != IR_CALL && op != IR_CONCAT) {
+                continue;
+            }
+            // What is alive right before the instruction, which for a concatenation includes the two strings it joins
+            vm_u32(&c->mapStarts)[value] = c->program->stack_map_registers.len;
+            for (unsigned int s = 0; s < c->stringValues.len; s++) {
+                if (live[s / 64] & (1ull << (s % 64))) {
+                    dynamic_array_append(&c->program->stack_map_registers, &vm_u32(&c->registers)[vm_u32(&c->stringValues)[s]]);
+                    vm_u32(&c->mapCounts)[value]++;
+                }
+            }
+        }
+    }
+}
+
+// Finds the concatenations whose result can't outlive the call of the function it's made in, and gives each of them a
+// slot (see VM_CONCAT_LOCAL). Returns how many slots the function needs. A string escapes when it's returned, passed to a
+// call, stored in a global or goes into a phi, and so does every string that goes into one that escapes, since that one
+// can be a rope that points to it (or a copy of it). Comparisons are the only other thing strings are used for, and they
+// don't keep anything. Keeping phis out is also what makes it safe to use the same slot every time the concatenation
+// runs: the SSA value it made last time is then only used before it runs again, since every use of a value comes after
+// its definition on every path
+static unsigned int vm_find_slots(VM_compiler* c) {
+    IR_function* fn = c->fn;
+    unsigned int count = fn->instrs.len;
+    vm_fill(&c->slots, count, IR_NONE);
+    for (unsigned int v = 0; v < count; v++) {
+        IR_instr* instr = ir_instr(fn, v);
+        if (instr->block == IR_NONE || instr->op == IR_CONCAT || instr->op == IR_COPY || (instr->op >= IR_LT && instr->op <= IR_NE)) {
+            continue;
+        }
+        for (unsigned int o = 0; o < instr->operand_count; o++) {
+            ir_instr(fn, *ir_operand(fn, v, o))->flags |= IR_FLAG_MARK;
+        }
+    }
+    // The values that escape through others are found one step at a time, so this goes on until a pass finds no more
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int v = count; v-- > 0;) {
+            IR_instr* instr = ir_instr(fn, v);
+            if (instr->block == IR_NONE || (instr->op != IR_CONCAT && instr->op != IR_COPY) || !(instr->flags & IR_FLAG_MARK)) {
+                continue;
+            }
+            for (unsigned int o = 0; o < instr->operand_count; o++) {
+                IR_instr* operand = ir_instr(fn, *ir_operand(fn, v, o));
+                if (!(operand->flags & IR_FLAG_MARK)) {
+                    operand->flags |= IR_FLAG_MARK;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    unsigned int slots = 0;
+    for (unsigned int v = 0; v < count; v++) {
+        IR_instr* instr = ir_instr(fn, v);
+        if (instr->block != IR_NONE && instr->op == IR_CONCAT && !(instr->flags & IR_FLAG_MARK) && slots < VM_MAX_SLOTS) {
+            vm_u32(&c->slots)[v] = slots++;
+        }
+        instr->flags &= (uint16_t)~IR_FLAG_MARK;
+    }
+    return slots;
+}
+
+// Gives the instruction that was just made for a call or concatenation its stack map
+static void vm_add_stack_map(VM_compiler* c, unsigned int value) {
+    if (vm_u32(&c->mapCounts)[value] == 0) {
+        return;
+    }
+    VM_stack_map map = {.pc = c->program->code.len - 1, .start = vm_u32(&c->mapStarts)[value], .count = vm_u32(&c->mapCounts)[value]};
+    dynamic_array_append(&c->program->stack_maps, &map);
+}
+
+// Emits the jump for the branch at the end of block that is taken when its condition is when, and returns it so that
+// its target can be filled in. A fused comparison becomes part of the jump, turned around if the constant is on the left
+// and inverted if the jump is for when it is false (which is always exact for ints)
+static unsigned int vm_emit_condition(VM_compiler* c, unsigned int block, bool when) {
+    static const unsigned char mirrored[] = {IR_GT, IR_GE, IR_LT, IR_LE, IR_EQ, IR_NE};
+    static const unsigned char inverted[] = {IR_GE, IR_GT, IR_LE, IR_LT, IR_NE, IR_EQ};
+    IR_function* fn = c->fn;
+    unsigned int cond = *ir_operand(fn, vm_terminator(fn, block), 0);
+    if (vm_kind(c, cond) != VM_VALUE_FUSED) {
+        return vm_emit_imm(c, when ? VM_JUMP_IF : VM_JUMP_IF_NOT, vm_register(c, cond), 0);
+    }
+
+    unsigned int op = ir_instr(fn, cond)->op;
+    unsigned int left = *ir_operand(fn, cond, 0), right = *ir_operand(fn, cond, 1);
+    unsigned int immediate = vm_immediate_operand(c, cond);
+    if (immediate == 0) {
+        unsigned int swap = left;
+        left = right;
+        right = swap;
+        op = mirrored[op - IR_LT];
+    }
+    if (!when) {
+        op = inverted[op - IR_LT];
+    }
+    if (immediate != IR_NONE) {
+        return vm_emit_relative(c, VM_JUMP_IF_LT_INT_IMM + (op - IR_LT), vm_register(c, left), (uint16_t)(int16_t)ir_instr(fn, right)->imm.i);
+    }
+    return vm_emit_relative(c, VM_JUMP_IF_LT_INT + (op - IR_LT), vm_register(c, left), vm_register(c, right));
+}
+
+// Whether the block does nothing but branch: it only has phis, the branch, and maybe a comparison fused into it, and
+// neither way out of it needs moves. Jumping to a block like that is the same as doing its branch right away, which is
+// what the end of a loop body does instead of jumping back to the condition
+static bool vm_only_branches(VM_compiler* c, unsigned int block) {
+    IR_function* fn = c->fn;
+    IR_block* blk = ir_block(fn, block);
+    unsigned int terminator = vm_terminator(fn, block);
+    if (ir_instr(fn, terminator)->op != IR_BRANCH) {
+        return false;
+    }
+    unsigned int cond = *ir_operand(fn, terminator, 0);
+    for (unsigned int i = 0; i + 1 < blk->instrs.len; i++) {
+        unsigned int value = vm_u32(&blk->instrs)[i];
+        if (ir_instr(fn, value)->op != IR_PHI && !(value == cond && vm_kind(c, value) == VM_VALUE_FUSED)) {
+            return false;
+        }
+    }
+    return !vm_edge_moves(c, block, blk->succs[0]) && !vm_edge_moves(c, block, blk->succs[1]);
+}
+
+// Emits what it takes to go from the end of one block to the start of another: the moves for its phis, then a jump
+// unless the block comes right after this one anyway. The last move and the jump are fused together
+static void vm_emit_edge(VM_compiler* c, unsigned int from, unsigned int to, unsigned int next) {
+    bool moved = vm_edge_moves(c, from, to);
+    if (moved) {
+        vm_emit_moves(c);
+    }
+    if (to == next) {
+        return;
+    }
+
+    if (vm_only_branches(c, to)) {
+        IR_block* blk = ir_block(c->fn, to);
+        if (blk->succs[0] == next) {
+            vm_add_fixup(c, vm_emit_condition(c, to, false), blk->succs[1]);
+        } else {
+            vm_add_fixup(c, vm_emit_condition(c, to, true), blk->succs[0]);
+            if (blk->succs[1] != next) {
+                vm_emit_jump(c, VM_JUMP, 0, blk->succs[1]);
+            }
+        }
+    } else if (moved) {
+        instruction* move = vm_code(c, c->program->code.len - 1);
+        instruction fused = {.full = 0};
+        fused.j.op = VM_MOVE_JUMP;
+        fused.j.a = move->r.a;
+        fused.j.b = move->r.b;
+        *move = fused;
+        vm_add_fixup(c, c->program->code.len - 1, to);
+    } else {
+        vm_emit_jump(c, VM_JUMP, 0, to);
+    }
+}
+
+// A branch has two edges, but only one of them can fall through to code right after it. When the edge that has to be
+// jumped to has phi moves, the jump goes to a stub after the function that does the moves and then jumps to the block
+static void vm_compile_branch(VM_compiler* c, unsigned int block, unsigned int next) {
+    IR_block* blk = ir_block(c->fn, block);
+    unsigned int taken = blk->succs[0], notTaken = blk->succs[1];
+    bool takenMoves = vm_edge_moves(c, block, taken);
+    bool notTakenMoves = vm_edge_moves(c, block, notTaken);
+    if (!notTakenMoves && (taken == next || takenMoves)) {
+        vm_add_fixup(c, vm_emit_condition(c, block, false), notTaken);
+        vm_emit_edge(c, block, taken, next);
+    } else if (!takenMoves) {
+        vm_add_fixup(c, vm_emit_condition(c, block, true), taken);
+        vm_emit_edge(c, block, notTaken, next);
+    } else {
+        VM_stub stub = {.instr = vm_emit_condition(c, block, true), .from = block, .to = taken};
+        dynamic_array_append(&c->stubs, &stub);
+        vm_emit_edge(c, block, notTaken, next);
+    }
+}
+
+static unsigned int vm_string_constant(VM_compiler* c, unsigned int symbol) {
+    unsigned int* constant = &vm_u32(&c->stringConstants)[symbol];
+    if (*constant == IR_NONE) {
+        string* str = interner_get(c->module->symbols, symbol);
+        VM_value value = str->len <= VM_SHORT_MAX ? vm_short_value(str->str, (uint32_t)str->len) : vm_string_value(vm_string_new(str->str, str->len));
+        *constant = vm_add_constant(c->program, value);
+    }
+    return *constant;
+}
+
+// The op for an IR op on values of the given type
+static unsigned int vm_typed_op(unsigned int op, unsigned int type) {
+    static const unsigned char ints[IR_OP_COUNT] = {
+        [IR_ADD] = VM_ADD_INT, [IR_SUB] = VM_SUB_INT, [IR_MUL] = VM_MUL_INT, [IR_DIV] = VM_DIV_INT, [IR_NEG] = VM_NEG_INT,
+        [IR_LT] = VM_LT_INT,   [IR_LE] = VM_LE_INT,   [IR_GT] = VM_GT_INT,   [IR_GE] = VM_GE_INT,   [IR_EQ] = VM_EQ_INT,
+        [IR_NE] = VM_NE_INT,
+    };
+    static const unsigned char floats[IR_OP_COUNT] = {
+        [IR_ADD] = VM_ADD_FLOAT, [IR_SUB] = VM_SUB_FLOAT, [IR_MUL] = VM_MUL_FLOAT, [IR_DIV] = VM_DIV_FLOAT,
+        [IR_NEG] = VM_NEG_FLOAT, [IR_LT] = VM_LT_FLOAT,   [IR_LE] = VM_LE_FLOAT,   [IR_GT] = VM_GT_FLOAT,
+        [IR_GE] = VM_GE_FLOAT,   [IR_EQ] = VM_EQ_FLOAT,   [IR_NE] = VM_NE_FLOAT,
+    };
+    if (type == SEM_TYPE_STRING) {
+        return op == IR_EQ ? VM_EQ_STRING : VM_NE_STRING;
+    }
+    return type == SEM_TYPE_FLOAT ? floats[op] : ints[op];
+}
+
+// Starts a new entry in the line table if the instructions about to be emitted come from a different statement than the
+// ones before them
+static void vm_add_line(VM_program* program, uint32_t offset) {
+    VM_line* last = program->lines.len > 0 ? &((VM_line*)program->lines.buf)[program->lines.len - 1] : NULL;
+    if (last != NULL && last->offset == offset) {
+        return;
+    }
+    if (last != NULL && last->pc == program->code.len) {
+        last->offset = offset;
+        return;
+    }
+    VM_line line = {.pc = program->code.len, .offset = offset};
+    dynamic_array_append(&program->lines, &line);
+}
+
+static void vm_compile_instr(VM_compiler* c, unsigned int block, unsigned int value, unsigned int next) {
+    IR_function* fn = c->fn;
+    IR_instr* instr = ir_instr(fn, value);
+    // Constants and the like that the optimizations made up just go along with the statement before them
+    if (instr->offset != IR_NONE) {
+        vm_add_line(c->program, instr->offset);
+    }
+    unsigned int dst = vm_defines_value(instr) ? vm_register(c, value) : 0;
+    unsigned int a = instr->operand_count > 0 ? vm_register(c, *ir_operand(fn, value, 0)) : 0;
+    unsigned int b = instr->operand_count > 1 ? vm_register(c, *ir_operand(fn, value, 1)) : 0;
+    switch (instr->op) {
+        case IR_NOP:
+        case IR_PARAM:
+        case IR_PHI:
+            break;
+        case IR_CONST_INT:
+            if (vm_kind(c, value) == VM_VALUE_REGISTER) {
+                vm_emit_imm(c, VM_LOAD_INT, dst, instr->imm.i);
+            }
+            break;
+        case IR_CONST_FLOAT: {
+            VM_value constant = vm_float_value(((double*)fn->floats.buf)[instr->imm.index]);
+            vm_emit_imm(c, VM_LOAD_CONST, dst, (int32_t)vm_add_constant(c->program, constant));
+            break;
+        }
+        case IR_CONST_STRING:
+            vm_emit_imm(c, VM_LOAD_CONST, dst, (int32_t)vm_string_constant(c, instr->imm.index));
+            break;
+        case IR_COPY:
+            if (dst != a) {
+                vm_emit(c, VM_MOVE, dst, a, 0);
+            }
+            break;
+        case IR_ADD:
+        case IR_SUB: {
+            unsigned int immediate = vm_immediate_operand(c, value);
+            if (immediate != IR_NONE) {
+                int32_t i = ir_instr(fn, *ir_operand(fn, value, immediate))->imm.i;
+                vm_emit(c, VM_ADD_INT_IMM, dst, immediate == 0 ? b : a, (uint16_t)(int16_t)(instr->op == IR_SUB ? -i : i));
+            } else {
+                vm_emit(c, vm_typed_op(instr->op, instr->type), dst, a, b);
+            }
+            break;
+        }
+        case IR_MUL:
+        case IR_DIV:
+            vm_emit(c, vm_typed_op(instr->op, instr->type), dst, a, b);
+            break;
+        case IR_NEG:
+            vm_emit(c, vm_typed_op(instr->op, instr->type), dst, a, 0);
+            break;
+        case IR_CONCAT:
+            if (vm_u32(&c->slots)[value] != IR_NONE) {
+                vm_emit(c, VM_CONCAT_LOCAL, dst, a, b);
+                vm_code(c, c->program->code.len - 1)->r.slot = (uint8_t)vm_u32(&c->slots)[value];
+            } else {
+                vm_emit(c, VM_CONCAT, dst, a, b);
+            }
+            vm_add_stack_map(c, value);
+            break;
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_EQ:
+        case IR_NE:
+            // Fused comparisons are done by the branch that uses them (see vm_emit_condition)
+            if (vm_kind(c, value) == VM_VALUE_REGISTER) {
+                vm_emit(c, vm_typed_op(instr->op, ir_instr(fn, *ir_operand(fn, value, 0))->type), dst, a, b);
+            }
+            break;
+        case IR_INT_TO_FLOAT:
+            vm_emit(c, VM_INT_TO_FLOAT, dst, a, 0);
+            break;
+        case IR_FLOAT_TO_INT:
+            vm_emit(c, VM_FLOAT_TO_INT, dst, a, 0);
+            break;
+        case IR_LOAD_GLOBAL:
+            vm_emit_imm(c, VM_LOAD_GLOBAL, dst, (int32_t)instr->imm.index);
+            break;
+        case IR_STORE_GLOBAL:
+            vm_emit_imm(c, VM_STORE_GLOBAL, a, (int32_t)instr->imm.index);
+            break;
+        case IR_CALL:
+            // The arguments only ever go into registers no value uses, so they can't overwrite each other
+            for (unsigned int i = 0; i < instr->operand_count; i++) {
+                vm_emit(c, VM_MOVE, c->function->registers + i, vm_register(c, *ir_operand(fn, value, i)), 0);
+            }
+            vm_emit_imm(c, VM_CALL, dst, (int32_t)instr->imm.index);
+            vm_add_stack_map(c, value);
+            break;
+        case IR_JUMP:
+            vm_emit_edge(c, block, ir_block(fn, block)->succs[0], next);
+            break;
+        case IR_BRANCH:
+            vm_compile_branch(c, block, next);
+            break;
+        case IR_RETURN:
+            if (instr->operand_count > 0) {
+                vm_emit(c, VM_RETURN, a, 0, 0);
+            } else {
+                vm_emit(c, VM_RETURN_NONE, 0, 0, 0);
+            }
+            break;
+    }
+}
+
+static int vm_compile_function(VM_compiler* c, unsigned int index) {
+    IR_function* fn = ir_function(c->module, index);
+    VM_function* function = &((VM_function*)c->program->functions.buf)[index];
+    c->fn = fn;
+    c->function = function;
+    ir_compute_dominators(fn);
+
+    vm_select_superinstructions(c);
+    unsigned int registers = vm_allocate_registers(c);
+    vm_find_stack_maps(c);
+    unsigned int slots = vm_find_slots(c);
+    unsigned int mostArgs = 0;
+    for (unsigned int v = 0; v < fn->instrs.len; v++) {
+        IR_instr* instr = ir_instr(fn, v);
+        if (instr->op == IR_CALL && instr->block != IR_NONE && instr->operand_count > mostArgs) {
+            mostArgs = instr->operand_count;
+        }
+    }
+    *function = (VM_function){.symbol = fn->symbol,
+                              .entry = c->program->code.len,
+                              .param_count = fn->param_count,
+                              .return_type = fn->return_type,
+                              .registers = registers,
+                              .frame_size = registers + mostArgs,
+                              .slots = slots};
+    if (function->frame_size > VM_MAX_REGISTERS) {
+        printf("The function %s needs %u registers, but the VM only has %u\n", interner_get(c->module->symbols, fn->symbol)->str,
+               function->frame_size, VM_MAX_REGISTERS);
+        return -1;
+    }
+
+    vm_add_line(c->program, IR_NONE);
+    vm_fill(&c->offsets, fn->blocks.len, IR_NONE);
+    c->fixups.len = 0;
+    c->stubs.len = 0;
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = vm_u32(&fn->rpo)[r];
+        unsigned int next = r + 1 < fn->rpo.len ? vm_u32(&fn->rpo)[r + 1] : IR_NONE;
+        IR_block* blk = ir_block(fn, block);
+        vm_u32(&c->offsets)[block] = c->program->code.len;
+        for (unsigned int i = 0; i < blk->instrs.len; i++) {
+            vm_compile_instr(c, block, vm_u32(&blk->instrs)[i], next);
+        }
+    }
+
+    for (unsigned int i = 0; i < c->stubs.len; i++) {
+        VM_stub stub = ((VM_stub*)c->stubs.buf)[i];
+        vm_set_target(c, stub.instr, c->program->code.len);
+        vm_emit_edge(c, stub.from, stub.to, IR_NONE);
+    }
+    if (c->program->code.len - function->entry > VM_MAX_JUMP) {
+        printf("The function %s has %u instructions, but jumps in the VM can only go %u instructions\n",
+               interner_get(c->module->symbols, fn->symbol)->str, c->program->code.len - function->entry, VM_MAX_JUMP);
+        return -1;
+    }
+    for (unsigned int i = 0; i < c->fixups.len; i++) {
+        VM_fixup* fixup = &((VM_fixup*)c->fixups.buf)[i];
+        vm_set_target(c, fixup->instr, vm_u32(&c->offsets)[fixup->block]);
+    }
+    return 0;
+}
+
+static void vm_program_init(VM_program* program, IR_module* module) {
+    dynamic_array_init(&program->code, &STRING("instruction"));
+    dynamic_array_init(&program->functions, &STRING("VM_function"));
+    dynamic_array_init(&program->constants, &STRING("VM_value"));
+    dynamic_array_init(&program->global_types, &STRING("unsigned int"));
+    dynamic_array_init(&program->stack_maps, &STRING("VM_stack_map"));
+    dynamic_array_init(&program->stack_map_registers, &STRING("unsigned int"));
+    dynamic_array_init(&program->lines, &STRING("VM_line"));
+    program->script = module->script;
+    program->global_count = module->global_count;
+    program->symbols = module->symbols;
+    program->file = (MappedFile){.data = NULL, .size = 0, .__mapped = false};
+    for (unsigned int i = 0; i < module->global_types.len; i++) {
+        dynamic_array_append(&program->global_types, &vm_u32(&module->global_types)[i]);
+    }
+}
+
+int vm_compile(VM_program* program, IR_module* module) {
+    vm_program_init(program, module);
+    VM_compiler c = {.program = program, .module = module};
+    dynamic_array_init(&c.registers, &STRING("unsigned int"));
+    dynamic_array_init(&c.intervals, &STRING("VM_interval"));
+    dynamic_array_init(&c.blockStarts, &STRING("unsigned int"));
+    dynamic_array_init(&c.blockEnds, &STRING("unsigned int"));
+    dynamic_array_init(&c.marks, &STRING("unsigned int"));
+    dynamic_array_init(&c.worklist, &STRING("unsigned int"));
+    dynamic_array_init(&c.offsets, &STRING("unsigned int"));
+    dynamic_array_init(&c.fixups, &STRING("VM_fixup"));
+    dynamic_array_init(&c.stubs, &STRING("VM_stub"));
+    dynamic_array_init(&c.moves, &STRING("VM_move"));
+    dynamic_array_init(&c.stringConstants, &STRING("unsigned int"));
+    dynamic_array_init(&c.kinds, &STRING("unsigned int"));
+    dynamic_array_init(&c.uses, &STRING("unsigned int"));
+    dynamic_array_init(&c.immediateUses, &STRING("unsigned int"));
+    dynamic_array_init(&c.stringValues, &STRING("unsigned int"));
+    dynamic_array_init(&c.stringIndices, &STRING("unsigned int"));
+    dynamic_array_init(&c.mapStarts, &STRING("unsigned int"));
+    dynamic_array_init(&c.mapCounts, &STRING("unsigned int"));
+    dynamic_array_init(&c.liveIn, &STRING("unsigned long long"));
+    dynamic_array_init(&c.live, &STRING("unsigned long long"));
+    dynamic_array_init(&c.slots, &STRING("unsigned int"));
+    vm_fill(&c.stringConstants, module->symbols->names.len, IR_NONE);
+
+    // Every function gets its spot first, since a call only needs the index of the function it calls
+    dynamic_array_resize(&program->functions, module->functions.len, true);
+    int result = 0;
+    for (unsigned int i = 0; i < module->functions.len && result == 0; i++) {
+        result = vm_compile_function(&c, i);
+    }
+
+    dynamic_array_free(&c.registers);
+    dynamic_array_free(&c.intervals);
+    dynamic_array_free(&c.blockStarts);
+    dynamic_array_free(&c.blockEnds);
+    dynamic_array_free(&c.marks);
+    dynamic_array_free(&c.worklist);
+    dynamic_array_free(&c.offsets);
+    dynamic_array_free(&c.fixups);
+    dynamic_array_free(&c.stubs);
+    dynamic_array_free(&c.moves);
+    dynamic_array_free(&c.stringConstants);
+    dynamic_array_free(&c.kinds);
+    dynamic_array_free(&c.uses);
+    dynamic_array_free(&c.immediateUses);
+    dynamic_array_free(&c.stringValues);
+    dynamic_array_free(&c.stringIndices);
+    dynamic_array_free(&c.mapStarts);
+    dynamic_array_free(&c.mapCounts);
+    dynamic_array_free(&c.liveIn);
+    dynamic_array_free(&c.live);
+    dynamic_array_free(&c.slots);
+    return result;
+}
+
+int vm_program_free(VM_program* program) {
+    if (program->file.data != NULL) {
+        // Everything but the constants and the names is in the file, including the strings
+        dynamic_array_free(&program->constants);
+        interner_free(program->symbols);
+        free(program->symbols);
+        mapped_file_close(&program->file);
+        return 0;
+    }
+    for (unsigned int i = 0; i < program->constants.len; i++) {
+        if (vm_is_string(((VM_value*)program->constants.buf)[i])) {
+            free(vm_string(((VM_value*)program->constants.buf)[i]));
+        }
+    }
+    dynamic_array_free(&program->code);
+    dynamic_array_free(&program->functions);
+    dynamic_array_free(&program->constants);
+    dynamic_array_free(&program->global_types);
+    dynamic_array_free(&program->stack_maps);
+    dynamic_array_free(&program->stack_map_registers);
+    dynamic_array_free(&program->lines);
+    return 0;
+}
+
+const char* vm_op_name(unsigned int op) {
+    return op < VM_OP_COUNT ? VM_OP_NAMES[op] : "unknown";
+}
+
+unsigned int vm_find_function(VM_program* program, const char* name) {
+    unsigned int symbol = interner_find(program->symbols, &(string){.str = (char*)name, .len = strlen(name), .__memsize = 0});
+    for (unsigned int i = 0; i < program->functions.len && symbol != UINT32_MAX; i++) {
+        if (((VM_function*)program->functions.buf)[i].symbol == symbol) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+uint32_t vm_find_offset(VM_program* program, uint32_t pc) {
+    VM_line* lines = (VM_line*)program->lines.buf;
+    unsigned int low = 0, high = program->lines.len;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (lines[middle].pc <= pc) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low > 0 ? lines[low - 1].offset : IR_NONE;
+}
+
+void vm_string_write(VM_value value, char* out, DynamicArray* stack) {
+    // The characters are written from the end back, so that the left half of a rope is the one that waits on the stack.
+    // Strings are mostly built up by adding to the end, which makes them ropes whose left halves are ropes, so this
+    // way the stack hardly grows at all
+    uint32_t end = vm_string_length(value);
+    unsigned int bottom = stack->len;
+    dynamic_array_append(stack, &value);
+    while (stack->len > bottom) {
+        VM_value piece = ((VM_value*)stack->buf)[--stack->len];
+        if (vm_is_short(piece)) {
+            end -= vm_short_length(piece);
+            for (uint32_t i = 0; i < vm_short_length(piece); i++) {
+                out[end + i] = vm_short_char(piece, i);
+            }
+            continue;
+        }
+        VM_string* str = vm_string(piece);
+        if (str->gc & VM_GC_ROPE) {
+            VM_rope* rope = (VM_rope*)str;
+            if (rope->right.bits != 0) {
+                dynamic_array_append(stack, &rope->left);
+                dynamic_array_append(stack, &rope->right);
+                continue;
+            }
+            str = vm_string(rope->left);
+        }
+        end -= str->len;
+        memcpy(out + end, str->chars, str->len);
+    }
+}
+
+void vm_print_value(VM_value value) {
+    if (vm_is_int(value)) {
+        printf("%d", vm_int(value));
+    } else if (vm_is_short(value) || vm_is_string(value)) {
+        uint32_t len = vm_string_length(value);
+        char* chars = (char*)malloc(len > 0 ? len : 1);
+        if (chars == NULL) {
+            printf("Failed to allocate memory in vm_print_value\n");
+            exit(-1);
+        }
+        DynamicArray stack;
+        dynamic_array_init(&stack, &STRING("VM_value"));
+        vm_string_write(value, chars, &stack);
+        fwrite(chars, 1, len, stdout);
+        dynamic_array_free(&stack);
+        free(chars);
+    } else {
+        printf("%g", value.f);
+    }
+}
+
+int vm_program_print(VM_program* program) {
+    const instruction* code = (const instruction*)program->code.buf;
+    for (unsigned int f = 0; f < program->functions.len; f++) {
+        VM_function* function = &((VM_function*)program->functions.buf)[f];
+        unsigned int end = f + 1 < program->functions.len ? ((VM_function*)program->functions.buf)[f + 1].entry : program->code.len;
+        printf("function %s, %u params, %u registers, %u slots\n", interner_get(program->symbols, function->symbol)->str,
+               function->param_count, function->frame_size, function->slots);
+        for (unsigned int pc = function->entry; pc < end; pc++) {
+            instruction ins = code[pc];
+            printf("  %5u  %-18s", pc, VM_OP_NAMES[ins.op]);
+            switch (ins.op) {
+                case VM_MOVE:
+                case VM_NEG_INT:
+                case VM_NEG_FLOAT:
+                case VM_INT_TO_FLOAT:
+                case VM_FLOAT_TO_INT:
+                    printf(" r%u, r%u", ins.r.a, ins.r.b);
+                    break;
+                case VM_LOAD_INT:
+                    printf(" r%u, %d", ins.i.a, ins.i.imm);
+                    break;
+                case VM_LOAD_CONST:
+                    printf(" r%u, ", ins.i.a);
+                    if (vm_is_string(((VM_value*)program->constants.buf)[ins.i.imm]) ||
+                        vm_is_short(((VM_value*)program->constants.buf)[ins.i.imm])) {
+                        printf("\"");
+                        vm_print_value(((VM_value*)program->constants.buf)[ins.i.imm]);
+                        printf("\"");
+                    } else {
+                        vm_print_value(((VM_value*)program->constants.buf)[ins.i.imm]);
+                    }
+                    break;
+                case VM_LOAD_GLOBAL:
+                case VM_STORE_GLOBAL:
+                    printf(" r%u, @%d", ins.i.a, ins.i.imm);
+                    break;
+                case VM_CALL:
+                    printf(" r%u, %s", ins.i.a,
+                           interner_get(program->symbols, ((VM_function*)program->functions.buf)[ins.i.imm].symbol)->str);
+                    break;
+                case VM_JUMP:
+                    printf(" %d", ins.i.imm);
+                    break;
+                case VM_JUMP_IF:
+                case VM_JUMP_IF_NOT:
+                    printf(" r%u, %d", ins.i.a, ins.i.imm);
+                    break;
+                case VM_RETURN:
+                    printf(" r%u", ins.r.a);
+                    break;
+                case VM_RETURN_NONE:
+                    break;
+                case VM_ADD_INT_IMM:
+                    printf(" r%u, r%u, %d", ins.r.a, ins.r.b, (int16_t)ins.r.c);
+                    break;
+                case VM_CONCAT_LOCAL:
+                    printf(" r%u, r%u, r%u, slot %u", ins.r.a, ins.r.b, ins.r.c, ins.r.slot);
+                    break;
+                case VM_JUMP_IF_LT_INT_IMM:
+                case VM_JUMP_IF_LE_INT_IMM:
+                case VM_JUMP_IF_GT_INT_IMM:
+                case VM_JUMP_IF_GE_INT_IMM:
+                case VM_JUMP_IF_EQ_INT_IMM:
+                case VM_JUMP_IF_NE_INT_IMM:
+                    printf(" r%u, %d, %d", ins.j.a, (int16_t)ins.j.b, (int32_t)pc + 1 + vm_jump_offset(ins));
+                    break;
+                case VM_JUMP_IF_LT_INT:
+                case VM_JUMP_IF_LE_INT:
+                case VM_JUMP_IF_GT_INT:
+                case VM_JUMP_IF_GE_INT:
+                case VM_JUMP_IF_EQ_INT:
+                case VM_JUMP_IF_NE_INT:
+                case VM_MOVE_JUMP:
+                    printf(" r%u, r%u, %d", ins.j.a, ins.j.b, (int32_t)pc + 1 + vm_jump_offset(ins));
+                    break;
+                default:
+                    printf(" r%u, r%u, r%u", ins.r.a, ins.r.b, ins.r.c);
+                    break;
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+// Globals are 0 until the top level of the file sets them, so a string global needs an empty string to start with. The
+// string constants that are short enough go in the intern table, so that nothing that is the same as one is ever made
+static void vm_init_globals(VM* vm) {
+    VM_program* program = vm->program;
+    for (unsigned int i = 0; i < program->constants.len; i++) {
+        VM_value constant = ((VM_value*)program->constants.buf)[i];
+        if (vm_is_string(constant) && vm_string(constant)->len <= VM_INTERN_MAX) {
+            VM_string* str = vm_string(constant);
+            uint32_t hash = vm_heap_hash(str->chars, str->len);
+            if (vm_heap_find_interned(&vm->heap, str->chars, str->len, hash) == NULL) {
+                vm_heap_intern(&vm->heap, str, hash);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < program->global_count; i++) {
+        unsigned int type = vm_u32(&program->global_types)[i];
+        if (type == SEM_TYPE_STRING) {
+            vm->globals[i] = vm_short_value("", 0);
+        } else if (type == SEM_TYPE_INT) {
+            vm->globals[i] = vm_int_value(0);
+        } else {
+            vm->globals[i] = (VM_value){.bits = 0};
+        }
+    }
+}
+
+int vm_init(VM* vm, VM_program* program) {
+    vm->program = program;
+    vm->stack = (VM_value*)malloc(VM_STACK_SIZE * sizeof(VM_value));
+    vm->frames = (VM_frame*)malloc(VM_MAX_FRAMES * sizeof(VM_frame));
+    vm->globals = (VM_value*)calloc(program->global_count > 0 ? program->global_count : 1, sizeof(VM_value));
+    if (vm->stack == NULL || vm->frames == NULL || vm->globals == NULL) {
+        printf("Failed to allocate memory in vm_init\n");
+        exit(-1);
+    }
+    vm_heap_init(&vm->heap);
+    vm->activation = NULL;
+    vm->error = NULL;
+    vm->error_function = UINT32_MAX;
+    vm->op_pairs = NULL;
+    vm->profile = NULL;
+    vm->natives = NULL;
+    vm->depth = 0;
+    vm->native_depth = 0;
+    vm_init_globals(vm);
+    return 0;
+}
+
+int vm_reset(VM* vm, VM_program* program) {
+    if (program != vm->program) {
+        // The machine code was made for the old program, and has the addresses of its globals built into it
+        bool jit = vm->natives != NULL;
+        vm_jit_free(vm);
+        free(vm->globals);
+        vm->program = program;
+        vm->globals = (VM_value*)malloc((program->global_count > 0 ? program->global_count : 1) * sizeof(VM_value));
+        if (vm->globals == NULL) {
+            printf("Failed to allocate memory in vm_reset\n");
+            exit(-1);
+        }
+        if (jit) {
+            vm_jit_enable(vm);
+        }
+    }
+    vm_heap_reset(&vm->heap);
+    vm->activation = NULL;
+    vm->error = NULL;
+    vm->error_function = UINT32_MAX;
+    vm->depth = 0;
+    vm->native_depth = 0;
+    vm_init_globals(vm);
+    return 0;
+}
+
+int vm_free(VM* vm) {
+    vm_jit_free(vm);
+    vm_profile_free(vm);
+    free(vm->op_pairs);
+    free(vm->stack);
+    free(vm->frames);
+    free(vm->globals);
+    vm_heap_free(&vm->heap);
+    return 0;
+}
+
+int vm_count_op_pairs(VM* vm) {
+    vm->op_pairs = (uint64_t*)calloc(VM_OP_COUNT * VM_OP_COUNT, sizeof(uint64_t));
+    if (vm->op_pairs == NULL) {
+        printf("Failed to allocate memory in vm_count_op_pairs\n");
+        exit(-1);
+    }
+    return 0;
+}
+
+static unsigned int vm_op_by_name(const char* name) {
+    for (unsigned int op = 0; op < VM_OP_COUNT; op++) {
+        if (strcmp(VM_OP_NAMES[op], name) == 0) {
+            return op;
+        }
+    }
+    return VM_OP_COUNT;
+}
+
+int vm_op_pairs_merge(uint64_t* pairs, string* path) {
+    // The file has one line for every pair, with the count followed by the names of the two ops. Going by names means
+    // counts from before ops were added or reordered still end up in the right place, and pairs of ops that no longer
+    // exist are dropped
+    MappedFile file;
+    if (mapped_file_open(&file, path) == 0) {
+        string text;
+        string_init(&text);
+        string_resize(&text, file.size);
+        memcpy(text.str, file.data, file.size);
+        mapped_file_close(&file);
+
+        char* line = text.str;
+        while (line < text.str + text.len) {
+            char* end = strchr(line, '\n');
+            if (end != NULL) {
+                *end = '\0';
+            }
+            unsigned long long count;
+            char first[32], second[32];
+            if (sscanf(line, "%llu %31s %31s", &count, first, second) == 3) {
+                unsigned int a = vm_op_by_name(first), b = vm_op_by_name(second);
+                if (a != VM_OP_COUNT && b != VM_OP_COUNT) {
+                    pairs[a * VM_OP_COUNT + b] += count;
+                }
+            }
+            if (end == NULL) {
+                break;
+            }
+            line = end + 1;
+        }
+        string_free(&text);
+    }
+
+    DynamicArray out;
+    dynamic_array_init(&out, &STRING("char"));
+    char buffer[96];
+    for (unsigned int i = 0; i < VM_OP_COUNT * VM_OP_COUNT; i++) {
+        if (pairs[i] == 0) {
+            continue;
+        }
+        int len = snprintf(buffer, sizeof(buffer), "%llu %s %s\n", (unsigned long long)pairs[i], VM_OP_NAMES[i / VM_OP_COUNT],
+                           VM_OP_NAMES[i % VM_OP_COUNT]);
+        for (int c = 0; c < len; c++) {
+            dynamic_array_append(&out, &buffer[c]);
+        }
+    }
+    int result = file_write_atomic(path, out.buf, out.len);
+    dynamic_array_free(&out);
+    return result;
+}
+
+static int vm_compare_pair_counts(const void* a, const void* b) {
+    uint64_t x = ((const VM_pair_count*)a)->count, y = ((const VM_pair_count*)b)->count;
+    return x > y ? -1 : x < y;
+}
+
+int vm_op_pairs_print(uint64_t* pairs, unsigned int limit) {
+    DynamicArray sorted;
+    dynamic_array_init(&sorted, &STRING("VM_pair_count"));
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < VM_OP_COUNT * VM_OP_COUNT; i++) {
+        if (pairs[i] > 0) {
+            VM_pair_count count = {.count = pairs[i], .pair = i};
+            dynamic_array_append(&sorted, &count);
+            total += pairs[i];
+        }
+    }
+    if (sorted.len > 0) {
+        dynamic_array_sort(&sorted, vm_compare_pair_counts, NULL);
+    }
+
+    printf("op pairs: %llu in total\n", (unsigned long long)total);
+    for (unsigned int i = 0; i < sorted.len && i < limit; i++) {
+        VM_pair_count* count = &((VM_pair_count*)sorted.buf)[i];
+        printf("%6.2f%% %14llu  %s -> %s\n", 100.0 * count->count / total, (unsigned long long)count->count,
+               VM_OP_NAMES[count->pair / VM_OP_COUNT], VM_OP_NAMES[count->pair % VM_OP_COUNT]);
+    }
+    dynamic_array_free(&sorted);
+    return 0;
+}
+
+// Copies the characters of a string that isn't a rope to out
+static inline void vm_flat_copy(VM_value value, char* out) {
+    if (vm_is_short(value)) {
+        for (uint32_t i = 0; i < vm_short_length(value); i++) {
+            out[i] = vm_short_char(value, i);
+        }
+    } else {
+        memcpy(out, vm_string(value)->chars, vm_string(value)->len);
+    }
+}
+
+// Joins the strings in registers l and r of base into register a, making whichever kind of string fits the length of
+// the result (see VirtualMachineHeap.h). Making the new string can collect, which can move the two strings, so a rope
+// only reads them from the registers afterwards. slot is where VM_CONCAT_LOCAL keeps its result (or NULL), which any flat
+// string goes in, even one short enough for the intern table: filling the slot is cheaper than looking the string up,
+// and it doesn't stay around to be found anyway
+static int vm_concat(VM* vm, VM_value* base, unsigned int a, unsigned int l, unsigned int r, VM_string* slot) {
+    VM_heap* heap = &vm->heap;
+    uint32_t leftLen = vm_string_length(base[l]);
+    uint32_t rightLen = vm_string_length(base[r]);
+    uint64_t len = (uint64_t)leftLen + rightLen;
+    if (len > UINT32_MAX) {
+        vm->error = "a string got too long";
+        return -1;
+    }
+    heap->joins++;
+    if (leftLen == 0 || rightLen == 0) {
+        base[a] = leftLen == 0 ? base[r] : base[l];
+        return 0;
+    }
+    if (len <= VM_SHORT_MAX) {
+        // Both halves are short too, so their characters just have to be lined up next to each other
+        heap->short_joins++;
+        uint64_t mask = ((uint64_t)1 << (8 * VM_SHORT_MAX)) - 1;
+        base[a].bits = VM_TAG_SHORT | len << 40 | (base[l].bits & mask) | (base[r].bits & mask) << (8 * leftLen);
+        return 0;
+    }
+    if (len >= VM_ROPE_MIN) {
+        heap->rope_joins++;
+        VM_rope* rope = (VM_rope*)vm_heap_alloc_rope(vm, (uint32_t)len);
+        if (rope == NULL) {
+            return -1;
+        }
+        rope->left = base[l];
+        rope->right = base[r];
+        base[a] = vm_string_value((VM_string*)rope);
+        return 0;
+    }
+
+    // Neither half can be a rope when the result is shorter than any rope
+    char chars[VM_ROPE_MIN];
+    vm_flat_copy(base[l], chars);
+    vm_flat_copy(base[r], chars + leftLen);
+    uint32_t hash = 0;
+    if (len <= VM_INTERN_MAX && slot == NULL) {
+        hash = vm_heap_hash(chars, (uint32_t)len);
+        VM_string* interned = vm_heap_find_interned(heap, chars, (uint32_t)len, hash);
+        if (interned != NULL) {
+            heap->interned_joins++;
+            base[a] = vm_string_value(interned);
+            return 0;
+        }
+    }
+    VM_string* str = slot;
+    if (slot != NULL) {
+        heap->local_joins++;
+        str->gc = VM_GC_STATIC | VM_GC_LOCAL;
+    } else {
+        heap->flat_joins++;
+        if ((str = vm_heap_alloc_string(vm, (uint32_t)len)) == NULL) {
+            return -1;
+        }
+    }
+    str->len = (uint32_t)len;
+    memcpy(str->chars, chars, len);
+    str->chars[len] = '\0';
+    if (slot == NULL && len <= VM_INTERN_MAX) {
+        vm_heap_intern(heap, str, hash);
+    }
+    base[a] = vm_string_value(str);
+    return 0;
+}
+
+// Short strings and the ones in the intern table are only ever equal to themselves, so the characters are only compared
+// for longer strings and the ones in slots, which flattens them if they're ropes. Returns -1 if there wasn't room to
+// flatten one
+static int vm_string_equal(VM* vm, VM_value l, VM_value r, bool* equal) {
+    *equal = l.bits == r.bits;
+    if (*equal || vm_is_short(l) || vm_is_short(r) || vm_string(l)->len != vm_string(r)->len ||
+        (vm_string(l)->len <= VM_INTERN_MAX && ((vm_string(l)->gc | vm_string(r)->gc) & VM_GC_LOCAL) == 0)) {
+        return 0;
+    }
+    VM_string* left = vm_string(l);
+    VM_string* right = vm_string(r);
+    if ((left->gc & VM_GC_ROPE) && (left = vm_heap_flatten(vm, left)) == NULL) {
+        return -1;
+    }
+    if ((right->gc & VM_GC_ROPE) && (right = vm_heap_flatten(vm, right)) == NULL) {
+        return -1;
+    }
+    *equal = left == right || memcmp(left->chars, right->chars, left->len) == 0;
+    return 0;
+}
+
+// vm_int_value, with the tag from intTag in vm_resume. The math of the ops is done on unsigned ints so that overflow
+// wraps around
+#define VM_INT(expr) ((VM_value){.bits = intTag | (uint32_t)(expr)})
+
+#ifdef VM_THREADED_DISPATCH
+#define VM_CASE(op) vm_##op:
+#define VM_NEXT()               \
+    do {                        \
+        ins = *pc++;            \
+        goto* dispatch[ins.op]; \
+    } while (0)
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#endif
+
+// Goes to target. A jump back is the end of a loop, which is where the JIT gets a chance to take over
+#define VM_JUMP_TO(target)                         \
+    do {                                           \
+        const instruction* jumpTarget = (target);  \
+        if (jumpTarget < pc && jit) {              \
+            pc = jumpTarget;                       \
+            goto vm_enter;                         \
+        }                                          \
+        pc = jumpTarget;                           \
+    } while (0)
+
+// Takes the slots of a function that is being called off the top of the frame regions. Returns NULL if the function
+// doesn't have any, or if they don't fit, in which case its concatenations just use the heap
+static inline unsigned char* vm_take_slots(VM_heap* heap, const VM_function* fn) {
+    size_t size = fn->slots * VM_SLOT_SIZE;
+    if (size == 0 || VM_HEAP_REGION_SIZE - heap->region_used < size) {
+        return NULL;
+    }
+    unsigned char* slots = heap->region + heap->region_used;
+    heap->region_used += size;
+    return slots;
+}
+
+// Gives the slots back when the call that took them returns. Everything taken after them was taken by calls it made,
+// which have all returned by now
+static inline void vm_give_back_slots(VM_heap* heap, unsigned char* slots) {
+    if (slots != NULL) {
+        heap->region_used = (size_t)(slots - heap->region);
+    }
+}
+
+// Counts the op for the op pairs and the profiler, right before it runs. previous is the op that ran before it (or
+// VM_OP_COUNT if it is the first one), and pc is where it is
+static inline void vm_count_op(VM* vm, unsigned int previous, unsigned int op, uint32_t function, uint32_t pc, unsigned int depth) {
+    if (vm->op_pairs != NULL && previous != VM_OP_COUNT) {
+        vm->op_pairs[previous * VM_OP_COUNT + op]++;
+    }
+    if (vm->profile != NULL) {
+        vm_profile_op(vm->profile, previous, op, ((uint64_t)function << 32) | pc, vm->depth + depth);
+    }
+}
+
+int vm_call(VM* vm, unsigned int function, VM_value* args, VM_value* result) {
+    VM_function* fn = &((VM_function*)vm->program->functions.buf)[function];
+    for (unsigned int i = 0; i < fn->param_count; i++) {
+        vm->stack[i] = args[i];
+    }
+    vm->error = NULL;
+    vm->depth = 0;
+    vm->native_depth = 0;
+    // A program that was stopped never gave back the slots of the calls it was in
+    vm->heap.region_used = 0;
+    return vm_resume(vm, function, vm->stack, fn->entry, result);
+}
+
+int vm_resume(VM* vm, unsigned int function, VM_value* base, unsigned int start, VM_value* result) {
+#ifdef VM_THREADED_DISPATCH
+    static void* const labels[VM_OP_COUNT] = {
+        [VM_MOVE] = &&vm_VM_MOVE,
+        [VM_LOAD_INT] = &&vm_VM_LOAD_INT,
+        [VM_LOAD_CONST] = &&vm_VM_LOAD_CONST,
+        [VM_ADD_INT] = &&vm_VM_ADD_INT,
+        [VM_SUB_INT] = &&vm_VM_SUB_INT,
+        [VM_MUL_INT] = &&vm_VM_MUL_INT,
+        [VM_DIV_INT] = &&vm_VM_DIV_INT,
+        [VM_NEG_INT] = &&vm_VM_NEG_INT,
+        [VM_ADD_FLOAT] = &&vm_VM_ADD_FLOAT,
+        [VM_SUB_FLOAT] = &&vm_VM_SUB_FLOAT,
+        [VM_MUL_FLOAT] = &&vm_VM_MUL_FLOAT,
+        [VM_DIV_FLOAT] = &&vm_VM_DIV_FLOAT,
+        [VM_NEG_FLOAT] = &&vm_VM_NEG_FLOAT,
+        [VM_CONCAT] = &&vm_VM_CONCAT,
+        [VM_CONCAT_LOCAL] = &&vm_VM_CONCAT_LOCAL,
+        [VM_LT_INT] = &&vm_VM_LT_INT,
+        [VM_LE_INT] = &&vm_VM_LE_INT,
+        [VM_GT_INT] = &&vm_VM_GT_INT,
+        [VM_GE_INT] = &&vm_VM_GE_INT,
+        [VM_EQ_INT] = &&vm_VM_EQ_INT,
+        [VM_NE_INT] = &&vm_VM_NE_INT,
+        [VM_LT_FLOAT] = &&vm_VM_LT_FLOAT,
+        [VM_LE_FLOAT] = &&vm_VM_LE_FLOAT,
+        [VM_GT_FLOAT] = &&vm_VM_GT_FLOAT,
+        [VM_GE_FLOAT] = &&vm_VM_GE_FLOAT,
+        [VM_EQ_FLOAT] = &&vm_VM_EQ_FLOAT,
+        [VM_NE_FLOAT] = &&vm_VM_NE_FLOAT,
+        [VM_EQ_STRING] = &&vm_VM_EQ_STRING,
+        [VM_NE_STRING] = &&vm_VM_NE_STRING,
+        [VM_INT_TO_FLOAT] = &&vm_VM_INT_TO_FLOAT,
+        [VM_FLOAT_TO_INT] = &&vm_VM_FLOAT_TO_INT,
+        [VM_LOAD_GLOBAL] = &&vm_VM_LOAD_GLOBAL,
+        [VM_STORE_GLOBAL] = &&vm_VM_STORE_GLOBAL,
+        [VM_CALL] = &&vm_VM_CALL,
+        [VM_JUMP] = &&vm_VM_JUMP,
+        [VM_JUMP_IF] = &&vm_VM_JUMP_IF,
+        [VM_JUMP_IF_NOT] = &&vm_VM_JUMP_IF_NOT,
+        [VM_RETURN] = &&vm_VM_RETURN,
+        [VM_RETURN_NONE] = &&vm_VM_RETURN_NONE,
+        [VM_ADD_INT_IMM] = &&vm_VM_ADD_INT_IMM,
+        [VM_JUMP_IF_LT_INT] = &&vm_VM_JUMP_IF_LT_INT,
+        [VM_JUMP_IF_LE_INT] = &&vm_VM_JUMP_IF_LE_INT,
+        [VM_JUMP_IF_GT_INT] = &&vm_VM_JUMP_IF_GT_INT,
+        [VM_JUMP_IF_GE_INT] = &&vm_VM_JUMP_IF_GE_INT,
+        [VM_JUMP_IF_EQ_INT] = &&vm_VM_JUMP_IF_EQ_INT,
+        [VM_JUMP_IF_NE_INT] = &&vm_VM_JUMP_IF_NE_INT,
+        [VM_JUMP_IF_LT_INT_IMM] = &&vm_VM_JUMP_IF_LT_INT_IMM,
+        [VM_JUMP_IF_LE_INT_IMM] = &&vm_VM_JUMP_IF_LE_INT_IMM,
+        [VM_JUMP_IF_GT_INT_IMM] = &&vm_VM_JUMP_IF_GT_INT_IMM,
+        [VM_JUMP_IF_GE_INT_IMM] = &&vm_VM_JUMP_IF_GE_INT_IMM,
+        [VM_JUMP_IF_EQ_INT_IMM] = &&vm_VM_JUMP_IF_EQ_INT_IMM,
+        [VM_JUMP_IF_NE_INT_IMM] = &&vm_VM_JUMP_IF_NE_INT_IMM,
+        [VM_MOVE_JUMP] = &&vm_VM_MOVE_JUMP,
+    };
+    // While op pairs are being counted or the profiler is on, every op goes through vm_instrument on its way to its own label
+    static void* const instrumented[VM_OP_COUNT] = {[0 ... VM_OP_COUNT - 1] = &&vm_instrument};
+    void* const* dispatch = vm->op_pairs != NULL || vm->profile != NULL ? instrumented : labels;
+#endif
+
+    VM_program* program = vm->program;
+    const instruction* code = (const instruction*)program->code.buf;
+    VM_function* functions = (VM_function*)program->functions.buf;
+    const VM_value* constants = (const VM_value*)program->constants.buf;
+    VM_value* globals = vm->globals;
+    VM_value* stackEnd = vm->stack + VM_STACK_SIZE;
+    // The frames of the runs further down the C stack come first
+    VM_frame* frames = vm->frames + vm->depth;
+    unsigned int maxDepth = VM_MAX_FRAMES - vm->depth;
+    unsigned int depth = 0;
+
+    VM_function* fn = &functions[function];
+    const instruction* pc = code + start;
+    instruction ins;
+    VM_value returned;
+    unsigned int previous = VM_OP_COUNT;
+#ifndef VM_THREADED_DISPATCH
+    bool instrument = vm->op_pairs != NULL || vm->profile != NULL;
+#endif
+    bool jit = vm->natives != NULL;
+    // Left to itself the compiler makes the 64 bit tag again in every op that makes an int, which costs about a tenth
+    // of the time of int heavy loops, so this hides that it is a constant to keep it in a register the whole time
+    uint64_t intTag = VM_TAG_INT;
+#if defined(__GNUC__)
+    __asm__("" : "+r"(intTag));
+#endif
+    // Only kept up to date when something can collect
+    VM_activation activation = {.outer = vm->activation, .frames = frames, .slots = vm_take_slots(&vm->heap, fn)};
+    vm->activation = &activation;
+
+    goto vm_enter;
+#ifdef VM_THREADED_DISPATCH
+vm_instrument:
+    vm_count_op(vm, previous, ins.op, (uint32_t)(fn - functions), (uint32_t)(pc - code) - 1, depth);
+    previous = ins.op;
+    goto* labels[ins.op];
+#else
+    for (;;) {
+        ins = *pc++;
+        if (instrument) {
+            vm_count_op(vm, previous, ins.op, (uint32_t)(fn - functions), (uint32_t)(pc - code) - 1, depth);
+            previous = ins.op;
+        }
+        switch (ins.op) {
+#endif
+
+    VM_CASE(VM_MOVE) {
+        base[ins.r.a] = base[ins.r.b];
+        VM_NEXT();
+    }
+    VM_CASE(VM_LOAD_INT) {
+        base[ins.i.a] = VM_INT(ins.i.imm);
+        VM_NEXT();
+    }
+    VM_CASE(VM_LOAD_CONST) {
+        base[ins.i.a] = constants[ins.i.imm];
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_ADD_INT) {
+        base[ins.r.a] = VM_INT((uint32_t)vm_int(base[ins.r.b]) + (uint32_t)vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_SUB_INT) {
+        base[ins.r.a] = VM_INT((uint32_t)vm_int(base[ins.r.b]) - (uint32_t)vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_MUL_INT) {
+        base[ins.r.a] = VM_INT((uint32_t)vm_int(base[ins.r.b]) * (uint32_t)vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_DIV_INT) {
+        int32_t l = vm_int(base[ins.r.b]), r = vm_int(base[ins.r.c]);
+        if (r == 0) {
+            vm->error = "division by zero";
+            goto error;
+        }
+        // INT32_MIN / -1 doesn't fit, so it wraps around like the other ops instead of being undefined
+        base[ins.r.a] = r == -1 ? VM_INT(0u - (uint32_t)l) : VM_INT(l / r);
+        VM_NEXT();
+    }
+    VM_CASE(VM_NEG_INT) {
+        base[ins.r.a] = VM_INT(0u - (uint32_t)vm_int(base[ins.r.b]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_ADD_FLOAT) {
+        base[ins.r.a].f = base[ins.r.b].f + base[ins.r.c].f;
+        VM_NEXT();
+    }
+    VM_CASE(VM_SUB_FLOAT) {
+        base[ins.r.a].f = base[ins.r.b].f - base[ins.r.c].f;
+        VM_NEXT();
+    }
+    VM_CASE(VM_MUL_FLOAT) {
+        base[ins.r.a].f = base[ins.r.b].f * base[ins.r.c].f;
+        VM_NEXT();
+    }
+    VM_CASE(VM_DIV_FLOAT) {
+        base[ins.r.a].f = base[ins.r.b].f / base[ins.r.c].f;
+        VM_NEXT();
+    }
+    VM_CASE(VM_NEG_FLOAT) {
+        base[ins.r.a].f = -base[ins.r.b].f;
+        VM_NEXT();
+    }
+    VM_CASE(VM_CONCAT) {
+        activation.base = base;
+        activation.pc = pc;
+        activation.depth = depth;
+        if (vm_concat(vm, base, ins.r.a, ins.r.b, ins.r.c, NULL) != 0) {
+            goto error;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_CONCAT_LOCAL) {
+        activation.base = base;
+        activation.pc = pc;
+        activation.depth = depth;
+        if (vm_concat(vm, base, ins.r.a, ins.r.b, ins.r.c, activation.slots == NULL ? NULL : (VM_string*)(activation.slots + ins.r.slot * VM_SLOT_SIZE)) != 0) {
+            goto error;
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_LT_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) < vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_LE_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) <= vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_GT_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) > vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_GE_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) >= vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_EQ_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) == vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_NE_INT) {
+        base[ins.r.a] = VM_INT(vm_int(base[ins.r.b]) != vm_int(base[ins.r.c]));
+        VM_NEXT();
+    }
+    VM_CASE(VM_LT_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f < base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_LE_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f <= base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_GT_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f > base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_GE_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f >= base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_EQ_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f == base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_NE_FLOAT) {
+        base[ins.r.a] = VM_INT(base[ins.r.b].f != base[ins.r.c].f);
+        VM_NEXT();
+    }
+    VM_CASE(VM_EQ_STRING) {
+        bool equal;
+        if (vm_string_equal(vm, base[ins.r.b], base[ins.r.c], &equal) != 0) {
+            goto error;
+        }
+        base[ins.r.a] = VM_INT(equal);
+        VM_NEXT();
+    }
+    VM_CASE(VM_NE_STRING) {
+        bool equal;
+        if (vm_string_equal(vm, base[ins.r.b], base[ins.r.c], &equal) != 0) {
+            goto error;
+        }
+        base[ins.r.a] = VM_INT(!equal);
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_INT_TO_FLOAT) {
+        base[ins.r.a].f = (double)vm_int(base[ins.r.b]);
+        VM_NEXT();
+    }
+    VM_CASE(VM_FLOAT_TO_INT) {
+        double f = base[ins.r.b].f;
+        base[ins.r.a] = VM_INT(f != f ? 0 : f >= 2147483647.0 ? INT32_MAX : f <= -2147483648.0 ? INT32_MIN : (int32_t)f);
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_LOAD_GLOBAL) {
+        base[ins.i.a] = globals[ins.i.imm];
+        VM_NEXT();
+    }
+    VM_CASE(VM_STORE_GLOBAL) {
+        globals[ins.i.imm] = base[ins.i.a];
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_CALL) {
+        VM_function* callee = &functions[ins.i.imm];
+        VM_value* calleeBase = base + fn->registers;
+        if (depth == maxDepth || calleeBase + callee->frame_size > stackEnd) {
+            vm->error = "stack overflow";
+            goto error;
+        }
+        frames[depth++] = (VM_frame){.pc = pc, .base = base, .function = fn, .dst = ins.i.a, .slots = activation.slots};
+        fn = callee;
+        base = calleeBase;
+        activation.slots = vm_take_slots(&vm->heap, callee);
+        pc = code + callee->entry;
+        if (jit) {
+            goto vm_enter;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP) {
+        VM_JUMP_TO(code + ins.i.imm);
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF) {
+        if (vm_int(base[ins.i.a]) != 0) {
+            VM_JUMP_TO(code + ins.i.imm);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_NOT) {
+        if (vm_int(base[ins.i.a]) == 0) {
+            VM_JUMP_TO(code + ins.i.imm);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_RETURN) {
+        returned = base[ins.r.a];
+    vm_return:
+        vm_give_back_slots(&vm->heap, activation.slots);
+        if (depth == 0) {
+            if (result != NULL) {
+                *result = returned;
+            }
+            vm->activation = activation.outer;
+            return 0;
+        }
+        VM_frame* frame = &frames[--depth];
+        fn = frame->function;
+        base = frame->base;
+        pc = frame->pc;
+        activation.slots = frame->slots;
+        base[frame->dst] = returned;
+        VM_NEXT();
+    }
+    VM_CASE(VM_RETURN_NONE) {
+    vm_return_none:
+        vm_give_back_slots(&vm->heap, activation.slots);
+        if (depth == 0) {
+            vm->activation = activation.outer;
+            return 0;
+        }
+        VM_frame* frame = &frames[--depth];
+        fn = frame->function;
+        base = frame->base;
+        pc = frame->pc;
+        activation.slots = frame->slots;
+        VM_NEXT();
+    }
+
+    VM_CASE(VM_ADD_INT_IMM) {
+        base[ins.r.a] = VM_INT((uint32_t)vm_int(base[ins.r.b]) + (uint32_t)(int16_t)ins.r.c);
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_LT_INT) {
+        if (vm_int(base[ins.j.a]) < vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_LE_INT) {
+        if (vm_int(base[ins.j.a]) <= vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_GT_INT) {
+        if (vm_int(base[ins.j.a]) > vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_GE_INT) {
+        if (vm_int(base[ins.j.a]) >= vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_EQ_INT) {
+        if (vm_int(base[ins.j.a]) == vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_NE_INT) {
+        if (vm_int(base[ins.j.a]) != vm_int(base[ins.j.b])) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_LT_INT_IMM) {
+        if (vm_int(base[ins.j.a]) < (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_LE_INT_IMM) {
+        if (vm_int(base[ins.j.a]) <= (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_GT_INT_IMM) {
+        if (vm_int(base[ins.j.a]) > (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_GE_INT_IMM) {
+        if (vm_int(base[ins.j.a]) >= (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_EQ_INT_IMM) {
+        if (vm_int(base[ins.j.a]) == (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_JUMP_IF_NE_INT_IMM) {
+        if (vm_int(base[ins.j.a]) != (int16_t)ins.j.b) {
+            VM_JUMP_TO(pc + vm_jump_offset(ins));
+        }
+        VM_NEXT();
+    }
+    VM_CASE(VM_MOVE_JUMP) {
+        base[ins.j.a] = base[ins.j.b];
+        VM_JUMP_TO(pc + vm_jump_offset(ins));
+        VM_NEXT();
+    }
+
+#ifndef VM_THREADED_DISPATCH
+        default:
+            vm->error = "bad instruction";
+            goto error;
+        }
+#endif
+
+    // Every call and every jump back to the start of a loop comes through here, which is where hot functions get
+    // compiled and where the interpreter hands the function over to its machine code
+vm_enter:
+    if (jit && vm_jit_ready(vm, (unsigned int)(fn - functions))) {
+        activation.base = NULL;
+        activation.depth = depth;
+        vm->depth += depth;
+        uint32_t exit = vm_jit_enter(vm, (unsigned int)(fn - functions), base, (unsigned int)(pc - code));
+        vm->depth -= depth;
+        if (exit == VM_JIT_ERROR) {
+            // Whatever stopped the program already said where
+            vm->activation = activation.outer;
+            return -1;
+        } else if (exit == VM_JIT_RETURNED) {
+            if (fn->return_type == SEM_TYPE_NONE) {
+                goto vm_return_none;
+            }
+            returned = base[0];
+            goto vm_return;
+        }
+        pc = code + exit;
+    }
+    VM_NEXT();
+
+#ifndef VM_THREADED_DISPATCH
+    }
+#endif
+
+error:
+    vm->error_function = fn->symbol;
+    vm->activation = activation.outer;
+    return -1;
+}
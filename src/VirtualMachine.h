@@ -0,0 +1,435 @@
+#ifndef VIRTUALMACHINE_H
+#define VIRTUALMACHINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "DynamicArray.h"
+#include "DynamicArrayIO.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "VirtualMachineHeap.h"
+#include "ir.h"
+
+// A register based bytecode VM that runs the optimized IR. Every function gets a window of registers on one big stack,
+// every SSA value of the function is given one of those registers (values that are never alive at the same time share
+// one), and every instruction names the registers it reads and writes directly, so there is no pushing and popping of
+// an operand stack like in a stack based VM
+
+// The number of registers on the stack, which is shared by every call that is running at the same time
+#define VM_STACK_SIZE (1u << 20)
+// How deep calls can go before the program is stopped
+#define VM_MAX_FRAMES (1u << 16)
+// Registers are named with 16 bits, so a function can't use more than this many (including the arguments of the calls it makes)
+#define VM_MAX_REGISTERS 65535u
+
+enum VM_ops {
+    // a = b
+    VM_MOVE,
+    // a = the int imm
+    VM_LOAD_INT,
+    // a = constant imm of the program (a float or a string)
+    VM_LOAD_CONST,
+
+    // a = b op c. Int math wraps around at 32 bits
+    VM_ADD_INT,
+    VM_SUB_INT,
+    VM_MUL_INT,
+    // Stops the program when c is 0
+    VM_DIV_INT,
+    // a = -b
+    VM_NEG_INT,
+    VM_ADD_FLOAT,
+    VM_SUB_FLOAT,
+    VM_MUL_FLOAT,
+    VM_DIV_FLOAT,
+    VM_NEG_FLOAT,
+    // a = b joined with c
+    VM_CONCAT,
+    // The same, for a join whose result never leaves the frame of the function (it isn't returned, passed to a call,
+    // stored in a global, or carried around a loop). A flat result goes in the slot of the frame the instruction names
+    // rather than the heap, and the slot is used over again every time the instruction runs
+    VM_CONCAT_LOCAL,
+
+    // a = 1 if b op c, and 0 if not
+    VM_LT_INT,
+    VM_LE_INT,
+    VM_GT_INT,
+    VM_GE_INT,
+    VM_EQ_INT,
+    VM_NE_INT,
+    VM_LT_FLOAT,
+    VM_LE_FLOAT,
+    VM_GT_FLOAT,
+    VM_GE_FLOAT,
+    VM_EQ_FLOAT,
+    VM_NE_FLOAT,
+    VM_EQ_STRING,
+    VM_NE_STRING,
+
+    // a = b converted
+    VM_INT_TO_FLOAT,
+    // Truncates towards 0. Floats that don't fit in an int are clamped to the closest one, and NaN becomes 0
+    VM_FLOAT_TO_INT,
+
+    // a = global imm
+    VM_LOAD_GLOBAL,
+    // global imm = a
+    VM_STORE_GLOBAL,
+
+    // Calls function imm and puts what it returns in a. The arguments are in the registers right after the ones the
+    // calling function uses, which become the first registers of the window of the function that is called
+    VM_CALL,
+    // Goes to the instruction at imm
+    VM_JUMP,
+    // Goes to the instruction at imm if a isn't 0
+    VM_JUMP_IF,
+    // Goes to the instruction at imm if a is 0
+    VM_JUMP_IF_NOT,
+    // Returns a from the function
+    VM_RETURN,
+    // Returns from a function that has nothing to return (only the top level of the file)
+    VM_RETURN_NONE,
+
+    // Superinstructions, which each do the work of a few of the ops above in one dispatch. Which sequences get one
+    // was picked with --op-pairs (see vm_op_pairs_merge), from the pairs that ran the most across a set of programs.
+    // a = b + c, where c is a 16 bit int rather than a register (this is also how a constant is subtracted)
+    VM_ADD_INT_IMM,
+    // A comparison of ints fused with the branch that uses it: goes to the instruction vm_jump_offset(ins) away from
+    // the next one if a op b. These are in the same order as the comparisons above
+    VM_JUMP_IF_LT_INT,
+    VM_JUMP_IF_LE_INT,
+    VM_JUMP_IF_GT_INT,
+    VM_JUMP_IF_GE_INT,
+    VM_JUMP_IF_EQ_INT,
+    VM_JUMP_IF_NE_INT,
+    // The same, but b is a 16 bit int rather than a register, which also takes care of loading the constant
+    VM_JUMP_IF_LT_INT_IMM,
+    VM_JUMP_IF_LE_INT_IMM,
+    VM_JUMP_IF_GT_INT_IMM,
+    VM_JUMP_IF_GE_INT_IMM,
+    VM_JUMP_IF_EQ_INT_IMM,
+    VM_JUMP_IF_NE_INT_IMM,
+    // a = b, then goes to the instruction vm_jump_offset(ins) away from the next one. This is the last phi move on
+    // an edge followed by the jump along it, which is how the back edge of most loops ends
+    VM_MOVE_JUMP,
+
+    VM_OP_COUNT
+};
+
+// Every instruction is one 64 bit word. The op is always the first byte, and the rest is either three registers,
+// a register and a 32 bit immediate (a constant, a global, a function, or the index of the instruction to jump to),
+// or two registers and a 24 bit jump that is relative to the next instruction (split in two to fit)
+typedef union {
+    uint64_t full;
+    // The operation is specified by the instruction
+    uint8_t op;
+    struct {
+        uint8_t op;
+        // The slot of VM_CONCAT_LOCAL, and 0 for every other op
+        uint8_t slot;
+        uint16_t a, b, c;
+    } r;
+    struct {
+        uint8_t op;
+        uint8_t __padding;
+        uint16_t a;
+        int32_t imm;
+    } i;
+    struct {
+        uint8_t op;
+        int8_t offset_high;
+        uint16_t a, b;
+        uint16_t offset_low;
+    } j;
+} instruction;
+
+// Relative jumps can only go this far in either direction, so a function can't have more instructions than this
+#define VM_MAX_JUMP ((1 << 23) - 1)
+
+// Returns how far away from the next instruction a relative jump goes
+inline int32_t vm_jump_offset(instruction ins) {
+    return (int32_t)((uint32_t)(int32_t)ins.j.offset_high << 16 | ins.j.offset_low);
+}
+
+// What a register holds, which is also what globals and constants are. Every value is one 64 bit word, NaN-boxed: a
+// float is just its own bits, and ints and strings are kept in the payload of NaNs that no float ever has, with a tag in
+// the top 16 bits. That way nothing is ever boxed, and what a value is takes one mask to tell (see vm_is_int). Float
+// math only ever makes the default NaN of the machine, with or without its sign bit, or hands on a NaN it was given,
+// so floats just have to go through vm_float_value when they come from anywhere else (like constants)
+typedef union VM_value {
+    double f;
+    uint64_t bits;
+} VM_value;
+
+#define VM_TAG_MASK 0xffff000000000000ull
+// The 32 bits of an int are the low half of the word
+#define VM_TAG_INT 0xfffa000000000000ull
+// The low 48 bits are the address of the VM_string, which is all of it on x86-64 and AArch64
+#define VM_TAG_STRING 0xfffc000000000000ull
+// A string of up to VM_SHORT_MAX characters, which is kept in the value itself rather than being allocated. The
+// characters are the low 5 bytes (the first one lowest), and the length is the byte above them
+#define VM_TAG_SHORT 0xfffe000000000000ull
+#define VM_NAN 0x7ff8000000000000ull
+
+inline VM_value vm_int_value(int32_t i) {
+    return (VM_value){.bits = VM_TAG_INT | (uint32_t)i};
+}
+
+inline VM_value vm_float_value(double f) {
+    return f != f ? (VM_value){.bits = VM_NAN} : (VM_value){.f = f};
+}
+
+inline VM_value vm_string_value(VM_string* str) {
+    return (VM_value){.bits = VM_TAG_STRING | (uint64_t)(uintptr_t)str};
+}
+
+inline int32_t vm_int(VM_value value) {
+    return (int32_t)(uint32_t)value.bits;
+}
+
+inline VM_string* vm_string(VM_value value) {
+    return (VM_string*)(uintptr_t)(value.bits & ~VM_TAG_MASK);
+}
+
+inline bool vm_is_int(VM_value value) {
+    return (value.bits & VM_TAG_MASK) == VM_TAG_INT;
+}
+
+// Whether the value points to a VM_string, which is every string but the short ones
+inline bool vm_is_string(VM_value value) {
+    return (value.bits & VM_TAG_MASK) == VM_TAG_STRING;
+}
+
+// A string short enough to be a short string is never anything else, so two short strings are the same string exactly
+// when their bits are, and a short string is never equal to any other kind
+#define VM_SHORT_MAX 5
+
+inline bool vm_is_short(VM_value value) {
+    return (value.bits & VM_TAG_MASK) == VM_TAG_SHORT;
+}
+
+inline uint32_t vm_short_length(VM_value value) {
+    return (uint32_t)(value.bits >> 40) & 0xff;
+}
+
+inline char vm_short_char(VM_value value, uint32_t i) {
+    return (char)(unsigned char)(value.bits >> (8 * i));
+}
+
+// Makes a short string out of len (at most VM_SHORT_MAX) characters
+inline VM_value vm_short_value(const char* chars, uint32_t len) {
+    uint64_t bits = VM_TAG_SHORT | (uint64_t)len << 40;
+    for (uint32_t i = 0; i < len; i++) {
+        bits |= (uint64_t)(unsigned char)chars[i] << (8 * i);
+    }
+    return (VM_value){.bits = bits};
+}
+
+// The length of any kind of string
+inline uint32_t vm_string_length(VM_value value) {
+    return vm_is_short(value) ? vm_short_length(value) : vm_string(value)->len;
+}
+
+// A string made by joining two others without copying either of them, which is a VM_string with VM_GC_ROPE set and
+// these in place of its characters. Its characters are the ones of left followed by the ones of right, and every rope
+// is at least VM_ROPE_MIN long. Once the rope has been flattened (see vm_heap_flatten), left is a flat string with all of
+// its characters, and right is 0, which no string ever is
+typedef struct VM_rope {
+    uint32_t len;
+    uint32_t gc;
+    VM_value left;
+    VM_value right;
+} VM_rope;
+
+// Every tag is above every float, including the NaN with its sign bit set
+inline bool vm_is_float(VM_value value) {
+    return value.bits < VM_TAG_INT;
+}
+
+typedef struct VM_function {
+    // The interned name of the function
+    unsigned int symbol;
+    // Where the first instruction of the function is in the code of the program
+    unsigned int entry;
+    unsigned int param_count;
+    unsigned int return_type;
+    // The number of registers the function uses itself. The arguments of the calls it makes go right after these
+    unsigned int registers;
+    // registers, plus the arguments of the call that has the most of them
+    unsigned int frame_size;
+    // How many slots the function takes from the frame regions when it's called (see VM_CONCAT_LOCAL)
+    unsigned int slots;
+} VM_function;
+
+// The most slots a function can have, since an instruction names its slot with 8 bits. Joins past that go to the heap
+#define VM_MAX_SLOTS 256u
+// How much room a slot takes, which is enough for any flat string the VM makes (anything longer is a rope)
+#define VM_SLOT_SIZE (sizeof(VM_string) + VM_ROPE_MIN)
+
+// The registers that hold strings while a call or a concatenation runs, which are the only instructions a collection can
+// happen in (a call because the function it calls can make strings). A register is only in here when the string in it is
+// used later on, so everything else in the frame is left alone by the collector, whatever it holds
+typedef struct VM_stack_map {
+    // The instruction
+    uint32_t pc;
+    // The registers are the ones from start up to, but not including, start + count in the stack_map_registers of the program
+    uint32_t start;
+    uint32_t count;
+} VM_stack_map;
+
+// Starts a run of instructions that all came from the statement at the given byte offset in the source file, which lasts
+// until the pc of the next entry. The offset is IR_NONE for instructions that don't belong to any one statement
+typedef struct VM_line {
+    uint32_t pc;
+    uint32_t offset;
+} VM_line;
+
+// A compiled (or loaded) program, which is everything about it that stays the same while it runs. Nothing in here is
+// changed by running it, so one program can be run by any number of VMs at once, on as many threads
+typedef struct VM_program {
+    // Of type instruction. The code of every function, one after the other
+    DynamicArray code;
+    // Of type VM_function, in the same order as the functions of the IR module
+    DynamicArray functions;
+    // The floats and strings the code loads with VM_LOAD_CONST (of type VM_value)
+    DynamicArray constants;
+    unsigned int script;
+    unsigned int global_count;
+    // The type of every global (of type unsigned int)
+    DynamicArray global_types;
+    // Of type VM_stack_map, in the order of the instructions. Calls and concatenations that don't have any strings to keep
+    // don't get one
+    DynamicArray stack_maps;
+    // Of type unsigned int
+    DynamicArray stack_map_registers;
+    // Of type VM_line, in the order of the instructions
+    DynamicArray lines;
+    // The names of the functions and the text of the string constants. Belongs to the tree the program came from, or to
+    // the program itself when it was loaded from a file
+    Interner* symbols;
+    // The file the program was loaded from (see vm_program_deserialize), which the code and the other tables point into.
+    // Its data is NULL when the program was compiled
+    MappedFile file;
+} VM_program;
+
+// What a call that hasn't returned yet needs to go back to its caller
+typedef struct VM_frame {
+    const instruction* pc;
+    VM_value* base;
+    VM_function* function;
+    // The register of the caller that gets what is returned
+    unsigned int dst;
+    // The slots of the caller in the frame regions, or NULL if it doesn't have any
+    unsigned char* slots;
+} VM_frame;
+
+// Every run of the interpreter (a vm_resume) has one of these, and so does every call machine code makes, which link up
+// into a list from the innermost one out. This is how the collector finds every frame that is still running
+typedef struct VM_activation {
+    struct VM_activation* outer;
+    // The registers of the function that is running, and the instruction right after the one it is at. base is NULL
+    // while the function is being run by machine code, which is then the one that keeps track of it
+    VM_value* base;
+    const instruction* pc;
+    // The frames of the calls the interpreter is in the middle of
+    VM_frame* frames;
+    unsigned int depth;
+    // The slots of the function that is running, which the interpreter keeps here rather than in a local variable since
+    // only calls, returns and VM_CONCAT_LOCAL need them
+    unsigned char* slots;
+} VM_activation;
+
+// Everything a run of a program changes (its registers, frames, globals and strings), which makes it the only thing a
+// thread running the program needs to own. VMs share nothing with each other, so running one never waits on another. The
+// one exception is the sampling of the profiler, since there is only one SIGPROF timer for the whole process
+typedef struct VM {
+    VM_program* program;
+    // VM_STACK_SIZE registers
+    VM_value* stack;
+    // VM_MAX_FRAMES frames
+    VM_frame* frames;
+    // One for every global of the program, which start out as 0, 0.0, or an empty string
+    VM_value* globals;
+    // Where the strings made while the program runs are kept
+    VM_heap heap;
+    // The innermost activation, or NULL when nothing is running
+    VM_activation* activation;
+    // What stopped the program, or NULL if nothing has
+    const char* error;
+    // The interned name of the function that was running when the program was stopped
+    unsigned int error_function;
+    // When this isn't NULL, every time an op runs right after another one the counter at
+    // [first op * VM_OP_COUNT + second op] goes up by 1. Calls and jumps count too, so these are the pairs as they
+    // actually run rather than as they are laid out
+    uint64_t* op_pairs;
+    // One for every function when the JIT is on (see VirtualMachineJit.h), and NULL when everything is interpreted
+    struct VM_native* natives;
+    // What the profiler has found so far while it is on (see VirtualMachineProfile.h), and NULL when it is off
+    struct VM_profile* profile;
+    // How many calls are running in the runs of the interpreter that are further down the C stack (the ones that called
+    // into machine code that called back into the interpreter), and how many runs of machine code haven't returned yet
+    unsigned int depth;
+    unsigned int native_depth;
+} VM;
+
+// Registers the types used by the VM. Should be called once before using any other function in this module
+int vm_module_init(void);
+
+// Makes the bytecode for every function of a module that went through the optimizations. Returns -1 (after printing
+// why) if a function is too big to be run
+int vm_compile(VM_program* program, IR_module* module);
+
+int vm_program_free(VM_program* program);
+
+// For use with the type registry
+int vm_program_deallocator(void* program);
+int vm_deallocator(void* vm);
+
+// Prints the bytecode of every function
+int vm_program_print(VM_program* program);
+
+int vm_init(VM* vm, VM_program* program);
+
+// Gets the VM ready to run a program from the start again, which can be a different one than before. Everything the
+// last program made is thrown away, but the stack, the frames, the heap and (when it's the same program) the globals and
+// the machine code are kept, so running many short programs one after the other only allocates once
+int vm_reset(VM* vm, VM_program* program);
+
+int vm_free(VM* vm);
+
+// Runs a function until it returns, and puts what it returned in result (which can be NULL). args has to have one value
+// for every parameter of the function. Returns -1 if the program had to be stopped, in which case vm->error says why
+int vm_call(VM* vm, unsigned int function, VM_value* args, VM_value* result);
+
+// Runs a function from the instruction at start with its registers already at base, until it returns. This is how machine code
+// calls functions and goes back to the interpreter
+int vm_resume(VM* vm, unsigned int function, VM_value* base, unsigned int start, VM_value* result);
+
+// Starts counting op pairs in vm->op_pairs, which is freed with the VM
+int vm_count_op_pairs(VM* vm);
+
+// Adds the op pairs counted in earlier runs, which are kept in the file at path, to pairs, and writes the sum back to the
+// file. This way the counts can be collected over a whole set of programs before deciding which pairs to fuse
+int vm_op_pairs_merge(uint64_t* pairs, string* path);
+
+// Prints the limit most common op pairs, along with how often they ran
+int vm_op_pairs_print(uint64_t* pairs, unsigned int limit);
+
+// Returns the name of the op as it is printed by vm_program_print
+const char* vm_op_name(unsigned int op);
+
+// Returns the index of the function with the given name, or -1 if there isn't one
+unsigned int vm_find_function(VM_program* program, const char* name);
+
+// Returns the byte offset in the source file of the statement the instruction at pc came from, or IR_NONE if it doesn't
+// belong to one
+uint32_t vm_find_offset(VM_program* program, uint32_t pc);
+
+// Writes the characters of any kind of string to out, which needs room for vm_string_length of them. A rope is gone
+// through without being flattened, with stack (an initialized array of VM_value, which is left the way it was) standing
+// in for recursion, so even a rope that is millions of joins deep doesn't run out of C stack
+void vm_string_write(VM_value value, char* out, DynamicArray* stack);
+
+void vm_print_value(VM_value value);
+
+#endif
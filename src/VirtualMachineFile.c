@@ -0,0 +1,243 @@
+#include "VirtualMachineFile.h"
+#include "DynamicArray.h"
+#include "DynamicArrayIO.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "VirtualMachine.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t vm_file_align(uint64_t offset) {
+    return (offset + VM_FILE_ALIGNMENT - 1) & ~(uint64_t)(VM_FILE_ALIGNMENT - 1);
+}
+
+// How much room a string takes in the string table
+static uint64_t vm_file_string_size(uint64_t len) {
+    return (sizeof(VM_string) + len + 1 + 7) & ~(uint64_t)7;
+}
+
+// Only goes by the magic, so that a file that starts like bytecode but is cut short is turned away as bytecode rather
+// than being read as source
+bool vm_file_is_bytecode(const void* data, size_t size) {
+    return size >= sizeof(((VM_file_header*)NULL)->magic) && memcmp(data, VM_FILE_MAGIC, sizeof(((VM_file_header*)NULL)->magic)) == 0;
+}
+
+int vm_program_serialize(VM_program* program, DynamicArray* data) {
+    // The names of the functions come first in the string table, and the strings of the constants after them, with
+    // every string that shows up more than once (like a constant that is also the name of a function) only there once
+    Interner strings;
+    interner_init(&strings);
+    DynamicArray symbols;
+    dynamic_array_init(&symbols, &STRING("unsigned int"));
+    for (unsigned int f = 0; f < program->functions.len; f++) {
+        unsigned int symbol = interner_intern(&strings, interner_get(program->symbols, ((VM_function*)program->functions.buf)[f].symbol));
+        dynamic_array_append(&symbols, &symbol);
+    }
+    unsigned int nameCount = strings.names.len;
+    DynamicArray constantStrings;
+    dynamic_array_init(&constantStrings, &STRING("unsigned int"));
+    for (unsigned int i = 0; i < program->constants.len; i++) {
+        VM_value constant = ((VM_value*)program->constants.buf)[i];
+        unsigned int index = UINT32_MAX;
+        if (vm_is_string(constant)) {
+            VM_string* str = vm_string(constant);
+            index = interner_intern(&strings, &(string){.str = str->chars, .len = str->len, .__memsize = 0});
+        }
+        dynamic_array_append(&constantStrings, &index);
+    }
+
+    // Everything is measured first so that the data only has to be allocated once
+    DynamicArray offsets;
+    dynamic_array_init(&offsets, &STRING("unsigned long long"));
+    uint64_t stringsSize = 0;
+    for (unsigned int i = 0; i < strings.names.len; i++) {
+        unsigned long long offset = stringsSize;
+        dynamic_array_append(&offsets, &offset);
+        stringsSize += vm_file_string_size(interner_get(&strings, i)->len);
+    }
+
+    VM_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VM_FILE_MAGIC, sizeof(header.magic));
+    header.version = VM_FILE_VERSION;
+    header.byte_order = VM_FILE_BYTE_ORDER;
+    header.script = program->script;
+    header.global_count = program->global_count;
+    header.code_count = program->code.len;
+    header.function_count = program->functions.len;
+    header.constant_count = program->constants.len;
+    header.stack_map_count = program->stack_maps.len;
+    header.stack_map_register_count = program->stack_map_registers.len;
+    header.string_count = strings.names.len;
+    header.name_count = nameCount;
+    header.line_count = program->lines.len;
+    header.code = vm_file_align(sizeof(VM_file_header));
+    header.functions = vm_file_align(header.code + (uint64_t)header.code_count * sizeof(instruction));
+    header.constants = vm_file_align(header.functions + (uint64_t)header.function_count * sizeof(VM_function));
+    header.global_types = vm_file_align(header.constants + (uint64_t)header.constant_count * sizeof(VM_value));
+    header.stack_maps = vm_file_align(header.global_types + (uint64_t)header.global_count * sizeof(unsigned int));
+    header.stack_map_registers = vm_file_align(header.stack_maps + (uint64_t)header.stack_map_count * sizeof(VM_stack_map));
+    header.lines = vm_file_align(header.stack_map_registers + (uint64_t)header.stack_map_register_count * sizeof(unsigned int));
+    header.strings = vm_file_align(header.lines + (uint64_t)header.line_count * sizeof(VM_line));
+    header.strings_size = stringsSize;
+    uint64_t total = header.strings + stringsSize;
+
+    int result = -1;
+    if (total <= UINT32_MAX) {
+        dynamic_array_resize(data, (unsigned int)total, true);
+        data->len = (unsigned int)total;
+        char* out = (char*)data->buf;
+        memset(out, 0, total);
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + header.code, program->code.buf, (size_t)header.code_count * sizeof(instruction));
+        VM_function* functions = (VM_function*)(out + header.functions);
+        for (unsigned int f = 0; f < header.function_count; f++) {
+            functions[f] = ((VM_function*)program->functions.buf)[f];
+            functions[f].symbol = ((unsigned int*)symbols.buf)[f];
+        }
+        VM_value* constants = (VM_value*)(out + header.constants);
+        for (unsigned int i = 0; i < header.constant_count; i++) {
+            unsigned int index = ((unsigned int*)constantStrings.buf)[i];
+            constants[i] = index == UINT32_MAX ? ((VM_value*)program->constants.buf)[i]
+                                               : (VM_value){.bits = VM_TAG_STRING | ((unsigned long long*)offsets.buf)[index]};
+        }
+        // An empty table has no buffer to copy from
+        if (header.global_count > 0) {
+            memcpy(out + header.global_types, program->global_types.buf, (size_t)header.global_count * sizeof(unsigned int));
+        }
+        if (header.stack_map_count > 0) {
+            memcpy(out + header.stack_maps, program->stack_maps.buf, (size_t)header.stack_map_count * sizeof(VM_stack_map));
+        }
+        if (header.stack_map_register_count > 0) {
+            memcpy(out + header.stack_map_registers, program->stack_map_registers.buf,
+                   (size_t)header.stack_map_register_count * sizeof(unsigned int));
+        }
+        if (header.line_count > 0) {
+            memcpy(out + header.lines, program->lines.buf, (size_t)header.line_count * sizeof(VM_line));
+        }
+        for (unsigned int i = 0; i < strings.names.len; i++) {
+            string* str = interner_get(&strings, i);
+            VM_string* record = (VM_string*)(out + header.strings + ((unsigned long long*)offsets.buf)[i]);
+            record->len = (uint32_t)str->len;
+            record->gc = VM_GC_STATIC;
+            memcpy(record->chars, str->str, str->len);
+        }
+        result = 0;
+    }
+
+    dynamic_array_free(&offsets);
+    dynamic_array_free(&constantStrings);
+    dynamic_array_free(&symbols);
+    interner_free(&strings);
+    return result;
+}
+
+// Returns the string at offset in the string table, or NULL if there isn't a whole string there
+static VM_string* vm_file_string(const char* strings, uint64_t stringsSize, uint64_t offset) {
+    if (offset % 8 != 0 || offset > stringsSize || stringsSize - offset < sizeof(VM_string)) {
+        return NULL;
+    }
+    VM_string* str = (VM_string*)(strings + offset);
+    if (stringsSize - offset - sizeof(VM_string) <= str->len || str->chars[str->len] != '\0' || str->gc != VM_GC_STATIC) {
+        return NULL;
+    }
+    return str;
+}
+
+// Points the array at count elements of data, which it doesn't own (see MappedArray)
+static void vm_file_array(DynamicArray* arr, string* type, const char* data, unsigned int count) {
+    dynamic_array_init(arr, type);
+    arr->buf = (void*)data;
+    arr->len = count;
+    arr->__memsize = 0;
+}
+
+int vm_program_deserialize(VM_program* program, MappedFile* file, const void* data, size_t size) {
+    const char* in = (const char*)data;
+    if (size < sizeof(VM_file_header) || !vm_file_is_bytecode(data, size)) {
+        return -1;
+    }
+    VM_file_header header;
+    memcpy(&header, in, sizeof(header));
+
+    // Only the tables are checked, which is all that can be done without going through every instruction. The code
+    // itself is trusted, the same way a native executable is
+    if (header.version != VM_FILE_VERSION || header.byte_order != VM_FILE_BYTE_ORDER || header.name_count > header.string_count ||
+        header.script >= header.function_count || (uintptr_t)in % 8 != 0 ||
+        !file_section_fits(header.code, header.code_count, sizeof(instruction), 1, size) ||
+        !file_section_fits(header.functions, header.function_count, sizeof(VM_function), 1, size) ||
+        !file_section_fits(header.constants, header.constant_count, sizeof(VM_value), 1, size) ||
+        !file_section_fits(header.global_types, header.global_count, sizeof(unsigned int), 1, size) ||
+        !file_section_fits(header.stack_maps, header.stack_map_count, sizeof(VM_stack_map), 1, size) ||
+        !file_section_fits(header.stack_map_registers, header.stack_map_register_count, sizeof(unsigned int), 1, size) ||
+        !file_section_fits(header.lines, header.line_count, sizeof(VM_line), 1, size) ||
+        !file_section_fits(header.strings, header.strings_size, 1, 1, size) ||
+        (header.code | header.functions | header.constants | header.global_types | header.stack_maps | header.stack_map_registers |
+         header.lines | header.strings) % 8 != 0) {
+        return -1;
+    }
+    const VM_function* functions = (const VM_function*)(in + header.functions);
+    for (unsigned int f = 0; f < header.function_count; f++) {
+        if (functions[f].entry >= header.code_count || functions[f].symbol >= header.name_count) {
+            return -1;
+        }
+    }
+    const VM_stack_map* maps = (const VM_stack_map*)(in + header.stack_maps);
+    for (unsigned int i = 0; i < header.stack_map_count; i++) {
+        if ((uint64_t)maps[i].start + maps[i].count > header.stack_map_register_count) {
+            return -1;
+        }
+    }
+    const char* strings = in + header.strings;
+    const VM_value* constants = (const VM_value*)(in + header.constants);
+    for (unsigned int i = 0; i < header.constant_count; i++) {
+        if (vm_is_string(constants[i]) && vm_file_string(strings, header.strings_size, constants[i].bits & ~VM_TAG_MASK) == NULL) {
+            return -1;
+        }
+    }
+    uint64_t offset = 0;
+    for (unsigned int i = 0; i < header.name_count; i++) {
+        VM_string* name = vm_file_string(strings, header.strings_size, offset);
+        if (name == NULL) {
+            return -1;
+        }
+        offset += vm_file_string_size(name->len);
+    }
+
+    // Everything the VM reads while running is used right where it is in the file
+    vm_file_array(&program->code, &STRING("instruction"), in + header.code, header.code_count);
+    vm_file_array(&program->functions, &STRING("VM_function"), in + header.functions, header.function_count);
+    vm_file_array(&program->global_types, &STRING("unsigned int"), in + header.global_types, header.global_count);
+    vm_file_array(&program->stack_maps, &STRING("VM_stack_map"), in + header.stack_maps, header.stack_map_count);
+    vm_file_array(&program->stack_map_registers, &STRING("unsigned int"), in + header.stack_map_registers, header.stack_map_register_count);
+    vm_file_array(&program->lines, &STRING("VM_line"), in + header.lines, header.line_count);
+    program->script = header.script;
+    program->global_count = header.global_count;
+
+    dynamic_array_init(&program->constants, &STRING("VM_value"));
+    for (unsigned int i = 0; i < header.constant_count; i++) {
+        VM_value constant = constants[i];
+        if (vm_is_string(constant)) {
+            constant = vm_string_value((VM_string*)(strings + (constant.bits & ~VM_TAG_MASK)));
+        }
+        dynamic_array_append(&program->constants, &constant);
+    }
+
+    program->symbols = (Interner*)malloc(sizeof(Interner));
+    if (program->symbols == NULL) {
+        printf("Failed to allocate memory in vm_program_deserialize\n");
+        exit(-1);
+    }
+    interner_init(program->symbols);
+    offset = 0;
+    for (unsigned int i = 0; i < header.name_count; i++) {
+        VM_string* name = (VM_string*)(strings + offset);
+        interner_intern(program->symbols, &(string){.str = name->chars, .len = name->len, .__memsize = 0});
+        offset += vm_file_string_size(name->len);
+    }
+    program->file = *file;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef VIRTUALMACHINEFILE_H
+#define VIRTUALMACHINEFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "DynamicArray.h"
+#include "DynamicArrayIO.h"
+#include "VirtualMachine.h"
+
+// The bytecode file format, which is a compiled program that can be run without the source it came from. Everything the
+// VM reads while running (the code, the function table, the stack maps, the line table, and the string constants) is laid out in the
+// file exactly the way it is in memory, so a loaded program runs straight from the mapped file without anything being
+// decoded. The only thing that is touched when a file is loaded is the constant pool, whose strings are turned from
+// offsets into addresses, and the names of the functions, which go into an Interner
+
+#define VM_FILE_MAGIC "BYTECODE"
+// Has to change along with anything about the layout of the file or the meaning of the bytecode, so that older files
+// are turned away instead of run
+#define VM_FILE_VERSION 4
+// Used to detect files that were written on a machine with a different byte order
+#define VM_FILE_BYTE_ORDER 0x01020304u
+// Every section starts at a multiple of this, counted from the start of the data
+#define VM_FILE_ALIGNMENT 64
+
+// The file starts with this, followed by the sections it points to
+typedef struct VM_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t script;
+    uint32_t global_count;
+    uint32_t code_count;
+    uint32_t function_count;
+    uint32_t constant_count;
+    uint32_t stack_map_count;
+    uint32_t stack_map_register_count;
+    // The number of strings in the string table, the first name_count of which are the names of the functions. The
+    // symbol of a function is the index of its name there
+    uint32_t string_count;
+    uint32_t name_count;
+    uint32_t line_count;
+    // Where each section begins, counted from the start of the data
+    uint64_t code;
+    uint64_t functions;
+    // Of type VM_value, except that a string holds the offset of the string in the string table rather than its address
+    uint64_t constants;
+    uint64_t global_types;
+    uint64_t stack_maps;
+    uint64_t stack_map_registers;
+    uint64_t lines;
+    // The string table is a VM_string for every distinct string, one after the other, each starting at a multiple of 8
+    uint64_t strings;
+    uint64_t strings_size;
+} VM_file_header;
+
+// Returns whether the data starts like a bytecode file
+bool vm_file_is_bytecode(const void* data, size_t size);
+
+// Turns the program into one block of bytes that can be written to a file (or stored in the Cache). data should be an
+// initialized array of char, and anything already in it is replaced. Returns -1 if the program is too big for the format
+int vm_program_serialize(VM_program* program, DynamicArray* data);
+
+// Makes a program out of the bytes made by vm_program_serialize, which are size bytes at data inside of file. The program
+// takes over file and uses the data in place, so the file is closed by vm_program_free. Nothing is changed if the data
+// isn't a valid program, in which case -1 is returned and file is left for the caller to close
+int vm_program_deserialize(VM_program* program, MappedFile* file, const void* data, size_t size);
+
+#endif
@@ -0,0 +1,419 @@
+#include "VirtualMachineHeap.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include "VirtualMachine.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int vm_heap_init(VM_heap* heap) {
+    *heap = (VM_heap){.limit = VM_HEAP_DEFAULT_LIMIT, .threshold = VM_HEAP_MIN_THRESHOLD};
+    dynamic_array_init(&heap->old, &STRING("VM_string*"));
+    dynamic_array_init(&heap->stack, &STRING("VM_value"));
+    heap->region = (unsigned char*)malloc(VM_HEAP_REGION_SIZE);
+    if (heap->region == NULL) {
+        printf("Failed to allocate memory in vm_heap_init\n");
+        exit(-1);
+    }
+    return vm_heap_set_limits(heap, VM_HEAP_NURSERY_SIZE, VM_HEAP_DEFAULT_LIMIT);
+}
+
+int vm_heap_free(VM_heap* heap) {
+    free(heap->nursery);
+    heap->nursery = NULL;
+    // The deallocator of the type frees every string
+    dynamic_array_free(&heap->old);
+    dynamic_array_free(&heap->stack);
+    free(heap->interned);
+    heap->interned = NULL;
+    free(heap->region);
+    heap->region = NULL;
+    return 0;
+}
+
+int vm_heap_reset(VM_heap* heap) {
+    VM_string** old = (VM_string**)heap->old.buf;
+    for (unsigned int i = 0; i < heap->old.len; i++) {
+        free(old[i]);
+    }
+    heap->old.len = 0;
+    heap->old_bytes = 0;
+    heap->nursery_used = 0;
+    heap->threshold = VM_HEAP_MIN_THRESHOLD;
+    if (heap->interned != NULL) {
+        memset(heap->interned, 0, heap->interned_capacity * sizeof(VM_string*));
+    }
+    heap->interned_count = 0;
+    heap->region_used = 0;
+    return 0;
+}
+
+int vm_heap_set_limits(VM_heap* heap, size_t nurserySize, size_t limit) {
+    // Every string in the nursery takes at least 16 bytes (see vm_heap_size), and there has to be room for a rope
+    nurserySize = nurserySize < 64 ? 64 : nurserySize & ~(size_t)7;
+    free(heap->nursery);
+    heap->nursery = (unsigned char*)malloc(nurserySize);
+    if (heap->nursery == NULL) {
+        printf("Failed to allocate memory in vm_heap_set_limits\n");
+        exit(-1);
+    }
+    heap->nursery_size = nurserySize;
+    heap->nursery_used = 0;
+    heap->limit = limit;
+    return 0;
+}
+
+// How much room a string takes in the nursery. There always has to be room for the address of its copy after the
+// header, and everything stays 8 byte aligned
+static size_t vm_heap_size(uint32_t len) {
+    size_t size = (sizeof(VM_string) + len + 1 + 7) & ~(size_t)7;
+    return size < sizeof(VM_string) + sizeof(VM_string*) ? sizeof(VM_string) + sizeof(VM_string*) : size;
+}
+
+// How many bytes a string in the old generation was allocated with
+static size_t vm_heap_old_size(VM_string* str) {
+    return str->gc & VM_GC_ROPE ? sizeof(VM_rope) : sizeof(VM_string) + str->len + 1;
+}
+
+static bool vm_heap_in_nursery(VM_heap* heap, VM_string* str) {
+    return (unsigned char*)str >= heap->nursery && (unsigned char*)str < heap->nursery + heap->nursery_size;
+}
+
+static VM_string* vm_heap_alloc_old(VM_heap* heap, uint32_t len, bool rope) {
+    size_t size = rope ? sizeof(VM_rope) : sizeof(VM_string) + len + 1;
+    VM_string* str = (VM_string*)malloc(size);
+    if (str == NULL) {
+        printf("Failed to allocate memory in vm_heap_alloc_old\n");
+        exit(-1);
+    }
+    str->len = len;
+    str->gc = VM_GC_OLD | (rope ? VM_GC_ROPE : 0);
+    dynamic_array_append(&heap->old, &str);
+    heap->old_bytes += size;
+    if (heap->old_bytes > heap->old_bytes_max) {
+        heap->old_bytes_max = heap->old_bytes;
+    }
+    return str;
+}
+
+// Moves a string out of the nursery, unless that already happened through another root, and returns where it is now.
+// A rope that is moved still points into the nursery afterwards (see vm_heap_promote)
+static VM_value vm_heap_promote_value(VM_heap* heap, VM_value value) {
+    if (!vm_is_string(value) || !vm_heap_in_nursery(heap, vm_string(value))) {
+        return value;
+    }
+    VM_string* str = vm_string(value);
+    if (str->gc & VM_GC_FORWARDED) {
+        VM_string* copy;
+        memcpy(&copy, str->chars, sizeof(VM_string*));
+        return vm_string_value(copy);
+    }
+    bool rope = (str->gc & VM_GC_ROPE) != 0;
+    VM_string* copy = vm_heap_alloc_old(heap, str->len, rope);
+    size_t size = vm_heap_old_size(copy);
+    memcpy(copy->chars, str->chars, size - sizeof(VM_string));
+    heap->promoted_bytes += size;
+    str->gc |= VM_GC_FORWARDED;
+    memcpy(str->chars, &copy, sizeof(VM_string*));
+    return vm_string_value(copy);
+}
+
+static void vm_heap_promote(VM_heap* heap, VM_value* root) {
+    unsigned int scan = heap->old.len;
+    *root = vm_heap_promote_value(heap, *root);
+    // Everything that was just moved is at the end of the old generation, which makes that the list of the ropes whose
+    // halves still have to follow them out of the nursery. The list only grows while it's gone through, so no matter
+    // how deep a rope is this never recurses
+    for (; scan < heap->old.len; scan++) {
+        VM_string* str = ((VM_string**)heap->old.buf)[scan];
+        if (str->gc & VM_GC_ROPE) {
+            VM_rope* rope = (VM_rope*)str;
+            rope->left = vm_heap_promote_value(heap, rope->left);
+            rope->right = vm_heap_promote_value(heap, rope->right);
+        }
+    }
+}
+
+static void vm_heap_mark(VM_heap* heap, VM_value* root) {
+    // Nothing is in the nursery during the marking, so everything but the constants is in the old generation
+    dynamic_array_append(&heap->stack, root);
+    while (heap->stack.len > 0) {
+        VM_value value = ((VM_value*)heap->stack.buf)[--heap->stack.len];
+        if (!vm_is_string(value)) {
+            continue;
+        }
+        VM_string* str = vm_string(value);
+        if ((str->gc & VM_GC_OLD) == 0 || (str->gc & VM_GC_MARKED) != 0) {
+            continue;
+        }
+        str->gc |= VM_GC_MARKED;
+        if (str->gc & VM_GC_ROPE) {
+            dynamic_array_append(&heap->stack, &((VM_rope*)str)->left);
+            dynamic_array_append(&heap->stack, &((VM_rope*)str)->right);
+        }
+    }
+}
+
+uint32_t vm_heap_hash(const char* chars, uint32_t len) {
+    // Goes through the characters eight at a time, since this is done for nearly every short string that is made
+    uint64_t hash = len * 0x9e3779b97f4a7c15ull;
+    for (uint32_t i = 0; i < len; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, chars + i, len - i < 8 ? len - i : 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    return (uint32_t)hash;
+}
+
+VM_string* vm_heap_find_interned(VM_heap* heap, const char* chars, uint32_t len, uint32_t hash) {
+    if (heap->interned_count == 0) {
+        return NULL;
+    }
+    uint32_t mask = heap->interned_capacity - 1;
+    for (uint32_t slot = hash & mask; heap->interned[slot] != NULL; slot = (slot + 1) & mask) {
+        VM_string* str = heap->interned[slot];
+        if (str->len == len && memcmp(str->chars, chars, len) == 0) {
+            return str;
+        }
+    }
+    return NULL;
+}
+
+static void vm_heap_insert_interned(VM_string** table, uint32_t capacity, VM_string* str, uint32_t hash) {
+    uint32_t slot = hash & (capacity - 1);
+    while (table[slot] != NULL) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    table[slot] = str;
+}
+
+// Moves every string that passes keep over to a new table of the given capacity, updating it to what keep returns
+static void vm_heap_rebuild_interned(VM_heap* heap, uint32_t capacity, VM_string* (*keep)(VM_heap*, VM_string*)) {
+    VM_string** table = (VM_string**)calloc(capacity, sizeof(VM_string*));
+    if (table == NULL) {
+        printf("Failed to allocate memory in vm_heap_rebuild_interned\n");
+        exit(-1);
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < heap->interned_capacity; i++) {
+        VM_string* str = heap->interned[i] != NULL ? keep(heap, heap->interned[i]) : NULL;
+        if (str != NULL) {
+            vm_heap_insert_interned(table, capacity, str, vm_heap_hash(str->chars, str->len));
+            count++;
+        }
+    }
+    free(heap->interned);
+    heap->interned = table;
+    heap->interned_capacity = capacity;
+    heap->interned_count = count;
+}
+
+static VM_string* vm_heap_keep_any(VM_heap* heap, VM_string* str) {
+    (void)heap;
+    return str;
+}
+
+int vm_heap_intern(VM_heap* heap, VM_string* str, uint32_t hash) {
+    // The table is kept at most half full, so that the runs of full slots that lookups go through stay short
+    if ((heap->interned_count + 1) * 2 > heap->interned_capacity) {
+        vm_heap_rebuild_interned(heap, heap->interned_capacity > 0 ? heap->interned_capacity * 2 : 64, vm_heap_keep_any);
+    }
+    vm_heap_insert_interned(heap->interned, heap->interned_capacity, str, hash);
+    heap->interned_count++;
+    return 0;
+}
+
+// After a minor collection, a string that is still in the nursery is gone, and one that was moved out is at its copy
+static VM_string* vm_heap_keep_promoted(VM_heap* heap, VM_string* str) {
+    if (!vm_heap_in_nursery(heap, str)) {
+        return str;
+    }
+    if ((str->gc & VM_GC_FORWARDED) == 0) {
+        return NULL;
+    }
+    VM_string* copy;
+    memcpy(&copy, str->chars, sizeof(VM_string*));
+    return copy;
+}
+
+// After the marking of a major collection, a string in the old generation that wasn't marked is gone
+static VM_string* vm_heap_keep_marked(VM_heap* heap, VM_string* str) {
+    (void)heap;
+    return (str->gc & VM_GC_OLD) == 0 || (str->gc & VM_GC_MARKED) != 0 ? str : NULL;
+}
+
+// Finds the stack map of the instruction right before pc
+static VM_stack_map* vm_heap_find_map(VM_program* program, const instruction* pc) {
+    uint32_t target = (uint32_t)(pc - (const instruction*)program->code.buf) - 1;
+    VM_stack_map* maps = (VM_stack_map*)program->stack_maps.buf;
+    unsigned int low = 0, high = program->stack_maps.len;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (maps[middle].pc < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < program->stack_maps.len && maps[low].pc == target ? &maps[low] : NULL;
+}
+
+static void vm_heap_visit_frame(VM* vm, VM_value* base, const instruction* pc, void (*visit)(VM_heap*, VM_value*)) {
+    VM_stack_map* map = vm_heap_find_map(vm->program, pc);
+    if (map == NULL) {
+        return;
+    }
+    unsigned int* registers = (unsigned int*)vm->program->stack_map_registers.buf + map->start;
+    for (unsigned int i = 0; i < map->count; i++) {
+        visit(&vm->heap, &base[registers[i]]);
+    }
+}
+
+static void vm_heap_visit_roots(VM* vm, void (*visit)(VM_heap*, VM_value*)) {
+    for (unsigned int i = 0; i < vm->program->global_count; i++) {
+        if (vm_is_string(vm->globals[i])) {
+            visit(&vm->heap, &vm->globals[i]);
+        }
+    }
+    for (VM_activation* activation = vm->activation; activation != NULL; activation = activation->outer) {
+        if (activation->base != NULL) {
+            vm_heap_visit_frame(vm, activation->base, activation->pc, visit);
+        }
+        for (unsigned int i = 0; i < activation->depth; i++) {
+            vm_heap_visit_frame(vm, activation->frames[i].base, activation->frames[i].pc, visit);
+        }
+    }
+}
+
+static uint64_t vm_heap_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+int vm_heap_collect(VM* vm, bool major) {
+    VM_heap* heap = &vm->heap;
+    uint64_t start = vm_heap_now();
+
+    // Copying out what the roots point to (and the halves of the ropes among them) is all a minor collection has to do.
+    // The intern table is gone through while what was copied can still be told apart from what wasn't
+    vm_heap_visit_roots(vm, vm_heap_promote);
+    if (heap->interned_count > 0) {
+        vm_heap_rebuild_interned(heap, heap->interned_capacity, vm_heap_keep_promoted);
+    }
+    heap->nursery_used = 0;
+    heap->minor_collections++;
+
+    if (major || heap->old_bytes > heap->threshold) {
+        vm_heap_visit_roots(vm, vm_heap_mark);
+        if (heap->interned_count > 0) {
+            vm_heap_rebuild_interned(heap, heap->interned_capacity, vm_heap_keep_marked);
+        }
+        VM_string** old = (VM_string**)heap->old.buf;
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < heap->old.len; i++) {
+            if (old[i]->gc & VM_GC_MARKED) {
+                old[i]->gc &= ~(uint32_t)VM_GC_MARKED;
+                old[kept++] = old[i];
+            } else {
+                size_t size = vm_heap_old_size(old[i]);
+                heap->old_bytes -= size;
+                heap->freed_bytes += size;
+                free(old[i]);
+            }
+        }
+        heap->old.len = kept;
+        heap->threshold = heap->old_bytes * 2 > VM_HEAP_MIN_THRESHOLD ? heap->old_bytes * 2 : VM_HEAP_MIN_THRESHOLD;
+        heap->major_collections++;
+    }
+
+    uint64_t pause = vm_heap_now() - start;
+    heap->pause_total += pause;
+    if (pause > heap->pause_max) {
+        heap->pause_max = pause;
+    }
+    return 0;
+}
+
+static VM_string* vm_heap_alloc(VM* vm, uint32_t len, bool rope) {
+    VM_heap* heap = &vm->heap;
+    size_t size = rope ? (sizeof(VM_rope) + 7) & ~(size_t)7 : vm_heap_size(len);
+    heap->allocated_bytes += size;
+    // A rope can point into the nursery, so it has to be made there itself
+    if (!rope && size > heap->nursery_size / 4) {
+        // Big strings would fill the nursery up too fast, so they go straight to the old generation
+        if (heap->old_bytes + size > heap->threshold || heap->old_bytes + size + heap->nursery_size > heap->limit) {
+            vm_heap_collect(vm, true);
+        }
+        if (heap->old_bytes + size + heap->nursery_size > heap->limit) {
+            vm->error = "out of memory (see --heap-limit)";
+            return NULL;
+        }
+        return vm_heap_alloc_old(heap, len, false);
+    }
+
+    if (heap->nursery_used + size > heap->nursery_size) {
+        vm_heap_collect(vm, false);
+        if (heap->old_bytes + heap->nursery_size > heap->limit) {
+            // Only a major collection can tell whether the strings that were just promoted are really still in use
+            vm_heap_collect(vm, true);
+            if (heap->old_bytes + heap->nursery_size > heap->limit) {
+                vm->error = "out of memory (see --heap-limit)";
+                return NULL;
+            }
+        }
+    }
+    VM_string* str = (VM_string*)(heap->nursery + heap->nursery_used);
+    heap->nursery_used += size;
+    str->len = len;
+    str->gc = rope ? VM_GC_ROPE : 0;
+    return str;
+}
+
+VM_string* vm_heap_alloc_string(VM* vm, uint32_t len) {
+    return vm_heap_alloc(vm, len, false);
+}
+
+VM_string* vm_heap_alloc_rope(VM* vm, uint32_t len) {
+    return vm_heap_alloc(vm, len, true);
+}
+
+VM_string* vm_heap_flatten(VM* vm, VM_string* rope) {
+    VM_heap* heap = &vm->heap;
+    VM_rope* halves = (VM_rope*)rope;
+    if (halves->right.bits == 0) {
+        return vm_string(halves->left);
+    }
+    if (heap->old_bytes + sizeof(VM_string) + rope->len + 1 + heap->nursery_size > heap->limit) {
+        vm->error = "out of memory (see --heap-limit)";
+        return NULL;
+    }
+    VM_string* flat = vm_heap_alloc_old(heap, rope->len, false);
+    vm_string_write(vm_string_value(rope), flat->chars, &heap->stack);
+    flat->chars[flat->len] = '\0';
+    heap->allocated_bytes += sizeof(VM_string) + rope->len + 1;
+    heap->flattened++;
+    // The halves aren't needed anymore, and are left for the collector if nothing else has them
+    halves->left = vm_string_value(flat);
+    halves->right.bits = 0;
+    return flat;
+}
+
+int vm_heap_print_stats(VM_heap* heap) {
+    printf("gc: %u minor and %u major collections, paused for %.3f ms in total and %.3f ms at most\n", heap->minor_collections,
+           heap->major_collections, heap->pause_total / 1e6, heap->pause_max / 1e6);
+    printf("gc: %llu bytes allocated, %llu promoted, %llu freed, at most %zu bytes in the old generation\n",
+           (unsigned long long)heap->allocated_bytes, (unsigned long long)heap->promoted_bytes,
+           (unsigned long long)heap->freed_bytes, heap->old_bytes_max);
+    printf("strings: %llu joins, %llu short, %llu found in the intern table, %llu ropes (%llu flattened)\n",
+           (unsigned long long)heap->joins, (unsigned long long)heap->short_joins, (unsigned long long)heap->interned_joins,
+           (unsigned long long)heap->rope_joins, (unsigned long long)heap->flattened);
+    uint64_t made = heap->flat_joins + heap->rope_joins + heap->local_joins;
+    printf("strings: %llu of the %llu strings made by joins (%.1f%%) were kept in frame regions instead of the heap\n",
+           (unsigned long long)heap->local_joins, (unsigned long long)made, made > 0 ? 100.0 * heap->local_joins / made : 0.0);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#ifndef VIRTUALMACHINEHEAP_H
+#define VIRTUALMACHINEHEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "DynamicArray.h"
+
+// The heap the VM keeps the strings it makes in. New strings are bump allocated in the nursery, and when it fills up
+// every string in it that is still in use is copied out into the old generation (a minor collection), which empties it.
+// Strings in the old generation are allocated one by one, and once they add up to more than a threshold the ones that
+// are no longer in use are freed with a mark and sweep (a major collection). Everything that is still in use is found
+// from the roots, which are the string globals and the registers that hold strings in every frame (see VM_stack_map),
+// and from there through the halves of ropes (see VM_rope). Neither collection needs a write barrier, since a string
+// never points to one younger than itself: a rope only points to strings that were there before it, which are copied
+// out of the nursery along with it, and flattening a rope only ever points it at a string in the old generation
+//
+// Joining strings makes one of three kinds, depending on how long the result is. Up to VM_SHORT_MAX characters it's a
+// short string, which isn't allocated at all. Up to VM_INTERN_MAX it goes through the intern table, which has every
+// string of that length that is still around, so the same string is never made twice and two of them are only equal
+// when they're the same one. The table is weak: it doesn't keep anything alive, and the collector drops the strings that
+// are gone from it. Anything from VM_ROPE_MIN on is a rope, so building a string up a piece at a time doesn't copy what
+// is there so far every time. The characters of a rope are only put together once they're needed (it's flattened)
+//
+// Joins that the compiler found never leave their function (see VM_CONCAT_LOCAL) don't need the heap at all. Every call
+// takes a slot for each of them off the top of the frame regions, which are one block that is used like a stack and
+// given back when the call returns. A string in a slot is static as far as the collector is concerned, which is safe
+// because nothing that outlives the call can point to it, and it has no pointers of its own. Slots are also left out of
+// the intern table, so they're the one kind of string of up to VM_INTERN_MAX characters whose characters are compared
+
+// The default size of the nursery
+#define VM_HEAP_NURSERY_SIZE (1u << 20)
+// The default limit for the nursery and the old generation together
+#define VM_HEAP_DEFAULT_LIMIT (1ull << 30)
+// How big the frame regions are. Calls whose slots don't fit anymore make their strings in the heap
+#define VM_HEAP_REGION_SIZE (1u << 20)
+// The longest string that goes through the intern table
+#define VM_INTERN_MAX 32
+// The shortest string that is made as a rope. Joining strings that add up to less than this just copies them
+#define VM_ROPE_MIN 64
+
+// A major collection happens once the old generation grows past twice what was left after the last one, or this
+// much, whichever is more
+#define VM_HEAP_MIN_THRESHOLD (4u << 20)
+
+enum VM_gc_flags {
+    // A constant of the program (or the empty string the VM starts string globals with), which isn't in the heap at all
+    VM_GC_STATIC = 1,
+    // In the old generation
+    VM_GC_OLD = 2,
+    VM_GC_MARKED = 4,
+    // Copied out of the nursery, with the address of the copy where its characters were
+    VM_GC_FORWARDED = 8,
+    // A rope (see VM_rope)
+    VM_GC_ROPE = 16,
+    // In the slot of a frame region, which always comes with VM_GC_STATIC. These are never in the intern table
+    VM_GC_LOCAL = 32,
+};
+
+// A string made while the program runs (or a string constant). The characters are always followed by a 0
+typedef struct VM_string {
+    uint32_t len;
+    // The VM_gc_flags of the string
+    uint32_t gc;
+    char chars[];
+} VM_string;
+
+typedef struct VM_heap {
+    unsigned char* nursery;
+    size_t nursery_size;
+    size_t nursery_used;
+    // Every string in the old generation (of type VM_string*)
+    DynamicArray old;
+    size_t old_bytes;
+    // A major collection happens when old_bytes goes past this
+    size_t threshold;
+    // The most bytes the nursery and the old generation can hold together
+    size_t limit;
+    // The intern table, which is open addressed with a power of 2 slots, with NULL for the empty ones
+    VM_string** interned;
+    uint32_t interned_capacity;
+    uint32_t interned_count;
+    // Stands in for recursion while going through ropes (of type VM_value)
+    DynamicArray stack;
+    // The frame regions, of VM_HEAP_REGION_SIZE bytes, the first region_used of which are taken by calls that haven't
+    // returned yet
+    unsigned char* region;
+    size_t region_used;
+
+    unsigned int minor_collections;
+    unsigned int major_collections;
+    // How long the program was stopped for collections, in total and at most at once, in nanoseconds
+    uint64_t pause_total;
+    uint64_t pause_max;
+    uint64_t allocated_bytes;
+    uint64_t promoted_bytes;
+    uint64_t freed_bytes;
+    size_t old_bytes_max;
+    // What the joins of strings made: how many there were in total, how many were short, how many were already in the
+    // intern table, how many were ropes, along with how many ropes were flattened, and how many were flat strings in the
+    // heap and in the slots of frame regions
+    uint64_t joins;
+    uint64_t short_joins;
+    uint64_t interned_joins;
+    uint64_t rope_joins;
+    uint64_t flattened;
+    uint64_t flat_joins;
+    uint64_t local_joins;
+} VM_heap;
+
+struct VM;
+
+int vm_heap_init(VM_heap* heap);
+
+int vm_heap_free(VM_heap* heap);
+
+// Frees every string in the heap and empties the intern table, leaving it the way it was right after vm_heap_init (and
+// vm_heap_set_limits) but with everything it allocated for itself still allocated. The counts and times printed by
+// vm_heap_print_stats keep adding up
+int vm_heap_reset(VM_heap* heap);
+
+// Changes the size of the nursery and the limit of the heap. Has to be called before anything is allocated
+int vm_heap_set_limits(VM_heap* heap, size_t nurserySize, size_t limit);
+
+// Makes a string of len characters (which are left for the caller to fill in, along with the 0 after them). This can
+// collect, so every string the caller holds has to be somewhere the collector looks (see VM_activation). Returns NULL,
+// with vm->error set, if the string doesn't fit under the limit of the heap
+VM_string* vm_heap_alloc_string(struct VM* vm, uint32_t len);
+
+// Makes a rope that is len characters long, whose halves are left for the caller to fill in before anything else is
+// allocated. Ropes are always made in the nursery, however small it is. Returns NULL like vm_heap_alloc_string
+VM_string* vm_heap_alloc_rope(struct VM* vm, uint32_t len);
+
+// Returns a flat string with the characters of the rope, which it's then pointed at, so that a rope is only flattened
+// once. This never collects, since it can be called while strings are in registers the collector doesn't know about, so
+// the flat string goes straight into the old generation. Returns NULL, with vm->error set, if it doesn't fit under the limit
+VM_string* vm_heap_flatten(struct VM* vm, VM_string* rope);
+
+// The hash the intern table uses
+uint32_t vm_heap_hash(const char* chars, uint32_t len);
+
+// Returns the string in the intern table with the given characters, or NULL if there isn't one
+VM_string* vm_heap_find_interned(VM_heap* heap, const char* chars, uint32_t len, uint32_t hash);
+
+// Adds a string to the intern table, which mustn't have one like it yet. The string has to be flat, and either in the
+// heap or around for as long as the VM is (like a constant)
+int vm_heap_intern(VM_heap* heap, VM_string* str, uint32_t hash);
+
+// Frees every string that is no longer in use. A minor collection only empties the nursery, while a major one also
+// goes through the old generation
+int vm_heap_collect(struct VM* vm, bool major);
+
+// Prints how many collections there were and how long the program was stopped for them
+int vm_heap_print_stats(VM_heap* heap);
+
+#endif
@@ -0,0 +1,529 @@
+#include "VirtualMachineJit.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include "VirtualMachine.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VM_JIT_SUPPORTED)
+#include <sys/mman.h>
+#endif
+
+// Machine code starts at the instruction it is entered at, and is called like this
+typedef uint32_t (*VM_native_entry)(VM_value* base, VM* vm, void* start);
+
+// A jump in the machine code to the start of an instruction, which gets filled in once everything is laid out
+typedef struct VM_jump_fixup {
+    // Where the 32 bit offset of the jump is in the machine code
+    uint32_t at;
+    // The instruction it goes to, counted from the start of the function
+    uint32_t target;
+} VM_jump_fixup;
+
+typedef struct VM_assembler {
+    VM* vm;
+    // Of type unsigned char
+    DynamicArray code;
+    // Of type VM_jump_fixup
+    DynamicArray fixups;
+    // Where the code that goes back to whatever entered the machine code is
+    unsigned int epilogue;
+} VM_assembler;
+
+int vm_jit_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("VM_jump_fixup"), NULL, sizeof(VM_jump_fixup));
+    return 0;
+}
+
+int vm_jit_enable(VM* vm) {
+#if defined(VM_JIT_SUPPORTED)
+    vm->natives = (VM_native*)calloc(vm->program->functions.len > 0 ? vm->program->functions.len : 1, sizeof(VM_native));
+    if (vm->natives == NULL) {
+        printf("Failed to allocate memory in vm_jit_enable\n");
+        exit(-1);
+    }
+    return 0;
+#else
+    (void)vm;
+    return -1;
+#endif
+}
+
+int vm_jit_free(VM* vm) {
+    if (vm->natives == NULL) {
+        return 0;
+    }
+    for (unsigned int f = 0; f < vm->program->functions.len; f++) {
+        VM_native* native = &vm->natives[f];
+        if (native->code != NULL) {
+#if defined(VM_JIT_SUPPORTED)
+            munmap(native->code, native->size);
+#endif
+            free(native->offsets);
+        }
+    }
+    free(vm->natives);
+    vm->natives = NULL;
+    return 0;
+}
+
+bool vm_jit_ready(VM* vm, unsigned int function) {
+    VM_native* native = &vm->natives[function];
+    if (native->state != VM_NATIVE_COMPILED) {
+        if (native->state == VM_NATIVE_INTERPRETED || ++native->hotness < VM_JIT_THRESHOLD) {
+            return false;
+        }
+        if (vm_jit_compile(vm, function) != 0) {
+            native->state = VM_NATIVE_INTERPRETED;
+            return false;
+        }
+    }
+    return vm->native_depth < VM_JIT_MAX_NESTING;
+}
+
+uint32_t vm_jit_enter(VM* vm, unsigned int function, VM_value* base, unsigned int pc) {
+    VM_native* native = &vm->natives[function];
+    VM_function* fn = &((VM_function*)vm->program->functions.buf)[function];
+    // POSIX lets data pointers be turned into function pointers, which is the only way to run code that was just made
+    VM_native_entry entry = (VM_native_entry)(void*)native->code;
+    vm->native_depth++;
+    uint32_t exit = entry(base, vm, native->code + native->offsets[pc - fn->entry]);
+    vm->native_depth--;
+    if (exit != VM_JIT_RETURNED && exit != VM_JIT_ERROR && ++native->deopts >= VM_JIT_MAX_DEOPTS) {
+        // The machine code can still be running further down the C stack, so it is kept until the VM is freed
+        native->state = VM_NATIVE_INTERPRETED;
+    }
+    return exit;
+}
+
+// What the machine code calls for a VM_CALL, where caller is the registers of the function making the call and pc is the
+// instruction right after the call. Returns 0 once the function returned (with what it returned in the first register at
+// base), -1 if the program was stopped, or 1 if the call can't be made from here. That is when it would overflow the
+// stack, and the calling function goes back to the interpreter so that it can stop the program the way it always does
+static int vm_jit_call(VM* vm, VM_value* base, unsigned int function, unsigned int pc, VM_value* caller) {
+    VM_function* fn = &((VM_function*)vm->program->functions.buf)[function];
+    if (vm->depth >= VM_MAX_FRAMES || base + fn->frame_size > vm->stack + VM_STACK_SIZE) {
+        return 1;
+    }
+    // The calling function is only in machine code, so this is how the collector finds the strings in its registers
+    VM_activation activation = {.outer = vm->activation, .base = caller, .pc = (const instruction*)vm->program->code.buf + pc};
+    vm->activation = &activation;
+    vm->depth++;
+    int status = vm_resume(vm, function, base, fn->entry, base);
+    vm->depth--;
+    vm->activation = activation.outer;
+    return status;
+}
+
+// The same as VM_FLOAT_TO_INT in the interpreter
+static uint64_t vm_jit_float_to_int(double f) {
+    return vm_int_value(f != f ? 0 : f >= 2147483647.0 ? INT32_MAX : f <= -2147483648.0 ? INT32_MIN : (int32_t)f).bits;
+}
+
+#if defined(VM_JIT_SUPPORTED)
+
+// The x86-64 registers the machine code uses. rbx always points at the registers of the function, r12 at the VM, and
+// r13 holds VM_TAG_INT, since all three are saved across calls to C
+enum VM_x86_registers {
+    VM_RAX = 0,
+    VM_RCX = 1,
+    VM_RDX = 2,
+    VM_RBX = 3,
+    VM_RSI = 6,
+    VM_RDI = 7,
+};
+
+static void vm_asm_bytes(VM_assembler* a, const unsigned char* bytes, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        dynamic_array_append(&a->code, (void*)&bytes[i]);
+    }
+}
+
+#define VM_ASM(a, ...) vm_asm_bytes(a, (const unsigned char[]){__VA_ARGS__}, sizeof((const unsigned char[]){__VA_ARGS__}))
+
+static void vm_asm_u32(VM_assembler* a, uint32_t value) {
+    VM_ASM(a, value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24);
+}
+
+static void vm_asm_u64(VM_assembler* a, uint64_t value) {
+    vm_asm_u32(a, (uint32_t)value);
+    vm_asm_u32(a, (uint32_t)(value >> 32));
+}
+
+static void vm_asm_patch(VM_assembler* a, unsigned int at, uint32_t value) {
+    unsigned char* code = (unsigned char*)a->code.buf;
+    for (unsigned int i = 0; i < 4; i++) {
+        code[at + i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// The ModRM byte and displacement for a VM register as the memory operand, with field in the reg field of the ModRM
+// (which is either another x86 register or part of the opcode)
+static void vm_asm_register(VM_assembler* a, unsigned int field, unsigned int reg) {
+    VM_ASM(a, 0x80 | field << 3 | VM_RBX);
+    vm_asm_u32(a, reg * (uint32_t)sizeof(VM_value));
+}
+
+// mov rax, [register]
+static void vm_asm_load(VM_assembler* a, unsigned int reg) {
+    VM_ASM(a, 0x48, 0x8b);
+    vm_asm_register(a, VM_RAX, reg);
+}
+
+// mov [register], rax
+static void vm_asm_store(VM_assembler* a, unsigned int reg) {
+    VM_ASM(a, 0x48, 0x89);
+    vm_asm_register(a, VM_RAX, reg);
+}
+
+// or rax, r13; mov [register], rax. The int is in eax, and every 32 bit op clears the top half of rax, which is where
+// the tag goes
+static void vm_asm_store_int(VM_assembler* a, unsigned int reg) {
+    VM_ASM(a, 0x4c, 0x09, 0xe8);
+    vm_asm_store(a, reg);
+}
+
+// Leaves the machine code, with status as what it returns
+static void vm_asm_exit(VM_assembler* a, uint32_t status) {
+    VM_ASM(a, 0xb8);
+    vm_asm_u32(a, status);
+    VM_ASM(a, 0xe9);
+    vm_asm_u32(a, (uint32_t)((int32_t)a->epilogue - (int32_t)(a->code.len + 4)));
+}
+
+// A jump (whose opcode was already emitted) to the start of an instruction of the function
+static void vm_asm_jump(VM_assembler* a, unsigned int target) {
+    VM_jump_fixup fixup = {.at = a->code.len, .target = target};
+    dynamic_array_append(&a->fixups, &fixup);
+    vm_asm_u32(a, 0);
+}
+
+// mov rax, address; call rax
+static void vm_asm_call(VM_assembler* a, uint64_t address) {
+    VM_ASM(a, 0x48, 0xb8);
+    vm_asm_u64(a, address);
+    VM_ASM(a, 0xff, 0xd0);
+}
+
+static void vm_asm_instruction(VM_assembler* a, VM_function* fn, unsigned int pc) {
+    // The condition codes of setcc and jcc for each comparison, in the order of the ops
+    static const unsigned char setcc[] = {0x9c, 0x9e, 0x9f, 0x9d, 0x94, 0x95};
+    static const unsigned char jcc[] = {0x8c, 0x8e, 0x8f, 0x8d, 0x84, 0x85};
+    static const unsigned char sse[] = {[VM_ADD_FLOAT - VM_ADD_FLOAT] = 0x58, [VM_SUB_FLOAT - VM_ADD_FLOAT] = 0x5c,
+                                        [VM_MUL_FLOAT - VM_ADD_FLOAT] = 0x59, [VM_DIV_FLOAT - VM_ADD_FLOAT] = 0x5e};
+    VM_program* program = a->vm->program;
+    instruction ins = ((const instruction*)program->code.buf)[pc];
+    unsigned int target = pc + 1 - fn->entry;
+    switch (ins.op) {
+        case VM_MOVE:
+            vm_asm_load(a, ins.r.b);
+            vm_asm_store(a, ins.r.a);
+            break;
+        case VM_LOAD_INT:
+            VM_ASM(a, 0x48, 0xb8);
+            vm_asm_u64(a, vm_int_value(ins.i.imm).bits);
+            vm_asm_store(a, ins.i.a);
+            break;
+        case VM_LOAD_CONST:
+            VM_ASM(a, 0x48, 0xb8);
+            vm_asm_u64(a, ((VM_value*)program->constants.buf)[ins.i.imm].bits);
+            vm_asm_store(a, ins.i.a);
+            break;
+
+        case VM_ADD_INT:
+        case VM_SUB_INT:
+        case VM_MUL_INT:
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            if (ins.op == VM_MUL_INT) {
+                VM_ASM(a, 0x0f, 0xaf);
+            } else {
+                VM_ASM(a, ins.op == VM_ADD_INT ? 0x03 : 0x2b);
+            }
+            vm_asm_register(a, VM_RAX, ins.r.c);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        case VM_ADD_INT_IMM:
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0x05);
+            vm_asm_u32(a, (uint32_t)(int32_t)(int16_t)ins.r.c);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        case VM_DIV_INT:
+            // mov eax, b; mov ecx, c; test ecx, ecx; jnz over the exit, so that the interpreter stops the program
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RCX, ins.r.c);
+            VM_ASM(a, 0x85, 0xc9, 0x75, 0x0a);
+            vm_asm_exit(a, pc);
+            // Dividing by -1 is a neg, which wraps INT32_MIN around instead of faulting like idiv would:
+            // cmp ecx, -1; jne over; neg eax; jmp over; cdq; idiv ecx
+            VM_ASM(a, 0x83, 0xf9, 0xff, 0x75, 0x04, 0xf7, 0xd8, 0xeb, 0x03, 0x99, 0xf7, 0xf9);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        case VM_NEG_INT:
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0xf7, 0xd8);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        case VM_ADD_FLOAT:
+        case VM_SUB_FLOAT:
+        case VM_MUL_FLOAT:
+        case VM_DIV_FLOAT:
+            // movsd xmm0, b; op xmm0, c; movsd a, xmm0
+            VM_ASM(a, 0xf2, 0x0f, 0x10);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0xf2, 0x0f, sse[ins.op - VM_ADD_FLOAT]);
+            vm_asm_register(a, VM_RAX, ins.r.c);
+            VM_ASM(a, 0xf2, 0x0f, 0x11);
+            vm_asm_register(a, VM_RAX, ins.r.a);
+            break;
+        case VM_NEG_FLOAT:
+            // Flips the sign bit with btc rax, 63
+            vm_asm_load(a, ins.r.b);
+            VM_ASM(a, 0x48, 0x0f, 0xba, 0xf8, 0x3f);
+            vm_asm_store(a, ins.r.a);
+            break;
+
+        case VM_LT_INT:
+        case VM_LE_INT:
+        case VM_GT_INT:
+        case VM_GE_INT:
+        case VM_EQ_INT:
+        case VM_NE_INT:
+            // mov eax, b; cmp eax, c; setcc al; movzx eax, al
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0x3b);
+            vm_asm_register(a, VM_RAX, ins.r.c);
+            VM_ASM(a, 0x0f, setcc[ins.op - VM_LT_INT], 0xc0, 0x0f, 0xb6, 0xc0);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        case VM_LT_FLOAT:
+        case VM_LE_FLOAT:
+        case VM_GT_FLOAT:
+        case VM_GE_FLOAT:
+        case VM_EQ_FLOAT:
+        case VM_NE_FLOAT: {
+            // ucomisd sets the flags like an unsigned compare, and sets the parity flag too when either side is NaN. a and
+            // ae are false when that happens, so less than is done as greater than with the sides swapped
+            bool swap = ins.op == VM_LT_FLOAT || ins.op == VM_LE_FLOAT;
+            VM_ASM(a, 0xf2, 0x0f, 0x10);
+            vm_asm_register(a, VM_RAX, swap ? ins.r.c : ins.r.b);
+            VM_ASM(a, 0x66, 0x0f, 0x2e);
+            vm_asm_register(a, VM_RAX, swap ? ins.r.b : ins.r.c);
+            if (ins.op == VM_EQ_FLOAT) {
+                // sete al; setnp cl; and al, cl
+                VM_ASM(a, 0x0f, 0x94, 0xc0, 0x0f, 0x9b, 0xc1, 0x20, 0xc8);
+            } else if (ins.op == VM_NE_FLOAT) {
+                // setne al; setp cl; or al, cl
+                VM_ASM(a, 0x0f, 0x95, 0xc0, 0x0f, 0x9a, 0xc1, 0x08, 0xc8);
+            } else {
+                bool orEqual = ins.op == VM_LE_FLOAT || ins.op == VM_GE_FLOAT;
+                VM_ASM(a, 0x0f, orEqual ? 0x93 : 0x97, 0xc0);
+            }
+            VM_ASM(a, 0x0f, 0xb6, 0xc0);
+            vm_asm_store_int(a, ins.r.a);
+            break;
+        }
+
+        case VM_INT_TO_FLOAT:
+            // cvtsi2sd xmm0, dword b
+            VM_ASM(a, 0xf2, 0x0f, 0x2a);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            VM_ASM(a, 0xf2, 0x0f, 0x11);
+            vm_asm_register(a, VM_RAX, ins.r.a);
+            break;
+        case VM_FLOAT_TO_INT:
+            VM_ASM(a, 0xf2, 0x0f, 0x10);
+            vm_asm_register(a, VM_RAX, ins.r.b);
+            vm_asm_call(a, (uint64_t)(uintptr_t)vm_jit_float_to_int);
+            vm_asm_store(a, ins.r.a);
+            break;
+
+        case VM_LOAD_GLOBAL:
+            // mov rax, &global; mov rax, [rax]
+            VM_ASM(a, 0x48, 0xb8);
+            vm_asm_u64(a, (uint64_t)(uintptr_t)&a->vm->globals[ins.i.imm]);
+            VM_ASM(a, 0x48, 0x8b, 0x00);
+            vm_asm_store(a, ins.i.a);
+            break;
+        case VM_STORE_GLOBAL:
+            // mov rcx, &global; mov [rcx], rax
+            vm_asm_load(a, ins.i.a);
+            VM_ASM(a, 0x48, 0xb9);
+            vm_asm_u64(a, (uint64_t)(uintptr_t)&a->vm->globals[ins.i.imm]);
+            VM_ASM(a, 0x48, 0x89, 0x01);
+            break;
+
+        case VM_CALL:
+            // vm_jit_call(vm, the registers right after the ones of this function, function, pc + 1, rbx)
+            VM_ASM(a, 0x48, 0x8d);
+            vm_asm_register(a, VM_RSI, fn->registers);
+            VM_ASM(a, 0x4c, 0x89, 0xe7, 0xba);
+            vm_asm_u32(a, (uint32_t)ins.i.imm);
+            VM_ASM(a, 0xb9);
+            vm_asm_u32(a, pc + 1);
+            VM_ASM(a, 0x49, 0x89, 0xd8);
+            vm_asm_call(a, (uint64_t)(uintptr_t)vm_jit_call);
+            // test eax, eax; jz over both exits; jns over the first one
+            VM_ASM(a, 0x85, 0xc0, 0x74, 0x16, 0x79, 0x0a);
+            vm_asm_exit(a, VM_JIT_ERROR);
+            vm_asm_exit(a, pc);
+            vm_asm_load(a, fn->registers);
+            vm_asm_store(a, ins.i.a);
+            break;
+        case VM_JUMP:
+            VM_ASM(a, 0xe9);
+            vm_asm_jump(a, (unsigned int)ins.i.imm - fn->entry);
+            break;
+        case VM_JUMP_IF:
+        case VM_JUMP_IF_NOT:
+            // cmp dword a, 0; jne or je
+            VM_ASM(a, 0x83);
+            vm_asm_register(a, 7, ins.i.a);
+            VM_ASM(a, 0x00, 0x0f, ins.op == VM_JUMP_IF ? 0x85 : 0x84);
+            vm_asm_jump(a, (unsigned int)ins.i.imm - fn->entry);
+            break;
+        case VM_JUMP_IF_LT_INT:
+        case VM_JUMP_IF_LE_INT:
+        case VM_JUMP_IF_GT_INT:
+        case VM_JUMP_IF_GE_INT:
+        case VM_JUMP_IF_EQ_INT:
+        case VM_JUMP_IF_NE_INT:
+            // mov eax, a; cmp eax, b
+            VM_ASM(a, 0x8b);
+            vm_asm_register(a, VM_RAX, ins.j.a);
+            VM_ASM(a, 0x3b);
+            vm_asm_register(a, VM_RAX, ins.j.b);
+            VM_ASM(a, 0x0f, jcc[ins.op - VM_JUMP_IF_LT_INT]);
+            vm_asm_jump(a, target + vm_jump_offset(ins));
+            break;
+        case VM_JUMP_IF_LT_INT_IMM:
+        case VM_JUMP_IF_LE_INT_IMM:
+        case VM_JUMP_IF_GT_INT_IMM:
+        case VM_JUMP_IF_GE_INT_IMM:
+        case VM_JUMP_IF_EQ_INT_IMM:
+        case VM_JUMP_IF_NE_INT_IMM:
+            // cmp dword a, imm
+            VM_ASM(a, 0x81);
+            vm_asm_register(a, 7, ins.j.a);
+            vm_asm_u32(a, (uint32_t)(int32_t)(int16_t)ins.j.b);
+            VM_ASM(a, 0x0f, jcc[ins.op - VM_JUMP_IF_LT_INT_IMM]);
+            vm_asm_jump(a, target + vm_jump_offset(ins));
+            break;
+        case VM_MOVE_JUMP:
+            vm_asm_load(a, ins.j.b);
+            vm_asm_store(a, ins.j.a);
+            VM_ASM(a, 0xe9);
+            vm_asm_jump(a, target + vm_jump_offset(ins));
+            break;
+        case VM_RETURN:
+            vm_asm_load(a, ins.r.a);
+            vm_asm_store(a, 0);
+            vm_asm_exit(a, VM_JIT_RETURNED);
+            break;
+        case VM_RETURN_NONE:
+            vm_asm_exit(a, VM_JIT_RETURNED);
+            break;
+
+        default:
+            // Strings are left to the interpreter
+            vm_asm_exit(a, pc);
+            break;
+    }
+}
+
+int vm_jit_compile(VM* vm, unsigned int function) {
+    VM_program* program = vm->program;
+    VM_function* fn = &((VM_function*)program->functions.buf)[function];
+    unsigned int end = function + 1 < program->functions.len ? ((VM_function*)program->functions.buf)[function + 1].entry : program->code.len;
+    VM_native* native = &vm->natives[function];
+    native->offsets = (uint32_t*)malloc((end - fn->entry + 1) * sizeof(uint32_t));
+    if (native->offsets == NULL) {
+        printf("Failed to allocate memory in vm_jit_compile\n");
+        exit(-1);
+    }
+
+    VM_assembler a = {.vm = vm};
+    dynamic_array_init(&a.code, &STRING("unsigned char"));
+    dynamic_array_init(&a.fixups, &STRING("VM_jump_fixup"));
+    // push r13; push rbx; push r12 (which also lines the stack up to 16 bytes for calls); mov rbx, rdi; mov r12, rsi;
+    // mov r13, VM_TAG_INT; jmp rdx, which is the instruction it was entered at
+    VM_ASM(&a, 0x41, 0x55, 0x53, 0x41, 0x54, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4, 0x49, 0xbd);
+    vm_asm_u64(&a, VM_TAG_INT);
+    VM_ASM(&a, 0xff, 0xe2);
+    a.epilogue = a.code.len;
+    // pop r12; pop rbx; pop r13; ret
+    VM_ASM(&a, 0x41, 0x5c, 0x5b, 0x41, 0x5d, 0xc3);
+    for (unsigned int pc = fn->entry; pc < end; pc++) {
+        native->offsets[pc - fn->entry] = a.code.len;
+        vm_asm_instruction(&a, fn, pc);
+    }
+    for (unsigned int i = 0; i < a.fixups.len; i++) {
+        VM_jump_fixup* fixup = &((VM_jump_fixup*)a.fixups.buf)[i];
+        vm_asm_patch(&a, fixup->at, (uint32_t)((int32_t)native->offsets[fixup->target] - (int32_t)(fixup->at + 4)));
+    }
+
+    // The code is written while the memory can only be written, and then it can only be run
+    size_t size = a.code.len;
+    void* code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        dynamic_array_free(&a.code);
+        dynamic_array_free(&a.fixups);
+        free(native->offsets);
+        native->offsets = NULL;
+        return -1;
+    }
+    memcpy(code, a.code.buf, size);
+    dynamic_array_free(&a.code);
+    dynamic_array_free(&a.fixups);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        free(native->offsets);
+        native->offsets = NULL;
+        return -1;
+    }
+    native->code = (unsigned char*)code;
+    native->size = size;
+    native->state = VM_NATIVE_COMPILED;
+    return 0;
+}
+
+#else
+
+int vm_jit_compile(VM* vm, unsigned int function) {
+    (void)vm;
+    (void)function;
+    (void)vm_jit_call;
+    (void)vm_jit_float_to_int;
+    return -1;
+}
+
+#endif
+
+int vm_jit_print_stats(VM* vm) {
+    if (vm->natives == NULL) {
+        printf("jit: off\n");
+        return 0;
+    }
+    unsigned int compiled = 0, deopts = 0;
+    size_t size = 0;
+    for (unsigned int f = 0; f < vm->program->functions.len; f++) {
+        VM_native* native = &vm->natives[f];
+        if (native->code != NULL) {
+            compiled++;
+            size += native->size;
+        }
+        deopts += native->deopts;
+    }
+    printf("jit: %u functions compiled to %zu bytes of machine code, %u deopts\n", compiled, size, deopts);
+    return 0;
+}
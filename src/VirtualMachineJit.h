@@ -0,0 +1,79 @@
+#ifndef VIRTUALMACHINEJIT_H
+#define VIRTUALMACHINEJIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "VirtualMachine.h"
+
+// A baseline JIT for the VM, which turns the bytecode of hot functions into x86-64 machine code one instruction at a
+// time. The machine code keeps every register in the same place on the VM stack as the interpreter does, so the two can
+// hand a running function back and forth at any instruction: the interpreter jumps into the machine code at the start
+// of a loop (or of the function) once it is hot, and the machine code goes back to the interpreter (deoptimizes) at any
+// instruction it doesn't do itself, like the string ops or a division by zero. This only works on Linux on x86-64, and
+// everything is just interpreted anywhere else
+
+#if defined(__linux__) && defined(__x86_64__)
+#define VM_JIT_SUPPORTED
+#endif
+
+// How many calls and jumps back to the start of a loop a function takes before it is compiled
+#ifndef VM_JIT_THRESHOLD
+#define VM_JIT_THRESHOLD 1000
+#endif
+// A function that goes back to the interpreter this many times is only interpreted from then on, since it keeps running
+// into something the machine code can't do
+#define VM_JIT_MAX_DEOPTS 64
+// Every call that machine code makes goes through the C stack, so this is how many times machine code can be running
+// at once before the interpreter stops handing calls over to it (the interpreter keeps its calls in the VM's own frames)
+#define VM_JIT_MAX_NESTING 1024
+
+// What machine code returns when the function returned (with what it returned in the first register of the function),
+// or when the program was stopped. Anything else is the instruction the interpreter has to go on from
+#define VM_JIT_RETURNED UINT32_MAX
+#define VM_JIT_ERROR (UINT32_MAX - 1)
+
+enum VM_native_states {
+    // Not hot yet
+    VM_NATIVE_COLD,
+    VM_NATIVE_COMPILED,
+    // Couldn't be compiled, or deoptimized too often
+    VM_NATIVE_INTERPRETED,
+};
+
+typedef struct VM_native {
+    unsigned int state;
+    uint32_t hotness;
+    uint32_t deopts;
+    // The machine code, in memory of its own that can be run but not written
+    unsigned char* code;
+    size_t size;
+    // Where the machine code of every instruction of the function starts in code
+    uint32_t* offsets;
+} VM_native;
+
+// Registers the types used by the JIT. Called by vm_module_init
+int vm_jit_module_init(void);
+
+// Lets the VM compile hot functions to machine code. Returns -1 (and leaves everything to the interpreter) where the JIT
+// isn't supported
+int vm_jit_enable(VM* vm);
+
+// Called by vm_free
+int vm_jit_free(VM* vm);
+
+// Counts a call of the function or a jump back in it, and returns whether it has machine code that can run right now
+// (compiling it first if this is what made it hot)
+bool vm_jit_ready(VM* vm, unsigned int function);
+
+// Runs the machine code of a function from instruction pc (which has to be in the function) with its registers at
+// base, until it returns or deoptimizes. Returns VM_JIT_RETURNED, VM_JIT_ERROR, or the instruction to go on from
+uint32_t vm_jit_enter(VM* vm, unsigned int function, VM_value* base, unsigned int pc);
+
+// Makes the machine code for a function. Returns -1 if it couldn't
+int vm_jit_compile(VM* vm, unsigned int function);
+
+// Prints how many functions were compiled and how often they went back to the interpreter
+int vm_jit_print_stats(VM* vm);
+
+#endif
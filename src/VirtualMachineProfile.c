@@ -0,0 +1,425 @@
+#include "VirtualMachineProfile.h"
+#include "DynamicArray.h"
+#include "DynamicArrayAlgorithms.h"
+#include "DynamicArrayIO.h"
+#include "HashMap.h"
+#include "Strings.h"
+#include "VirtualMachine.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef VM_PROFILE_SAMPLING
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+extern inline uint64_t vm_profile_now(void);
+extern inline void vm_profile_op(VM_profile* profile, unsigned int previous, unsigned int op, uint64_t position, uint32_t depth);
+
+// Something that showed up in count samples (or ran for count ticks), for sorting
+typedef struct VM_profile_count {
+    uint64_t count;
+    uint64_t key;
+} VM_profile_count;
+
+int vm_profile_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("VM_profile_count"), NULL, sizeof(VM_profile_count));
+    return 0;
+}
+
+#ifdef VM_PROFILE_SAMPLING
+// The signal handler can't be given anything, so the profile it writes to has to be here
+static VM_profile* volatile vmProfiled = NULL;
+static struct sigaction vmProfilePrevious;
+
+// Only touches memory that was allocated up front, so it is fine for this to interrupt anything
+static void vm_profile_sample(int signal) {
+    (void)signal;
+    VM_profile* profile = vmProfiled;
+    if (profile == NULL || profile->position == UINT64_MAX) {
+        return;
+    }
+    uint64_t position = profile->position;
+    uint32_t depth = profile->depth;
+    uint32_t skip = depth >= VM_PROFILE_MAX_DEPTH ? depth - (VM_PROFILE_MAX_DEPTH - 1) : 0;
+    uint32_t count = depth - skip + 1;
+    size_t len = profile->samples_len;
+    if (len + 1 + 2 * (size_t)count > VM_PROFILE_SAMPLE_WORDS) {
+        profile->dropped++;
+        return;
+    }
+    uint32_t* out = profile->samples + len;
+    *out++ = count;
+    for (uint32_t i = skip; i < depth; i++) {
+        VM_frame* frame = &profile->frames[i];
+        *out++ = (uint32_t)(frame->function - profile->functions);
+        *out++ = (uint32_t)(frame->pc - profile->code) - 1;
+    }
+    *out++ = (uint32_t)(position >> 32);
+    *out++ = (uint32_t)position;
+    profile->samples_len = (size_t)(out - profile->samples);
+    profile->sample_count++;
+}
+#endif
+
+void vm_profile_time(VM_profile* profile, unsigned int op) {
+    // xorshift32, which is plenty random for this
+    uint32_t x = profile->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    profile->random = x;
+    profile->countdown = VM_PROFILE_TIMING_PERIOD / 2 + x % VM_PROFILE_TIMING_PERIOD;
+    profile->timing = op;
+    profile->started = vm_profile_now();
+}
+
+int vm_profile_start(VM* vm) {
+    VM_profile* profile = (VM_profile*)calloc(1, sizeof(VM_profile));
+    if (profile == NULL) {
+        printf("Failed to allocate memory in vm_profile_start\n");
+        exit(-1);
+    }
+    profile->position = UINT64_MAX;
+    profile->timing = VM_OP_COUNT;
+    profile->countdown = 1;
+    profile->random = 0x9e3779b9u;
+    profile->frames = vm->frames;
+    profile->functions = (const VM_function*)vm->program->functions.buf;
+    profile->code = (const instruction*)vm->program->code.buf;
+    vm->profile = profile;
+
+#ifdef VM_PROFILE_SAMPLING
+    profile->samples = (uint32_t*)malloc(VM_PROFILE_SAMPLE_WORDS * sizeof(uint32_t));
+    if (profile->samples == NULL) {
+        printf("Failed to allocate memory in vm_profile_start\n");
+        exit(-1);
+    }
+    vmProfiled = profile;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = vm_profile_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    struct itimerval timer = {.it_interval = {.tv_sec = 0, .tv_usec = VM_PROFILE_INTERVAL},
+                              .it_value = {.tv_sec = 0, .tv_usec = VM_PROFILE_INTERVAL}};
+    if (sigaction(SIGPROF, &action, &vmProfilePrevious) != 0 || setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+        vmProfiled = NULL;
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int vm_profile_stop(VM* vm) {
+#ifdef VM_PROFILE_SAMPLING
+    if (vm->profile != NULL && vmProfiled == vm->profile) {
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        setitimer(ITIMER_PROF, &timer, NULL);
+        sigaction(SIGPROF, &vmProfilePrevious, NULL);
+        vmProfiled = NULL;
+    }
+#else
+    (void)vm;
+#endif
+    return 0;
+}
+
+int vm_profile_free(VM* vm) {
+    if (vm->profile == NULL) {
+        return 0;
+    }
+    vm_profile_stop(vm);
+    free(vm->profile->samples);
+    free(vm->profile);
+    vm->profile = NULL;
+    return 0;
+}
+
+static int vm_profile_compare_counts(const void* a, const void* b) {
+    const VM_profile_count* x = (const VM_profile_count*)a;
+    const VM_profile_count* y = (const VM_profile_count*)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Goes over every sample that only has frames that make sense. A sample is only ever cut short or taken halfway
+// through a call when the signal came in on another thread than the one running the program
+static bool vm_profile_next_sample(VM* vm, size_t* at, uint32_t** frames, uint32_t* count) {
+    VM_profile* profile = vm->profile;
+    while (*at < profile->samples_len) {
+        *count = profile->samples[*at];
+        *frames = profile->samples + *at + 1;
+        *at += 1 + 2 * (size_t)*count;
+        bool valid = *at <= profile->samples_len;
+        for (uint32_t i = 0; i < *count && valid; i++) {
+            valid = (*frames)[2 * i] < vm->program->functions.len && (*frames)[2 * i + 1] < vm->program->code.len;
+        }
+        if (valid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The offset of the start of every line of the source (of type unsigned int)
+static void vm_profile_find_lines(DynamicArray* starts, string* source) {
+    unsigned int start = 0;
+    dynamic_array_append(starts, &start);
+    for (unsigned int i = 0; source != NULL && i < source->len; i++) {
+        if (source->str[i] == '\n') {
+            start = i + 1;
+            dynamic_array_append(starts, &start);
+        }
+    }
+}
+
+// Returns the index of the line the offset is on (the line number minus one)
+static unsigned int vm_profile_line(DynamicArray* starts, uint32_t offset) {
+    unsigned int* lines = (unsigned int*)starts->buf;
+    unsigned int low = 0, high = starts->len;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (lines[middle] <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low - 1;
+}
+
+static const char* vm_profile_function_name(VM* vm, uint32_t function) {
+    return interner_get(vm->program->symbols, ((VM_function*)vm->program->functions.buf)[function].symbol)->str;
+}
+
+static void vm_profile_sort(DynamicArray* counts) {
+    if (counts->len > 0) {
+        dynamic_array_sort(counts, vm_profile_compare_counts, NULL);
+    }
+}
+
+static void vm_profile_print_ops(VM_profile* profile, unsigned int limit) {
+    DynamicArray sorted;
+    dynamic_array_init(&sorted, &STRING("VM_profile_count"));
+    uint64_t total = 0;
+    for (unsigned int op = 0; op < VM_OP_COUNT; op++) {
+        if (profile->counts[op] > 0) {
+            // Ops that were never timed are too rare to matter
+            uint64_t ticks = profile->timed[op] > 0 ? (uint64_t)((double)profile->ticks[op] / profile->timed[op] * profile->counts[op]) : 0;
+            VM_profile_count count = {.count = ticks, .key = op};
+            dynamic_array_append(&sorted, &count);
+            total += ticks;
+        }
+    }
+    vm_profile_sort(&sorted);
+
+    printf("profile: ops by time (about %llu %s in total)\n", (unsigned long long)total, VM_PROFILE_TICKS);
+    for (unsigned int i = 0; i < sorted.len && i < limit; i++) {
+        VM_profile_count* count = &((VM_profile_count*)sorted.buf)[i];
+        uint64_t runs = profile->counts[count->key];
+        printf("%6.2f%% %14llu runs %16llu %s %8.1f each  %s\n", total > 0 ? 100.0 * count->count / total : 0.0,
+               (unsigned long long)runs, (unsigned long long)count->count, VM_PROFILE_TICKS, (double)count->count / runs,
+               vm_op_name((unsigned int)count->key));
+    }
+    dynamic_array_free(&sorted);
+}
+
+int vm_profile_print(VM* vm, string* source, const char* path, unsigned int limit) {
+    VM_profile* profile = vm->profile;
+    if (profile == NULL) {
+        return -1;
+    }
+    vm_profile_print_ops(profile, limit);
+#ifdef VM_PROFILE_SAMPLING
+    printf("profile: %llu samples, one every %u us of CPU time (%llu dropped)\n", (unsigned long long)profile->sample_count,
+           VM_PROFILE_INTERVAL, (unsigned long long)profile->dropped);
+
+    // The statement every sample was at, keyed by (function << 32) | offset. A function is counted once for every sample
+    // it is anywhere in (no matter how many times it is in there), and once more as the innermost one
+    HashMap statements;
+    hash_map_init(&statements, &STRING("unsigned long long"), &STRING("unsigned long long"));
+    unsigned int functionCount = vm->program->functions.len;
+    uint64_t* totals = (uint64_t*)calloc(functionCount, sizeof(uint64_t));
+    uint64_t* selfs = (uint64_t*)calloc(functionCount, sizeof(uint64_t));
+    uint64_t* seen = (uint64_t*)calloc(functionCount, sizeof(uint64_t));
+    if (totals == NULL || selfs == NULL || seen == NULL) {
+        printf("Failed to allocate memory in vm_profile_print\n");
+        exit(-1);
+    }
+    uint64_t samples = 0;
+    size_t at = 0;
+    uint32_t* frames;
+    uint32_t count;
+    while (vm_profile_next_sample(vm, &at, &frames, &count)) {
+        samples++;
+        for (uint32_t i = 0; i < count; i++) {
+            if (seen[frames[2 * i]] != samples) {
+                seen[frames[2 * i]] = samples;
+                totals[frames[2 * i]]++;
+            }
+        }
+        uint32_t function = frames[2 * (count - 1)];
+        selfs[function]++;
+        unsigned long long key = ((unsigned long long)function << 32) | vm_find_offset(vm->program, frames[2 * count - 1]);
+        unsigned long long* value = (unsigned long long*)hash_map_get(&statements, &key);
+        unsigned long long one = 1;
+        if (value != NULL) {
+            (*value)++;
+        } else {
+            hash_map_insert(&statements, &key, &one);
+        }
+    }
+
+    DynamicArray sorted;
+    dynamic_array_init(&sorted, &STRING("VM_profile_count"));
+    unsigned int iterator = 0;
+    void* key;
+    void* value;
+    while (hash_map_iterate(&statements, &iterator, &key, &value)) {
+        VM_profile_count entry = {.count = *(unsigned long long*)value, .key = *(unsigned long long*)key};
+        dynamic_array_append(&sorted, &entry);
+    }
+    vm_profile_sort(&sorted);
+    DynamicArray lines;
+    dynamic_array_init(&lines, &STRING("unsigned int"));
+    vm_profile_find_lines(&lines, source);
+    printf("profile: hottest statements\n");
+    for (unsigned int i = 0; i < sorted.len && i < limit; i++) {
+        VM_profile_count* entry = &((VM_profile_count*)sorted.buf)[i];
+        uint32_t offset = (uint32_t)entry->key;
+        printf("%6.2f%% %8llu  %s", 100.0 * entry->count / samples, (unsigned long long)entry->count,
+               vm_profile_function_name(vm, (uint32_t)(entry->key >> 32)));
+        if (offset == IR_NONE) {
+            printf("\n");
+        } else if (source == NULL || offset >= source->len) {
+            printf(" at offset %u\n", offset);
+        } else {
+            // Several statements can be on one line, so the statement is shown from where it starts
+            unsigned int line = vm_profile_line(&lines, offset);
+            unsigned int end = offset;
+            while (end < source->len && source->str[end] != '\n') {
+                end++;
+            }
+            printf("  %s:%u:%u: %.*s\n", path, line + 1, offset - ((unsigned int*)lines.buf)[line] + 1, (int)(end - offset),
+                   source->str + offset);
+        }
+    }
+
+    sorted.len = 0;
+    for (unsigned int f = 0; f < functionCount; f++) {
+        if (totals[f] > 0) {
+            VM_profile_count entry = {.count = totals[f], .key = f};
+            dynamic_array_append(&sorted, &entry);
+        }
+    }
+    vm_profile_sort(&sorted);
+    printf("profile: hottest functions (total, then self)\n");
+    for (unsigned int i = 0; i < sorted.len && i < limit; i++) {
+        VM_profile_count* entry = &((VM_profile_count*)sorted.buf)[i];
+        printf("%6.2f%% %6.2f%%  %s\n", 100.0 * entry->count / samples, 100.0 * selfs[entry->key] / samples,
+               vm_profile_function_name(vm, (uint32_t)entry->key));
+    }
+
+    dynamic_array_free(&lines);
+    dynamic_array_free(&sorted);
+    hash_map_free(&statements);
+    free(totals);
+    free(selfs);
+    free(seen);
+#else
+    (void)source;
+    (void)path;
+#endif
+    return 0;
+}
+
+static void vm_profile_append(DynamicArray* text, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    char* out = buffer;
+    if (len >= (int)sizeof(buffer)) {
+        // Only a really long name gets here
+        out = (char*)malloc((size_t)len + 1);
+        if (out == NULL) {
+            printf("Failed to allocate memory in vm_profile_append\n");
+            exit(-1);
+        }
+        va_start(args, format);
+        vsnprintf(out, (size_t)len + 1, format, args);
+        va_end(args);
+    }
+    for (int i = 0; i < len; i++) {
+        dynamic_array_append(text, &out[i]);
+    }
+    if (out != buffer) {
+        free(out);
+    }
+}
+
+int vm_profile_write_collapsed(VM* vm, string* source, string* path) {
+    if (vm->profile == NULL) {
+        return -1;
+    }
+    // Every frame is the name of the function, followed by the line it is at when there is a source to find it in
+    DynamicArray lines;
+    dynamic_array_init(&lines, &STRING("unsigned int"));
+    vm_profile_find_lines(&lines, source);
+    HashMap stacks;
+    hash_map_init(&stacks, &STRING("string"), &STRING("unsigned long long"));
+    DynamicArray stack;
+    dynamic_array_init(&stack, &STRING("char"));
+    size_t at = 0;
+    uint32_t* frames;
+    uint32_t count;
+    while (vm_profile_next_sample(vm, &at, &frames, &count)) {
+        stack.len = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            vm_profile_append(&stack, i == 0 ? "%s" : ";%s", vm_profile_function_name(vm, frames[2 * i]));
+            uint32_t offset = vm_find_offset(vm->program, frames[2 * i + 1]);
+            if (source != NULL && offset != IR_NONE && offset < source->len) {
+                vm_profile_append(&stack, ":%u", vm_profile_line(&lines, offset) + 1);
+            }
+        }
+        string key = {.str = (char*)stack.buf, .len = stack.len, .__memsize = 0};
+        unsigned long long* value = (unsigned long long*)hash_map_get(&stacks, &key);
+        unsigned long long one = 1;
+        if (value != NULL) {
+            (*value)++;
+        } else {
+            hash_map_insert(&stacks, &key, &one);
+        }
+    }
+
+    DynamicArray text;
+    dynamic_array_init(&text, &STRING("char"));
+    unsigned int iterator = 0;
+    void* key;
+    void* value;
+    while (hash_map_iterate(&stacks, &iterator, &key, &value)) {
+        string* name = (string*)key;
+        for (unsigned int i = 0; i < name->len; i++) {
+            dynamic_array_append(&text, &name->str[i]);
+        }
+        vm_profile_append(&text, " %llu\n", *(unsigned long long*)value);
+    }
+    int result = file_write_atomic(path, text.buf, text.len);
+
+    dynamic_array_free(&text);
+    dynamic_array_free(&stack);
+    hash_map_free(&stacks);
+    dynamic_array_free(&lines);
+    return result;
+}
@@ -0,0 +1,134 @@
+#ifndef VIRTUALMACHINEPROFILE_H
+#define VIRTUALMACHINEPROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "Strings.h"
+#include "VirtualMachine.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// A profiler for the interpreter, which is made of two parts. The first counts every op exactly as it runs, and times
+// about one in VM_PROFILE_TIMING_PERIOD of them from their start to the start of the next op, which the total time of
+// every op is worked out from. Timing every op would more than double how long the program takes, and the samples would
+// mostly show where the timing went. The second is a sampler that SIGPROF interrupts every
+// VM_PROFILE_INTERVAL microseconds of CPU time, which writes down the function and statement the program is at along
+// with every call it is in the middle of. Both only happen in the instrumented dispatch of the interpreter (the same one
+// that counts op pairs), so nothing changes for the interpreter while the profiler is off. Machine code isn't profiled,
+// which is why the profiler turns the JIT off
+
+// Sampling needs setitimer, so everywhere else only the op counts are kept
+#if defined(__unix__) || defined(__APPLE__)
+#define VM_PROFILE_SAMPLING
+#endif
+
+// How many ops there are between the ones that are timed on average. The actual distance is random, so that the ops
+// that are timed don't line up with a loop of the same length
+#define VM_PROFILE_TIMING_PERIOD 64
+// How often a sample is taken, in microseconds of CPU time
+#define VM_PROFILE_INTERVAL 1000
+// A sample only keeps this many of the innermost frames
+#define VM_PROFILE_MAX_DEPTH 64
+// How much room there is for samples (in words), which is allocated up front since the signal handler can't allocate.
+// Samples that don't fit anymore are dropped
+#define VM_PROFILE_SAMPLE_WORDS (1u << 22)
+
+// What the time of every op is measured in, which is cycles of the time stamp counter where there is one, and
+// nanoseconds anywhere else
+#if defined(__x86_64__) || defined(__i386__)
+#define VM_PROFILE_TICKS "cycles"
+#else
+#define VM_PROFILE_TICKS "ns"
+#endif
+
+inline uint64_t vm_profile_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+typedef struct VM_profile {
+    // How many times every op ran, how many of those were timed, and how many ticks the timed ones took
+    uint64_t counts[VM_OP_COUNT];
+    uint64_t timed[VM_OP_COUNT];
+    uint64_t ticks[VM_OP_COUNT];
+    // The op that is being timed (VM_OP_COUNT if none is), and when it started
+    uint32_t timing;
+    uint64_t started;
+    // How many more ops run before the next one is timed, and the state of the random numbers that picks that
+    uint32_t countdown;
+    uint32_t random;
+    // Where the interpreter is, as (function << 32) | instruction, which every op updates for the signal handler. It is
+    // UINT64_MAX until the first op runs
+    volatile uint64_t position;
+    // How many frames there are under the function that is running (in the frames of the VM)
+    volatile uint32_t depth;
+    // Everything the signal handler needs to walk the frames, since it can't get to the VM any other way
+    VM_frame* frames;
+    const VM_function* functions;
+    const instruction* code;
+    // The samples, one after the other. Each one is the number of frames in it, followed by the function and the
+    // instruction of every frame from the outermost one in (for a caller, the instruction is the call)
+    uint32_t* samples;
+    volatile size_t samples_len;
+    volatile uint64_t sample_count;
+    volatile uint64_t dropped;
+} VM_profile;
+
+// Starts timing the op (and picks the next one to time). Called by vm_profile_op
+void vm_profile_time(VM_profile* profile, unsigned int op);
+
+// Called by the interpreter right before every op runs while the profiler is on. previous is the op that ran before it
+// in the same run of the interpreter (VM_OP_COUNT if there wasn't one), and position is where the op is, in the format
+// of the position of the profile
+inline void vm_profile_op(VM_profile* profile, unsigned int previous, unsigned int op, uint64_t position, uint32_t depth) {
+    profile->counts[op]++;
+    // The position is one store, so the signal handler never sees the function of one op with the pc of another
+    profile->position = position;
+    profile->depth = depth;
+    if (profile->timing != VM_OP_COUNT) {
+        // The op before this one is only done now. Anything other than the op before it was timed in a run of the
+        // interpreter that already ended, and isn't counted
+        if (profile->timing == previous) {
+            profile->ticks[previous] += vm_profile_now() - profile->started;
+            profile->timed[previous]++;
+        }
+        profile->timing = VM_OP_COUNT;
+    }
+    if (--profile->countdown == 0) {
+        vm_profile_time(profile, op);
+    }
+}
+
+// Registers the types used by the profiler. Called by vm_module_init
+int vm_profile_module_init(void);
+
+// Turns the profiler on for everything the VM runs from now on. Nothing is sampled where VM_PROFILE_SAMPLING isn't
+// defined, but the ops are still counted
+int vm_profile_start(VM* vm);
+
+// Stops taking samples. What was found is kept until vm_free
+int vm_profile_stop(VM* vm);
+
+// Called by vm_free
+int vm_profile_free(VM* vm);
+
+// Prints the limit ops that took the most time, followed by the limit statements and functions that showed up in the
+// most samples. source is the file the program was compiled from, which is used to turn offsets into lines, and can be
+// NULL if there isn't one (for a program loaded from a bytecode file)
+int vm_profile_print(VM* vm, string* source, const char* path, unsigned int limit);
+
+// Writes the samples to the file as collapsed stacks, one line for every distinct stack with the functions from the
+// outermost one in separated by semicolons, followed by how many samples it was in. This is the format flame graph
+// tools (like flamegraph.pl and speedscope) take
+int vm_profile_write_collapsed(VM* vm, string* source, string* path);
+
+#endif
@@ -0,0 +1,132 @@
+#include "VirtualMachineRunner.h"
+#include "ThreadPool.h"
+#include "VirtualMachine.h"
+#include "VirtualMachineHeap.h"
+#include "VirtualMachineJit.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// What the threads running a batch share
+typedef struct VM_batch {
+    VM_run* runs;
+    unsigned int count;
+    VM_run_options* options;
+    // The first run that no thread has taken yet
+    atomic_uint next;
+} VM_batch;
+
+int vm_run_main(VM* vm, VM_value* result, bool* hasResult) {
+    VM_program* program = vm->program;
+    *hasResult = false;
+    if (vm_call(vm, program->script, NULL, NULL) != 0) {
+        return -1;
+    }
+    unsigned int entry = vm_find_function(program, "main");
+    if (entry == UINT32_MAX || ((VM_function*)program->functions.buf)[entry].param_count != 0) {
+        return 0;
+    }
+    if (vm_call(vm, entry, NULL, result) != 0) {
+        return -1;
+    }
+    *hasResult = true;
+    return 0;
+}
+
+// The strings of a VM are gone once it moves on to the next run, so a string that is returned needs a copy of its own,
+// which is always flat
+static VM_string* vm_run_copy_string(VM* vm, VM_value value) {
+    uint32_t len = vm_string_length(value);
+    VM_string* copy = (VM_string*)malloc(sizeof(VM_string) + len + 1);
+    if (copy == NULL) {
+        printf("Failed to allocate memory in vm_run_copy_string\n");
+        exit(-1);
+    }
+    copy->len = len;
+    copy->gc = VM_GC_STATIC;
+    vm_string_write(value, copy->chars, &vm->heap.stack);
+    copy->chars[len] = '\0';
+    return copy;
+}
+
+static uint64_t vm_run_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Takes runs until there are none left, running all of them on the same VM. The VM is only made once the thread gets
+// its first run, so a thread that comes too late to get one doesn't allocate anything
+static void vm_run_worker(void* arg) {
+    VM_batch* batch = (VM_batch*)arg;
+    VM vm;
+    bool ready = false;
+    unsigned int i;
+    while ((i = atomic_fetch_add_explicit(&batch->next, 1, memory_order_relaxed)) < batch->count) {
+        VM_run* run = &batch->runs[i];
+        if (!ready) {
+            vm_init(&vm, run->program);
+            vm_heap_set_limits(&vm.heap, batch->options->nursery_size, batch->options->heap_limit);
+            if (batch->options->jit) {
+                vm_jit_enable(&vm);
+            }
+            ready = true;
+        } else {
+            vm_reset(&vm, run->program);
+        }
+
+        uint64_t start = vm_run_now();
+        VM_value result;
+        if (vm_run_main(&vm, &result, &run->has_result) != 0) {
+            run->error = vm.error;
+            run->error_function = vm.error_function;
+        } else if (run->has_result) {
+            run->result = vm_is_string(result) ? vm_string_value(vm_run_copy_string(&vm, result)) : result;
+        }
+        run->time = vm_run_now() - start;
+    }
+    if (ready) {
+        vm_free(&vm);
+    }
+}
+
+int vm_run_all(ThreadPool* pool, VM_run* runs, unsigned int count, VM_run_options* options) {
+    for (unsigned int i = 0; i < count; i++) {
+        runs[i].has_result = false;
+        runs[i].error = NULL;
+        runs[i].error_function = UINT32_MAX;
+        runs[i].time = 0;
+    }
+    VM_batch batch = {.runs = runs, .count = count, .options = options};
+    atomic_init(&batch.next, 0);
+
+    if (pool == NULL) {
+        vm_run_worker(&batch);
+    } else {
+        // One worker for every thread of the pool, and one for the calling thread, which helps out in thread_pool_wait
+        unsigned int workers = pool->thread_count + 1 < count ? pool->thread_count + 1 : count;
+        for (unsigned int i = 0; i < workers; i++) {
+            thread_pool_submit(pool, vm_run_worker, &batch);
+        }
+        thread_pool_wait(pool);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (runs[i].error != NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int vm_run_free(VM_run* run) {
+    if (run->has_result && vm_is_string(run->result)) {
+        free(vm_string(run->result));
+    }
+    run->has_result = false;
+    return 0;
+}
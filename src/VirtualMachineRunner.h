@@ -0,0 +1,49 @@
+#ifndef VIRTUALMACHINERUNNER_H
+#define VIRTUALMACHINERUNNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ThreadPool.h"
+#include "VirtualMachine.h"
+
+// Runs a batch of programs at the same time on a thread pool. Every thread that takes part gets a VM of its own (an
+// isolate), which it runs one program after the other on, resetting it in between (see vm_reset). The programs
+// themselves are shared, so the same program can be in the batch any number of times. The threads only ever agree on
+// which run comes next, which is one atomic counter, so nothing waits on a lock while the programs run
+
+// One program for vm_run_all to run, along with what came of running it
+typedef struct VM_run {
+    VM_program* program;
+    // What main returned, if the program has a main without parameters (has_result). A string is copied out of the VM
+    // it was made in, and belongs to the run until vm_run_free
+    VM_value result;
+    bool has_result;
+    // What stopped the program, or NULL if it ran to the end, along with the interned name of the function it was in
+    const char* error;
+    unsigned int error_function;
+    // How long the run took, in nanoseconds
+    uint64_t time;
+} VM_run;
+
+typedef struct VM_run_options {
+    // Whether hot functions are compiled to machine code
+    bool jit;
+    // Passed to vm_heap_set_limits for every VM
+    size_t nursery_size;
+    size_t heap_limit;
+} VM_run_options;
+
+// Runs the top level of the program the VM was made for, and then main if there is a function with that name and no
+// parameters. What main returned goes in result (which is left alone when main doesn't run), and hasResult says whether
+// it did. Returns -1 if the program had to be stopped, in which case vm->error says why
+int vm_run_main(VM* vm, VM_value* result, bool* hasResult);
+
+// Runs every one of the count runs on the pool (and the calling thread), and returns once they have all finished. With a
+// NULL pool they all run on the calling thread. The programs of the runs have to stay alive until then. Returns -1 if any
+// of them had to be stopped
+int vm_run_all(ThreadPool* pool, VM_run* runs, unsigned int count, VM_run_options* options);
+
+int vm_run_free(VM_run* run);
+
+#endif
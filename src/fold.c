@@ -0,0 +1,663 @@
+#include "fold.h"
+#include "DynamicArray.h"
+#include "Strings.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// A value that is known at compile time
+typedef struct FoldValue {
+    bool known;
+    // One of the SEM_TYPEs
+    unsigned int type;
+    int32_t i;
+    double f;
+    // The interned contents of a string
+    unsigned int symbol;
+} FoldValue;
+
+// What is known about every variable at the current point in the code
+typedef struct FoldState {
+    // Of type FoldValue, indexed by slot
+    DynamicArray locals;
+    DynamicArray globals;
+    // false once the code can't be reached anymore (after a return)
+    bool reachable;
+} FoldState;
+
+typedef struct Folder {
+    AST* ast;
+    Semantic* sem;
+    FoldStats stats;
+    // Globals are only tracked at the top level of the file. Inside of a function nothing is known about them, since
+    // they could have been changed by whatever called the function
+    bool track_globals;
+} Folder;
+
+static const FoldValue FOLD_UNKNOWN = {.known = false};
+
+static void fold_state_init(FoldState* state, unsigned int locals, unsigned int globals) {
+    dynamic_array_init(&state->locals, &STRING("FoldValue"));
+    dynamic_array_init(&state->globals, &STRING("FoldValue"));
+    for (unsigned int i = 0; i < locals; i++) {
+        dynamic_array_append(&state->locals, (void*)&FOLD_UNKNOWN);
+    }
+    for (unsigned int i = 0; i < globals; i++) {
+        dynamic_array_append(&state->globals, (void*)&FOLD_UNKNOWN);
+    }
+    state->reachable = true;
+}
+
+static void fold_state_free(FoldState* state) {
+    dynamic_array_free(&state->locals);
+    dynamic_array_free(&state->globals);
+}
+
+// Both states have to have been made with the same number of slots
+static void fold_state_copy(FoldState* dest, FoldState* src) {
+    // The buffers are NULL when there are no slots, which memcpy doesn't allow even for 0 bytes
+    if (src->locals.len > 0) {
+        memcpy(dest->locals.buf, src->locals.buf, src->locals.len * sizeof(FoldValue));
+    }
+    if (src->globals.len > 0) {
+        memcpy(dest->globals.buf, src->globals.buf, src->globals.len * sizeof(FoldValue));
+    }
+    dest->reachable = src->reachable;
+}
+
+static bool fold_value_equal(FoldValue* a, FoldValue* b) {
+    if (!a->known || !b->known || a->type != b->type) {
+        return false;
+    }
+    switch (a->type) {
+        case SEM_TYPE_INT:
+            return a->i == b->i;
+        case SEM_TYPE_FLOAT:
+            // Compared bit by bit, so that 0.0 and -0.0 are different and NaN is equal to itself
+            return memcmp(&a->f, &b->f, sizeof(double)) == 0;
+        case SEM_TYPE_STRING:
+            return a->symbol == b->symbol;
+    }
+    return false;
+}
+
+static void fold_merge_values(DynamicArray* dest, DynamicArray* other) {
+    for (unsigned int i = 0; i < dest->len; i++) {
+        FoldValue* value = &((FoldValue*)dest->buf)[i];
+        if (!fold_value_equal(value, &((FoldValue*)other->buf)[i])) {
+            *value = FOLD_UNKNOWN;
+        }
+    }
+}
+
+// Combines the states at the end of two paths that join back together. A variable is only still known if it has
+// the same value on both paths, except that a path that can't be reached (because it returned) doesn't count
+static void fold_state_merge(FoldState* dest, FoldState* other) {
+    if (!other->reachable) {
+        return;
+    } else if (!dest->reachable) {
+        fold_state_copy(dest, other);
+        return;
+    }
+    fold_merge_values(&dest->locals, &other->locals);
+    fold_merge_values(&dest->globals, &other->globals);
+}
+
+static void fold_forget_globals(FoldState* state) {
+    for (unsigned int i = 0; i < state->globals.len; i++) {
+        ((FoldValue*)state->globals.buf)[i] = FOLD_UNKNOWN;
+    }
+}
+
+// Returns where the value of the variable the node refers to is kept track of, or NULL if it isn't
+static FoldValue* fold_lookup(Folder* folder, FoldState* state, unsigned int node) {
+    SemanticInfo* info = semantic_get(folder->sem, node);
+    if (info->kind == SEM_KIND_LOCAL) {
+        return &((FoldValue*)state->locals.buf)[info->slot];
+    } else if (info->kind == SEM_KIND_GLOBAL && folder->track_globals) {
+        return &((FoldValue*)state->globals.buf)[info->slot];
+    }
+    return NULL;
+}
+
+static FoldValue fold_convert(FoldValue value, unsigned int type) {
+    if (!value.known || value.type == type) {
+        return value;
+    } else if (type == SEM_TYPE_FLOAT && value.type == SEM_TYPE_INT) {
+        return (FoldValue){.known = true, .type = SEM_TYPE_FLOAT, .f = value.i};
+    } else if (type == SEM_TYPE_INT && value.type == SEM_TYPE_FLOAT) {
+        // Converting a float that doesn't fit in an int is undefined in C, so it is left for the program to do
+        if (value.f != value.f || value.f >= 2147483648.0 || value.f <= -2147483649.0) {
+            return FOLD_UNKNOWN;
+        }
+        return (FoldValue){.known = true, .type = SEM_TYPE_INT, .i = (int32_t)value.f};
+    }
+    return FOLD_UNKNOWN;
+}
+
+// The value a variable has when it is declared without an initial value
+static FoldValue fold_default_value(Folder* folder, unsigned int type) {
+    if (type == SEM_TYPE_STRING) {
+        return (FoldValue){.known = true, .type = SEM_TYPE_STRING, .symbol = interner_intern(&folder->ast->symbols, &STRING(""))};
+    } else if (type == SEM_TYPE_FLOAT) {
+        return (FoldValue){.known = true, .type = SEM_TYPE_FLOAT, .f = 0.0};
+    }
+    return (FoldValue){.known = true, .type = SEM_TYPE_INT, .i = 0};
+}
+
+// Rewrites the node into a constant holding the value. Its children (if it had any) are cut out of the tree
+static void fold_replace(Folder* folder, unsigned int index, FoldValue value) {
+    AST* ast = folder->ast;
+    AST_node* node = ast_get(ast, index);
+    node->flags = 0;
+    node->data = 0;
+    node->first_child = AST_NONE;
+
+    if (value.type == SEM_TYPE_INT) {
+        node->type = AST_INT_CONSTANT;
+        node->flags = AST_FLAG_INLINE_INT;
+        node->payload.inline_int = value.i;
+    } else if (value.type == SEM_TYPE_FLOAT) {
+        node->type = AST_FLOAT_CONSTANT;
+        node->payload.constant = ast->floats.len;
+        dynamic_array_append(&ast->floats, &value.f);
+    } else {
+        node->type = AST_STRING_CONSTANT;
+        node->payload.symbol = value.symbol;
+    }
+
+    *semantic_get(folder->sem, index) = (SemanticInfo){.type = value.type, .kind = SEM_KIND_NONE, .slot = AST_NONE};
+}
+
+// Moves the node at from into the place of the node at to, keeping the place of to among its siblings
+static void fold_move(Folder* folder, unsigned int to, unsigned int from) {
+    AST_node* dest = ast_get(folder->ast, to);
+    unsigned int sibling = dest->next_sibling;
+    *dest = *ast_get(folder->ast, from);
+    dest->next_sibling = sibling;
+    *semantic_get(folder->sem, to) = *semantic_get(folder->sem, from);
+    ((unsigned int*)folder->ast->locations.buf)[to] = ((unsigned int*)folder->ast->locations.buf)[from];
+}
+
+static void fold_make_empty(Folder* folder, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    node->type = AST_EMPTY;
+    node->flags = 0;
+    node->data = 0;
+    node->first_child = AST_NONE;
+    *semantic_get(folder->sem, index) = (SemanticInfo){.type = SEM_TYPE_NONE, .kind = SEM_KIND_NONE, .slot = AST_NONE};
+}
+
+static FoldValue fold_node_value(Folder* folder, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    switch (node->type) {
+        case AST_INT_CONSTANT:
+            // Ints are 32 bits, so bigger constants wrap around just like they would when the program runs
+            return (FoldValue){.known = true, .type = SEM_TYPE_INT, .i = (int32_t)(uint32_t)ast_int_value(folder->ast, index)};
+        case AST_FLOAT_CONSTANT:
+            return (FoldValue){.known = true, .type = SEM_TYPE_FLOAT, .f = ast_float_value(folder->ast, index)};
+        case AST_STRING_CONSTANT:
+            return (FoldValue){.known = true, .type = SEM_TYPE_STRING, .symbol = node->payload.symbol};
+    }
+    return FOLD_UNKNOWN;
+}
+
+static FoldValue fold_int_operator(unsigned int op, int32_t l, int32_t r) {
+    FoldValue result = {.known = true, .type = SEM_TYPE_INT};
+    // The math is done on unsigned ints so that overflow wraps around instead of being undefined
+    switch (op) {
+        case OP_PLUS:
+        case OP_PLUS_EQUAL:
+            result.i = (int32_t)((uint32_t)l + (uint32_t)r);
+            return result;
+        case OP_MINUS:
+        case OP_MINUS_EQUAL:
+            result.i = (int32_t)((uint32_t)l - (uint32_t)r);
+            return result;
+        case OP_MULT:
+        case OP_MULT_EQUAL:
+            result.i = (int32_t)((uint32_t)l * (uint32_t)r);
+            return result;
+        case OP_DIV:
+        case OP_DIV_EQUAL:
+            if (r == 0 || (l == INT32_MIN && r == -1)) {
+                return FOLD_UNKNOWN;
+            }
+            result.i = l / r;
+            return result;
+        case OP_LESS:
+            result.i = l < r;
+            return result;
+        case OP_GREATER:
+            result.i = l > r;
+            return result;
+        case OP_LESS_EQUAL:
+            result.i = l <= r;
+            return result;
+        case OP_GREATER_EQUAL:
+            result.i = l >= r;
+            return result;
+        case OP_EQUAL_EQUAL:
+            result.i = l == r;
+            return result;
+        case OP_NOT_EQUAL:
+            result.i = l != r;
+            return result;
+    }
+    return FOLD_UNKNOWN;
+}
+
+static FoldValue fold_float_operator(unsigned int op, double l, double r) {
+    FoldValue result = {.known = true, .type = SEM_TYPE_FLOAT};
+    switch (op) {
+        case OP_PLUS:
+        case OP_PLUS_EQUAL:
+            result.f = l + r;
+            return result;
+        case OP_MINUS:
+        case OP_MINUS_EQUAL:
+            result.f = l - r;
+            return result;
+        case OP_MULT:
+        case OP_MULT_EQUAL:
+            result.f = l * r;
+            return result;
+        case OP_DIV:
+        case OP_DIV_EQUAL:
+            result.f = l / r;
+            return result;
+    }
+
+    // Comparisons of floats still give back an int
+    result.type = SEM_TYPE_INT;
+    switch (op) {
+        case OP_LESS:
+            result.i = l < r;
+            return result;
+        case OP_GREATER:
+            result.i = l > r;
+            return result;
+        case OP_LESS_EQUAL:
+            result.i = l <= r;
+            return result;
+        case OP_GREATER_EQUAL:
+            result.i = l >= r;
+            return result;
+        case OP_EQUAL_EQUAL:
+            result.i = l == r;
+            return result;
+        case OP_NOT_EQUAL:
+            result.i = l != r;
+            return result;
+    }
+    return FOLD_UNKNOWN;
+}
+
+// Works out the result of an operator on two known values. The semantic pass already made sure the types make sense together
+static FoldValue fold_operator(Folder* folder, unsigned int op, FoldValue l, FoldValue r) {
+    if (!l.known || !r.known) {
+        return FOLD_UNKNOWN;
+    }
+
+    if (l.type == SEM_TYPE_STRING) {
+        if (op == OP_EQUAL_EQUAL || op == OP_NOT_EQUAL) {
+            // Interning means equal strings always have the same symbol
+            return (FoldValue){.known = true, .type = SEM_TYPE_INT, .i = (l.symbol == r.symbol) == (op == OP_EQUAL_EQUAL)};
+        }
+
+        string joined;
+        string_init(&joined);
+        string_concat(&joined, interner_get(&folder->ast->symbols, l.symbol), interner_get(&folder->ast->symbols, r.symbol));
+        FoldValue result = {.known = true, .type = SEM_TYPE_STRING, .symbol = interner_intern(&folder->ast->symbols, &joined)};
+        string_free(&joined);
+        return result;
+    }
+
+    if (l.type == SEM_TYPE_FLOAT || r.type == SEM_TYPE_FLOAT) {
+        return fold_float_operator(op, fold_convert(l, SEM_TYPE_FLOAT).f, fold_convert(r, SEM_TYPE_FLOAT).f);
+    }
+    return fold_int_operator(op, l.i, r.i);
+}
+
+static FoldValue fold_expression(Folder* folder, FoldState* state, unsigned int index);
+static void fold_statement(Folder* folder, FoldState* state, unsigned int index);
+
+static FoldValue fold_negate(FoldValue value) {
+    if (value.known && value.type == SEM_TYPE_INT) {
+        value.i = (int32_t)(0u - (uint32_t)value.i);
+    } else if (value.known) {
+        value.f = -value.f;
+    }
+    return value;
+}
+
+// Works out the value of an expression if it is known, without changing the tree or what is known about any variable.
+// Anything with a side effect (an assignment or a call) is treated as unknown
+static FoldValue fold_evaluate(Folder* folder, FoldState* state, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    switch (node->type) {
+        case AST_INT_CONSTANT:
+        case AST_FLOAT_CONSTANT:
+        case AST_STRING_CONSTANT:
+            return fold_node_value(folder, index);
+
+        case AST_VARIABLE: {
+            FoldValue* known = fold_lookup(folder, state, index);
+            return known != NULL ? *known : FOLD_UNKNOWN;
+        }
+
+        case AST_EXPRESSION:
+        case AST_COMPARISON: {
+            FoldValue l = fold_evaluate(folder, state, node->first_child);
+            FoldValue r = fold_evaluate(folder, state, ast_get(folder->ast, node->first_child)->next_sibling);
+            return fold_operator(folder, node->data, l, r);
+        }
+
+        case AST_UNARY: {
+            return fold_negate(fold_evaluate(folder, state, node->first_child));
+        }
+    }
+    return FOLD_UNKNOWN;
+}
+
+// Replaces the node with the value if it is known, and returns the value either way
+static FoldValue fold_result(Folder* folder, unsigned int index, FoldValue value) {
+    if (value.known) {
+        fold_replace(folder, index, value);
+        folder->stats.folded++;
+    }
+    return value;
+}
+
+// For a known value that is about to be stored in a variable of a different type, does the conversion ahead of time
+static FoldValue fold_converted(Folder* folder, unsigned int index, FoldValue value, unsigned int type) {
+    if (!value.known || value.type == type) {
+        return value;
+    }
+    value = fold_convert(value, type);
+    return fold_result(folder, index, value);
+}
+
+static FoldValue fold_expression(Folder* folder, FoldState* state, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    switch (node->type) {
+        case AST_INT_CONSTANT:
+        case AST_FLOAT_CONSTANT:
+        case AST_STRING_CONSTANT:
+            return fold_node_value(folder, index);
+
+        case AST_VARIABLE: {
+            FoldValue* known = fold_lookup(folder, state, index);
+            if (known == NULL || !known->known) {
+                return FOLD_UNKNOWN;
+            }
+            FoldValue value = *known;
+            fold_replace(folder, index, value);
+            folder->stats.propagated++;
+            return value;
+        }
+
+        case AST_EXPRESSION:
+        case AST_COMPARISON: {
+            unsigned int op = node->data;
+            unsigned int right = ast_get(folder->ast, node->first_child)->next_sibling;
+            FoldValue l = fold_expression(folder, state, node->first_child);
+            FoldValue r = fold_expression(folder, state, right);
+            return fold_result(folder, index, fold_operator(folder, op, l, r));
+        }
+
+        case AST_UNARY: {
+            return fold_result(folder, index, fold_negate(fold_expression(folder, state, node->first_child)));
+        }
+
+        case AST_ASSIGNMENT: {
+            unsigned int op = node->data;
+            unsigned int target = node->first_child;
+            unsigned int valueNode = ast_get(folder->ast, target)->next_sibling;
+            unsigned int type = semantic_get(folder->sem, target)->type;
+            FoldValue value = fold_expression(folder, state, valueNode);
+            if (op == OP_EQUAL) {
+                value = fold_converted(folder, valueNode, value, type);
+            }
+
+            FoldValue* known = fold_lookup(folder, state, target);
+            if (known != NULL) {
+                *known = op == OP_EQUAL ? value : fold_convert(fold_operator(folder, op, *known, value), type);
+            }
+            // The assignment itself still has to happen, so it is never replaced, even if its value is known
+            return FOLD_UNKNOWN;
+        }
+
+        case AST_CALL:
+            AST_FOR_EACH_CHILD(folder->ast, index, arg) {
+                fold_expression(folder, state, arg);
+            }
+            // The function could change any global
+            fold_forget_globals(state);
+            return FOLD_UNKNOWN;
+    }
+    return FOLD_UNKNOWN;
+}
+
+typedef struct FoldForgetContext {
+    Folder* folder;
+    FoldState* state;
+} FoldForgetContext;
+
+static int fold_forget_enter(AST* ast, unsigned int node, void* ctx) {
+    FoldForgetContext* forget = (FoldForgetContext*)ctx;
+    unsigned int type = ast_get(ast, node)->type;
+    if (type == AST_ASSIGNMENT || type == AST_DECLARATION) {
+        FoldValue* known = fold_lookup(forget->folder, forget->state, type == AST_ASSIGNMENT ? ast_get(ast, node)->first_child : node);
+        if (known != NULL) {
+            *known = FOLD_UNKNOWN;
+        }
+    } else if (type == AST_CALL) {
+        fold_forget_globals(forget->state);
+    }
+    return AST_VISIT_CONTINUE;
+}
+
+// Forgets everything about the variables that are changed anywhere in the node. Used for loops, since at the start of
+// an iteration those variables could have the values from the last iteration instead of the ones from before the loop
+static void fold_forget_changed(Folder* folder, FoldState* state, unsigned int index) {
+    FoldForgetContext forget = {.folder = folder, .state = state};
+    AST_visitor visitor = {.enter = fold_forget_enter, .leave = NULL, .ctx = &forget};
+    ast_visit(folder->ast, index, &visitor);
+}
+
+static void fold_loop(Folder* folder, FoldState* state, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    bool isFor = node->type == AST_FOR;
+    unsigned int init = isFor ? node->first_child : AST_NONE;
+    unsigned int condition = isFor ? ast_get(folder->ast, init)->next_sibling : node->first_child;
+    // For a for loop the step comes before the body in the tree, but it runs after it
+    unsigned int step = isFor ? ast_get(folder->ast, condition)->next_sibling : AST_NONE;
+    unsigned int body = isFor ? ast_get(folder->ast, step)->next_sibling : ast_get(folder->ast, condition)->next_sibling;
+
+    if (isFor) {
+        fold_statement(folder, state, init);
+    }
+
+    // The first time the condition is checked, everything known from before the loop still holds. If the condition is
+    // false then, the loop never runs at all
+    bool infinite = ast_get(folder->ast, condition)->type == AST_EMPTY;
+    FoldValue first = infinite ? FOLD_UNKNOWN : fold_evaluate(folder, state, condition);
+    bool neverRuns = first.known && first.type == SEM_TYPE_INT && first.i == 0;
+
+    fold_forget_changed(folder, state, condition);
+    fold_forget_changed(folder, state, body);
+    if (isFor) {
+        fold_forget_changed(folder, state, step);
+    }
+
+    // Whatever is known now holds at the start of every iteration
+    FoldValue result = infinite ? FOLD_UNKNOWN : fold_expression(folder, state, condition);
+    if (neverRuns || (result.known && result.type == SEM_TYPE_INT && result.i == 0)) {
+        // The loop never runs. A for loop still runs its initializer, so it becomes a block with just that in it
+        // (which also keeps any variable it declares scoped like before)
+        folder->stats.branches++;
+        if (isFor) {
+            node = ast_get(folder->ast, index);
+            node->type = AST_BLOCK;
+            ast_get(folder->ast, init)->next_sibling = AST_NONE;
+        } else {
+            fold_make_empty(folder, index);
+        }
+        return;
+    }
+
+    FoldState iteration;
+    fold_state_init(&iteration, state->locals.len, state->globals.len);
+    fold_state_copy(&iteration, state);
+    fold_statement(folder, &iteration, body);
+    if (isFor) {
+        fold_statement(folder, &iteration, step);
+    }
+    fold_state_free(&iteration);
+}
+
+static void fold_branch(Folder* folder, FoldState* state, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    unsigned int thenBody = ast_get(folder->ast, node->first_child)->next_sibling;
+    unsigned int elseBody = ast_get(folder->ast, thenBody)->next_sibling;
+
+    FoldValue condition = fold_expression(folder, state, node->first_child);
+    if (condition.known && condition.type == SEM_TYPE_INT) {
+        folder->stats.branches++;
+        unsigned int taken = condition.i != 0 ? thenBody : elseBody;
+        if (taken == AST_NONE) {
+            fold_make_empty(folder, index);
+            return;
+        }
+        fold_move(folder, index, taken);
+        fold_statement(folder, state, index);
+        return;
+    }
+
+    FoldState otherPath;
+    fold_state_init(&otherPath, state->locals.len, state->globals.len);
+    fold_state_copy(&otherPath, state);
+    fold_statement(folder, state, thenBody);
+    if (elseBody != AST_NONE) {
+        fold_statement(folder, &otherPath, elseBody);
+    }
+    fold_state_merge(state, &otherPath);
+    fold_state_free(&otherPath);
+}
+
+// Folds every statement in a list of siblings, and cuts off the list after any statement that can't be continued past
+static void fold_statements(Folder* folder, FoldState* state, unsigned int first) {
+    for (unsigned int child = first; child != AST_NONE; child = ast_get(folder->ast, child)->next_sibling) {
+        fold_statement(folder, state, child);
+        if (!state->reachable) {
+            ast_get(folder->ast, child)->next_sibling = AST_NONE;
+            break;
+        }
+    }
+}
+
+static void fold_statement(Folder* folder, FoldState* state, unsigned int index) {
+    AST_node* node = ast_get(folder->ast, index);
+    switch (node->type) {
+        case AST_DECLARATION: {
+            unsigned int type = semantic_get(folder->sem, index)->type;
+            FoldValue value = fold_default_value(folder, type);
+            if (node->first_child != AST_NONE) {
+                value = fold_converted(folder, node->first_child, fold_expression(folder, state, node->first_child), type);
+            }
+            FoldValue* known = fold_lookup(folder, state, index);
+            if (known != NULL) {
+                *known = value;
+            }
+            break;
+        }
+
+        case AST_BLOCK:
+            fold_statements(folder, state, node->first_child);
+            break;
+
+        case AST_BRANCH:
+            fold_branch(folder, state, index);
+            break;
+
+        case AST_WHILE:
+        case AST_FOR:
+            fold_loop(folder, state, index);
+            break;
+
+        case AST_RETURN:
+            if (node->first_child != AST_NONE) {
+                fold_expression(folder, state, node->first_child);
+            }
+            state->reachable = false;
+            break;
+
+        case AST_EMPTY:
+        case AST_ERROR:
+            break;
+
+        default:
+            // An expression used as a statement
+            fold_expression(folder, state, index);
+            break;
+    }
+}
+
+static int fold_count_enter(AST* ast, unsigned int node, void* ctx) {
+    (void)ast;
+    (void)node;
+    (*(unsigned int*)ctx)++;
+    return AST_VISIT_CONTINUE;
+}
+
+static unsigned int fold_count_nodes(AST* ast) {
+    unsigned int count = 0;
+    AST_visitor visitor = {.enter = fold_count_enter, .leave = NULL, .ctx = &count};
+    ast_visit(ast, 0, &visitor);
+    return count;
+}
+
+int fold_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("FoldValue"), NULL, sizeof(FoldValue));
+    return 0;
+}
+
+int fold_constants(AST* ast, Semantic* sem, FoldStats* stats) {
+    Folder folder = {.ast = ast, .sem = sem, .stats = {0}, .track_globals = true};
+    unsigned int before = fold_count_nodes(ast);
+
+    // The top level of the file runs from top to bottom, skipping over the functions
+    FoldState script;
+    fold_state_init(&script, sem->script_local_count, sem->global_count);
+    AST_FOR_EACH_CHILD(ast, 0, item) {
+        if (ast_get(ast, item)->type != AST_FUNCTION) {
+            fold_statement(&folder, &script, item);
+        }
+    }
+    fold_state_free(&script);
+
+    folder.track_globals = false;
+    for (unsigned int i = 0; i < sem->functions.len; i++) {
+        SemanticFunction* function = &((SemanticFunction*)sem->functions.buf)[i];
+        FoldState state;
+        fold_state_init(&state, function->local_count, sem->global_count);
+
+        // Nothing is known about the parameters, and the body is the last child
+        unsigned int body = AST_NONE;
+        AST_FOR_EACH_CHILD(ast, function->node, child) {
+            body = child;
+        }
+        fold_statements(&folder, &state, ast_get(ast, body)->first_child);
+        fold_state_free(&state);
+    }
+
+    folder.stats.eliminated = before - fold_count_nodes(ast);
+    if (stats != NULL) {
+        *stats = folder.stats;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "parser.h"
+#include "semantic.h"
+
+// Constant folding and propagation over the tree. Arithmetic on constants is done at compile time, variables whose
+// value is known at a point in the code are replaced by that value, and if and while statements whose condition is
+// always the same are replaced by the part that actually runs. Anything after a return in a block is removed too.
+//
+// Since the tree is changed in place, the semantic pass has to have been run (without errors) first, and its info is
+// kept up to date for every node that is rewritten. Nodes that are cut out of the tree stay in the nodes array, they just
+// can't be reached from the root anymore.
+//
+// Note: ints are 32 bits, and wrap around on overflow. Division by 0 is never folded, so that it still fails when the program runs
+
+typedef struct FoldStats {
+    // Operators that were done at compile time
+    unsigned int folded;
+    // Uses of variables that were replaced by their value
+    unsigned int propagated;
+    // if, while, and for statements whose condition was known, so only one path was kept
+    unsigned int branches;
+    // How many fewer nodes can be reached from the root than before the pass
+    unsigned int eliminated;
+} FoldStats;
+
+// Registers the types used by this module. Should be called once before fold_constants
+int fold_module_init(void);
+
+// Runs the pass over the whole tree. stats can be NULL
+int fold_constants(AST* ast, Semantic* sem, FoldStats* stats);
+
+#endif
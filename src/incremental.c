@@ -0,0 +1,276 @@
+#include "incremental.h"
+#include "Cache.h"
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "DynamicArrayIO.h"
+#include "DynamicArrayAlgorithms.h"
+#include "HashMap.h"
+#include "Interner.h"
+#include "parser.h"
+#include "semantic.h"
+#include "Strings.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int incremental_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("IncrementalFunction"), NULL, sizeof(IncrementalFunction));
+    return 0;
+}
+
+static uint64_t incremental_align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+// Copies count elements of the given size from the data onto the end of the array
+static void incremental_copy(DynamicArray* arr, const char* from, unsigned int count) {
+    if (count == 0) {
+        return;
+    }
+    // This is called once per function, so the array grows by at least double to keep from reallocating every time. A new
+    // array has room for one element on paper but no buffer yet, so that counts as full too
+    if (arr->buf == NULL || arr->len + count > arr->__memsize) {
+        unsigned int size = arr->__memsize * 2 > arr->len + count ? arr->__memsize * 2 : arr->len + count;
+        dynamic_array_resize(arr, size, false);
+    }
+    memcpy((char*)arr->buf + (size_t)arr->len * arr->element_size, from, (size_t)count * arr->element_size);
+    arr->len += count;
+}
+
+// Loads the entry into the incremental. Everything is checked before anything is loaded, so a bad entry leaves it empty
+static int incremental_load(Incremental* inc, const void* data, size_t size) {
+    const char* in = (const char*)data;
+    if (size < sizeof(IncrementalFileHeader)) {
+        return -1;
+    }
+    IncrementalFileHeader header;
+    memcpy(&header, in, sizeof(header));
+    if (!file_section_fits(header.functions, header.function_count, sizeof(IncrementalFunction), 8, size) ||
+        !file_section_fits(header.dependencies, header.dependency_count, sizeof(SemanticDependency), 8, size) ||
+        !file_section_fits(header.info, header.node_count, sizeof(SemanticInfo), 8, size) ||
+        !file_section_fits(header.tree, header.tree_size, 1, 8, size) || header.tree_size < sizeof(AST_file_header)) {
+        return -1;
+    }
+
+    AST_file_header tree;
+    memcpy(&tree, in + header.tree, sizeof(tree));
+    if (tree.node_count != header.node_count) {
+        return -1;
+    }
+    const IncrementalFunction* functions = (const IncrementalFunction*)(in + header.functions);
+    for (unsigned int i = 0; i < header.function_count; i++) {
+        const AST_reusable_function* parse = &functions[i].parse;
+        if (parse->nodes_start >= parse->nodes_end || parse->nodes_end > tree.node_count || parse->ints_start > parse->ints_end ||
+            parse->ints_end > tree.int_count || parse->floats_start > parse->floats_end || parse->floats_end > tree.float_count ||
+            functions[i].dependencies_start > functions[i].dependencies_end || functions[i].dependencies_end > header.dependency_count) {
+            return -1;
+        }
+    }
+    const SemanticDependency* dependencies = (const SemanticDependency*)(in + header.dependencies);
+    for (unsigned int i = 0; i < header.dependency_count; i++) {
+        if (dependencies[i].symbol >= tree.symbol_count) {
+            return -1;
+        }
+    }
+
+    // The tree has no tokens of its own, since the locations of the functions count from wherever they end up in the file
+    DynamicArray tokens;
+    dynamic_array_init(&tokens, &STRING("token"));
+    int result = ast_deserialize(&inc->parse.arena, &tokens, in + header.tree, header.tree_size);
+    inc->parse.arena.tokens = NULL;
+    dynamic_array_free(&tokens);
+    if (result != 0) {
+        return -1;
+    }
+
+    incremental_copy(&inc->functions, (const char*)functions, header.function_count);
+    incremental_copy(&inc->dependencies, (const char*)dependencies, header.dependency_count);
+    incremental_copy(&inc->semantic.info, in + header.info, header.node_count);
+    for (unsigned int i = 0; i < header.function_count; i++) {
+        AST_reusable_function function = functions[i].parse;
+        unsigned long long hash = function.hash;
+        dynamic_array_append(&inc->parse.functions, &function);
+        hash_map_insert(&inc->parse.by_hash, &hash, &i);
+    }
+    return 0;
+}
+
+int incremental_open(Incremental* inc, Cache* cache, string* path) {
+    inc->cache = cache;
+    // The path is what stays the same from one run to the next, unlike the contents of the file
+    inc->key = cache_key(path->str, path->len, "functions");
+    ast_reuse_init(&inc->parse);
+    semantic_reuse_init(&inc->semantic);
+    dynamic_array_init(&inc->functions, &STRING("IncrementalFunction"));
+    dynamic_array_init(&inc->dependencies, &STRING("SemanticDependency"));
+
+    MappedFile entry;
+    const void* payload;
+    size_t size;
+    if (cache_lookup(cache, inc->key, &entry, &payload, &size) != 0) {
+        return -1;
+    }
+    int result = incremental_load(inc, payload, size);
+    cache_loaded(cache, inc->key, result == 0);
+    mapped_file_close(&entry);
+    return result;
+}
+
+int incremental_prepare(Incremental* inc, AST* ast) {
+    SemanticReuse* reuse = &inc->semantic;
+    reuse->functions.len = 0;
+    reuse->dependencies.len = 0;
+    IncrementalFunction* functions = (IncrementalFunction*)inc->functions.buf;
+
+    for (unsigned int i = 0; i < inc->parse.items.len; i++) {
+        AST_function_item* item = &((AST_function_item*)inc->parse.items.buf)[i];
+        if (item->reused == AST_NONE || !functions[item->reused].semantic) {
+            continue;
+        }
+
+        IncrementalFunction* function = &functions[item->reused];
+        SemanticReusable reusable = {.nodes_start = item->nodes_start, .node = item->nodes_end - 1, .local_count = function->local_count,
+                                     .info_start = function->parse.nodes_start, .dependencies_start = reuse->dependencies.len};
+        // The dependencies name things by their ids in the tree of the entry, which have to be turned into ids in the real tree.
+        // Every name a function depends on is used in the function, so it was interned when the function was copied in
+        bool found = true;
+        for (unsigned int j = function->dependencies_start; j < function->dependencies_end && found; j++) {
+            SemanticDependency dependency = ((SemanticDependency*)inc->dependencies.buf)[j];
+            dependency.symbol = interner_find(&ast->symbols, interner_get(&inc->parse.arena.symbols, dependency.symbol));
+            found = dependency.symbol != AST_NONE;
+            dynamic_array_append(&reuse->dependencies, &dependency);
+        }
+        if (!found) {
+            reuse->dependencies.len = reusable.dependencies_start;
+            continue;
+        }
+        reusable.dependencies_end = reuse->dependencies.len;
+        dynamic_array_append(&reuse->functions, &reusable);
+    }
+    return 0;
+}
+
+int incremental_save(Incremental* inc, AST* ast, Semantic* sem, DynamicArray* diagnostics) {
+    // Every function that had to be analyzed is either missing from the entry or out of date in it. That includes every
+    // function that had to be parsed, since those never have results to reuse
+    unsigned int stale = inc->semantic.analyzed;
+    if (stale == 0 || (uint64_t)stale * INCREMENTAL_REWRITE_FRACTION < inc->parse.items.len) {
+        return 0;
+    }
+
+    // The offsets of the errors are sorted so that they can be matched up with the functions (which are in order) in one pass
+    DynamicArray errors;
+    dynamic_array_init(&errors, &STRING("unsigned int"));
+    for (unsigned int i = 0; i < diagnostics->len; i++) {
+        Diagnostic* diagnostic = &((Diagnostic*)diagnostics->buf)[i];
+        if (diagnostic->severity == DIAG_ERROR) {
+            dynamic_array_append(&errors, &diagnostic->offset);
+        }
+    }
+    dynamic_array_radix_sort(&errors, 0, DA_TYPE_UNSIGNED_INT, NULL);
+
+    AST arena;
+    ast_init(&arena);
+    DynamicArray parsed;
+    dynamic_array_init(&parsed, &STRING("AST_reusable_function"));
+    ast_extract_functions(&arena, ast, &inc->parse.items, &parsed);
+
+    DynamicArray functions;
+    dynamic_array_init(&functions, &STRING("IncrementalFunction"));
+    DynamicArray dependencies;
+    dynamic_array_init(&dependencies, &STRING("SemanticDependency"));
+    DynamicArray info;
+    dynamic_array_init(&info, &STRING("SemanticInfo"));
+
+    token* tokens = (token*)ast->tokens->buf;
+    unsigned int* errorOffsets = (unsigned int*)errors.buf;
+    unsigned int nextError = 0;
+    for (unsigned int i = 0; i < inc->parse.items.len; i++) {
+        AST_function_item* item = &((AST_function_item*)inc->parse.items.buf)[i];
+        if (!item->clean) {
+            continue;
+        }
+
+        // Errors are reported at the token of the node they are about, so an error in the function is somewhere in its tokens
+        unsigned int first = tokens[item->tokens_start].offset;
+        unsigned int last = tokens[item->tokens_end - 1].offset;
+        while (nextError < errors.len && errorOffsets[nextError] < first) {
+            nextError++;
+        }
+        unsigned int node = item->nodes_end - 1;
+        IncrementalFunction function = {.parse = ((AST_reusable_function*)parsed.buf)[i], .local_count = 0,
+                                        .semantic = nextError == errors.len || errorOffsets[nextError] > last,
+                                        .dependencies_start = dependencies.len};
+        if (function.semantic) {
+            function.local_count = ((SemanticFunction*)sem->functions.buf)[semantic_get(sem, node)->slot].local_count;
+            unsigned int start = dependencies.len;
+            semantic_dependencies(sem, ast, node, &dependencies);
+            for (unsigned int j = start; j < dependencies.len; j++) {
+                SemanticDependency* dependency = &((SemanticDependency*)dependencies.buf)[j];
+                dependency->symbol = interner_find(&arena.symbols, interner_get(&ast->symbols, dependency->symbol));
+            }
+        }
+        function.dependencies_end = dependencies.len;
+        // The results are kept for every node even when they won't be used, so that they line up with the nodes of the tree
+        incremental_copy(&info, (const char*)semantic_get(sem, item->nodes_start), item->nodes_end - item->nodes_start);
+        dynamic_array_append(&functions, &function);
+    }
+
+    DynamicArray tree;
+    dynamic_array_init(&tree, &STRING("char"));
+    int result = -1;
+    if (arena.nodes.len > 0 && ast_serialize(&arena, &tree) == 0) {
+        IncrementalFileHeader header;
+        memset(&header, 0, sizeof(header));
+        header.function_count = functions.len;
+        header.dependency_count = dependencies.len;
+        header.node_count = arena.nodes.len;
+        header.functions = incremental_align(sizeof(header));
+        header.dependencies = incremental_align(header.functions + (uint64_t)functions.len * sizeof(IncrementalFunction));
+        header.info = incremental_align(header.dependencies + (uint64_t)dependencies.len * sizeof(SemanticDependency));
+        header.tree = incremental_align(header.info + (uint64_t)info.len * sizeof(SemanticInfo));
+        header.tree_size = tree.len;
+
+        size_t total = header.tree + header.tree_size;
+        char* out = (char*)calloc(total, 1);
+        if (out == NULL) {
+            printf("Failed to allocate memory in incremental_save\n");
+            exit(-1);
+        }
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + header.functions, functions.buf, (size_t)functions.len * sizeof(IncrementalFunction));
+        if (dependencies.len > 0) {
+            memcpy(out + header.dependencies, dependencies.buf, (size_t)dependencies.len * sizeof(SemanticDependency));
+        }
+        memcpy(out + header.info, info.buf, (size_t)info.len * sizeof(SemanticInfo));
+        memcpy(out + header.tree, tree.buf, tree.len);
+        result = cache_store(inc->cache, inc->key, out, total);
+        free(out);
+    }
+
+    dynamic_array_free(&tree);
+    dynamic_array_free(&info);
+    dynamic_array_free(&dependencies);
+    dynamic_array_free(&functions);
+    dynamic_array_free(&parsed);
+    dynamic_array_free(&errors);
+    ast_free(&arena);
+    return result;
+}
+
+int incremental_free(Incremental* inc) {
+    ast_reuse_free(&inc->parse);
+    semantic_reuse_free(&inc->semantic);
+    dynamic_array_free(&inc->functions);
+    dynamic_array_free(&inc->dependencies);
+    return 0;
+}
+
+int incremental_print_stats(Incremental* inc) {
+    unsigned int functions = inc->parse.reused + inc->parse.parsed;
+    printf("incremental: %u of %u functions reused by the parser, %u of %u by the semantic pass\n", inc->parse.reused, functions,
+           inc->semantic.reused, inc->semantic.reused + inc->semantic.analyzed);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+#include "Cache.h"
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "parser.h"
+#include "semantic.h"
+#include "Strings.h"
+
+// Remembers every function of a file between runs, so that after an edit only the functions that changed are parsed again,
+// and only the functions that changed or use something that changed are analyzed again. Everything is kept in one entry of
+// the cache per file (keyed by its path rather than its contents, since the contents are what changes between runs).
+// A function is matched up with its entry by the hash of its tokens, so moving it around in the file or changing the
+// functions around it doesn't stop it from being reused
+
+// Writing the entry costs about as much as parsing the whole file, so it isn't written again after every change. Functions
+// that aren't in the entry (or are out of date in it) just get parsed and analyzed like they would without it, so the entry
+// is only written again once at least 1 out of this many functions had to be
+#define INCREMENTAL_REWRITE_FRACTION 16
+
+// A function as it is kept in the entry
+typedef struct IncrementalFunction {
+    // Where the function is in the tree of the entry
+    AST_reusable_function parse;
+    uint32_t local_count;
+    // Whether the semantic results of the function were kept. They aren't when the semantic pass found errors in it
+    uint32_t semantic;
+    // The range of its SemanticDependencies in the entry, from start up to, but not including, end. The symbols of the
+    // dependencies are names in the tree of the entry
+    uint32_t dependencies_start, dependencies_end;
+} IncrementalFunction;
+
+// The entry starts with this, followed by the functions, the dependencies, a SemanticInfo for every node of the tree,
+// and finally the tree itself (as made by ast_serialize). Each section starts at an offset that is a multiple of 8
+typedef struct IncrementalFileHeader {
+    uint32_t function_count;
+    uint32_t dependency_count;
+    uint32_t node_count;
+    uint32_t __padding;
+    uint64_t functions;
+    uint64_t dependencies;
+    uint64_t info;
+    uint64_t tree;
+    uint64_t tree_size;
+} IncrementalFileHeader;
+
+typedef struct Incremental {
+    Cache* cache;
+    uint64_t key;
+    // Given to ast_generate and semantic_analyze
+    AST_reuse parse;
+    SemanticReuse semantic;
+    // Of type IncrementalFunction, in the same order as the functions of parse
+    DynamicArray functions;
+    // Of type SemanticDependency
+    DynamicArray dependencies;
+} Incremental;
+
+// Registers the types used by this module. Should be called once after semantic_module_init
+int incremental_module_init(void);
+
+// Loads what was kept about the functions of the file at path the last time it was compiled with this cache.
+// Returns -1 if nothing was kept, in which case every function will be parsed and analyzed, but the incremental
+// still has to be freed
+int incremental_open(Incremental* inc, Cache* cache, string* path);
+
+// Works out which functions can have their semantic results reused. Has to be called after ast_generate was given inc->parse,
+// and before semantic_analyze is given inc->semantic
+int incremental_prepare(Incremental* inc, AST* ast);
+
+// Keeps every function that had no errors for the next run, if enough has changed since the entry was last written
+// (see INCREMENTAL_REWRITE_FRACTION). Has to be called after semantic_analyze, before anything (like constant folding)
+// changes the tree
+int incremental_save(Incremental* inc, AST* ast, Semantic* sem, DynamicArray* diagnostics);
+
+int incremental_free(Incremental* inc);
+
+// Prints how many functions were reused by the parser and by the semantic pass
+int incremental_print_stats(Incremental* inc);
+
+#endif
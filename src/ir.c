@@ -0,0 +1,1198 @@
+#include "ir.h"
+#include "DynamicArray.h"
+#include "HashMap.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern inline IR_instr* ir_instr(IR_function* fn, unsigned int value);
+extern inline IR_block* ir_block(IR_function* fn, unsigned int block);
+extern inline IR_function* ir_function(IR_module* module, unsigned int function);
+extern inline uint32_t* ir_operand(IR_function* fn, unsigned int value, unsigned int n);
+
+// A phi that was made in a block before all of the predecessors of the block were known. Its operands are filled in
+// once the block is sealed
+typedef struct IR_incomplete_phi {
+    unsigned int block;
+    unsigned int slot;
+    unsigned int phi;
+} IR_incomplete_phi;
+
+typedef struct IR_builder {
+    IR_module* module;
+    IR_function* fn;
+    AST* ast;
+    Semantic* sem;
+    // The block new instructions go into, or IR_NONE when the code being lowered can't be reached (after a return)
+    unsigned int block;
+    unsigned int loop_depth;
+    // The offset of the statement being lowered, which every instruction made by ir_emit gets
+    unsigned int offset;
+    // The value each local has at the end of each block, keyed by (block << 32) | slot
+    HashMap defs;
+    // Whether every predecessor of each block is known yet (of type bool)
+    DynamicArray sealed;
+    // Of type IR_incomplete_phi
+    DynamicArray incomplete;
+} IR_builder;
+
+// Small helpers for the lists of unsigned ints in blocks. These shift the elements directly, since the general purpose
+// insert and remove of DynamicArray copy the tail of the array into a new one
+static void ir_list_insert(DynamicArray* list, unsigned int index, unsigned int value) {
+    dynamic_array_append(list, &value);
+    unsigned int* items = (unsigned int*)list->buf;
+    memmove(&items[index + 1], &items[index], (list->len - 1 - index) * sizeof(unsigned int));
+    items[index] = value;
+}
+
+static void ir_list_remove(DynamicArray* list, unsigned int index) {
+    unsigned int* items = (unsigned int*)list->buf;
+    memmove(&items[index], &items[index + 1], (list->len - 1 - index) * sizeof(unsigned int));
+    list->len--;
+}
+
+// Returns where the value is in the list, or IR_NONE if it isn't in it
+static unsigned int ir_list_find(DynamicArray* list, unsigned int value) {
+    for (unsigned int i = 0; i < list->len; i++) {
+        if (((unsigned int*)list->buf)[i] == value) {
+            return i;
+        }
+    }
+    return IR_NONE;
+}
+
+int ir_block_deallocator(void* block) {
+    dynamic_array_free(&((IR_block*)block)->instrs);
+    dynamic_array_free(&((IR_block*)block)->preds);
+    return 0;
+}
+
+int ir_function_deallocator(void* function) {
+    IR_function* fn = (IR_function*)function;
+    dynamic_array_free(&fn->blocks);
+    dynamic_array_free(&fn->instrs);
+    dynamic_array_free(&fn->operands);
+    dynamic_array_free(&fn->floats);
+    dynamic_array_free(&fn->rpo);
+    return 0;
+}
+
+int ir_deallocator(void* module) {
+    return ir_free((IR_module*)module);
+}
+
+int ir_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("IR_instr"), NULL, sizeof(IR_instr));
+    dynamic_array_registry_type_append(&STRING("IR_block"), ir_block_deallocator, sizeof(IR_block));
+    dynamic_array_registry_type_append(&STRING("IR_function"), ir_function_deallocator, sizeof(IR_function));
+    dynamic_array_registry_type_append(&STRING("IR_module"), ir_deallocator, sizeof(IR_module));
+    dynamic_array_registry_type_append(&STRING("IR_incomplete_phi"), NULL, sizeof(IR_incomplete_phi));
+    dynamic_array_registry_type_append(&STRING("IR_loop_report"), NULL, sizeof(IR_loop_report));
+    return 0;
+}
+
+int ir_init(IR_module* module) {
+    dynamic_array_init(&module->functions, &STRING("IR_function"));
+    dynamic_array_init(&module->global_types, &STRING("unsigned int"));
+    dynamic_array_init(&module->loop_reports, &STRING("IR_loop_report"));
+    module->script = 0;
+    module->global_count = 0;
+    module->symbols = NULL;
+    return 0;
+}
+
+int ir_free(IR_module* module) {
+    dynamic_array_free(&module->functions);
+    dynamic_array_free(&module->global_types);
+    dynamic_array_free(&module->loop_reports);
+    return 0;
+}
+
+static void ir_function_init(IR_function* fn, unsigned int symbol, unsigned int paramCount, unsigned int returnType) {
+    fn->symbol = symbol;
+    fn->param_count = paramCount;
+    fn->return_type = returnType;
+    dynamic_array_init(&fn->blocks, &STRING("IR_block"));
+    dynamic_array_init(&fn->instrs, &STRING("IR_instr"));
+    dynamic_array_init(&fn->operands, &STRING("unsigned int"));
+    dynamic_array_init(&fn->floats, &STRING("double"));
+    dynamic_array_init(&fn->rpo, &STRING("unsigned int"));
+}
+
+bool ir_is_terminator(unsigned int op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+bool ir_has_side_effects(IR_instr* instr) {
+    switch (instr->op) {
+        case IR_STORE_GLOBAL:
+        case IR_CALL:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN:
+            return true;
+        case IR_DIV:
+            return instr->type == SEM_TYPE_INT;
+    }
+    return false;
+}
+
+unsigned int ir_add_block(IR_function* fn) {
+    IR_block block = {.succs = {IR_NONE, IR_NONE}, .idom = IR_NONE, .rpo_index = IR_NONE, .loop_depth = 0, .offset = IR_NONE};
+    dynamic_array_init(&block.instrs, &STRING("unsigned int"));
+    dynamic_array_init(&block.preds, &STRING("unsigned int"));
+    dynamic_array_append(&fn->blocks, &block);
+    return fn->blocks.len - 1;
+}
+
+unsigned int ir_add_instr(IR_function* fn, unsigned int block, unsigned int op, unsigned int type, uint32_t* operands, unsigned int count) {
+    IR_instr instr = {.op = op, .type = type, .flags = 0, .block = block, .operands_start = fn->operands.len, .operand_count = count, .imm.index = 0,
+                      .offset = IR_NONE};
+    for (unsigned int i = 0; i < count; i++) {
+        dynamic_array_append(&fn->operands, &operands[i]);
+    }
+    unsigned int value = fn->instrs.len;
+    dynamic_array_append(&fn->instrs, &instr);
+
+    if (block != IR_NONE) {
+        DynamicArray* instrs = &ir_block(fn, block)->instrs;
+        unsigned int at = instrs->len;
+        if (at > 0 && ir_is_terminator(ir_instr(fn, ((unsigned int*)instrs->buf)[at - 1])->op)) {
+            at--;
+        }
+        ir_list_insert(instrs, at, value);
+    }
+    return value;
+}
+
+void ir_add_edge(IR_function* fn, unsigned int from, unsigned int to) {
+    IR_block* source = ir_block(fn, from);
+    source->succs[source->succs[0] == IR_NONE ? 0 : 1] = to;
+    dynamic_array_append(&ir_block(fn, to)->preds, &from);
+}
+
+void ir_remove_edge(IR_function* fn, unsigned int from, unsigned int to) {
+    IR_block* source = ir_block(fn, from);
+    if (source->succs[0] == to) {
+        source->succs[0] = source->succs[1];
+        source->succs[1] = IR_NONE;
+    } else if (source->succs[1] == to) {
+        source->succs[1] = IR_NONE;
+    }
+
+    IR_block* dest = ir_block(fn, to);
+    unsigned int index = ir_list_find(&dest->preds, from);
+    if (index == IR_NONE) {
+        return;
+    }
+    ir_list_remove(&dest->preds, index);
+
+    for (unsigned int i = 0; i < dest->instrs.len; i++) {
+        unsigned int value = ((unsigned int*)dest->instrs.buf)[i];
+        IR_instr* phi = ir_instr(fn, value);
+        if (phi->op != IR_PHI) {
+            break;
+        }
+        uint32_t* operands = ir_operand(fn, value, 0);
+        memmove(&operands[index], &operands[index + 1], (phi->operand_count - 1 - index) * sizeof(uint32_t));
+        phi->operand_count--;
+    }
+}
+
+void ir_insert_instr(IR_function* fn, unsigned int value, unsigned int block, unsigned int index) {
+    ir_instr(fn, value)->block = block;
+    ir_list_insert(&ir_block(fn, block)->instrs, index, value);
+}
+
+void ir_move_instr(IR_function* fn, unsigned int value, unsigned int block) {
+    IR_instr* instr = ir_instr(fn, value);
+    DynamicArray* from = &ir_block(fn, instr->block)->instrs;
+    ir_list_remove(from, ir_list_find(from, value));
+
+    DynamicArray* to = &ir_block(fn, block)->instrs;
+    unsigned int at = to->len;
+    if (at > 0 && ir_is_terminator(ir_instr(fn, ((unsigned int*)to->buf)[at - 1])->op)) {
+        at--;
+    }
+    ir_insert_instr(fn, value, block, at);
+}
+
+void ir_add_phi_operand(IR_function* fn, unsigned int phi, unsigned int operand) {
+    // The operands of an instruction have to be next to each other, so they are all moved to the end of the array
+    unsigned int start = fn->operands.len;
+    unsigned int count = ir_instr(fn, phi)->operand_count;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int existing = *ir_operand(fn, phi, i);
+        dynamic_array_append(&fn->operands, &existing);
+    }
+    dynamic_array_append(&fn->operands, &operand);
+    IR_instr* instr = ir_instr(fn, phi);
+    instr->operands_start = start;
+    instr->operand_count = count + 1;
+}
+
+void ir_remove_instr(IR_function* fn, unsigned int value) {
+    IR_instr* instr = ir_instr(fn, value);
+    if (instr->block != IR_NONE) {
+        DynamicArray* instrs = &ir_block(fn, instr->block)->instrs;
+        unsigned int index = ir_list_find(instrs, value);
+        if (index != IR_NONE) {
+            ir_list_remove(instrs, index);
+        }
+    }
+    instr->op = IR_NOP;
+    instr->type = SEM_TYPE_NONE;
+    instr->block = IR_NONE;
+    instr->operand_count = 0;
+}
+
+// Returns the number of phis at the start of the block
+static unsigned int ir_phi_count(IR_function* fn, unsigned int block) {
+    DynamicArray* instrs = &ir_block(fn, block)->instrs;
+    unsigned int count = 0;
+    while (count < instrs->len && ir_instr(fn, ((unsigned int*)instrs->buf)[count])->op == IR_PHI) {
+        count++;
+    }
+    return count;
+}
+
+// Called before the op of a phi is changed to something else, to move it to just after the other phis of its block
+static void ir_unphi(IR_function* fn, unsigned int value) {
+    IR_instr* instr = ir_instr(fn, value);
+    if (instr->op != IR_PHI || instr->block == IR_NONE) {
+        return;
+    }
+    DynamicArray* instrs = &ir_block(fn, instr->block)->instrs;
+    ir_list_remove(instrs, ir_list_find(instrs, value));
+    // The instruction is still a phi at this point, so it has to be taken out before counting
+    ir_list_insert(instrs, ir_phi_count(fn, instr->block), value);
+}
+
+void ir_replace_with_copy(IR_function* fn, unsigned int value, unsigned int source) {
+    ir_unphi(fn, value);
+    IR_instr* instr = ir_instr(fn, value);
+    instr->op = IR_COPY;
+    instr->operands_start = fn->operands.len;
+    instr->operand_count = 1;
+    dynamic_array_append(&fn->operands, &source);
+}
+
+void ir_replace_with_int(IR_function* fn, unsigned int value, int32_t i) {
+    ir_unphi(fn, value);
+    IR_instr* instr = ir_instr(fn, value);
+    instr->op = IR_CONST_INT;
+    instr->type = SEM_TYPE_INT;
+    instr->operand_count = 0;
+    instr->imm.i = i;
+}
+
+void ir_replace_with_float(IR_function* fn, unsigned int value, double f) {
+    ir_unphi(fn, value);
+    IR_instr* instr = ir_instr(fn, value);
+    instr->op = IR_CONST_FLOAT;
+    instr->type = SEM_TYPE_FLOAT;
+    instr->operand_count = 0;
+    instr->imm.index = fn->floats.len;
+    dynamic_array_append(&fn->floats, &f);
+}
+
+void ir_replace_with_string(IR_function* fn, unsigned int value, unsigned int symbol) {
+    ir_unphi(fn, value);
+    IR_instr* instr = ir_instr(fn, value);
+    instr->op = IR_CONST_STRING;
+    instr->type = SEM_TYPE_STRING;
+    instr->operand_count = 0;
+    instr->imm.index = symbol;
+}
+
+unsigned int ir_resolve(IR_function* fn, unsigned int value) {
+    // The limit is only there so a cycle of copies (which can only come from code that can't be reached) can't hang this
+    for (unsigned int i = 0; i < fn->instrs.len && ir_instr(fn, value)->op == IR_COPY; i++) {
+        value = *ir_operand(fn, value, 0);
+    }
+    return value;
+}
+
+unsigned int ir_instr_count(IR_function* fn) {
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < fn->blocks.len; i++) {
+        count += ir_block(fn, i)->instrs.len;
+    }
+    return count;
+}
+
+unsigned int ir_block_count(IR_function* fn) {
+    return fn->rpo.len;
+}
+
+// Removes every instruction and edge of a block that can't be reached. The block itself stays in the blocks array so
+// the indices of the others don't change
+static void ir_kill_block(IR_function* fn, unsigned int block) {
+    IR_block* b = ir_block(fn, block);
+    while (b->succs[0] != IR_NONE) {
+        ir_remove_edge(fn, block, b->succs[0]);
+        b = ir_block(fn, block);
+    }
+    while (b->instrs.len > 0) {
+        ir_remove_instr(fn, ((unsigned int*)b->instrs.buf)[b->instrs.len - 1]);
+    }
+    b->preds.len = 0;
+    b->idom = IR_NONE;
+    b->rpo_index = IR_NONE;
+}
+
+// Finds the closest block that dominates both a and b, using the dominators found so far
+static unsigned int ir_intersect(IR_function* fn, unsigned int a, unsigned int b) {
+    while (a != b) {
+        while (ir_block(fn, a)->rpo_index > ir_block(fn, b)->rpo_index) {
+            a = ir_block(fn, a)->idom;
+        }
+        while (ir_block(fn, b)->rpo_index > ir_block(fn, a)->rpo_index) {
+            b = ir_block(fn, b)->idom;
+        }
+    }
+    return a;
+}
+
+int ir_compute_dominators(IR_function* fn) {
+    unsigned int count = fn->blocks.len;
+    for (unsigned int i = 0; i < count; i++) {
+        ir_block(fn, i)->rpo_index = IR_NONE;
+        ir_block(fn, i)->idom = IR_NONE;
+    }
+
+    // Finds the postorder with a depth first search. Each entry on the stack is a block and the next successor to visit
+    DynamicArray stack;
+    dynamic_array_init(&stack, &STRING("unsigned int"));
+    DynamicArray postorder;
+    dynamic_array_init(&postorder, &STRING("unsigned int"));
+    // rpo_index is used to mark blocks as visited during the search, and gets its real value after
+    unsigned int visiting = 0, zero = 0;
+    ir_block(fn, 0)->rpo_index = visiting;
+    dynamic_array_append(&stack, &visiting);
+    dynamic_array_append(&stack, &zero);
+    while (stack.len > 0) {
+        unsigned int block = ((unsigned int*)stack.buf)[stack.len - 2];
+        unsigned int* next = &((unsigned int*)stack.buf)[stack.len - 1];
+        IR_block* b = ir_block(fn, block);
+        if (*next < 2 && b->succs[*next] != IR_NONE) {
+            unsigned int succ = b->succs[(*next)++];
+            if (ir_block(fn, succ)->rpo_index == IR_NONE) {
+                ir_block(fn, succ)->rpo_index = visiting;
+                dynamic_array_append(&stack, &succ);
+                dynamic_array_append(&stack, &zero);
+            }
+            continue;
+        }
+        dynamic_array_append(&postorder, &block);
+        stack.len -= 2;
+    }
+    dynamic_array_free(&stack);
+
+    fn->rpo.len = 0;
+    for (unsigned int i = postorder.len; i > 0; i--) {
+        unsigned int block = ((unsigned int*)postorder.buf)[i - 1];
+        ir_block(fn, block)->rpo_index = fn->rpo.len;
+        dynamic_array_append(&fn->rpo, &block);
+    }
+    dynamic_array_free(&postorder);
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (ir_block(fn, i)->rpo_index == IR_NONE) {
+            ir_kill_block(fn, i);
+        }
+    }
+
+    // Every block's dominator is refined until nothing changes. Going in reverse postorder means this usually only
+    // takes two rounds
+    unsigned int* rpo = (unsigned int*)fn->rpo.buf;
+    ir_block(fn, 0)->idom = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int i = 1; i < fn->rpo.len; i++) {
+            IR_block* b = ir_block(fn, rpo[i]);
+            unsigned int idom = IR_NONE;
+            for (unsigned int p = 0; p < b->preds.len; p++) {
+                unsigned int pred = ((unsigned int*)b->preds.buf)[p];
+                if (ir_block(fn, pred)->idom == IR_NONE) {
+                    continue;
+                }
+                idom = idom == IR_NONE ? pred : ir_intersect(fn, pred, idom);
+            }
+            if (b->idom != idom) {
+                b->idom = idom;
+                changed = true;
+            }
+        }
+    }
+    ir_block(fn, 0)->idom = IR_NONE;
+    return 0;
+}
+
+bool ir_dominates(IR_function* fn, unsigned int a, unsigned int b) {
+    while (b != IR_NONE) {
+        if (a == b) {
+            return true;
+        }
+        b = ir_block(fn, b)->idom;
+    }
+    return false;
+}
+
+// Building the SSA form.
+// Every local slot is treated as a variable, and the value it has at the end of each block is recorded in defs. Reading
+// a variable in a block that doesn't set it looks for the value in the predecessors, adding a phi if there is more than
+// one. Blocks whose predecessors aren't all known yet (loop headers before the end of the loop) get a phi with no
+// operands that is filled in when the block is sealed
+
+static uint64_t ir_def_key(unsigned int block, unsigned int slot) {
+    return ((uint64_t)block << 32) | slot;
+}
+
+static void ir_write_variable(IR_builder* b, unsigned int slot, unsigned int block, unsigned int value) {
+    uint64_t key = ir_def_key(block, slot);
+    hash_map_insert(&b->defs, &key, &value);
+}
+
+static unsigned int ir_constant_int(IR_function* fn, unsigned int block, int32_t i) {
+    unsigned int value = ir_add_instr(fn, block, IR_CONST_INT, SEM_TYPE_INT, NULL, 0);
+    ir_instr(fn, value)->imm.i = i;
+    return value;
+}
+
+static unsigned int ir_constant_float(IR_function* fn, unsigned int block, double f) {
+    unsigned int value = ir_add_instr(fn, block, IR_CONST_FLOAT, SEM_TYPE_FLOAT, NULL, 0);
+    ir_instr(fn, value)->imm.index = fn->floats.len;
+    dynamic_array_append(&fn->floats, &f);
+    return value;
+}
+
+static unsigned int ir_constant_string(IR_function* fn, unsigned int block, unsigned int symbol) {
+    unsigned int value = ir_add_instr(fn, block, IR_CONST_STRING, SEM_TYPE_STRING, NULL, 0);
+    ir_instr(fn, value)->imm.index = symbol;
+    return value;
+}
+
+// The value a variable has when it is declared without one
+static unsigned int ir_default_value(IR_builder* b, unsigned int block, unsigned int type) {
+    if (type == SEM_TYPE_STRING) {
+        return ir_constant_string(b->fn, block, interner_intern(b->module->symbols, &STRING("")));
+    } else if (type == SEM_TYPE_FLOAT) {
+        return ir_constant_float(b->fn, block, 0.0);
+    }
+    return ir_constant_int(b->fn, block, 0);
+}
+
+static unsigned int ir_add_phi(IR_function* fn, unsigned int block, unsigned int type) {
+    unsigned int value = ir_add_instr(fn, IR_NONE, IR_PHI, type, NULL, 0);
+    ir_instr(fn, value)->block = block;
+    ir_list_insert(&ir_block(fn, block)->instrs, 0, value);
+    return value;
+}
+
+// A phi whose operands are all the same value (or the phi itself) isn't needed, so it becomes a copy of that value
+static unsigned int ir_try_remove_trivial_phi(IR_builder* b, unsigned int phi) {
+    IR_function* fn = b->fn;
+    unsigned int same = IR_NONE;
+    for (unsigned int i = 0; i < ir_instr(fn, phi)->operand_count; i++) {
+        unsigned int operand = ir_resolve(fn, *ir_operand(fn, phi, i));
+        if (operand == same || operand == phi) {
+            continue;
+        } else if (same != IR_NONE) {
+            return phi;
+        }
+        same = operand;
+    }
+
+    if (same == IR_NONE) {
+        // The variable is never set on any path here, which can only happen in code that can't be reached. The value goes
+        // in the entry block, since the copy made below has to come before anything else in this block
+        same = ir_default_value(b, 0, ir_instr(fn, phi)->type);
+    }
+    ir_replace_with_copy(fn, phi, same);
+    return same;
+}
+
+static unsigned int ir_read_variable(IR_builder* b, unsigned int slot, unsigned int block, unsigned int type);
+
+static unsigned int ir_add_phi_operands(IR_builder* b, unsigned int phi, unsigned int slot) {
+    IR_function* fn = b->fn;
+    unsigned int block = ir_instr(fn, phi)->block;
+    unsigned int type = ir_instr(fn, phi)->type;
+
+    // Reading from the predecessors can add operands for other phis, so this phi's are collected first and then added
+    // all at once to keep them next to each other
+    DynamicArray operands;
+    dynamic_array_init(&operands, &STRING("unsigned int"));
+    for (unsigned int i = 0; i < ir_block(fn, block)->preds.len; i++) {
+        unsigned int pred = ((unsigned int*)ir_block(fn, block)->preds.buf)[i];
+        unsigned int value = ir_read_variable(b, slot, pred, type);
+        dynamic_array_append(&operands, &value);
+    }
+
+    IR_instr* instr = ir_instr(fn, phi);
+    instr->operands_start = fn->operands.len;
+    instr->operand_count = operands.len;
+    for (unsigned int i = 0; i < operands.len; i++) {
+        dynamic_array_append(&fn->operands, &((unsigned int*)operands.buf)[i]);
+    }
+    dynamic_array_free(&operands);
+    return ir_try_remove_trivial_phi(b, phi);
+}
+
+static unsigned int ir_read_variable(IR_builder* b, unsigned int slot, unsigned int block, unsigned int type) {
+    uint64_t key = ir_def_key(block, slot);
+    unsigned int* known = hash_map_get(&b->defs, &key);
+    if (known != NULL) {
+        return *known;
+    }
+
+    IR_function* fn = b->fn;
+    IR_block* blk = ir_block(fn, block);
+    unsigned int value;
+    if (!((bool*)b->sealed.buf)[block]) {
+        value = ir_add_phi(fn, block, type);
+        IR_incomplete_phi incomplete = {.block = block, .slot = slot, .phi = value};
+        dynamic_array_append(&b->incomplete, &incomplete);
+    } else if (blk->preds.len == 1) {
+        value = ir_read_variable(b, slot, ((unsigned int*)blk->preds.buf)[0], type);
+    } else if (blk->preds.len == 0) {
+        // Only possible in code that can't be reached
+        value = ir_default_value(b, block, type);
+    } else {
+        // Recording the phi before looking at the predecessors stops loops from recursing forever
+        value = ir_add_phi(fn, block, type);
+        ir_write_variable(b, slot, block, value);
+        value = ir_add_phi_operands(b, value, slot);
+    }
+    ir_write_variable(b, slot, block, value);
+    return value;
+}
+
+// Marks that every predecessor of the block is now known, which finishes off the phis that were waiting on that
+static void ir_seal_block(IR_builder* b, unsigned int block) {
+    ((bool*)b->sealed.buf)[block] = true;
+    unsigned int i = 0;
+    while (i < b->incomplete.len) {
+        IR_incomplete_phi incomplete = ((IR_incomplete_phi*)b->incomplete.buf)[i];
+        if (incomplete.block != block) {
+            i++;
+            continue;
+        }
+        ((IR_incomplete_phi*)b->incomplete.buf)[i] = ((IR_incomplete_phi*)b->incomplete.buf)[b->incomplete.len - 1];
+        b->incomplete.len--;
+        ir_add_phi_operands(b, incomplete.phi, incomplete.slot);
+    }
+}
+
+static unsigned int ir_new_block(IR_builder* b) {
+    unsigned int block = ir_add_block(b->fn);
+    ir_block(b->fn, block)->loop_depth = b->loop_depth;
+    bool sealed = false;
+    dynamic_array_append(&b->sealed, &sealed);
+    return block;
+}
+
+static unsigned int ir_emit(IR_builder* b, unsigned int op, unsigned int type, uint32_t* operands, unsigned int count) {
+    unsigned int value = ir_add_instr(b->fn, b->block, op, type, operands, count);
+    ir_instr(b->fn, value)->offset = b->offset;
+    return value;
+}
+
+// Ends the current block with a jump to another one
+static void ir_jump(IR_builder* b, unsigned int to) {
+    if (b->block == IR_NONE) {
+        return;
+    }
+    ir_emit(b, IR_JUMP, SEM_TYPE_NONE, NULL, 0);
+    ir_add_edge(b->fn, b->block, to);
+    b->block = IR_NONE;
+}
+
+static unsigned int ir_convert(IR_builder* b, unsigned int value, unsigned int type) {
+    unsigned int from = ir_instr(b->fn, value)->type;
+    if (from == SEM_TYPE_INT && type == SEM_TYPE_FLOAT) {
+        return ir_emit(b, IR_INT_TO_FLOAT, SEM_TYPE_FLOAT, &value, 1);
+    } else if (from == SEM_TYPE_FLOAT && type == SEM_TYPE_INT) {
+        return ir_emit(b, IR_FLOAT_TO_INT, SEM_TYPE_INT, &value, 1);
+    }
+    return value;
+}
+
+// Returns the IR op for one of the operators of the language
+static unsigned int ir_operator(unsigned int op, unsigned int type) {
+    switch (op) {
+        case OP_PLUS:
+        case OP_PLUS_EQUAL:
+            return type == SEM_TYPE_STRING ? IR_CONCAT : IR_ADD;
+        case OP_MINUS:
+        case OP_MINUS_EQUAL:
+            return IR_SUB;
+        case OP_MULT:
+        case OP_MULT_EQUAL:
+            return IR_MUL;
+        case OP_DIV:
+        case OP_DIV_EQUAL:
+            return IR_DIV;
+        case OP_LESS:
+            return IR_LT;
+        case OP_LESS_EQUAL:
+            return IR_LE;
+        case OP_GREATER:
+            return IR_GT;
+        case OP_GREATER_EQUAL:
+            return IR_GE;
+        case OP_EQUAL_EQUAL:
+            return IR_EQ;
+        case OP_NOT_EQUAL:
+            return IR_NE;
+    }
+    return IR_NOP;
+}
+
+// Does an operator on two values, converting them to the same type first
+static unsigned int ir_binary(IR_builder* b, unsigned int op, unsigned int resultType, unsigned int l, unsigned int r) {
+    unsigned int lType = ir_instr(b->fn, l)->type;
+    unsigned int rType = ir_instr(b->fn, r)->type;
+    unsigned int type = lType == SEM_TYPE_FLOAT || rType == SEM_TYPE_FLOAT ? SEM_TYPE_FLOAT : lType;
+    uint32_t operands[2] = {ir_convert(b, l, type), ir_convert(b, r, type)};
+    return ir_emit(b, ir_operator(op, type), resultType, operands, 2);
+}
+
+static unsigned int ir_lower_expression(IR_builder* b, unsigned int index);
+
+static unsigned int ir_read(IR_builder* b, unsigned int node) {
+    SemanticInfo* info = semantic_get(b->sem, node);
+    if (info->kind == SEM_KIND_GLOBAL) {
+        unsigned int value = ir_emit(b, IR_LOAD_GLOBAL, info->type, NULL, 0);
+        ir_instr(b->fn, value)->imm.index = info->slot;
+        return value;
+    }
+    return ir_read_variable(b, info->slot, b->block, info->type);
+}
+
+// Stores a value (already of the right type) in the variable that the node declares or refers to
+static void ir_write(IR_builder* b, unsigned int node, unsigned int value) {
+    SemanticInfo* info = semantic_get(b->sem, node);
+    if (info->kind == SEM_KIND_GLOBAL) {
+        unsigned int store = ir_emit(b, IR_STORE_GLOBAL, SEM_TYPE_NONE, &value, 1);
+        ir_instr(b->fn, store)->imm.index = info->slot;
+        return;
+    }
+    ir_write_variable(b, info->slot, b->block, value);
+}
+
+static unsigned int ir_lower_call(IR_builder* b, unsigned int index) {
+    SemanticInfo* info = semantic_get(b->sem, index);
+    SemanticFunction* function = &((SemanticFunction*)b->sem->functions.buf)[info->slot];
+
+    DynamicArray args;
+    dynamic_array_init(&args, &STRING("unsigned int"));
+    unsigned int param = ast_get(b->ast, function->node)->first_child;
+    AST_FOR_EACH_CHILD(b->ast, index, arg) {
+        unsigned int value = ir_convert(b, ir_lower_expression(b, arg), semantic_get(b->sem, param)->type);
+        dynamic_array_append(&args, &value);
+        param = ast_get(b->ast, param)->next_sibling;
+    }
+
+    unsigned int value = ir_emit(b, IR_CALL, function->return_type, (uint32_t*)args.buf, args.len);
+    ir_instr(b->fn, value)->imm.index = info->slot;
+    dynamic_array_free(&args);
+    return value;
+}
+
+static unsigned int ir_lower_expression(IR_builder* b, unsigned int index) {
+    AST_node* node = ast_get(b->ast, index);
+    unsigned int type = semantic_get(b->sem, index)->type;
+    switch (node->type) {
+        case AST_INT_CONSTANT:
+            return ir_constant_int(b->fn, b->block, (int32_t)(uint32_t)ast_int_value(b->ast, index));
+        case AST_FLOAT_CONSTANT:
+            return ir_constant_float(b->fn, b->block, ast_float_value(b->ast, index));
+        case AST_STRING_CONSTANT:
+            return ir_constant_string(b->fn, b->block, node->payload.symbol);
+
+        case AST_VARIABLE:
+            return ir_read(b, index);
+
+        case AST_EXPRESSION:
+        case AST_COMPARISON: {
+            unsigned int op = node->data;
+            unsigned int right = ast_get(b->ast, node->first_child)->next_sibling;
+            unsigned int l = ir_lower_expression(b, node->first_child);
+            unsigned int r = ir_lower_expression(b, right);
+            return ir_binary(b, op, type, l, r);
+        }
+
+        case AST_UNARY: {
+            unsigned int operand = ir_lower_expression(b, node->first_child);
+            return ir_emit(b, IR_NEG, type, &operand, 1);
+        }
+
+        case AST_ASSIGNMENT: {
+            unsigned int op = node->data;
+            unsigned int target = node->first_child;
+            unsigned int value = ir_lower_expression(b, ast_get(b->ast, target)->next_sibling);
+            if (op != OP_EQUAL) {
+                unsigned int current = ir_read(b, target);
+                unsigned int resultType = type == SEM_TYPE_STRING ? SEM_TYPE_STRING :
+                                          ir_instr(b->fn, current)->type == SEM_TYPE_FLOAT || ir_instr(b->fn, value)->type == SEM_TYPE_FLOAT ? SEM_TYPE_FLOAT : SEM_TYPE_INT;
+                value = ir_binary(b, op, resultType, current, value);
+            }
+            value = ir_convert(b, value, type);
+            ir_write(b, target, value);
+            return value;
+        }
+
+        case AST_CALL:
+            return ir_lower_call(b, index);
+    }
+    return ir_constant_int(b->fn, b->block, 0);
+}
+
+// Lowers a condition into an int that is 0 when it is false
+static unsigned int ir_lower_condition(IR_builder* b, unsigned int index) {
+    unsigned int value = ir_lower_expression(b, index);
+    if (ir_instr(b->fn, value)->type == SEM_TYPE_FLOAT) {
+        uint32_t operands[2] = {value, ir_constant_float(b->fn, b->block, 0.0)};
+        value = ir_emit(b, IR_NE, SEM_TYPE_INT, operands, 2);
+    }
+    return value;
+}
+
+// Ends the current block with a branch on the value
+static void ir_branch(IR_builder* b, unsigned int condition, unsigned int then, unsigned int otherwise) {
+    ir_emit(b, IR_BRANCH, SEM_TYPE_NONE, &condition, 1);
+    ir_add_edge(b->fn, b->block, then);
+    ir_add_edge(b->fn, b->block, otherwise);
+    b->block = IR_NONE;
+}
+
+// Continues in the block if anything can jump to it, otherwise the code that follows can't be reached
+static void ir_continue_in(IR_builder* b, unsigned int block) {
+    ir_seal_block(b, block);
+    b->block = ir_block(b->fn, block)->preds.len > 0 ? block : IR_NONE;
+}
+
+static void ir_lower_statement(IR_builder* b, unsigned int index);
+
+static void ir_lower_branch(IR_builder* b, unsigned int index) {
+    AST_node* node = ast_get(b->ast, index);
+    unsigned int condition = node->first_child;
+    unsigned int thenBody = ast_get(b->ast, condition)->next_sibling;
+    unsigned int elseBody = ast_get(b->ast, thenBody)->next_sibling;
+
+    unsigned int value = ir_lower_condition(b, condition);
+    unsigned int thenBlock = ir_new_block(b);
+    unsigned int elseBlock = elseBody != AST_NONE ? ir_new_block(b) : IR_NONE;
+    unsigned int join = ir_new_block(b);
+    ir_branch(b, value, thenBlock, elseBlock != IR_NONE ? elseBlock : join);
+
+    ir_seal_block(b, thenBlock);
+    b->block = thenBlock;
+    ir_lower_statement(b, thenBody);
+    ir_jump(b, join);
+
+    if (elseBlock != IR_NONE) {
+        ir_seal_block(b, elseBlock);
+        b->block = elseBlock;
+        ir_lower_statement(b, elseBody);
+        ir_jump(b, join);
+    }
+    ir_continue_in(b, join);
+}
+
+static void ir_lower_loop(IR_builder* b, unsigned int index) {
+    AST_node* node = ast_get(b->ast, index);
+    bool isFor = node->type == AST_FOR;
+    unsigned int init = isFor ? node->first_child : AST_NONE;
+    unsigned int condition = isFor ? ast_get(b->ast, init)->next_sibling : node->first_child;
+    unsigned int step = isFor ? ast_get(b->ast, condition)->next_sibling : AST_NONE;
+    unsigned int body = isFor ? ast_get(b->ast, step)->next_sibling : ast_get(b->ast, condition)->next_sibling;
+
+    if (isFor) {
+        ir_lower_statement(b, init);
+        if (b->block == IR_NONE) {
+            return;
+        }
+    }
+
+    // The header can't be sealed until the jump back from the end of the loop is added
+    b->loop_depth++;
+    unsigned int header = ir_new_block(b);
+    unsigned int bodyBlock = ir_new_block(b);
+    unsigned int stepBlock = isFor ? ir_new_block(b) : IR_NONE;
+    b->loop_depth--;
+    unsigned int exit = ir_new_block(b);
+    ir_block(b->fn, header)->offset = ast_token(b->ast, index)->offset;
+    ir_jump(b, header);
+
+    b->block = header;
+    if (ast_get(b->ast, condition)->type == AST_EMPTY) {
+        ir_jump(b, bodyBlock);
+    } else {
+        ir_branch(b, ir_lower_condition(b, condition), bodyBlock, exit);
+    }
+
+    b->loop_depth++;
+    ir_seal_block(b, bodyBlock);
+    b->block = bodyBlock;
+    ir_lower_statement(b, body);
+    if (isFor) {
+        ir_jump(b, stepBlock);
+        ir_continue_in(b, stepBlock);
+        ir_lower_statement(b, step);
+    }
+    ir_jump(b, header);
+    b->loop_depth--;
+
+    ir_seal_block(b, header);
+    ir_continue_in(b, exit);
+}
+
+// Returns where the statement starts in the source. The token of a node is the one that says what it is (like the
+// operator of an assignment), which isn't always the first one, but the first child of a node is always on its left
+static uint32_t ir_statement_offset(AST* ast, unsigned int index) {
+    uint32_t offset = ast_token(ast, index)->offset;
+    for (unsigned int child = ast_get(ast, index)->first_child; child != AST_NONE; child = ast_get(ast, child)->first_child) {
+        if (ast_token(ast, child)->offset < offset) {
+            offset = ast_token(ast, child)->offset;
+        }
+    }
+    return offset;
+}
+
+static void ir_lower_statement(IR_builder* b, unsigned int index) {
+    if (b->block == IR_NONE) {
+        // Nothing after a return runs
+        return;
+    }
+
+    // Everything the statement turns into belongs to it, except for what the statements inside of it turn into
+    unsigned int outer = b->offset;
+    AST_node* node = ast_get(b->ast, index);
+    if (node->type != AST_BLOCK) {
+        b->offset = ir_statement_offset(b->ast, index);
+    }
+    switch (node->type) {
+        case AST_DECLARATION: {
+            unsigned int type = semantic_get(b->sem, index)->type;
+            unsigned int value = node->first_child != AST_NONE ? ir_convert(b, ir_lower_expression(b, node->first_child), type) : ir_default_value(b, b->block, type);
+            ir_write(b, index, value);
+            break;
+        }
+
+        case AST_BLOCK:
+            AST_FOR_EACH_CHILD(b->ast, index, child) {
+                ir_lower_statement(b, child);
+            }
+            break;
+
+        case AST_BRANCH:
+            ir_lower_branch(b, index);
+            break;
+
+        case AST_WHILE:
+        case AST_FOR:
+            ir_lower_loop(b, index);
+            break;
+
+        case AST_RETURN: {
+            unsigned int value = node->first_child != AST_NONE ? ir_convert(b, ir_lower_expression(b, node->first_child), b->fn->return_type) : ir_default_value(b, b->block, b->fn->return_type);
+            ir_emit(b, IR_RETURN, SEM_TYPE_NONE, &value, 1);
+            b->block = IR_NONE;
+            break;
+        }
+
+        case AST_EMPTY:
+        case AST_ERROR:
+        case AST_FUNCTION:
+            break;
+
+        default:
+            // An expression used as a statement
+            ir_lower_expression(b, index);
+            break;
+    }
+    b->offset = outer;
+}
+
+// Sets up the builder for a new function and makes its entry block
+static void ir_begin_function(IR_builder* b, IR_function* fn) {
+    b->fn = fn;
+    b->loop_depth = 0;
+    b->sealed.len = 0;
+    b->incomplete.len = 0;
+    hash_map_free(&b->defs);
+    hash_map_init(&b->defs, &STRING("unsigned long long"), &STRING("unsigned int"));
+    b->block = ir_new_block(b);
+    ir_seal_block(b, b->block);
+}
+
+// Adds the return at the end of a function that can run off the end of its body, and cleans up the blocks that can't be reached
+static void ir_end_function(IR_builder* b, bool hasValue) {
+    if (b->block != IR_NONE) {
+        if (hasValue) {
+            unsigned int value = ir_default_value(b, b->block, b->fn->return_type);
+            ir_emit(b, IR_RETURN, SEM_TYPE_NONE, &value, 1);
+        } else {
+            ir_emit(b, IR_RETURN, SEM_TYPE_NONE, NULL, 0);
+        }
+    }
+    ir_compute_dominators(b->fn);
+}
+
+int ir_generate(IR_module* module, AST* ast, Semantic* sem) {
+    module->symbols = &ast->symbols;
+    module->global_count = sem->global_count;
+    for (unsigned int i = 0; i < sem->global_count; i++) {
+        unsigned int none = SEM_TYPE_NONE;
+        dynamic_array_append(&module->global_types, &none);
+    }
+
+    IR_builder b = {.module = module, .ast = ast, .sem = sem};
+    hash_map_init(&b.defs, &STRING("unsigned long long"), &STRING("unsigned int"));
+    dynamic_array_init(&b.sealed, &STRING("bool"));
+    dynamic_array_init(&b.incomplete, &STRING("IR_incomplete_phi"));
+
+    // Every function gets its spot first so that the pointers stay valid while they are filled in
+    dynamic_array_resize(&module->functions, sem->functions.len + 1, true);
+    for (unsigned int i = 0; i < sem->functions.len; i++) {
+        SemanticFunction* function = &((SemanticFunction*)sem->functions.buf)[i];
+        IR_function* fn = ir_function(module, i);
+        ir_function_init(fn, function->symbol, function->param_count, function->return_type);
+        ir_begin_function(&b, fn);
+        b.offset = ast_token(ast, function->node)->offset;
+
+        unsigned int param = 0;
+        unsigned int body = AST_NONE;
+        AST_FOR_EACH_CHILD(ast, function->node, child) {
+            if (param < function->param_count) {
+                SemanticInfo* info = semantic_get(sem, child);
+                unsigned int value = ir_emit(&b, IR_PARAM, info->type, NULL, 0);
+                ir_instr(fn, value)->imm.index = param++;
+                ir_write_variable(&b, info->slot, b.block, value);
+            }
+            body = child;
+        }
+        ir_lower_statement(&b, body);
+        ir_end_function(&b, true);
+    }
+
+    // The top level of the file runs from top to bottom, skipping over the functions
+    module->script = sem->functions.len;
+    IR_function* script = ir_function(module, module->script);
+    ir_function_init(script, interner_intern(&ast->symbols, &STRING("<script>")), 0, SEM_TYPE_NONE);
+    ir_begin_function(&b, script);
+    b.offset = IR_NONE;
+    AST_FOR_EACH_CHILD(ast, 0, item) {
+        AST_node* node = ast_get(ast, item);
+        if (node->type == AST_DECLARATION && semantic_get(sem, item)->kind == SEM_KIND_GLOBAL) {
+            ((unsigned int*)module->global_types.buf)[semantic_get(sem, item)->slot] = semantic_get(sem, item)->type;
+        }
+        ir_lower_statement(&b, item);
+    }
+    ir_end_function(&b, false);
+
+    hash_map_free(&b.defs);
+    dynamic_array_free(&b.sealed);
+    dynamic_array_free(&b.incomplete);
+    return 0;
+}
+
+int ir_verify(IR_module* module, IR_function* fn) {
+    const char* name = interner_get(module->symbols, fn->symbol)->str;
+    int result = 0;
+
+    // Where every instruction is in its block, so uses in the same block can be checked against it
+    DynamicArray positions;
+    dynamic_array_init(&positions, &STRING("unsigned int"));
+    dynamic_array_resize(&positions, fn->instrs.len, true);
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* b = ir_block(fn, ((unsigned int*)fn->rpo.buf)[r]);
+        for (unsigned int i = 0; i < b->instrs.len; i++) {
+            ((unsigned int*)positions.buf)[((unsigned int*)b->instrs.buf)[i]] = i;
+        }
+    }
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        IR_block* b = ir_block(fn, block);
+        if (b->instrs.len == 0 || !ir_is_terminator(ir_instr(fn, ((unsigned int*)b->instrs.buf)[b->instrs.len - 1])->op)) {
+            printf("IR error in %s: block b%u doesn't end with a terminator\n", name, block);
+            result = -1;
+            continue;
+        }
+
+        for (unsigned int s = 0; s < 2; s++) {
+            if (b->succs[s] != IR_NONE && ir_list_find(&ir_block(fn, b->succs[s])->preds, block) == IR_NONE) {
+                printf("IR error in %s: b%u is a successor of b%u, but doesn't have it as a predecessor\n", name, b->succs[s], block);
+                result = -1;
+            }
+        }
+
+        bool phis = true;
+        for (unsigned int i = 0; i < b->instrs.len; i++) {
+            unsigned int value = ((unsigned int*)b->instrs.buf)[i];
+            IR_instr* instr = ir_instr(fn, value);
+            if (instr->block != block) {
+                printf("IR error in %s: v%u is in b%u, but says it is in b%u\n", name, value, block, instr->block);
+                result = -1;
+            }
+            if (instr->op == IR_PHI && (!phis || instr->operand_count != b->preds.len)) {
+                printf("IR error in %s: phi v%u in b%u is out of place or has the wrong number of operands\n", name, value, block);
+                result = -1;
+                continue;
+            }
+            phis = phis && instr->op == IR_PHI;
+            if (ir_is_terminator(instr->op) != (i == b->instrs.len - 1)) {
+                printf("IR error in %s: v%u is in the wrong place in b%u\n", name, value, block);
+                result = -1;
+            }
+            if (instr->op == IR_BRANCH && (b->succs[0] == IR_NONE || b->succs[1] == IR_NONE)) {
+                printf("IR error in %s: the branch at the end of b%u doesn't have two successors\n", name, block);
+                result = -1;
+            }
+
+            for (unsigned int o = 0; o < instr->operand_count; o++) {
+                unsigned int operand = *ir_operand(fn, value, o);
+                IR_instr* def = operand < fn->instrs.len ? ir_instr(fn, operand) : NULL;
+                if (def == NULL || def->block == IR_NONE || def->type == SEM_TYPE_NONE) {
+                    printf("IR error in %s: v%u uses v%u, which isn't a value\n", name, value, operand);
+                    result = -1;
+                    continue;
+                }
+                // A phi operand only has to be available at the end of the predecessor it comes from
+                unsigned int useBlock = instr->op == IR_PHI ? ((unsigned int*)b->preds.buf)[o] : block;
+                bool before = def->block != useBlock || instr->op == IR_PHI || ((unsigned int*)positions.buf)[operand] < i;
+                if (!ir_dominates(fn, def->block, useBlock) || !before) {
+                    printf("IR error in %s: v%u uses v%u, which doesn't dominate it\n", name, value, operand);
+                    result = -1;
+                }
+            }
+        }
+    }
+    dynamic_array_free(&positions);
+    return result;
+}
+
+static const char* IR_OP_NAMES[IR_OP_COUNT] = {
+    [IR_NOP] = "nop",
+    [IR_CONST_INT] = "const",
+    [IR_CONST_FLOAT] = "const",
+    [IR_CONST_STRING] = "const",
+    [IR_PARAM] = "param",
+    [IR_COPY] = "copy",
+    [IR_PHI] = "phi",
+    [IR_ADD] = "add",
+    [IR_SUB] = "sub",
+    [IR_MUL] = "mul",
+    [IR_DIV] = "div",
+    [IR_NEG] = "neg",
+    [IR_CONCAT] = "concat",
+    [IR_LT] = "lt",
+    [IR_LE] = "le",
+    [IR_GT] = "gt",
+    [IR_GE] = "ge",
+    [IR_EQ] = "eq",
+    [IR_NE] = "ne",
+    [IR_INT_TO_FLOAT] = "int_to_float",
+    [IR_FLOAT_TO_INT] = "float_to_int",
+    [IR_LOAD_GLOBAL] = "load_global",
+    [IR_STORE_GLOBAL] = "store_global",
+    [IR_CALL] = "call",
+    [IR_JUMP] = "jump",
+    [IR_BRANCH] = "branch",
+    [IR_RETURN] = "return",
+};
+
+static void ir_print_instr(IR_module* module, IR_function* fn, unsigned int value) {
+    IR_instr* instr = ir_instr(fn, value);
+    IR_block* b = ir_block(fn, instr->block);
+    printf("    ");
+    if (instr->type != SEM_TYPE_NONE) {
+        printf("v%u = ", value);
+    }
+    printf("%s", IR_OP_NAMES[instr->op]);
+    if (instr->type != SEM_TYPE_NONE) {
+        printf(".%s", semantic_type_name(instr->type));
+    }
+
+    switch (instr->op) {
+        case IR_CONST_INT:
+            printf(" %d", instr->imm.i);
+            break;
+        case IR_CONST_FLOAT:
+            printf(" %g", ((double*)fn->floats.buf)[instr->imm.index]);
+            break;
+        case IR_CONST_STRING:
+            printf(" \"%s\"", interner_get(module->symbols, instr->imm.index)->str);
+            break;
+        case IR_PARAM:
+            printf(" %u", instr->imm.index);
+            break;
+        case IR_LOAD_GLOBAL:
+        case IR_STORE_GLOBAL:
+            printf(" @%u", instr->imm.index);
+            break;
+        case IR_CALL:
+            printf(" %s", interner_get(module->symbols, ir_function(module, instr->imm.index)->symbol)->str);
+            break;
+    }
+
+    for (unsigned int i = 0; i < instr->operand_count; i++) {
+        printf(i == 0 ? " v%u" : ", v%u", *ir_operand(fn, value, i));
+        if (instr->op == IR_PHI) {
+            printf(" (b%u)", ((unsigned int*)b->preds.buf)[i]);
+        }
+    }
+
+    if (instr->op == IR_JUMP) {
+        printf(" b%u", b->succs[0]);
+    } else if (instr->op == IR_BRANCH) {
+        printf(", b%u, b%u", b->succs[0], b->succs[1]);
+    }
+    printf("\n");
+}
+
+int ir_print_function(IR_module* module, IR_function* fn) {
+    printf("function %s, %u params", interner_get(module->symbols, fn->symbol)->str, fn->param_count);
+    if (fn->return_type != SEM_TYPE_NONE) {
+        printf(", returns %s", semantic_type_name(fn->return_type));
+    }
+    printf("\n");
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        IR_block* b = ir_block(fn, block);
+        printf("  b%u:", block);
+        for (unsigned int i = 0; i < b->preds.len; i++) {
+            printf(i == 0 ? " preds b%u" : ", b%u", ((unsigned int*)b->preds.buf)[i]);
+        }
+        if (b->idom != IR_NONE) {
+            printf(" idom b%u", b->idom);
+        }
+        if (b->loop_depth > 0) {
+            printf(" loop depth %u", b->loop_depth);
+        }
+        printf("\n");
+        for (unsigned int i = 0; i < b->instrs.len; i++) {
+            ir_print_instr(module, fn, ((unsigned int*)b->instrs.buf)[i]);
+        }
+    }
+    return 0;
+}
+
+int ir_print(IR_module* module) {
+    for (unsigned int i = 0; i < module->functions.len; i++) {
+        ir_print_function(module, ir_function(module, i));
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "DynamicArray.h"
+#include "Interner.h"
+#include "parser.h"
+#include "semantic.h"
+
+// The intermediate representation that sits between the tree and the code that actually runs. Every function is a
+// control flow graph of basic blocks, and every block is a list of instructions. The IR is in SSA form: every instruction
+// defines at most one value, each value is defined exactly once, and values that come from different paths are joined
+// with phi instructions at the start of a block. A value is referred to by the index of the instruction that defines it.
+
+// Used in place of a value, block, or instruction index when there isn't one
+#define IR_NONE UINT32_MAX
+
+enum IR_ops {
+    // The instruction was removed. It stays in the instructions array so indices don't change, but it isn't in any block
+    IR_NOP,
+    // imm.i is the value
+    IR_CONST_INT,
+    // imm.index is the index of the value in the floats array of the function
+    IR_CONST_FLOAT,
+    // imm.index is the interned id of the string
+    IR_CONST_STRING,
+    // The parameter of the function with the index imm.index
+    IR_PARAM,
+    // The same value as the only operand. These are made by the optimizations and then removed by copy propagation
+    IR_COPY,
+    // One operand for every predecessor of the block, in the same order as the preds array of the block
+    IR_PHI,
+
+    // Arithmetic on two operands of the same type as the instruction (int or float)
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_NEG,
+    // Joins two strings together
+    IR_CONCAT,
+
+    // Comparisons of two operands of the same type. The result is always an int that is 1 or 0
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_EQ,
+    IR_NE,
+
+    IR_INT_TO_FLOAT,
+    // Truncates towards 0, like a cast in C
+    IR_FLOAT_TO_INT,
+
+    // imm.index is the slot of the global
+    IR_LOAD_GLOBAL,
+    // Stores the only operand in the global with the slot imm.index. Doesn't define a value
+    IR_STORE_GLOBAL,
+    // Calls the function with the index imm.index (in the functions of the module), with the operands as the arguments
+    IR_CALL,
+
+    // The instructions below end a block, and every block ends with exactly one of them.
+    // Goes to the only successor of the block
+    IR_JUMP,
+    // Goes to the first successor of the block if the operand (an int) isn't 0, and the second one if it is
+    IR_BRANCH,
+    // Returns the operand from the function, or nothing if there isn't one (only for the top level of the file)
+    IR_RETURN,
+
+    IR_OP_COUNT
+};
+
+// Set on instructions by passes that need to mark them, and always cleared when the pass ends
+#define IR_FLAG_MARK 1
+
+typedef struct IR_instr {
+    // One of the IR_ops
+    uint8_t op;
+    // The type of the value the instruction defines (one of the SEM_TYPEs), which is SEM_TYPE_NONE if it doesn't define one
+    uint8_t type;
+    uint16_t flags;
+    // The block the instruction is in, or IR_NONE once it has been removed
+    uint32_t block;
+    // The operands are the values in the operands array of the function from operands_start up to operands_start + operand_count
+    uint32_t operands_start;
+    uint32_t operand_count;
+    union {
+        int32_t i;
+        uint32_t index;
+    } imm;
+    // The byte offset in the source file of the statement the instruction came from, or IR_NONE for instructions the
+    // optimizations made up that don't belong to any one statement
+    uint32_t offset;
+} IR_instr;
+
+typedef struct IR_block {
+    // The instructions of the block in order (of type unsigned int). Phis are always first, and the terminator is always last
+    DynamicArray instrs;
+    // The blocks that can jump to this one (of type unsigned int)
+    DynamicArray preds;
+    // The blocks this one can jump to. Unused ones are IR_NONE
+    uint32_t succs[2];
+    // The immediate dominator of the block, or IR_NONE for the entry block and blocks that can't be reached.
+    // Only valid after ir_compute_dominators
+    uint32_t idom;
+    // Where the block is in reverse postorder. Only valid after ir_compute_dominators
+    uint32_t rpo_index;
+    // How many loops the block is inside of. Set when the IR is made from the tree
+    uint32_t loop_depth;
+    // For the header of a loop, the byte offset in the source file of the while or for statement it came from.
+    // IR_NONE for every other block
+    uint32_t offset;
+} IR_block;
+
+typedef struct IR_function {
+    // The interned name of the function
+    unsigned int symbol;
+    unsigned int param_count;
+    unsigned int return_type;
+    // Of type IR_block. The entry block is always block 0
+    DynamicArray blocks;
+    // Of type IR_instr. Instruction i defines value i
+    DynamicArray instrs;
+    // The operands of every instruction (of type unsigned int)
+    DynamicArray operands;
+    // The values of float constants (of type double)
+    DynamicArray floats;
+    // The blocks in reverse postorder (of type unsigned int), which only includes blocks that can be reached.
+    // Only valid after ir_compute_dominators
+    DynamicArray rpo;
+} IR_function;
+
+// What the loop optimizations did to one loop
+typedef struct IR_loop_report {
+    // The interned name of the function the loop is in
+    unsigned int function;
+    // The byte offset in the source file of the loop
+    unsigned int offset;
+    // The number of instructions moved out of the loop
+    unsigned int hoisted;
+    // The number of multiplications replaced by additions
+    unsigned int reduced;
+    // How many copies of the body the loop was unrolled into (0 if it wasn't)
+    unsigned int unrolled;
+} IR_loop_report;
+
+typedef struct IR_module {
+    // Of type IR_function. Function i is the function with index i in the semantic pass, and the code at the top level of
+    // the file is the last function
+    DynamicArray functions;
+    unsigned int script;
+    unsigned int global_count;
+    // The type of every global (of type unsigned int)
+    DynamicArray global_types;
+    // What the loop optimizations did (of type IR_loop_report), one entry for every loop they changed
+    DynamicArray loop_reports;
+    // The names and strings used in the module. This belongs to the tree the module was made from, which has to outlive it
+    Interner* symbols;
+} IR_module;
+
+// Registers the types used by the IR. Should be called once before using any other function in this module
+int ir_module_init(void);
+
+int ir_init(IR_module* module);
+
+int ir_free(IR_module* module);
+
+// For use with the type registry
+int ir_deallocator(void* module);
+int ir_function_deallocator(void* function);
+int ir_block_deallocator(void* block);
+
+// Makes the IR for the whole program from a tree that passed the semantic pass without errors.
+// The SSA form is built directly while going over the tree, using the algorithm from "Simple and Efficient Construction
+// of Static Single Assignment Form" by Braun et al., so there is never a version of the IR that isn't in SSA form
+int ir_generate(IR_module* module, AST* ast, Semantic* sem);
+
+inline IR_instr* ir_instr(IR_function* fn, unsigned int value) {
+    return &((IR_instr*)fn->instrs.buf)[value];
+}
+
+inline IR_block* ir_block(IR_function* fn, unsigned int block) {
+    return &((IR_block*)fn->blocks.buf)[block];
+}
+
+inline IR_function* ir_function(IR_module* module, unsigned int function) {
+    return &((IR_function*)module->functions.buf)[function];
+}
+
+// Returns a pointer to the nth operand of the instruction
+inline uint32_t* ir_operand(IR_function* fn, unsigned int value, unsigned int n) {
+    return &((uint32_t*)fn->operands.buf)[ir_instr(fn, value)->operands_start + n];
+}
+
+// Whether the instruction ends a block
+bool ir_is_terminator(unsigned int op);
+
+// Whether the instruction does anything besides defining its value, which means it can't be removed or moved around
+// even if its value is never used. Int division counts, since dividing by 0 stops the program
+bool ir_has_side_effects(IR_instr* instr);
+
+// Adds a new, empty block to the function and returns its index
+unsigned int ir_add_block(IR_function* fn);
+
+// Adds an instruction with the given operands to the end of the block (before the terminator if the block has one) and
+// returns its value. block can be IR_NONE to make an instruction that isn't in a block yet
+unsigned int ir_add_instr(IR_function* fn, unsigned int block, unsigned int op, unsigned int type, uint32_t* operands, unsigned int count);
+
+// Adds an edge between two blocks, filling in the first free successor of from
+void ir_add_edge(IR_function* fn, unsigned int from, unsigned int to);
+
+// Removes the edge between two blocks, along with the operand for it in every phi of to
+void ir_remove_edge(IR_function* fn, unsigned int from, unsigned int to);
+
+// Puts an instruction that isn't in a block yet into a block, at the given position in its list of instructions
+void ir_insert_instr(IR_function* fn, unsigned int value, unsigned int block, unsigned int index);
+
+// Moves the instruction from its block to the end of another one (before the terminator)
+void ir_move_instr(IR_function* fn, unsigned int value, unsigned int block);
+
+// Adds one more operand to the end of a phi, for a predecessor that was just added to its block
+void ir_add_phi_operand(IR_function* fn, unsigned int phi, unsigned int operand);
+
+// Takes the instruction out of its block. It becomes an IR_NOP
+void ir_remove_instr(IR_function* fn, unsigned int value);
+
+// Turns the instruction into a copy of another value, keeping its place in its block (phis are moved out of the phi
+// section of the block, since a copy isn't a phi)
+void ir_replace_with_copy(IR_function* fn, unsigned int value, unsigned int source);
+
+// Turns the instruction into a constant
+void ir_replace_with_int(IR_function* fn, unsigned int value, int32_t i);
+void ir_replace_with_float(IR_function* fn, unsigned int value, double f);
+void ir_replace_with_string(IR_function* fn, unsigned int value, unsigned int symbol);
+
+// Follows a chain of copies back to the value that isn't a copy
+unsigned int ir_resolve(IR_function* fn, unsigned int value);
+
+// Removes every block that can't be reached from the entry block, and fills in rpo, idom, and rpo_index of the blocks
+// that can. Uses "A Simple, Fast Dominance Algorithm" by Cooper, Harvey, and Kennedy
+int ir_compute_dominators(IR_function* fn);
+
+// Whether block a dominates block b (every path from the entry to b goes through a). Needs ir_compute_dominators
+bool ir_dominates(IR_function* fn, unsigned int a, unsigned int b);
+
+// Returns the number of instructions that are still in a block
+unsigned int ir_instr_count(IR_function* fn);
+
+// Returns the number of blocks that can be reached. Needs ir_compute_dominators
+unsigned int ir_block_count(IR_function* fn);
+
+// Checks that the function is well formed: every block ends in one terminator, phis match the predecessors, and every
+// operand is defined by an instruction that dominates its use. Prints what is wrong and returns -1 if it isn't
+int ir_verify(IR_module* module, IR_function* fn);
+
+// Prints the IR of every function in the module
+int ir_print(IR_module* module);
+
+int ir_print_function(IR_module* module, IR_function* fn);
+
+#endif
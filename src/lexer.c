@@ -3,9 +3,14 @@
 #include "Strings.h"
 #include <stdbool.h>
 #include <stdint.h>
-#include <limits.h>
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
+static bool lexer_is_word_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool lexer_is_word_char(char c) {
+    return lexer_is_word_start(c) || (c >= '0' && c <= '9');
+}
 
 int token_deallocator(void* tok) {
     // Only deallocate if it is not a keyword token
@@ -30,7 +35,8 @@ int lexer_module_init(void) {
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_FOR, .name = STRING("for"), .vtag = false});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_IF, .name = STRING("if"), .vtag = false});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_WHILE, .name = STRING("while"), .vtag = false});
-    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_RETURN, .name = STRING("return "), .vtag = false});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_RETURN, .name = STRING("return"), .vtag = false});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_KEYWORD, .id = KEY_ELSE, .name = STRING("else"), .vtag = false});
 
     // The punctuators are being appended below
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_PUNCTUATOR, .id = PUNC_BRACKET_L, .name = STRING("[")});
@@ -40,8 +46,21 @@ int lexer_module_init(void) {
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_PUNCTUATOR, .id = PUNC_PAREN_L, .name = STRING("(")});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_PUNCTUATOR, .id = PUNC_PAREN_R, .name = STRING(")")});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_PUNCTUATOR, .id = PUNC_SEMICOLON, .name = STRING(";")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_PUNCTUATOR, .id = PUNC_COMMA, .name = STRING(",")});
 
     // The operators are being appended below
+    // The two character operators have to come before the one character ones, since the first match is the one that is used.
+    // Otherwise <= would be lexed as < followed by =
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_LESS_EQUAL, .name = STRING("<=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_GREATER_EQUAL, .name = STRING(">=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_EQUAL_EQUAL, .name = STRING("==")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_NOT_EQUAL, .name = STRING("!=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_PLUS_EQUAL, .name = STRING("+=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_MINUS_EQUAL, .name = STRING("-=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_MULT_EQUAL, .name = STRING("*=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_DIV_EQUAL, .name = STRING("/=")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_LESS, .name = STRING("<")});
+    dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_GREATER, .name = STRING(">")});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_PLUS, .name = STRING("+")});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_EQUAL, .name = STRING("=")});
     dynamic_array_append(&LanguageReservedWords, &(language_identifier){.type = LRES_OPERATOR, .id = OP_MINUS, .name = STRING("-")});
@@ -56,6 +75,16 @@ int lexer_module_terminate(void) {
     return 0;
 }
 
+string* lexer_reserved_word(unsigned int type, unsigned int id) {
+    for (unsigned int i = 0; i < LanguageReservedWords.len; i++) {
+        language_identifier* word = &((language_identifier*)LanguageReservedWords.buf)[i];
+        if (word->type == type && word->id == id) {
+            return &word->name;
+        }
+    }
+    return NULL;
+}
+
 int lexer(DynamicArray* tokens, DynamicArray* knownIdentifiers, string* file) {
     // Very important for tokens dynamic array to actually be an array of tokens
     if (tokens->type != dynamic_array_registry_get_typeID(&STRING("token"))) {
@@ -69,19 +98,21 @@ int lexer(DynamicArray* tokens, DynamicArray* knownIdentifiers, string* file) {
     unsigned int quoteIndices[2];
 
     // Keeps track of what known identifiers have been declared in the code while
-    // lexing. This allows for the identification of identifiers in expressions.
-    // the identifiers themselves will be determined based on variable declaration,
-    // like int x, float y, or string str. Thus, after a variable keyword, identifier
-    // is expected. This is the primary heuristic for determining identifiers
+    // lexing. The identifiers themselves are determined based on variable declaration,
+    // like int x, float y, or string str. Thus, an identifier right after a variable keyword
+    // is a newly declared one
     if (knownIdentifiers->type != dynamic_array_registry_get_typeID(&STRING("string"))) {
         dynamic_array_free(knownIdentifiers);
         dynamic_array_init(knownIdentifiers, &STRING("string"));
     }
 
+    // Whether or not the previous token was a variable keyword (like int or float)
+    bool afterVtag = false;
+
     for (int i = 0; i < file->len; i++) {
         // Looks for the string literals
         // The part with file.str[i-1] is to allow for quotes to be included in strings by the following method: \"
-        if (file->str[i] == '"' && i > 0 && file->str[i - 1] != '\\') {
+        if (file->str[i] == '"' && (i == 0 || file->str[i - 1] != '\\')) {
             quoteIndices[quoteCount % 2] = i;
             quoteCount++;
 
@@ -91,114 +122,110 @@ int lexer(DynamicArray* tokens, DynamicArray* knownIdentifiers, string* file) {
                 string_init(&literal);
                 // Add +1 to the from argument below because otherwise quote symbol would be included
                 string_substring(&literal, file, quoteIndices[0] + 1, quoteIndices[1]);
-                dynamic_array_append(tokens, &(token){.literal = literal, .type = LRES_LITERAL});
+                dynamic_array_append(tokens, &(token){.literal = literal, .type = LRES_LITERAL, .id = LIT_STRING, .offset = quoteIndices[0]});
+                afterVtag = false;
             }
 
             // This prevents wasting time searching for keywords, identifiers, etc later on
             goto loop_exit;
-        } else if (file->str[i] == ' ' || file->str[i] == '\n') {
-            // Skip redudant checking by passing over newlines and spaces
+        } else if (quoteCount % 2 == 1) {
+            // Everything inside of a string literal is handled once the closing quote is found
+            goto loop_exit;
+        } else if (file->str[i] == ' ' || file->str[i] == '\n' || file->str[i] == '\t' || file->str[i] == '\r') {
+            // Skip redudant checking by passing over whitespace
             goto loop_exit;
         } else if (file->str[i] >= '0' && file->str[i] <= '9') {
             // This is where numerical literals are searched for
             int end = i;
+            bool isFloat = false;
             // The loop basically continues as long as the current character is a number or a period, since there
             // could be decimal values
             for (int j = i; j < file->len && ((file->str[j] >= '0' && file->str[j] <= '9') || file->str[j] == '.'); j++) {
+                isFloat = isFloat || file->str[j] == '.';
                 end++;
             }
 
             string numerical_literal;
             string_init(&numerical_literal);
             string_substring(&numerical_literal, file, i, end);
-            dynamic_array_append(tokens, &(token){.type = LRES_LITERAL, .literal = numerical_literal});
+            dynamic_array_append(tokens, &(token){.type = LRES_LITERAL, .id = isFloat ? LIT_FLOAT : LIT_INT, .literal = numerical_literal, .offset = i});
+            afterVtag = false;
             // the minus one is to account for the iteration of i by one at the end of the loop
             i = end - 1;
             goto loop_exit;
-        }
+        } else if (lexer_is_word_start(file->str[i])) {
+            // Keywords and identifiers are read as whole words. This makes sure that a keyword is never found in the middle of an
+            // identifier (like the int in print), and that identifiers don't have to be declared before they can be lexed
+            int end = i;
+            while (end < file->len && lexer_is_word_char(file->str[end])) {
+                end++;
+            }
+            string word = {.str = file->str + i, .len = end - i, .__memsize = 0};
 
-        // Only want to check for keywords and identifiers if not inside a string literal
-        if (quoteCount % 2 == 0) {
+            language_identifier* keyword = NULL;
             for (int j = 0; j < LanguageReservedWords.len; j++) {
-                language_identifier* ldent = dynamic_array_get(&LanguageReservedWords, &INDEX(j));
-                if (string_compare_with_offset(file, &ldent->name, i)) {
-                    //Check for comments first, as those can be skipped
-                    if (ldent->type == LRES_COMMENT) {
-                        if (ldent->id == COMM_DSLASH) {
-                            // Account for length of double slashes by adding the length of the name of ldent
-                            int comm_end = i + ldent->name.len;
-                            for (int k = comm_end; k < file->len && file->str[k] != '\n'; k++) {
-                                comm_end++;
-                            }
-
-                            // The minus one is to account for the fact that i is incremented by one after this
-                            i = comm_end - 1;
-                            goto loop_exit;
-                        } 
-                    }
-                    // For debugging purposes, the literal part of the token will contain the string name of the keyword
-                    dynamic_array_append(tokens, &(token){.type = ldent->type, .id = ldent->id, .literal = ldent->name});
-
-                    // If the current token is a variable keyword (like int or float), then immediately begin search for the expected
-                    // declaration of the identifier
-                    if (ldent->type == LRES_KEYWORD && ldent->vtag == true) {
-                        // Add 1 to account for expected space after variable keyword declaration: int x = 2; <- note the space between int and x
-                        int start = i + ldent->name.len + 1;
-                        int ends[4];
-                        // The three possible characters that could delimate the end of a variable declaration are a space, an equal sign,
-                        // or a semicolon. Unfortunately, these have to be hard coded in here. Also, for functions the ( character has to be
-                        // added to the list of potential because function declarations look like int main(). 
-                        ends[0] = string_find_with_offset(file, &STRING(" "), start);
-                        ends[1] = string_find_with_offset(file, &STRING("="), start);
-                        ends[2] = string_find_with_offset(file, &STRING(";"), start);
-                        ends[3] = string_find_with_offset(file, &STRING("("), start);
-
-                        // If ( is not found in the file, then ends[3] will have the value -1 because that is what the function will return.
-                        // This is problematic because then it will result in -1 being the smallest index, which is nonsensical
-                        // So, basically if ends[3] is less than 0, it is just made the integer maximum value in order to ensure it doesn't
-                        // interfere with finding the true ending index
-                        if (ends[3] < 0) {
-                            ends[3] = INT_MAX;
-                        }
-                        // Whichever comes first is what will delimate the identifier
-                        int end = MIN(MIN(MIN(ends[0], ends[1]), ends[2]), ends[3]);
-
-                        string s1, s2;
-                        string_init(&s1);
-                        string_init(&s2);
-                        string_substring(&s1, file, start, end);
-                        string_copy(&s2, &s1);
+                language_identifier* ldent = &((language_identifier*)LanguageReservedWords.buf)[j];
+                if (ldent->type == LRES_KEYWORD && string_compare(&ldent->name, &word)) {
+                    keyword = ldent;
+                    break;
+                }
+            }
 
-                        dynamic_array_append(tokens, &(token){.type = LRES_IDENTIFIER, .literal = s1});
-                        dynamic_array_append(knownIdentifiers, &s2);
+            if (keyword != NULL) {
+                // For debugging purposes, the literal part of the token will contain the string name of the keyword
+                dynamic_array_append(tokens, &(token){.type = LRES_KEYWORD, .id = keyword->id, .literal = keyword->name, .offset = i});
+                afterVtag = keyword->vtag;
+            } else {
+                string identifier;
+                string_init(&identifier);
+                string_copy(&identifier, &word);
+                dynamic_array_append(tokens, &(token){.type = LRES_IDENTIFIER, .literal = identifier, .offset = i});
+
+                // If the previous token was a variable keyword (like int or float), then this is the declaration of the identifier
+                if (afterVtag) {
+                    string known;
+                    string_init(&known);
+                    string_copy(&known, &word);
+                    dynamic_array_append(knownIdentifiers, &known);
+                }
+                afterVtag = false;
+            }
 
-                        // Allows for skipping of redudant checks
-                        // the minus one is to account for the iteration of i by one at the end of the loop
-                        i = end - 1;
-                        goto loop_exit;
-                    }
+            // the minus one is to account for the iteration of i by one at the end of the loop
+            i = end - 1;
+            goto loop_exit;
+        }
 
-                    // This allows for the skipping of redudant checks for keywords when one has already been found at the current location
-                    // The minus one is to account for the fact that i will be iterated by one at the end of this loop
-                    i += ldent->name.len - 1;
-                    goto loop_exit;
-                }
+        for (int j = 0; j < LanguageReservedWords.len; j++) {
+            language_identifier* ldent = &((language_identifier*)LanguageReservedWords.buf)[j];
+            // Keywords were already handled above
+            if (ldent->type == LRES_KEYWORD) {
+                continue;
             }
 
-            // Searches for the known identifiers (the ones that have already been declared)
-            for (int j = 0; j < knownIdentifiers->len; j++) {
-                string* identifier = dynamic_array_get(knownIdentifiers, &INDEX(j));
-                if (string_compare_with_offset(file, identifier, i)) {
-                    string s3;
-                    string_init(&s3);
-                    string_copy(&s3, identifier);
-                    dynamic_array_append(tokens, &(token){.type = LRES_IDENTIFIER, .literal = s3});
-
-                    // This allows for the lexer to skip over redudant checks
-                    // the minus one is to account for the iteration of i by one at the end of the loop
-                    i += s3.len - 1;
-                    goto loop_exit;
+            if (string_compare_with_offset(file, &ldent->name, i)) {
+                //Check for comments first, as those can be skipped
+                if (ldent->type == LRES_COMMENT) {
+                    if (ldent->id == COMM_DSLASH) {
+                        // Account for length of double slashes by adding the length of the name of ldent
+                        int comm_end = i + ldent->name.len;
+                        for (int k = comm_end; k < file->len && file->str[k] != '\n'; k++) {
+                            comm_end++;
+                        }
+
+                        // The minus one is to account for the fact that i is incremented by one after this
+                        i = comm_end - 1;
+                        goto loop_exit;
+                    }
                 }
+                // For debugging purposes, the literal part of the token will contain the string name of the punctuator or operator
+                dynamic_array_append(tokens, &(token){.type = ldent->type, .id = ldent->id, .literal = ldent->name, .offset = i});
+                afterVtag = false;
+
+                // This allows for the skipping of redudant checks for keywords when one has already been found at the current location
+                // The minus one is to account for the fact that i will be iterated by one at the end of this loop
+                i += ldent->name.len - 1;
+                goto loop_exit;
             }
         }
 
@@ -22,6 +22,9 @@ typedef struct token {
     // keywords use this for debugging purposes to keep the string version of the keyword available
     // for print debugging
     string literal;
+
+    // Where the token starts in the file, as a byte offset. Used for pointing at the token in error messages
+    unsigned int offset;
 } token;
 
 // Used to specify the type field in the token parameter
@@ -45,7 +48,8 @@ enum Keywords {
     KEY_WHILE,
     KEY_FOR,
     KEY_RETURN,
-    KEY_STRING
+    KEY_STRING,
+    KEY_ELSE
 };
 
 enum Punctuators {
@@ -55,7 +59,8 @@ enum Punctuators {
     PUNC_CURLY_L,
     PUNC_CURLY_R,
     PUNC_PAREN_L,
-    PUNC_PAREN_R
+    PUNC_PAREN_R,
+    PUNC_COMMA
 };
 
 enum Operators {
@@ -63,7 +68,25 @@ enum Operators {
     OP_PLUS,
     OP_MINUS,
     OP_MULT,
-    OP_DIV
+    OP_DIV,
+    OP_LESS,
+    OP_GREATER,
+    OP_LESS_EQUAL,
+    OP_GREATER_EQUAL,
+    OP_EQUAL_EQUAL,
+    OP_NOT_EQUAL,
+    OP_PLUS_EQUAL,
+    OP_MINUS_EQUAL,
+    OP_MULT_EQUAL,
+    OP_DIV_EQUAL
+};
+
+// Used for the id of literal tokens, so that the parser can tell string literals apart from numbers
+// (the literal "123" and the number 123 would otherwise be the same token)
+enum Literals {
+    LIT_STRING,
+    LIT_INT,
+    LIT_FLOAT
 };
 
 enum Comments {
@@ -103,4 +126,8 @@ int lexer_module_terminate(void);
 // This is useful for the parsing part of the compiler
 int lexer(DynamicArray* tokens, DynamicArray* knownIdentifiers, string* file);
 
+// Returns the name of the keyword, punctuator, operator, or comment with the given type and id, or NULL if there isn't one.
+// The name is the same one that the lexer puts in the literal of those tokens, so it must not be modified or freed
+string* lexer_reserved_word(unsigned int type, unsigned int id);
+
 #endif
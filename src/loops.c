@@ -0,0 +1,782 @@
+#include "loops.h"
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "DynamicArrayAlgorithms.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "ir.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+int loops_deallocator(void* loop) {
+    dynamic_array_free(&((IR_loop*)loop)->blocks);
+    return 0;
+}
+
+int loops_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("IR_loop"), loops_deallocator, sizeof(IR_loop));
+    return 0;
+}
+
+static unsigned int* loops_block_instrs(IR_function* fn, unsigned int block) {
+    return (unsigned int*)ir_block(fn, block)->instrs.buf;
+}
+
+static unsigned int loops_terminator(IR_function* fn, unsigned int block) {
+    IR_block* b = ir_block(fn, block);
+    return ((unsigned int*)b->instrs.buf)[b->instrs.len - 1];
+}
+
+// Makes an array of bools with one entry for every block, all false
+static void loops_init_marks(IR_function* fn, DynamicArray* marks) {
+    dynamic_array_init(marks, &STRING("bool"));
+    dynamic_array_resize(marks, fn->blocks.len, true);
+    memset(marks->buf, 0, fn->blocks.len * sizeof(bool));
+}
+
+static void loops_set_marks(IR_loop* loop, DynamicArray* marks, bool value) {
+    for (unsigned int i = 0; i < loop->blocks.len; i++) {
+        ((bool*)marks->buf)[((unsigned int*)loop->blocks.buf)[i]] = value;
+    }
+}
+
+static bool loops_marked(DynamicArray* marks, unsigned int block) {
+    return block != IR_NONE && ((bool*)marks->buf)[block];
+}
+
+// Whether the value is defined inside of the loop whose blocks are marked
+static bool loops_defined_inside(IR_function* fn, DynamicArray* marks, unsigned int value) {
+    return loops_marked(marks, ir_instr(fn, value)->block);
+}
+
+// Puts a new block on the edge between two blocks
+static unsigned int loops_split_edge(IR_function* fn, unsigned int from, unsigned int to) {
+    unsigned int block = ir_add_block(fn);
+    ir_block(fn, block)->loop_depth = ir_block(fn, from)->loop_depth < ir_block(fn, to)->loop_depth ? ir_block(fn, from)->loop_depth : ir_block(fn, to)->loop_depth;
+    ir_add_instr(fn, block, IR_JUMP, SEM_TYPE_NONE, NULL, 0);
+
+    // The new block takes the place of from in the preds of to, so the phis of to don't have to change
+    IR_block* source = ir_block(fn, from);
+    source->succs[source->succs[0] == to ? 0 : 1] = block;
+    DynamicArray* preds = &ir_block(fn, to)->preds;
+    for (unsigned int p = 0; p < preds->len; p++) {
+        if (((unsigned int*)preds->buf)[p] == from) {
+            ((unsigned int*)preds->buf)[p] = block;
+            break;
+        }
+    }
+    ir_block(fn, block)->succs[0] = to;
+    dynamic_array_append(&ir_block(fn, block)->preds, &from);
+    return block;
+}
+
+// Whether the edge from the block to the header at the given index of the reverse postorder goes back to it. Every
+// loop the language can express has a header that dominates the rest of it, so an edge that goes backwards in the
+// reverse postorder always ends at a block that dominates where it came from, which makes walking up the dominator tree unnecessary
+static bool loops_back_edge(IR_function* fn, unsigned int from, unsigned int header) {
+    unsigned int index = ir_block(fn, from)->rpo_index;
+    return index != IR_NONE && index >= header;
+}
+
+// Fills in the blocks of every loop. Returns true if a preheader had to be made, which means the dominators have changed
+static bool loops_collect(IR_function* fn, DynamicArray* loops) {
+    DynamicArray marks;
+    loops_init_marks(fn, &marks);
+    DynamicArray worklist;
+    dynamic_array_init(&worklist, &STRING("unsigned int"));
+    // The reverse postorder indices of the blocks in the loop, which are sorted to put the blocks in order
+    DynamicArray found;
+    dynamic_array_init(&found, &STRING("unsigned int"));
+    bool split = false;
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int header = ((unsigned int*)fn->rpo.buf)[r];
+        IR_block* h = ir_block(fn, header);
+
+        // The loop is the header and everything that can reach one of its back edges without going through it
+        unsigned int latches = 0;
+        unsigned int latch = IR_NONE;
+        found.len = 0;
+        ((bool*)marks.buf)[header] = true;
+        dynamic_array_append(&found, &r);
+        for (unsigned int p = 0; p < h->preds.len; p++) {
+            unsigned int pred = ((unsigned int*)h->preds.buf)[p];
+            if (!loops_back_edge(fn, pred, r)) {
+                continue;
+            }
+            latches++;
+            latch = pred;
+            if (!((bool*)marks.buf)[pred]) {
+                ((bool*)marks.buf)[pred] = true;
+                dynamic_array_append(&worklist, &pred);
+                dynamic_array_append(&found, &ir_block(fn, pred)->rpo_index);
+            }
+        }
+        if (latches == 0) {
+            ((bool*)marks.buf)[header] = false;
+            continue;
+        }
+        while (worklist.len > 0) {
+            IR_block* b = ir_block(fn, ((unsigned int*)worklist.buf)[--worklist.len]);
+            for (unsigned int p = 0; p < b->preds.len; p++) {
+                unsigned int pred = ((unsigned int*)b->preds.buf)[p];
+                if (!((bool*)marks.buf)[pred]) {
+                    ((bool*)marks.buf)[pred] = true;
+                    dynamic_array_append(&worklist, &pred);
+                    dynamic_array_append(&found, &ir_block(fn, pred)->rpo_index);
+                }
+            }
+        }
+
+        IR_loop loop = {.header = header, .preheader = IR_NONE, .latch = latches == 1 ? latch : IR_NONE, .innermost = true};
+        dynamic_array_init(&loop.blocks, &STRING("unsigned int"));
+        dynamic_array_radix_sort(&found, 0, DA_TYPE_UNSIGNED_INT, NULL);
+        for (unsigned int i = 0; i < found.len; i++) {
+            unsigned int block = ((unsigned int*)fn->rpo.buf)[((unsigned int*)found.buf)[i]];
+            ((bool*)marks.buf)[block] = false;
+            dynamic_array_append(&loop.blocks, &block);
+        }
+
+        h = ir_block(fn, header);
+        unsigned int outside = 0;
+        unsigned int entry = IR_NONE;
+        for (unsigned int p = 0; p < h->preds.len; p++) {
+            unsigned int pred = ((unsigned int*)h->preds.buf)[p];
+            if (!loops_back_edge(fn, pred, r)) {
+                outside++;
+                entry = pred;
+            }
+        }
+        if (outside == 1 && ir_instr(fn, loops_terminator(fn, entry))->op == IR_JUMP) {
+            loop.preheader = entry;
+        } else if (outside == 1) {
+            loops_split_edge(fn, entry, header);
+            split = true;
+        }
+        dynamic_array_append(loops, &loop);
+    }
+
+    dynamic_array_free(&marks);
+    dynamic_array_free(&worklist);
+    dynamic_array_free(&found);
+    return split;
+}
+
+int loops_find(IR_function* fn, DynamicArray* loops) {
+    if (loops_collect(fn, loops)) {
+        // Only the new blocks changed, so going again finds the same loops, this time with every preheader in place
+        for (unsigned int i = 0; i < loops->len; i++) {
+            loops_deallocator(&((IR_loop*)loops->buf)[i]);
+        }
+        loops->len = 0;
+        ir_compute_dominators(fn);
+        loops_collect(fn, loops);
+    }
+
+    // A loop inside of another one has fewer blocks, so sorting by size puts inner loops first
+    dynamic_array_radix_sort(loops, offsetof(IR_loop, blocks) + offsetof(DynamicArray, len), DA_TYPE_UNSIGNED_INT, NULL);
+
+    // Any loop with another header in it isn't innermost
+    DynamicArray headers;
+    loops_init_marks(fn, &headers);
+    IR_loop* all = (IR_loop*)loops->buf;
+    for (unsigned int i = 0; i < loops->len; i++) {
+        ((bool*)headers.buf)[all[i].header] = true;
+    }
+    for (unsigned int i = 0; i < loops->len; i++) {
+        for (unsigned int b = 1; b < all[i].blocks.len; b++) {
+            if (((bool*)headers.buf)[((unsigned int*)all[i].blocks.buf)[b]]) {
+                all[i].innermost = false;
+                break;
+            }
+        }
+    }
+    dynamic_array_free(&headers);
+    return 0;
+}
+
+// Returns the report for the loop with the given header, adding one if it doesn't have one yet. Returns NULL for loops
+// that don't come from the source (like ones whose header was copied by unrolling an outer loop)
+static IR_loop_report* loops_get_report(IR_module* module, IR_function* fn, unsigned int header) {
+    unsigned int offset = ir_block(fn, header)->offset;
+    if (offset == IR_NONE) {
+        return NULL;
+    }
+    for (unsigned int i = 0; i < module->loop_reports.len; i++) {
+        IR_loop_report* report = &((IR_loop_report*)module->loop_reports.buf)[i];
+        if (report->function == fn->symbol && report->offset == offset) {
+            return report;
+        }
+    }
+    IR_loop_report report = {.function = fn->symbol, .offset = offset};
+    dynamic_array_append(&module->loop_reports, &report);
+    return &((IR_loop_report*)module->loop_reports.buf)[module->loop_reports.len - 1];
+}
+
+// Whether the instruction gives the same result every time it runs, as long as its operands don't change, and is
+// safe to run even on paths where it wouldn't have run before
+static bool loops_can_hoist(IR_function* fn, unsigned int value, bool storesGlobals, bool calls) {
+    IR_instr* instr = ir_instr(fn, value);
+    switch (instr->op) {
+        case IR_CONST_INT:
+        case IR_CONST_FLOAT:
+        case IR_CONST_STRING:
+        case IR_COPY:
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_NEG:
+        case IR_CONCAT:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_EQ:
+        case IR_NE:
+        case IR_INT_TO_FLOAT:
+        case IR_FLOAT_TO_INT:
+            return true;
+        case IR_DIV: {
+            // Int division can only be moved if it can't fail
+            if (instr->type != SEM_TYPE_INT) {
+                return true;
+            }
+            IR_instr* divisor = ir_instr(fn, *ir_operand(fn, value, 1));
+            return divisor->op == IR_CONST_INT && divisor->imm.i != 0 && divisor->imm.i != -1;
+        }
+        case IR_LOAD_GLOBAL:
+            // Calls could change any global. Stores to globals are only tracked loop-wide rather than per global
+            return !storesGlobals && !calls;
+    }
+    return false;
+}
+
+unsigned int loops_hoist_invariants(IR_module* module, IR_function* fn) {
+    unsigned int changes = 0;
+    DynamicArray loops;
+    dynamic_array_init(&loops, &STRING("IR_loop"));
+    loops_find(fn, &loops);
+    DynamicArray marks;
+    loops_init_marks(fn, &marks);
+    DynamicArray snapshot;
+    dynamic_array_init(&snapshot, &STRING("unsigned int"));
+
+    for (unsigned int l = 0; l < loops.len; l++) {
+        IR_loop* loop = &((IR_loop*)loops.buf)[l];
+        if (loop->preheader == IR_NONE) {
+            continue;
+        }
+        loops_set_marks(loop, &marks, true);
+
+        bool storesGlobals = false, calls = false;
+        for (unsigned int b = 0; b < loop->blocks.len; b++) {
+            IR_block* block = ir_block(fn, ((unsigned int*)loop->blocks.buf)[b]);
+            for (unsigned int i = 0; i < block->instrs.len; i++) {
+                unsigned int op = ir_instr(fn, ((unsigned int*)block->instrs.buf)[i])->op;
+                storesGlobals = storesGlobals || op == IR_STORE_GLOBAL;
+                calls = calls || op == IR_CALL;
+            }
+        }
+
+        // Going in reverse postorder means the operands of an instruction are always looked at before it, so one
+        // pass is enough to move chains of invariant instructions
+        unsigned int hoisted = 0;
+        for (unsigned int b = 0; b < loop->blocks.len; b++) {
+            unsigned int block = ((unsigned int*)loop->blocks.buf)[b];
+            IR_block* blk = ir_block(fn, block);
+            dynamic_array_resize(&snapshot, blk->instrs.len, true);
+            memcpy(snapshot.buf, blk->instrs.buf, blk->instrs.len * sizeof(unsigned int));
+
+            for (unsigned int i = 0; i < snapshot.len; i++) {
+                unsigned int value = ((unsigned int*)snapshot.buf)[i];
+                if (!loops_can_hoist(fn, value, storesGlobals, calls)) {
+                    continue;
+                }
+                bool invariant = true;
+                for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count && invariant; o++) {
+                    invariant = !loops_defined_inside(fn, &marks, *ir_operand(fn, value, o));
+                }
+                if (invariant) {
+                    ir_move_instr(fn, value, loop->preheader);
+                    hoisted++;
+                }
+            }
+        }
+
+        loops_set_marks(loop, &marks, false);
+        if (hoisted > 0) {
+            changes += hoisted;
+            IR_loop_report* report = loops_get_report(module, fn, loop->header);
+            if (report != NULL) {
+                report->hoisted += hoisted;
+            }
+        }
+    }
+
+    dynamic_array_free(&snapshot);
+    dynamic_array_free(&marks);
+    dynamic_array_free(&loops);
+    return changes;
+}
+
+// Returns the index of the block in the preds of another one
+static unsigned int loops_pred_index(IR_function* fn, unsigned int block, unsigned int pred) {
+    DynamicArray* preds = &ir_block(fn, block)->preds;
+    for (unsigned int p = 0; p < preds->len; p++) {
+        if (((unsigned int*)preds->buf)[p] == pred) {
+            return p;
+        }
+    }
+    return IR_NONE;
+}
+
+// Checks whether the phi is a basic induction variable of the loop: it starts at some value, and the value that comes
+// back around from the latch is the phi plus or minus a value from outside the loop. Fills in the step and the
+// instruction that does the increment if it is
+static bool loops_induction_variable(IR_function* fn, DynamicArray* marks, unsigned int phi, unsigned int latchIndex, unsigned int* step, unsigned int* increment) {
+    IR_instr* instr = ir_instr(fn, phi);
+    if (instr->op != IR_PHI || instr->type != SEM_TYPE_INT) {
+        return false;
+    }
+    unsigned int next = *ir_operand(fn, phi, latchIndex);
+    IR_instr* inc = ir_instr(fn, next);
+    if ((inc->op != IR_ADD && inc->op != IR_SUB) || inc->type != SEM_TYPE_INT) {
+        return false;
+    }
+    unsigned int a = *ir_operand(fn, next, 0);
+    unsigned int b = *ir_operand(fn, next, 1);
+    if (a == phi && !loops_defined_inside(fn, marks, b)) {
+        *step = b;
+    } else if (inc->op == IR_ADD && b == phi && !loops_defined_inside(fn, marks, a)) {
+        *step = a;
+    } else {
+        return false;
+    }
+    *increment = next;
+    return true;
+}
+
+unsigned int loops_strength_reduce(IR_module* module, IR_function* fn) {
+    unsigned int changes = 0;
+    DynamicArray loops;
+    dynamic_array_init(&loops, &STRING("IR_loop"));
+    loops_find(fn, &loops);
+    DynamicArray marks;
+    loops_init_marks(fn, &marks);
+    DynamicArray snapshot;
+    dynamic_array_init(&snapshot, &STRING("unsigned int"));
+    DynamicArray phis;
+    dynamic_array_init(&phis, &STRING("unsigned int"));
+
+    for (unsigned int l = 0; l < loops.len; l++) {
+        IR_loop* loop = &((IR_loop*)loops.buf)[l];
+        if (loop->preheader == IR_NONE || loop->latch == IR_NONE || ir_block(fn, loop->header)->preds.len != 2) {
+            continue;
+        }
+        unsigned int header = loop->header;
+        unsigned int preheader = loop->preheader;
+        unsigned int entryIndex = loops_pred_index(fn, header, preheader);
+        unsigned int latchIndex = 1 - entryIndex;
+        loops_set_marks(loop, &marks, true);
+
+        // The phis are copied first, since new ones are added to the header as the loop goes
+        phis.len = 0;
+        for (unsigned int i = 0; i < ir_block(fn, header)->instrs.len && ir_instr(fn, loops_block_instrs(fn, header)[i])->op == IR_PHI; i++) {
+            dynamic_array_append(&phis, &loops_block_instrs(fn, header)[i]);
+        }
+
+        unsigned int reduced = 0;
+        for (unsigned int p = 0; p < phis.len; p++) {
+            unsigned int iv = ((unsigned int*)phis.buf)[p];
+            unsigned int step, increment;
+            if (!loops_induction_variable(fn, &marks, iv, latchIndex, &step, &increment)) {
+                continue;
+            }
+
+            for (unsigned int b = 0; b < loop->blocks.len; b++) {
+                unsigned int block = ((unsigned int*)loop->blocks.buf)[b];
+                IR_block* blk = ir_block(fn, block);
+                dynamic_array_resize(&snapshot, blk->instrs.len, true);
+                memcpy(snapshot.buf, blk->instrs.buf, blk->instrs.len * sizeof(unsigned int));
+
+                for (unsigned int i = 0; i < snapshot.len; i++) {
+                    unsigned int mul = ((unsigned int*)snapshot.buf)[i];
+                    IR_instr* instr = ir_instr(fn, mul);
+                    if (instr->op != IR_MUL || instr->type != SEM_TYPE_INT) {
+                        continue;
+                    }
+                    unsigned int a = *ir_operand(fn, mul, 0);
+                    unsigned int c = *ir_operand(fn, mul, 1);
+                    unsigned int factor = a == iv ? c : c == iv ? a : IR_NONE;
+                    if (factor == IR_NONE || loops_defined_inside(fn, &marks, factor)) {
+                        continue;
+                    }
+
+                    // iv * factor starts at start * factor and goes up by step * factor every iteration. Ints wrap
+                    // around, so this is exact even when the multiplication overflows
+                    uint32_t operands[2] = {*ir_operand(fn, iv, entryIndex), factor};
+                    unsigned int start = ir_add_instr(fn, preheader, IR_MUL, SEM_TYPE_INT, operands, 2);
+                    operands[0] = step;
+                    unsigned int scaledStep = ir_add_instr(fn, preheader, IR_MUL, SEM_TYPE_INT, operands, 2);
+
+                    operands[entryIndex] = start;
+                    operands[latchIndex] = start;
+                    unsigned int derived = ir_add_instr(fn, IR_NONE, IR_PHI, SEM_TYPE_INT, operands, 2);
+                    ir_insert_instr(fn, derived, header, 0);
+
+                    operands[0] = derived;
+                    operands[1] = scaledStep;
+                    unsigned int next = ir_add_instr(fn, IR_NONE, ir_instr(fn, increment)->op, SEM_TYPE_INT, operands, 2);
+                    ir_instr(fn, next)->offset = ir_instr(fn, increment)->offset;
+                    unsigned int incrementBlock = ir_instr(fn, increment)->block;
+                    DynamicArray* instrs = &ir_block(fn, incrementBlock)->instrs;
+                    unsigned int at = 0;
+                    while (((unsigned int*)instrs->buf)[at] != increment) {
+                        at++;
+                    }
+                    ir_insert_instr(fn, next, incrementBlock, at + 1);
+                    *ir_operand(fn, derived, latchIndex) = next;
+
+                    ir_replace_with_copy(fn, mul, derived);
+                    reduced++;
+                }
+            }
+        }
+
+        loops_set_marks(loop, &marks, false);
+        if (reduced > 0) {
+            changes += reduced;
+            IR_loop_report* report = loops_get_report(module, fn, header);
+            if (report != NULL) {
+                report->reduced += reduced;
+            }
+        }
+    }
+
+    dynamic_array_free(&phis);
+    dynamic_array_free(&snapshot);
+    dynamic_array_free(&marks);
+    dynamic_array_free(&loops);
+    return changes;
+}
+
+// Works out a comparison the same way the program would
+static bool loops_compare(unsigned int op, int32_t a, int32_t b) {
+    switch (op) {
+        case IR_LT:
+            return a < b;
+        case IR_LE:
+            return a <= b;
+        case IR_GT:
+            return a > b;
+        case IR_GE:
+            return a >= b;
+        case IR_EQ:
+            return a == b;
+        case IR_NE:
+            return a != b;
+    }
+    return false;
+}
+
+// Works out how many times the loop runs, if the exit test in its header compares an induction variable that starts
+// at a constant and moves by a constant with another constant. Returns IR_NONE if it isn't known or is more than
+// LOOP_UNROLL_MAX_TRIPS
+static unsigned int loops_trip_count(IR_function* fn, IR_loop* loop, DynamicArray* marks, unsigned int entryIndex, unsigned int latchIndex) {
+    unsigned int branch = loops_terminator(fn, loop->header);
+    if (ir_instr(fn, branch)->op != IR_BRANCH) {
+        return IR_NONE;
+    }
+    bool continueWhenTrue = loops_marked(marks, ir_block(fn, loop->header)->succs[0]);
+
+    unsigned int condition = *ir_operand(fn, branch, 0);
+    IR_instr* compare = ir_instr(fn, condition);
+    if (compare->op < IR_LT || compare->op > IR_NE || ir_instr(fn, *ir_operand(fn, condition, 0))->type != SEM_TYPE_INT) {
+        return IR_NONE;
+    }
+    unsigned int left = *ir_operand(fn, condition, 0);
+    unsigned int right = *ir_operand(fn, condition, 1);
+    bool ivOnLeft = ir_instr(fn, left)->op == IR_PHI && ir_instr(fn, left)->block == loop->header;
+    unsigned int iv = ivOnLeft ? left : right;
+    unsigned int bound = ivOnLeft ? right : left;
+    unsigned int step, increment;
+    if (ir_instr(fn, iv)->block != loop->header || ir_instr(fn, bound)->op != IR_CONST_INT ||
+        !loops_induction_variable(fn, marks, iv, latchIndex, &step, &increment)) {
+        return IR_NONE;
+    }
+    IR_instr* start = ir_instr(fn, *ir_operand(fn, iv, entryIndex));
+    if (start->op != IR_CONST_INT || ir_instr(fn, step)->op != IR_CONST_INT) {
+        return IR_NONE;
+    }
+
+    int32_t value = start->imm.i;
+    int32_t by = ir_instr(fn, step)->imm.i;
+    int32_t limit = ir_instr(fn, bound)->imm.i;
+    bool subtract = ir_instr(fn, increment)->op == IR_SUB;
+    for (unsigned int trips = 0; trips <= LOOP_UNROLL_MAX_TRIPS; trips++) {
+        bool result = ivOnLeft ? loops_compare(compare->op, value, limit) : loops_compare(compare->op, limit, value);
+        if (result != continueWhenTrue) {
+            return trips;
+        }
+        value = (int32_t)(subtract ? (uint32_t)value - (uint32_t)by : (uint32_t)value + (uint32_t)by);
+    }
+    return IR_NONE;
+}
+
+// Makes the loop's values that are used after it go through phis in the exit block, so that when copies of the loop
+// add more ways into the exit block, the phis are the only thing that has to be updated
+static void loops_add_exit_phis(IR_function* fn, DynamicArray* marks, unsigned int exit) {
+    DynamicArray exitPhis;
+    dynamic_array_init(&exitPhis, &STRING("unsigned int"));
+    unsigned int count = fn->instrs.len;
+    dynamic_array_resize(&exitPhis, count, true);
+    memset(exitPhis.buf, 0xff, count * sizeof(unsigned int));
+    DynamicArray snapshot;
+    dynamic_array_init(&snapshot, &STRING("unsigned int"));
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        if (loops_marked(marks, block)) {
+            continue;
+        }
+        IR_block* b = ir_block(fn, block);
+        dynamic_array_resize(&snapshot, b->instrs.len, true);
+        memcpy(snapshot.buf, b->instrs.buf, b->instrs.len * sizeof(unsigned int));
+        for (unsigned int i = 0; i < snapshot.len; i++) {
+            unsigned int value = ((unsigned int*)snapshot.buf)[i];
+            if (value >= count) {
+                // One of the new phis, whose operand has to stay the value from inside of the loop
+                continue;
+            }
+            for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+                unsigned int operand = *ir_operand(fn, value, o);
+                if (!loops_defined_inside(fn, marks, operand)) {
+                    continue;
+                }
+                unsigned int* phi = &((unsigned int*)exitPhis.buf)[operand];
+                if (*phi == IR_NONE) {
+                    unsigned int made = ir_add_instr(fn, IR_NONE, IR_PHI, ir_instr(fn, operand)->type, &operand, 1);
+                    ir_insert_instr(fn, made, exit, 0);
+                    phi = &((unsigned int*)exitPhis.buf)[operand];
+                    *phi = made;
+                }
+                *ir_operand(fn, value, o) = *phi;
+            }
+        }
+    }
+    dynamic_array_free(&snapshot);
+    dynamic_array_free(&exitPhis);
+}
+
+// Copies the loop once in front of itself. The copy of the header is entered from entry instead of the loop's own
+// header, and the copy of the latch jumps to the loop's header. Returns the copy of the latch, which is the new way into the loop
+static unsigned int loops_peel(IR_function* fn, IR_loop* loop, unsigned int entry, unsigned int entryIndex, unsigned int latchIndex, unsigned int originalCount, DynamicArray* valueMap, DynamicArray* blockMap) {
+    unsigned int* blocks = (unsigned int*)loop->blocks.buf;
+    for (unsigned int b = 0; b < loop->blocks.len; b++) {
+        unsigned int copy = ir_add_block(fn);
+        ir_block(fn, copy)->loop_depth = ir_block(fn, blocks[b])->loop_depth - 1;
+        ((unsigned int*)blockMap->buf)[blocks[b]] = copy;
+    }
+
+    DynamicArray operands;
+    dynamic_array_init(&operands, &STRING("unsigned int"));
+    unsigned int* values = (unsigned int*)valueMap->buf;
+    for (unsigned int b = 0; b < loop->blocks.len; b++) {
+        unsigned int block = blocks[b];
+        unsigned int copy = ((unsigned int*)blockMap->buf)[block];
+        for (unsigned int i = 0; i < ir_block(fn, block)->instrs.len; i++) {
+            unsigned int value = loops_block_instrs(fn, block)[i];
+            IR_instr instr = *ir_instr(fn, value);
+            unsigned int cloned;
+            if (instr.op == IR_PHI && block == loop->header) {
+                // The copy of the header is only entered one way, so its phis just take the value from that way
+                unsigned int incoming = *ir_operand(fn, value, entryIndex);
+                cloned = ir_add_instr(fn, copy, IR_COPY, instr.type, &incoming, 1);
+                ir_instr(fn, cloned)->offset = instr.offset;
+            } else {
+                operands.len = 0;
+                for (unsigned int o = 0; o < instr.operand_count; o++) {
+                    unsigned int operand = *ir_operand(fn, value, o);
+                    if (operand < originalCount && values[operand] != IR_NONE) {
+                        operand = values[operand];
+                    }
+                    dynamic_array_append(&operands, &operand);
+                }
+                cloned = ir_add_instr(fn, copy, instr.op, instr.type, (uint32_t*)operands.buf, operands.len);
+                ir_instr(fn, cloned)->imm = instr.imm;
+                ir_instr(fn, cloned)->offset = instr.offset;
+            }
+            values[value] = cloned;
+        }
+    }
+    dynamic_array_free(&operands);
+
+    unsigned int* copies = (unsigned int*)blockMap->buf;
+    unsigned int header = loop->header;
+    unsigned int latchCopy = copies[loop->latch];
+    for (unsigned int b = 0; b < loop->blocks.len; b++) {
+        unsigned int block = blocks[b];
+        IR_block* original = ir_block(fn, block);
+        IR_block* copy = ir_block(fn, copies[block]);
+        for (unsigned int s = 0; s < 2; s++) {
+            unsigned int succ = original->succs[s];
+            if (succ == IR_NONE || succ == header) {
+                copy->succs[s] = succ;
+            } else if (copies[succ] != IR_NONE) {
+                copy->succs[s] = copies[succ];
+            } else {
+                // Leaving the loop. The exit phis get the copy's version of their value
+                copy->succs[s] = succ;
+                unsigned int from = loops_pred_index(fn, succ, block);
+                dynamic_array_append(&ir_block(fn, succ)->preds, &copies[block]);
+                for (unsigned int i = 0; i < ir_block(fn, succ)->instrs.len; i++) {
+                    unsigned int phi = loops_block_instrs(fn, succ)[i];
+                    if (ir_instr(fn, phi)->op != IR_PHI) {
+                        break;
+                    }
+                    unsigned int operand = *ir_operand(fn, phi, from);
+                    ir_add_phi_operand(fn, phi, operand < originalCount && values[operand] != IR_NONE ? values[operand] : operand);
+                }
+            }
+            copy = ir_block(fn, copies[block]);
+            original = ir_block(fn, block);
+        }
+
+        if (block != header) {
+            for (unsigned int p = 0; p < original->preds.len; p++) {
+                unsigned int pred = copies[((unsigned int*)original->preds.buf)[p]];
+                dynamic_array_append(&ir_block(fn, copies[block])->preds, &pred);
+            }
+        }
+    }
+
+    // entry now goes into the copy, and the copy's latch goes into the loop
+    unsigned int headerCopy = copies[header];
+    dynamic_array_append(&ir_block(fn, headerCopy)->preds, &entry);
+    IR_block* e = ir_block(fn, entry);
+    e->succs[e->succs[0] == header ? 0 : 1] = headerCopy;
+    ((unsigned int*)ir_block(fn, header)->preds.buf)[entryIndex] = latchCopy;
+    for (unsigned int i = 0; i < ir_block(fn, header)->instrs.len; i++) {
+        unsigned int phi = loops_block_instrs(fn, header)[i];
+        if (ir_instr(fn, phi)->op != IR_PHI) {
+            break;
+        }
+        unsigned int operand = *ir_operand(fn, phi, latchIndex);
+        *ir_operand(fn, phi, entryIndex) = operand < originalCount && values[operand] != IR_NONE ? values[operand] : operand;
+    }
+    return latchCopy;
+}
+
+unsigned int loops_unroll(IR_module* module, IR_function* fn) {
+    unsigned int changes = 0;
+    DynamicArray loops;
+    dynamic_array_init(&loops, &STRING("IR_loop"));
+    loops_find(fn, &loops);
+    DynamicArray marks;
+    loops_init_marks(fn, &marks);
+
+    // The loops are unrolled in the order they come in the function. A loop can use the values of one that comes before
+    // it, and unrolling that one first changes those uses to go through its exit phis before they get copied
+    DynamicArray order;
+    dynamic_array_init(&order, &STRING("unsigned long long"));
+    for (unsigned int l = 0; l < loops.len; l++) {
+        IR_loop* loop = &((IR_loop*)loops.buf)[l];
+        if (loop->innermost) {
+            unsigned long long key = ((unsigned long long)ir_block(fn, loop->header)->rpo_index << 32) | l;
+            dynamic_array_append(&order, &key);
+        }
+    }
+    if (order.len > 0) {
+        dynamic_array_radix_sort(&order, 0, DA_TYPE_UNSIGNED_LONG_LONG, NULL);
+    }
+
+    for (unsigned int o = 0; o < order.len; o++) {
+        IR_loop* loop = &((IR_loop*)loops.buf)[(unsigned int)((unsigned long long*)order.buf)[o]];
+        unsigned int header = loop->header;
+        if (loop->preheader == IR_NONE || loop->latch == IR_NONE || loop->latch == header ||
+            ir_block(fn, header)->preds.len != 2 || ir_instr(fn, loops_terminator(fn, loop->latch))->op != IR_JUMP) {
+            continue;
+        }
+        loops_set_marks(loop, &marks, true);
+
+        // The only way out of the loop has to be the test in the header (returns from inside of it are fine)
+        bool oneExit = true;
+        unsigned int size = 0;
+        for (unsigned int b = 0; b < loop->blocks.len; b++) {
+            IR_block* blk = ir_block(fn, ((unsigned int*)loop->blocks.buf)[b]);
+            size += blk->instrs.len;
+            for (unsigned int s = 0; s < 2; s++) {
+                if (blk->succs[s] != IR_NONE && !loops_marked(&marks, blk->succs[s]) && b != 0) {
+                    oneExit = false;
+                }
+            }
+        }
+        IR_block* h = ir_block(fn, header);
+        unsigned int exit = h->succs[1] != IR_NONE && !loops_marked(&marks, h->succs[1]) ? h->succs[1] : h->succs[0];
+        unsigned int entryIndex = loops_pred_index(fn, header, loop->preheader);
+        unsigned int latchIndex = 1 - entryIndex;
+        unsigned int trips = oneExit && !loops_marked(&marks, exit) && ir_block(fn, exit)->preds.len == 1 ?
+                             loops_trip_count(fn, loop, &marks, entryIndex, latchIndex) : IR_NONE;
+        if (trips == IR_NONE || trips == 0 || trips * size > LOOP_UNROLL_MAX_INSTRS) {
+            loops_set_marks(loop, &marks, false);
+            continue;
+        }
+
+        loops_add_exit_phis(fn, &marks, exit);
+
+        unsigned int originalCount = fn->instrs.len;
+        DynamicArray valueMap;
+        dynamic_array_init(&valueMap, &STRING("unsigned int"));
+        dynamic_array_resize(&valueMap, originalCount, true);
+        DynamicArray blockMap;
+        dynamic_array_init(&blockMap, &STRING("unsigned int"));
+        unsigned int entry = loop->preheader;
+        for (unsigned int t = 0; t < trips; t++) {
+            memset(valueMap.buf, 0xff, originalCount * sizeof(unsigned int));
+            dynamic_array_resize(&blockMap, fn->blocks.len + loop->blocks.len, true);
+            memset(blockMap.buf, 0xff, blockMap.len * sizeof(unsigned int));
+            entry = loops_peel(fn, loop, entry, entryIndex, latchIndex, originalCount, &valueMap, &blockMap);
+        }
+        dynamic_array_free(&valueMap);
+        dynamic_array_free(&blockMap);
+
+        // The copies are new blocks, which the loops after this one can use values from
+        loops_set_marks(loop, &marks, false);
+        unsigned int old = marks.len;
+        dynamic_array_resize(&marks, fn->blocks.len, true);
+        memset((bool*)marks.buf + old, 0, (marks.len - old) * sizeof(bool));
+
+        changes++;
+        IR_loop_report* report = loops_get_report(module, fn, header);
+        if (report != NULL) {
+            report->unrolled = trips;
+        }
+    }
+
+    dynamic_array_free(&order);
+    dynamic_array_free(&marks);
+    dynamic_array_free(&loops);
+    if (changes > 0) {
+        ir_compute_dominators(fn);
+    }
+    return changes;
+}
+
+int loops_report(IR_module* module, DynamicArray* diagnostics) {
+    for (unsigned int i = 0; i < module->loop_reports.len; i++) {
+        IR_loop_report* report = &((IR_loop_report*)module->loop_reports.buf)[i];
+        const char* name = interner_get(module->symbols, report->function)->str;
+        if (report->unrolled > 0) {
+            diagnostics_add(diagnostics, DIAG_NOTE, report->offset, "loop in %s was fully unrolled into %u %s of its body",
+                            name, report->unrolled, report->unrolled == 1 ? "copy" : "copies");
+        }
+        if (report->hoisted > 0 || report->reduced > 0) {
+            diagnostics_add(diagnostics, DIAG_NOTE, report->offset, "loop in %s: %u instruction%s hoisted out of the loop, %u multiplication%s strength reduced",
+                            name, report->hoisted, report->hoisted == 1 ? "" : "s", report->reduced, report->reduced == 1 ? "" : "s");
+        }
+    }
+    return 0;
+}
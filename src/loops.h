@@ -0,0 +1,59 @@
+#ifndef LOOPS_H
+#define LOOPS_H
+
+#include <stdbool.h>
+#include "DynamicArray.h"
+#include "ir.h"
+#include "optimize.h"
+
+// Optimizations for the loops in the IR. Loops are found from the back edges of the control flow graph (edges to a
+// block that dominates the one they come from), so they work the same for while and for loops
+
+// Loops whose number of iterations is known are only unrolled if they run at most this many times, and the copies of
+// the body don't add up to more than LOOP_UNROLL_MAX_INSTRS instructions
+#define LOOP_UNROLL_MAX_TRIPS 16
+#define LOOP_UNROLL_MAX_INSTRS 256
+
+typedef struct IR_loop {
+    unsigned int header;
+    // The only block outside of the loop that jumps to the header, which always ends in a jump to it.
+    // IR_NONE if more than one block outside of the loop jumps to the header
+    unsigned int preheader;
+    // The only block in the loop that jumps back to the header, or IR_NONE if there is more than one
+    unsigned int latch;
+    // Whether the loop has no other loops inside of it
+    bool innermost;
+    // The blocks in the loop (of type unsigned int), in reverse postorder, so the header is always first
+    DynamicArray blocks;
+} IR_loop;
+
+// Moves instructions whose values are the same on every iteration out of the loop and into the preheader
+unsigned int loops_hoist_invariants(IR_module* module, IR_function* fn);
+
+// Replaces multiplications of an induction variable (a variable that goes up or down by the same amount every
+// iteration) by a value that doesn't change in the loop with a new induction variable that goes up by the product instead
+unsigned int loops_strength_reduce(IR_module* module, IR_function* fn);
+
+// Fully unrolls small innermost loops whose number of iterations is known ahead of time. The body is copied in front
+// of the loop once per iteration, which leaves the loop itself unable to run again, and constant propagation then removes it
+unsigned int loops_unroll(IR_module* module, IR_function* fn);
+
+static const IR_pass IR_PASS_HOIST_INVARIANTS = {.name = "loop invariant code motion", .run = loops_hoist_invariants};
+static const IR_pass IR_PASS_STRENGTH_REDUCE = {.name = "strength reduction", .run = loops_strength_reduce};
+static const IR_pass IR_PASS_UNROLL = {.name = "loop unrolling", .run = loops_unroll};
+
+// Registers the types used by this module. Should be called once after ir_module_init
+int loops_module_init(void);
+
+// For use with the type registry
+int loops_deallocator(void* loop);
+
+// Finds every loop in the function and adds it to loops (an array of IR_loop), innermost loops first. Loops whose
+// header has one block outside of the loop jumping to it, but with a branch, get a new preheader block on that edge.
+// The dominators of the function have to be up to date
+int loops_find(IR_function* fn, DynamicArray* loops);
+
+// Adds a note to diagnostics (an array of Diagnostics) for every loop that the loop optimizations changed
+int loops_report(IR_module* module, DynamicArray* diagnostics);
+
+#endif
@@ -1,17 +1,324 @@
+#include "Cache.h"
+#include "Diagnostics.h"
 #include "DynamicArray.h"
 #include "Strings.h"
 #include "lexer.h"
+#include "fold.h"
+#include "incremental.h"
+#include "ir.h"
+#include "loops.h"
+#include "optimize.h"
+#include "parser.h"
+#include "semantic.h"
+#include "ThreadPool.h"
+#include "VirtualMachine.h"
+#include "VirtualMachineFile.h"
+#include "VirtualMachineJit.h"
+#include "VirtualMachineProfile.h"
+#include "VirtualMachineRunner.h"
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+// Usage: main <file> [--tokens] [--ast] [--types] [--ir] [--stats] [--verify-ir] [--loops] [--cache <dir>] [--cache-limit <bytes>]
+//            [--bytecode] [--emit-bytecode <file>] [--run] [--interpret] [--op-pairs <file>] [--profile <file>]
+//            [--heap-limit <bytes>] [--nursery <bytes>] [--isolates <count>] [--threads <count>]
+// --tokens prints every token produced by the lexer (this is also what happens when no flags are given)
+// --ast prints the abstract syntax tree generated by the parser
+// --types prints the tree along with the type and storage slot the semantic pass found for every node
+// --ir prints the SSA form of every function after it has been optimized
+// --stats prints what each optimization pass did, along with how long each pass over the IR took
+// --verify-ir checks that the IR is well formed after every pass
+// --loops prints a note for every loop that was unrolled, or had instructions hoisted out of it or strength reduced
+// --cache keeps the tokens and tree of every file that parsed without errors in the given directory, so that running on
+// the same file again skips the lexer and parser. It also keeps every function of the file, so that after the file is
+// changed only the functions that changed are parsed again, and only the ones that changed or use something that
+// changed are checked again. --cache-limit is how big the directory can get (64MB by default)
+// --bytecode prints the bytecode the VM runs for every function
+// --emit-bytecode writes the bytecode to the given file, which can then be given to main in place of the source. Only
+// --bytecode, --run, --interpret, --op-pairs, --profile, --stats, --heap-limit, --nursery, --isolates and --threads do
+// anything for a bytecode file. With --cache, the bytecode is also kept in the cache, so running a file that hasn't changed skips straight to the VM
+// --run runs the top level of the file in the VM, and then main if there is a function with that name and no parameters,
+// printing what main returned. Hot functions are compiled to machine code where the JIT is supported
+// --interpret runs everything in the interpreter instead, to compare the two. Implies --run
+// --op-pairs counts how often every op of the VM runs right after every other one while running, adds the counts to the
+// ones already in the given file, and prints the most common pairs of all the runs so far. Implies --interpret
+// --profile counts how often every op runs and how long it takes, and samples where the program is every millisecond of
+// CPU time. It prints the ops that took the longest along with the hottest statements and functions, and writes every
+// sampled stack to the given file in the collapsed format flame graph tools take. Implies --interpret
+// --heap-limit is how many bytes the strings the program makes can take up at once (1GB by default), and --nursery is how
+// big the part of the heap new strings are made in is (1MB by default)
+// --isolates runs the program the given number of times at once, each run in a VM of its own, and prints how many runs
+// there were a second. --threads is how many threads that is spread over (one for every core by default). Implies --run,
+// and is ignored by --op-pairs and --profile
+// Note: the tree printed by --types is the one after constant folding
+
+// What to do with a program once it has been compiled or loaded
+typedef struct RunOptions {
+    bool printBytecode;
+    bool printStats;
+    bool run;
+    bool interpret;
+    char *emitBytecode;
+    char *opPairs;
+    char *profile;
+    unsigned long long heapLimit;
+    unsigned long long nurserySize;
+    unsigned int isolates;
+    unsigned int threads;
+} RunOptions;
+
+// Runs the program options->isolates times at once, all sharing the one program. Every run does the same thing, so only
+// the first one that was stopped (or else the first one) is printed
+static int run_isolates(VM_program *program, RunOptions *options) {
+    unsigned int threads = options->threads > 0 ? options->threads : thread_pool_default_size();
+    // The thread that calls vm_run_all takes part as well, so one thread doesn't need a pool at all
+    ThreadPool pool;
+    if (threads > 1) {
+        thread_pool_init(&pool, threads - 1);
+    }
+    VM_run *runs = (VM_run *)malloc(options->isolates * sizeof(VM_run));
+    if (runs == NULL) {
+        printf("Failed to allocate memory in run_isolates\n");
+        exit(-1);
+    }
+    for (unsigned int i = 0; i < options->isolates; i++) {
+        runs[i].program = program;
+    }
+    VM_run_options runOptions = {.jit = !options->interpret, .nursery_size = options->nurserySize, .heap_limit = options->heapLimit};
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = vm_run_all(threads > 1 ? &pool : NULL, runs, options->isolates, &runOptions);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    VM_run *shown = &runs[0];
+    for (unsigned int i = 0; i < options->isolates && result != 0; i++) {
+        if (runs[i].error != NULL) {
+            shown = &runs[i];
+            break;
+        }
+    }
+    if (shown->error != NULL) {
+        printf("Runtime error in %s: %s\n", interner_get(program->symbols, shown->error_function)->str, shown->error);
+    } else if (shown->has_result) {
+        printf("main returned ");
+        vm_print_value(shown->result);
+        printf("\n");
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("isolates: %u runs on %u thread%s in %.3f ms (%.0f runs per second)\n", options->isolates, threads, threads == 1 ? "" : "s",
+           seconds * 1e3, options->isolates / seconds);
+    for (unsigned int i = 0; i < options->isolates; i++) {
+        vm_run_free(&runs[i]);
+    }
+    free(runs);
+    if (threads > 1) {
+        thread_pool_free(&pool);
+    }
+    return result;
+}
+
+// source is the file the program was compiled from, or NULL if it was loaded from a bytecode file
+static int run_program(VM_program *program, RunOptions *options, string *source, const char *path) {
+    int result = 0;
+    if (options->printBytecode) {
+        vm_program_print(program);
+    }
+    if (options->emitBytecode != NULL) {
+        DynamicArray data;
+        dynamic_array_init(&data, &STRING("char"));
+        if (vm_program_serialize(program, &data) != 0 ||
+            file_write_atomic(&(string){.str = options->emitBytecode, .len = strlen(options->emitBytecode), .__memsize = 0},
+                              data.buf, data.len) != 0) {
+            printf("Couldn't write the bytecode to %s\n", options->emitBytecode);
+            result = -1;
+        }
+        dynamic_array_free(&data);
+    }
+    if (!options->run) {
+        return result;
+    }
+    if (options->isolates > 0 && options->opPairs == NULL && options->profile == NULL) {
+        return run_isolates(program, options) != 0 ? -1 : result;
+    }
+
+    VM vm;
+    vm_init(&vm, program);
+    vm_heap_set_limits(&vm.heap, options->nurserySize, options->heapLimit);
+    if (options->opPairs != NULL) {
+        vm_count_op_pairs(&vm);
+    }
+    if (!options->interpret) {
+        vm_jit_enable(&vm);
+    }
+    if (options->profile != NULL && vm_profile_start(&vm) != 0) {
+        printf("Samples can't be taken here, so the profile only has the op counts\n");
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    VM_value value;
+    bool returned;
+    if (vm_run_main(&vm, &value, &returned) != 0) {
+        printf("Runtime error in %s: %s\n", interner_get(program->symbols, vm.error_function)->str, vm.error);
+        result = -1;
+    } else if (returned) {
+        printf("main returned ");
+        vm_print_value(value);
+        printf("\n");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (options->profile != NULL) {
+        vm_profile_stop(&vm);
+        vm_profile_print(&vm, source, path, 20);
+        string profilePath = {.str = options->profile, .len = strlen(options->profile), .__memsize = 0};
+        if (vm_profile_write_collapsed(&vm, source, &profilePath) != 0) {
+            printf("Couldn't write the profile to %s\n", options->profile);
+        }
+    }
+    if (options->printStats) {
+        printf("vm: %u instructions, ran in %.3f ms\n", program->code.len,
+               (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+        vm_jit_print_stats(&vm);
+        vm_heap_print_stats(&vm.heap);
+    }
+    if (options->opPairs != NULL) {
+        vm_op_pairs_merge(vm.op_pairs, &(string){.str = options->opPairs, .len = strlen(options->opPairs), .__memsize = 0});
+        vm_op_pairs_print(vm.op_pairs, 20);
+    }
+    vm_free(&vm);
+    return result;
+}
 
 int main(int argc, char **argv) {
     if (argc <= 1) {
         return -1;
     }
 
+    char *path = NULL;
+    bool printTokens = false;
+    bool printAST = false;
+    bool printTypes = false;
+    bool printStats = false;
+    bool printIR = false;
+    bool verifyIR = false;
+    bool printLoops = false;
+    bool printBytecode = false;
+    bool run = false;
+    bool interpret = false;
+    char *opPairs = NULL;
+    char *emitBytecode = NULL;
+    char *profile = NULL;
+    char *cacheDir = NULL;
+    unsigned long long cacheLimit = CACHE_DEFAULT_LIMIT;
+    unsigned long long heapLimit = VM_HEAP_DEFAULT_LIMIT;
+    unsigned long long nurserySize = VM_HEAP_NURSERY_SIZE;
+    unsigned int isolates = 0;
+    unsigned int threads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tokens") == 0) {
+            printTokens = true;
+        } else if (strcmp(argv[i], "--ast") == 0) {
+            printAST = true;
+        } else if (strcmp(argv[i], "--types") == 0) {
+            printTypes = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else if (strcmp(argv[i], "--ir") == 0) {
+            printIR = true;
+        } else if (strcmp(argv[i], "--verify-ir") == 0) {
+            verifyIR = true;
+        } else if (strcmp(argv[i], "--loops") == 0) {
+            printLoops = true;
+        } else if (strcmp(argv[i], "--bytecode") == 0) {
+            printBytecode = true;
+        } else if (strcmp(argv[i], "--emit-bytecode") == 0 && i + 1 < argc) {
+            emitBytecode = argv[++i];
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = true;
+        } else if (strcmp(argv[i], "--op-pairs") == 0 && i + 1 < argc) {
+            opPairs = argv[++i];
+            run = true;
+            interpret = true;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile = argv[++i];
+            run = true;
+            interpret = true;
+        } else if (strcmp(argv[i], "--interpret") == 0) {
+            run = true;
+            interpret = true;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc) {
+            cacheLimit = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--heap-limit") == 0 && i + 1 < argc) {
+            heapLimit = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--nursery") == 0 && i + 1 < argc) {
+            nurserySize = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--isolates") == 0 && i + 1 < argc) {
+            isolates = (unsigned int)strtoul(argv[++i], NULL, 10);
+            run = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path == NULL) {
+        return -1;
+    }
+    if (!printAST && !printTypes && !printStats && !printIR && !verifyIR && !printLoops && !printBytecode && !run &&
+        emitBytecode == NULL) {
+        printTokens = true;
+    }
+
     dynamic_array_registry_init();
     lexer_module_init();
+    diagnostics_module_init();
+    ast_module_init();
+    semantic_module_init();
+    fold_module_init();
+    ir_module_init();
+    optimize_module_init();
+    loops_module_init();
+    incremental_module_init();
+    vm_module_init();
+
+    RunOptions options = {.printBytecode = printBytecode,
+                          .printStats = printStats,
+                          .run = run,
+                          .interpret = interpret,
+                          .emitBytecode = emitBytecode,
+                          .opPairs = opPairs,
+                          .profile = profile,
+                          .heapLimit = heapLimit,
+                          .nurserySize = nurserySize,
+                          .isolates = isolates,
+                          .threads = threads};
+
+    // A bytecode file is run straight from where it is mapped, without the rest of the compiler being involved
+    MappedFile input;
+    if (mapped_file_open(&input, &(string){.str = path, .len = strlen(path), .__memsize = 0}) == 0) {
+        if (vm_file_is_bytecode(input.data, input.size)) {
+            VM_program program;
+            int result = -1;
+            if (vm_program_deserialize(&program, &input, input.data, input.size) == 0) {
+                result = run_program(&program, &options, NULL, path);
+                vm_program_free(&program);
+            } else {
+                printf("%s isn't a valid bytecode file, or was made by a different version\n", path);
+                mapped_file_close(&input);
+            }
+            lexer_module_terminate();
+            dynamic_array_registry_terminate();
+            return result;
+        }
+        mapped_file_close(&input);
+    }
 
     DynamicArray tokens;
     dynamic_array_init(&tokens, &STRING("token"));
@@ -23,10 +330,60 @@ int main(int argc, char **argv) {
     string_init(&file);
     string_read_file(
         &file,
-        &(string){.str = argv[1], .len = strlen(argv[1]), .__memsize = 0});
-    lexer(&tokens, &identifiers, &file);
+        &(string){.str = path, .len = strlen(path), .__memsize = 0});
+
+    // With a cache, a file that has been seen before gets its tokens and tree back from the cache instead of being lexed
+    // and parsed again. The key covers every byte of the file, so any change to it is a miss
+    Cache cache;
+    bool useCache = cacheDir != NULL &&
+                    cache_open(&cache, &(string){.str = cacheDir, .len = strlen(cacheDir), .__memsize = 0}, cacheLimit) == 0;
+    if (cacheDir != NULL && !useCache) {
+        printf("Couldn't open the cache directory %s, so the cache won't be used\n", cacheDir);
+    }
+    uint64_t cacheKey = useCache ? cache_key(file.str, file.len, "ast") : 0;
+    uint64_t bytecodeKey = useCache ? cache_key(file.str, file.len, "bytecode") : 0;
+
+    MappedFile entry;
+    const void* payload;
+    size_t payloadSize;
+
+    // Bytecode is only cached for files without any diagnostics, so when nothing but the bytecode is needed a hit skips
+    // everything before the VM
+    bool onlyBytecode = !printTokens && !printAST && !printTypes && !printIR && !verifyIR && !printLoops;
+    if (useCache && onlyBytecode && cache_lookup(&cache, bytecodeKey, &entry, &payload, &payloadSize) == 0) {
+        VM_program program;
+        bool loaded = vm_program_deserialize(&program, &entry, payload, payloadSize) == 0;
+        cache_loaded(&cache, bytecodeKey, loaded);
+        if (loaded) {
+            int result = run_program(&program, &options, &file, path);
+            vm_program_free(&program);
+            if (printStats) {
+                cache_print_stats(&cache);
+            }
+            cache_close(&cache);
+            dynamic_array_free(&tokens);
+            dynamic_array_free(&identifiers);
+            string_free(&file);
+            lexer_module_terminate();
+            dynamic_array_registry_terminate();
+            return result;
+        }
+        mapped_file_close(&entry);
+    }
+
+    AST ast;
+    ast_init(&ast);
+    bool cached = false;
+    if (useCache && cache_lookup(&cache, cacheKey, &entry, &payload, &payloadSize) == 0) {
+        cached = ast_deserialize(&ast, &tokens, payload, payloadSize) == 0;
+        cache_loaded(&cache, cacheKey, cached);
+        mapped_file_close(&entry);
+    }
+    if (!cached) {
+        lexer(&tokens, &identifiers, &file);
+    }
 
-    for (int i = 0; i < tokens.len; i++) {
+    for (int i = 0; i < tokens.len && printTokens; i++) {
         token *tok = dynamic_array_get(&tokens, &INDEX(i));
         if (tok->type == LRES_LITERAL) {
             printf("TOKEN %d:\ntype: literal\nval: %s\n\n", i,
@@ -46,10 +403,133 @@ int main(int argc, char **argv) {
         }
     }
 
+    DynamicArray diagnostics;
+    dynamic_array_init(&diagnostics, &STRING("Diagnostic"));
+
+    ThreadPool pool;
+    thread_pool_init(&pool, 0);
+
+    // When the file changed since it was last cached, the functions that didn't change are still reused
+    Incremental incremental;
+    bool useIncremental = useCache && !cached;
+    bool seenBefore = false;
+    if (useIncremental) {
+        seenBefore = incremental_open(&incremental, &cache, &(string){.str = path, .len = strlen(path), .__memsize = 0}) == 0;
+    }
+
+    // Only trees without syntax errors are cached, so a hit never has any errors to report. A file that changed since it
+    // was last compiled is most likely being edited, and its functions are already kept, so the whole file isn't stored
+    // again (that would only fill the cache up with versions of it that won't be seen again)
+    int result = 0;
+    if (!cached) {
+        result = ast_generate(&ast, &tokens, &file, &diagnostics, &pool, useIncremental ? &incremental.parse : NULL);
+        if (useCache && !seenBefore && result == 0) {
+            DynamicArray data;
+            dynamic_array_init(&data, &STRING("char"));
+            if (ast_serialize(&ast, &data) == 0) {
+                cache_store(&cache, cacheKey, data.buf, data.len);
+            }
+            dynamic_array_free(&data);
+        }
+    }
+    if (printAST) {
+        ast_print(&ast, 0, 0);
+    }
+
+    Semantic sem;
+    semantic_init(&sem);
+    if (useIncremental) {
+        incremental_prepare(&incremental, &ast);
+        sem.reuse = &incremental.semantic;
+    }
+    if (semantic_analyze(&sem, &ast, &diagnostics) != 0) {
+        result = -1;
+    }
+    if (useIncremental) {
+        incremental_save(&incremental, &ast, &sem, &diagnostics);
+    }
+
+    diagnostics_print(&diagnostics, &file, path);
+
+    // The optimizations count on the tree being valid, so they only run when there were no errors
+    IR_module ir;
+    ir_init(&ir);
+    if (result == 0) {
+        FoldStats foldStats;
+        fold_constants(&ast, &sem, &foldStats);
+        if (printStats) {
+            printf("constant folding: %u operators folded, %u variables propagated, %u branches folded, %u nodes eliminated\n",
+                   foldStats.folded, foldStats.propagated, foldStats.branches, foldStats.eliminated);
+        }
+
+        ir_generate(&ir, &ast, &sem);
+        IR_pass_manager passes;
+        pass_manager_init(&passes);
+        pass_manager_add_defaults(&passes);
+        passes.verify = verifyIR;
+        if (pass_manager_run(&passes, &ir) != 0) {
+            result = -1;
+        }
+        if (printStats) {
+            pass_manager_print_stats(&passes);
+        }
+        pass_manager_free(&passes);
+        if (printLoops) {
+            DynamicArray notes;
+            dynamic_array_init(&notes, &STRING("Diagnostic"));
+            loops_report(&ir, &notes);
+            diagnostics_print(&notes, &file, path);
+            dynamic_array_free(&notes);
+        }
+        if (printIR) {
+            ir_print(&ir);
+        }
+
+        VM_program program;
+        if ((printBytecode || run || emitBytecode != NULL) && result == 0) {
+            if (vm_compile(&program, &ir) != 0) {
+                result = -1;
+            } else {
+                if (useCache && !seenBefore && diagnostics.len == 0) {
+                    DynamicArray data;
+                    dynamic_array_init(&data, &STRING("char"));
+                    if (vm_program_serialize(&program, &data) == 0) {
+                        cache_store(&cache, bytecodeKey, data.buf, data.len);
+                    }
+                    dynamic_array_free(&data);
+                }
+                if (run_program(&program, &options, &file, path) != 0) {
+                    result = -1;
+                }
+            }
+            vm_program_free(&program);
+        }
+    }
+    if (printTypes) {
+        semantic_print(&sem, &ast, 0, 0);
+    }
+
+    if (useIncremental) {
+        if (printStats) {
+            incremental_print_stats(&incremental);
+        }
+        incremental_free(&incremental);
+    }
+    if (useCache) {
+        if (printStats) {
+            cache_print_stats(&cache);
+        }
+        cache_close(&cache);
+    }
+    ir_free(&ir);
+    semantic_free(&sem);
+    ast_free(&ast);
+    thread_pool_free(&pool);
+    dynamic_array_free(&diagnostics);
     dynamic_array_free(&tokens);
     dynamic_array_free(&identifiers);
     string_free(&file);
     lexer_module_terminate();
     dynamic_array_registry_terminate();
-    return 0;
+    return result;
 }
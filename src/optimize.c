@@ -0,0 +1,944 @@
+#include "optimize.h"
+#include "DynamicArray.h"
+#include "HashMap.h"
+#include "Interner.h"
+#include "Strings.h"
+#include "ir.h"
+#include "loops.h"
+#include "semantic.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// The key used to find instructions that compute the same thing during value numbering
+typedef struct IR_value_key {
+    uint32_t op;
+    uint32_t type;
+    uint32_t imm;
+    uint32_t a;
+    uint32_t b;
+} IR_value_key;
+
+enum IR_lattice_states {
+    // Nothing is known about the value yet, because the code that defines it hasn't been found to run
+    LATTICE_TOP,
+    LATTICE_CONSTANT,
+    // The value can be different every time it is computed
+    LATTICE_BOTTOM
+};
+
+// What constant propagation knows about a value
+typedef struct IR_lattice {
+    // One of the lattice states
+    unsigned int state;
+    unsigned int type;
+    int32_t i;
+    double f;
+    unsigned int symbol;
+} IR_lattice;
+
+static unsigned long long optimize_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+static unsigned int* optimize_block_instrs(IR_function* fn, unsigned int block) {
+    return (unsigned int*)ir_block(fn, block)->instrs.buf;
+}
+
+// Copies the instructions of a block, for passes that change the list while going over it
+static void optimize_snapshot(IR_function* fn, unsigned int block, DynamicArray* snapshot) {
+    IR_block* b = ir_block(fn, block);
+    dynamic_array_resize(snapshot, b->instrs.len, true);
+    if (b->instrs.len > 0) {
+        memcpy(snapshot->buf, b->instrs.buf, b->instrs.len * sizeof(unsigned int));
+    }
+}
+
+// Points every operand of every instruction at the value behind any copies. Returns how many operands were changed
+static unsigned int optimize_resolve_operands(IR_function* fn) {
+    unsigned int changes = 0;
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        for (unsigned int i = 0; i < ir_block(fn, block)->instrs.len; i++) {
+            unsigned int value = optimize_block_instrs(fn, block)[i];
+            for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+                uint32_t* operand = ir_operand(fn, value, o);
+                unsigned int resolved = ir_resolve(fn, *operand);
+                if (resolved != *operand) {
+                    *operand = resolved;
+                    changes++;
+                }
+            }
+        }
+    }
+    return changes;
+}
+
+// Merges the block with its only successor when it is that block's only predecessor, since the jump between them doesn't do anything
+static unsigned int optimize_merge_blocks(IR_function* fn) {
+    unsigned int merged = 0;
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        while (true) {
+            IR_block* b = ir_block(fn, block);
+            // The block is empty if it was already merged into the one before it
+            if (b->instrs.len == 0) {
+                break;
+            }
+            unsigned int jump = optimize_block_instrs(fn, block)[b->instrs.len - 1];
+            unsigned int next = b->succs[0];
+            if (ir_instr(fn, jump)->op != IR_JUMP || next == block || next == 0 || ir_block(fn, next)->preds.len != 1) {
+                break;
+            }
+
+            // With only one predecessor, every phi of the next block just passes along its only operand. Each one moves
+            // behind the other phis when it becomes a copy, so the next one is always first
+            while (ir_instr(fn, optimize_block_instrs(fn, next)[0])->op == IR_PHI) {
+                unsigned int value = optimize_block_instrs(fn, next)[0];
+                ir_replace_with_copy(fn, value, *ir_operand(fn, value, 0));
+            }
+
+            ir_remove_instr(fn, jump);
+            IR_block* dest = ir_block(fn, block);
+            IR_block* src = ir_block(fn, next);
+            for (unsigned int i = 0; i < src->instrs.len; i++) {
+                unsigned int value = ((unsigned int*)src->instrs.buf)[i];
+                ir_instr(fn, value)->block = block;
+                dynamic_array_append(&dest->instrs, &value);
+            }
+            src->instrs.len = 0;
+            src->preds.len = 0;
+
+            dest->succs[0] = src->succs[0];
+            dest->succs[1] = src->succs[1];
+            src->succs[0] = IR_NONE;
+            src->succs[1] = IR_NONE;
+            for (unsigned int s = 0; s < 2; s++) {
+                if (dest->succs[s] == IR_NONE) {
+                    continue;
+                }
+                IR_block* succ = ir_block(fn, dest->succs[s]);
+                for (unsigned int p = 0; p < succ->preds.len; p++) {
+                    if (((unsigned int*)succ->preds.buf)[p] == next) {
+                        ((unsigned int*)succ->preds.buf)[p] = block;
+                    }
+                }
+            }
+            merged++;
+        }
+    }
+    return merged;
+}
+
+unsigned int optimize_dead_code(IR_module* module, IR_function* fn) {
+    (void)module;
+    unsigned int changes = optimize_merge_blocks(fn);
+    if (changes > 0) {
+        ir_compute_dominators(fn);
+    }
+    // Merging can leave copies behind, which go away here since nothing uses them once the operands skip over them
+    optimize_resolve_operands(fn);
+
+    // Everything with a side effect is needed, and so is everything a needed instruction uses
+    DynamicArray worklist;
+    dynamic_array_init(&worklist, &STRING("unsigned int"));
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        for (unsigned int i = 0; i < ir_block(fn, block)->instrs.len; i++) {
+            unsigned int value = optimize_block_instrs(fn, block)[i];
+            if (ir_has_side_effects(ir_instr(fn, value))) {
+                ir_instr(fn, value)->flags |= IR_FLAG_MARK;
+                dynamic_array_append(&worklist, &value);
+            }
+        }
+    }
+    while (worklist.len > 0) {
+        unsigned int value = ((unsigned int*)worklist.buf)[--worklist.len];
+        for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+            unsigned int operand = *ir_operand(fn, value, o);
+            IR_instr* def = ir_instr(fn, operand);
+            if (!(def->flags & IR_FLAG_MARK)) {
+                def->flags |= IR_FLAG_MARK;
+                dynamic_array_append(&worklist, &operand);
+            }
+        }
+    }
+    dynamic_array_free(&worklist);
+
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* b = ir_block(fn, ((unsigned int*)fn->rpo.buf)[r]);
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < b->instrs.len; i++) {
+            unsigned int value = ((unsigned int*)b->instrs.buf)[i];
+            IR_instr* instr = ir_instr(fn, value);
+            if (instr->flags & IR_FLAG_MARK) {
+                instr->flags &= ~IR_FLAG_MARK;
+                ((unsigned int*)b->instrs.buf)[kept++] = value;
+                continue;
+            }
+            // The instruction is already out of the list, so it is just marked as removed
+            instr->op = IR_NOP;
+            instr->type = SEM_TYPE_NONE;
+            instr->block = IR_NONE;
+            instr->operand_count = 0;
+            changes++;
+        }
+        b->instrs.len = kept;
+    }
+    return changes;
+}
+
+static bool optimize_is_commutative(unsigned int op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE;
+}
+
+// Fills in the key for an instruction that can be numbered, or returns false for ones that can't (because they have
+// side effects, read something that can change, or have too many operands)
+static bool optimize_value_key(IR_function* fn, unsigned int value, IR_value_key* key) {
+    IR_instr* instr = ir_instr(fn, value);
+    *key = (IR_value_key){.op = instr->op, .type = instr->type, .imm = 0, .a = IR_NONE, .b = IR_NONE};
+    switch (instr->op) {
+        case IR_CONST_INT:
+        case IR_CONST_STRING:
+        case IR_PARAM:
+            key->imm = instr->imm.index;
+            return true;
+        case IR_CONST_FLOAT: {
+            // Compared by their bits, so 0.0 and -0.0 stay apart
+            uint64_t bits;
+            memcpy(&bits, &((double*)fn->floats.buf)[instr->imm.index], sizeof(double));
+            key->a = (uint32_t)bits;
+            key->b = (uint32_t)(bits >> 32);
+            return true;
+        }
+        case IR_PHI:
+            // Phis are only the same if they are in the same block
+            if (instr->operand_count != 2) {
+                return false;
+            }
+            key->imm = instr->block;
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_NEG:
+        case IR_CONCAT:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_EQ:
+        case IR_NE:
+        case IR_INT_TO_FLOAT:
+        case IR_FLOAT_TO_INT:
+            // Int division can fail, but a second one with the same operands never runs unless the first one didn't
+            break;
+        default:
+            return false;
+    }
+
+    key->a = ir_resolve(fn, *ir_operand(fn, value, 0));
+    if (instr->operand_count > 1) {
+        key->b = ir_resolve(fn, *ir_operand(fn, value, 1));
+        if (optimize_is_commutative(instr->op) && key->a > key->b) {
+            uint32_t swap = key->a;
+            key->a = key->b;
+            key->b = swap;
+        }
+    }
+    return true;
+}
+
+unsigned int optimize_value_numbering(IR_module* module, IR_function* fn) {
+    (void)module;
+    unsigned int changes = 0;
+    unsigned int count = fn->blocks.len;
+
+    // The children of every block in the dominator tree, stored as one list with where each block's children start
+    DynamicArray childStart;
+    dynamic_array_init(&childStart, &STRING("unsigned int"));
+    dynamic_array_resize(&childStart, count + 1, true);
+    memset(childStart.buf, 0, (count + 1) * sizeof(unsigned int));
+    unsigned int* starts = (unsigned int*)childStart.buf;
+    for (unsigned int r = 1; r < fn->rpo.len; r++) {
+        starts[ir_block(fn, ((unsigned int*)fn->rpo.buf)[r])->idom + 1]++;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        starts[i + 1] += starts[i];
+    }
+    DynamicArray children;
+    dynamic_array_init(&children, &STRING("unsigned int"));
+    dynamic_array_resize(&children, fn->rpo.len, true);
+    DynamicArray filled;
+    dynamic_array_init(&filled, &STRING("unsigned int"));
+    dynamic_array_resize(&filled, count, true);
+    memset(filled.buf, 0, count * sizeof(unsigned int));
+    for (unsigned int r = 1; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        unsigned int idom = ir_block(fn, block)->idom;
+        ((unsigned int*)children.buf)[starts[idom] + ((unsigned int*)filled.buf)[idom]++] = block;
+    }
+    dynamic_array_free(&filled);
+
+    // Values found in a block are available in every block it dominates, so the table is scoped to the dominator tree:
+    // everything added for a block is taken back out once all of the blocks under it are done
+    HashMap available;
+    hash_map_init(&available, &STRING("IR_value_key"), &STRING("unsigned int"));
+    DynamicArray added;
+    dynamic_array_init(&added, &STRING("IR_value_key"));
+    // Each entry on the stack is a block, the length of added when it was entered, and the next child to visit
+    DynamicArray stack;
+    dynamic_array_init(&stack, &STRING("unsigned int"));
+    DynamicArray snapshot;
+    dynamic_array_init(&snapshot, &STRING("unsigned int"));
+
+    unsigned int entry[3] = {0, 0, 0};
+    for (unsigned int i = 0; i < 3; i++) {
+        dynamic_array_append(&stack, &entry[i]);
+    }
+    bool entering = true;
+    while (stack.len > 0) {
+        unsigned int* top = &((unsigned int*)stack.buf)[stack.len - 3];
+        unsigned int block = top[0];
+        if (entering) {
+            optimize_snapshot(fn, block, &snapshot);
+            for (unsigned int i = 0; i < snapshot.len; i++) {
+                unsigned int value = ((unsigned int*)snapshot.buf)[i];
+                IR_value_key key;
+                if (!optimize_value_key(fn, value, &key)) {
+                    continue;
+                }
+                unsigned int* existing = hash_map_get(&available, &key);
+                if (existing != NULL) {
+                    ir_replace_with_copy(fn, value, *existing);
+                    changes++;
+                } else {
+                    hash_map_insert(&available, &key, &value);
+                    dynamic_array_append(&added, &key);
+                }
+            }
+        }
+
+        top = &((unsigned int*)stack.buf)[stack.len - 3];
+        if (starts[block] + top[2] < starts[block + 1]) {
+            unsigned int child = ((unsigned int*)children.buf)[starts[block] + top[2]++];
+            unsigned int next[3] = {child, added.len, 0};
+            for (unsigned int i = 0; i < 3; i++) {
+                dynamic_array_append(&stack, &next[i]);
+            }
+            entering = true;
+            continue;
+        }
+
+        // Leaving the block
+        while (added.len > top[1]) {
+            hash_map_remove(&available, &((IR_value_key*)added.buf)[--added.len]);
+        }
+        stack.len -= 3;
+        entering = false;
+    }
+
+    hash_map_free(&available);
+    dynamic_array_free(&added);
+    dynamic_array_free(&stack);
+    dynamic_array_free(&snapshot);
+    dynamic_array_free(&childStart);
+    dynamic_array_free(&children);
+    return changes;
+}
+
+unsigned int optimize_copy_propagation(IR_module* module, IR_function* fn) {
+    (void)module;
+    unsigned int changes = 0;
+
+    // Turning one phi into a copy can make another one trivial (a loop phi whose other operand was that phi), so this
+    // keeps going until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int r = 0; r < fn->rpo.len; r++) {
+            unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+            unsigned int i = 0;
+            while (i < ir_block(fn, block)->instrs.len) {
+                unsigned int value = optimize_block_instrs(fn, block)[i];
+                IR_instr* instr = ir_instr(fn, value);
+                if (instr->op != IR_PHI) {
+                    break;
+                }
+
+                unsigned int same = IR_NONE;
+                bool trivial = true;
+                for (unsigned int o = 0; o < instr->operand_count; o++) {
+                    unsigned int operand = ir_resolve(fn, *ir_operand(fn, value, o));
+                    if (operand == value || operand == same) {
+                        continue;
+                    } else if (same != IR_NONE) {
+                        trivial = false;
+                        break;
+                    }
+                    same = operand;
+                }
+                if (!trivial || same == IR_NONE) {
+                    i++;
+                    continue;
+                }
+                // The phi moves out of the phis at the start of the block, so the next one is now at i
+                ir_replace_with_copy(fn, value, same);
+                changes++;
+                changed = true;
+            }
+        }
+    }
+
+    changes += optimize_resolve_operands(fn);
+
+    // Nothing uses the copies anymore
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        IR_block* b = ir_block(fn, ((unsigned int*)fn->rpo.buf)[r]);
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < b->instrs.len; i++) {
+            unsigned int value = ((unsigned int*)b->instrs.buf)[i];
+            IR_instr* instr = ir_instr(fn, value);
+            if (instr->op == IR_COPY) {
+                instr->op = IR_NOP;
+                instr->type = SEM_TYPE_NONE;
+                instr->block = IR_NONE;
+                instr->operand_count = 0;
+                changes++;
+                continue;
+            }
+            ((unsigned int*)b->instrs.buf)[kept++] = value;
+        }
+        b->instrs.len = kept;
+    }
+    return changes;
+}
+
+// The state of constant propagation for one function
+typedef struct IR_sccp {
+    IR_module* module;
+    IR_function* fn;
+    // Of type IR_lattice, one for every value
+    DynamicArray values;
+    // Whether each block has been found to run (of type bool)
+    DynamicArray executable;
+    // Whether each edge has been found to be taken (of type bool). The edges into a block are stored together, in the
+    // order of its preds, starting at edgeStart of the block
+    DynamicArray edges;
+    DynamicArray edgeStart;
+    // Every instruction that uses each value, stored together starting at useStart of the value
+    DynamicArray uses;
+    DynamicArray useStart;
+    // Edges that were just found to be taken, as pairs of blocks
+    DynamicArray flowWorklist;
+    // Values whose lattice just changed
+    DynamicArray ssaWorklist;
+} IR_sccp;
+
+static IR_lattice* sccp_value(IR_sccp* s, unsigned int value) {
+    return &((IR_lattice*)s->values.buf)[value];
+}
+
+static bool* sccp_block_executable(IR_sccp* s, unsigned int block) {
+    return &((bool*)s->executable.buf)[block];
+}
+
+static bool* sccp_edge(IR_sccp* s, unsigned int block, unsigned int pred) {
+    return &((bool*)s->edges.buf)[((unsigned int*)s->edgeStart.buf)[block] + pred];
+}
+
+static void sccp_build_uses(IR_sccp* s) {
+    IR_function* fn = s->fn;
+    unsigned int count = fn->instrs.len;
+    dynamic_array_resize(&s->useStart, count + 1, true);
+    unsigned int* starts = (unsigned int*)s->useStart.buf;
+    memset(starts, 0, (count + 1) * sizeof(unsigned int));
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        for (unsigned int i = 0; i < ir_block(fn, block)->instrs.len; i++) {
+            unsigned int value = optimize_block_instrs(fn, block)[i];
+            for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+                starts[*ir_operand(fn, value, o) + 1]++;
+            }
+        }
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        starts[i + 1] += starts[i];
+    }
+
+    if (starts[count] > 0) {
+        dynamic_array_resize(&s->uses, starts[count], true);
+    }
+    DynamicArray filled;
+    dynamic_array_init(&filled, &STRING("unsigned int"));
+    dynamic_array_resize(&filled, count, true);
+    memset(filled.buf, 0, count * sizeof(unsigned int));
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        for (unsigned int i = 0; i < ir_block(fn, block)->instrs.len; i++) {
+            unsigned int value = optimize_block_instrs(fn, block)[i];
+            for (unsigned int o = 0; o < ir_instr(fn, value)->operand_count; o++) {
+                unsigned int operand = *ir_operand(fn, value, o);
+                ((unsigned int*)s->uses.buf)[starts[operand] + ((unsigned int*)filled.buf)[operand]++] = value;
+            }
+        }
+    }
+    dynamic_array_free(&filled);
+}
+
+static void sccp_mark_edge(IR_sccp* s, unsigned int from, unsigned int to) {
+    unsigned int pair[2] = {from, to};
+    dynamic_array_append(&s->flowWorklist, &pair[0]);
+    dynamic_array_append(&s->flowWorklist, &pair[1]);
+}
+
+static IR_lattice sccp_constant_int(int32_t i) {
+    return (IR_lattice){.state = LATTICE_CONSTANT, .type = SEM_TYPE_INT, .i = i};
+}
+
+static IR_lattice sccp_constant_float(double f) {
+    return (IR_lattice){.state = LATTICE_CONSTANT, .type = SEM_TYPE_FLOAT, .f = f};
+}
+
+static bool sccp_equal(IR_lattice* a, IR_lattice* b) {
+    switch (a->type) {
+        case SEM_TYPE_INT:
+            return a->i == b->i;
+        case SEM_TYPE_FLOAT:
+            return memcmp(&a->f, &b->f, sizeof(double)) == 0;
+        case SEM_TYPE_STRING:
+            return a->symbol == b->symbol;
+    }
+    return false;
+}
+
+// Works out the result of an op on two constants (r is ignored for ops with one operand)
+static IR_lattice sccp_fold(IR_sccp* s, unsigned int op, IR_lattice* l, IR_lattice* r) {
+    static const IR_lattice bottom = {.state = LATTICE_BOTTOM};
+    if (op == IR_INT_TO_FLOAT) {
+        return sccp_constant_float(l->i);
+    } else if (op == IR_FLOAT_TO_INT) {
+        // Converting a float that doesn't fit in an int is undefined in C, so it is left for the program to do
+        if (l->f != l->f || l->f >= 2147483648.0 || l->f <= -2147483649.0) {
+            return bottom;
+        }
+        return sccp_constant_int((int32_t)l->f);
+    }
+
+    if (l->type == SEM_TYPE_STRING) {
+        if (op == IR_EQ || op == IR_NE) {
+            // Interning means equal strings always have the same symbol
+            return sccp_constant_int((l->symbol == r->symbol) == (op == IR_EQ));
+        }
+        string joined;
+        string_init(&joined);
+        string_concat(&joined, interner_get(s->module->symbols, l->symbol), interner_get(s->module->symbols, r->symbol));
+        IR_lattice result = {.state = LATTICE_CONSTANT, .type = SEM_TYPE_STRING, .symbol = interner_intern(s->module->symbols, &joined)};
+        string_free(&joined);
+        return result;
+    }
+
+    if (l->type == SEM_TYPE_FLOAT) {
+        double a = l->f, b = r != NULL ? r->f : 0.0;
+        switch (op) {
+            case IR_ADD:
+                return sccp_constant_float(a + b);
+            case IR_SUB:
+                return sccp_constant_float(a - b);
+            case IR_MUL:
+                return sccp_constant_float(a * b);
+            case IR_DIV:
+                return sccp_constant_float(a / b);
+            case IR_NEG:
+                return sccp_constant_float(-a);
+            case IR_LT:
+                return sccp_constant_int(a < b);
+            case IR_LE:
+                return sccp_constant_int(a <= b);
+            case IR_GT:
+                return sccp_constant_int(a > b);
+            case IR_GE:
+                return sccp_constant_int(a >= b);
+            case IR_EQ:
+                return sccp_constant_int(a == b);
+            case IR_NE:
+                return sccp_constant_int(a != b);
+        }
+        return bottom;
+    }
+
+    // The math is done on unsigned ints so that overflow wraps around instead of being undefined
+    int32_t a = l->i, b = r != NULL ? r->i : 0;
+    switch (op) {
+        case IR_ADD:
+            return sccp_constant_int((int32_t)((uint32_t)a + (uint32_t)b));
+        case IR_SUB:
+            return sccp_constant_int((int32_t)((uint32_t)a - (uint32_t)b));
+        case IR_MUL:
+            return sccp_constant_int((int32_t)((uint32_t)a * (uint32_t)b));
+        case IR_NEG:
+            return sccp_constant_int((int32_t)(0u - (uint32_t)a));
+        case IR_DIV:
+            // Left for the program to do, so that it still fails when it runs
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                return bottom;
+            }
+            return sccp_constant_int(a / b);
+        case IR_LT:
+            return sccp_constant_int(a < b);
+        case IR_LE:
+            return sccp_constant_int(a <= b);
+        case IR_GT:
+            return sccp_constant_int(a > b);
+        case IR_GE:
+            return sccp_constant_int(a >= b);
+        case IR_EQ:
+            return sccp_constant_int(a == b);
+        case IR_NE:
+            return sccp_constant_int(a != b);
+    }
+    return bottom;
+}
+
+static IR_lattice sccp_evaluate(IR_sccp* s, unsigned int value) {
+    static const IR_lattice bottom = {.state = LATTICE_BOTTOM};
+    IR_function* fn = s->fn;
+    IR_instr* instr = ir_instr(fn, value);
+    switch (instr->op) {
+        case IR_CONST_INT:
+            return sccp_constant_int(instr->imm.i);
+        case IR_CONST_FLOAT:
+            return sccp_constant_float(((double*)fn->floats.buf)[instr->imm.index]);
+        case IR_CONST_STRING:
+            return (IR_lattice){.state = LATTICE_CONSTANT, .type = SEM_TYPE_STRING, .symbol = instr->imm.index};
+        case IR_COPY:
+            return *sccp_value(s, *ir_operand(fn, value, 0));
+
+        case IR_PHI: {
+            // Only the edges that are taken count
+            IR_lattice result = {.state = LATTICE_TOP};
+            for (unsigned int i = 0; i < instr->operand_count; i++) {
+                if (!*sccp_edge(s, instr->block, i)) {
+                    continue;
+                }
+                IR_lattice* operand = sccp_value(s, *ir_operand(fn, value, i));
+                if (operand->state == LATTICE_BOTTOM || (result.state == LATTICE_CONSTANT && operand->state == LATTICE_CONSTANT && !sccp_equal(&result, operand))) {
+                    return bottom;
+                } else if (operand->state == LATTICE_CONSTANT) {
+                    result = *operand;
+                }
+            }
+            return result;
+        }
+
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_NEG:
+        case IR_CONCAT:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_EQ:
+        case IR_NE:
+        case IR_INT_TO_FLOAT:
+        case IR_FLOAT_TO_INT: {
+            IR_lattice* l = sccp_value(s, *ir_operand(fn, value, 0));
+            IR_lattice* r = instr->operand_count > 1 ? sccp_value(s, *ir_operand(fn, value, 1)) : NULL;
+            if (l->state == LATTICE_BOTTOM || (r != NULL && r->state == LATTICE_BOTTOM)) {
+                return bottom;
+            } else if (l->state == LATTICE_TOP || (r != NULL && r->state == LATTICE_TOP)) {
+                return (IR_lattice){.state = LATTICE_TOP};
+            }
+            return sccp_fold(s, instr->op, l, r);
+        }
+    }
+    // Params, globals, and calls could be anything
+    return bottom;
+}
+
+static void sccp_visit(IR_sccp* s, unsigned int value) {
+    IR_function* fn = s->fn;
+    IR_instr* instr = ir_instr(fn, value);
+    IR_block* b = ir_block(fn, instr->block);
+    if (instr->op == IR_JUMP) {
+        sccp_mark_edge(s, instr->block, b->succs[0]);
+        return;
+    } else if (instr->op == IR_BRANCH) {
+        IR_lattice* condition = sccp_value(s, *ir_operand(fn, value, 0));
+        if (condition->state == LATTICE_CONSTANT) {
+            sccp_mark_edge(s, instr->block, b->succs[condition->i != 0 ? 0 : 1]);
+        } else if (condition->state == LATTICE_BOTTOM) {
+            sccp_mark_edge(s, instr->block, b->succs[0]);
+            sccp_mark_edge(s, instr->block, b->succs[1]);
+        }
+        return;
+    } else if (instr->type == SEM_TYPE_NONE) {
+        return;
+    }
+
+    IR_lattice result = sccp_evaluate(s, value);
+    IR_lattice* current = sccp_value(s, value);
+    // Values only ever move down the lattice, so a change of state is the only change there can be
+    if (result.state == current->state) {
+        return;
+    }
+    *current = result;
+    unsigned int* starts = (unsigned int*)s->useStart.buf;
+    for (unsigned int u = starts[value]; u < starts[value + 1]; u++) {
+        dynamic_array_append(&s->ssaWorklist, &((unsigned int*)s->uses.buf)[u]);
+    }
+}
+
+static void sccp_visit_block(IR_sccp* s, unsigned int block, bool phisOnly) {
+    for (unsigned int i = 0; i < ir_block(s->fn, block)->instrs.len; i++) {
+        unsigned int value = optimize_block_instrs(s->fn, block)[i];
+        if (phisOnly && ir_instr(s->fn, value)->op != IR_PHI) {
+            break;
+        }
+        sccp_visit(s, value);
+    }
+}
+
+// Rewrites the function with what was found: values that are constant become constants, and branches that only go one way become jumps
+static unsigned int sccp_rewrite(IR_sccp* s) {
+    IR_function* fn = s->fn;
+    unsigned int changes = 0;
+    DynamicArray snapshot;
+    dynamic_array_init(&snapshot, &STRING("unsigned int"));
+    for (unsigned int r = 0; r < fn->rpo.len; r++) {
+        unsigned int block = ((unsigned int*)fn->rpo.buf)[r];
+        if (!*sccp_block_executable(s, block)) {
+            continue;
+        }
+        optimize_snapshot(fn, block, &snapshot);
+        for (unsigned int i = 0; i < snapshot.len; i++) {
+            unsigned int value = ((unsigned int*)snapshot.buf)[i];
+            IR_instr* instr = ir_instr(fn, value);
+            IR_lattice* lattice = sccp_value(s, value);
+
+            if (instr->op == IR_BRANCH) {
+                IR_lattice* condition = sccp_value(s, *ir_operand(fn, value, 0));
+                if (condition->state != LATTICE_CONSTANT) {
+                    continue;
+                }
+                IR_block* b = ir_block(fn, block);
+                unsigned int notTaken = b->succs[condition->i != 0 ? 1 : 0];
+                unsigned int taken = b->succs[condition->i != 0 ? 0 : 1];
+                if (notTaken != taken) {
+                    ir_remove_edge(fn, block, notTaken);
+                }
+                instr = ir_instr(fn, value);
+                instr->op = IR_JUMP;
+                instr->operand_count = 0;
+                changes++;
+                continue;
+            }
+
+            if (lattice->state != LATTICE_CONSTANT || instr->op == IR_CONST_INT || instr->op == IR_CONST_FLOAT || instr->op == IR_CONST_STRING) {
+                continue;
+            }
+            if (lattice->type == SEM_TYPE_INT) {
+                ir_replace_with_int(fn, value, lattice->i);
+            } else if (lattice->type == SEM_TYPE_FLOAT) {
+                ir_replace_with_float(fn, value, lattice->f);
+            } else {
+                ir_replace_with_string(fn, value, lattice->symbol);
+            }
+            changes++;
+        }
+    }
+    dynamic_array_free(&snapshot);
+
+    // The blocks that were never found to run can't be reached anymore now that the branches to them are gone
+    unsigned int before = fn->rpo.len;
+    ir_compute_dominators(fn);
+    return changes + (before - fn->rpo.len);
+}
+
+unsigned int optimize_constant_propagation(IR_module* module, IR_function* fn) {
+    IR_sccp s = {.module = module, .fn = fn};
+    dynamic_array_init(&s.values, &STRING("IR_lattice"));
+    dynamic_array_init(&s.executable, &STRING("bool"));
+    dynamic_array_init(&s.edges, &STRING("bool"));
+    dynamic_array_init(&s.edgeStart, &STRING("unsigned int"));
+    dynamic_array_init(&s.uses, &STRING("unsigned int"));
+    dynamic_array_init(&s.useStart, &STRING("unsigned int"));
+    dynamic_array_init(&s.flowWorklist, &STRING("unsigned int"));
+    dynamic_array_init(&s.ssaWorklist, &STRING("unsigned int"));
+
+    dynamic_array_resize(&s.values, fn->instrs.len, true);
+    memset(s.values.buf, 0, fn->instrs.len * sizeof(IR_lattice));
+    dynamic_array_resize(&s.executable, fn->blocks.len, true);
+    memset(s.executable.buf, 0, fn->blocks.len * sizeof(bool));
+    dynamic_array_resize(&s.edgeStart, fn->blocks.len, true);
+    unsigned int edgeCount = 0;
+    for (unsigned int i = 0; i < fn->blocks.len; i++) {
+        ((unsigned int*)s.edgeStart.buf)[i] = edgeCount;
+        edgeCount += ir_block(fn, i)->preds.len;
+    }
+    if (edgeCount > 0) {
+        dynamic_array_resize(&s.edges, edgeCount, true);
+        memset(s.edges.buf, 0, edgeCount * sizeof(bool));
+    }
+    sccp_build_uses(&s);
+
+    *sccp_block_executable(&s, 0) = true;
+    sccp_visit_block(&s, 0, false);
+    while (s.flowWorklist.len > 0 || s.ssaWorklist.len > 0) {
+        if (s.flowWorklist.len > 0) {
+            s.flowWorklist.len -= 2;
+            unsigned int from = ((unsigned int*)s.flowWorklist.buf)[s.flowWorklist.len];
+            unsigned int to = ((unsigned int*)s.flowWorklist.buf)[s.flowWorklist.len + 1];
+            IR_block* b = ir_block(fn, to);
+            unsigned int pred = 0;
+            while (((unsigned int*)b->preds.buf)[pred] != from) {
+                pred++;
+            }
+            if (*sccp_edge(&s, to, pred)) {
+                continue;
+            }
+            *sccp_edge(&s, to, pred) = true;
+
+            // The phis have a new operand to look at. The rest of the block only has to be looked at the first time it is found to run
+            bool first = !*sccp_block_executable(&s, to);
+            *sccp_block_executable(&s, to) = true;
+            sccp_visit_block(&s, to, !first);
+            continue;
+        }
+
+        unsigned int value = ((unsigned int*)s.ssaWorklist.buf)[--s.ssaWorklist.len];
+        if (*sccp_block_executable(&s, ir_instr(fn, value)->block)) {
+            sccp_visit(&s, value);
+        }
+    }
+
+    unsigned int changes = sccp_rewrite(&s);
+
+    dynamic_array_free(&s.values);
+    dynamic_array_free(&s.executable);
+    dynamic_array_free(&s.edges);
+    dynamic_array_free(&s.edgeStart);
+    dynamic_array_free(&s.uses);
+    dynamic_array_free(&s.useStart);
+    dynamic_array_free(&s.flowWorklist);
+    dynamic_array_free(&s.ssaWorklist);
+    return changes;
+}
+
+int optimize_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("IR_pass"), NULL, sizeof(IR_pass));
+    dynamic_array_registry_type_append(&STRING("IR_pass_stats"), NULL, sizeof(IR_pass_stats));
+    dynamic_array_registry_type_append(&STRING("IR_pass_manager"), pass_manager_deallocator, sizeof(IR_pass_manager));
+    dynamic_array_registry_type_append(&STRING("IR_value_key"), NULL, sizeof(IR_value_key));
+    dynamic_array_registry_type_append(&STRING("IR_lattice"), NULL, sizeof(IR_lattice));
+    return 0;
+}
+
+int pass_manager_init(IR_pass_manager* pm) {
+    dynamic_array_init(&pm->passes, &STRING("IR_pass"));
+    dynamic_array_init(&pm->stats, &STRING("IR_pass_stats"));
+    pm->verify = false;
+    return 0;
+}
+
+int pass_manager_free(IR_pass_manager* pm) {
+    dynamic_array_free(&pm->passes);
+    dynamic_array_free(&pm->stats);
+    return 0;
+}
+
+int pass_manager_deallocator(void* pm) {
+    return pass_manager_free((IR_pass_manager*)pm);
+}
+
+int pass_manager_add(IR_pass_manager* pm, const IR_pass* pass) {
+    dynamic_array_append(&pm->passes, (void*)pass);
+    return 0;
+}
+
+int pass_manager_add_defaults(IR_pass_manager* pm) {
+    // Constant propagation goes first since it removes the most. Its constants often make other values the same, which
+    // value numbering then finds. Copy propagation cleans up after both, and dead code elimination removes what is left unused
+    pass_manager_add(pm, &IR_PASS_CONSTANT_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_COPY_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_VALUE_NUMBERING);
+    pass_manager_add(pm, &IR_PASS_COPY_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_DEAD_CODE);
+
+    // Unrolling needs the constants that a loop steps by to be outside of it, so invariant code motion runs before it.
+    // Unrolling leaves behind constants and a loop that can no longer run, so everything above runs again after it.
+    // Strength reduction goes last so that the factors it multiplies by are already outside of the loop, and the
+    // multiplications it adds to the preheader are often by constants, which constant propagation then folds
+    pass_manager_add(pm, &IR_PASS_HOIST_INVARIANTS);
+    pass_manager_add(pm, &IR_PASS_UNROLL);
+    pass_manager_add(pm, &IR_PASS_CONSTANT_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_COPY_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_VALUE_NUMBERING);
+    pass_manager_add(pm, &IR_PASS_COPY_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_HOIST_INVARIANTS);
+    pass_manager_add(pm, &IR_PASS_STRENGTH_REDUCE);
+    pass_manager_add(pm, &IR_PASS_CONSTANT_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_COPY_PROPAGATION);
+    pass_manager_add(pm, &IR_PASS_DEAD_CODE);
+    return 0;
+}
+
+static void pass_manager_measure(IR_module* module, unsigned int* instrs, unsigned int* blocks) {
+    *instrs = 0;
+    *blocks = 0;
+    for (unsigned int i = 0; i < module->functions.len; i++) {
+        *instrs += ir_instr_count(ir_function(module, i));
+        *blocks += ir_block_count(ir_function(module, i));
+    }
+}
+
+int pass_manager_run(IR_pass_manager* pm, IR_module* module) {
+    pm->stats.len = 0;
+    for (unsigned int p = 0; p < pm->passes.len; p++) {
+        IR_pass* pass = &((IR_pass*)pm->passes.buf)[p];
+        IR_pass_stats stats = {.name = pass->name};
+        pass_manager_measure(module, &stats.instrs_before, &stats.blocks_before);
+
+        for (unsigned int i = 0; i < module->functions.len; i++) {
+            IR_function* fn = ir_function(module, i);
+            unsigned long long start = optimize_now();
+            stats.changes += pass->run(module, fn);
+            stats.nanoseconds += optimize_now() - start;
+
+            if (pm->verify && ir_verify(module, fn) != 0) {
+                printf("the IR was left in a bad state by %s\n", pass->name);
+                dynamic_array_append(&pm->stats, &stats);
+                return -1;
+            }
+        }
+
+        pass_manager_measure(module, &stats.instrs_after, &stats.blocks_after);
+        dynamic_array_append(&pm->stats, &stats);
+    }
+    return 0;
+}
+
+int pass_manager_print_stats(IR_pass_manager* pm) {
+    if (pm->stats.len == 0) {
+        return 0;
+    }
+    IR_pass_stats* all = (IR_pass_stats*)pm->stats.buf;
+    unsigned long long total = 0;
+    for (unsigned int i = 0; i < pm->stats.len; i++) {
+        IR_pass_stats* stats = &all[i];
+        total += stats->nanoseconds;
+        printf("%s: %.3f ms, %u changes, %u -> %u instructions, %u -> %u blocks\n", stats->name, stats->nanoseconds / 1e6,
+               stats->changes, stats->instrs_before, stats->instrs_after, stats->blocks_before, stats->blocks_after);
+    }
+    printf("all ir passes: %.3f ms, %u -> %u instructions, %u -> %u blocks\n", total / 1e6, all[0].instrs_before,
+           all[pm->stats.len - 1].instrs_after, all[0].blocks_before, all[pm->stats.len - 1].blocks_after);
+    return 0;
+}
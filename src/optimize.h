@@ -0,0 +1,82 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include <stdbool.h>
+#include "DynamicArray.h"
+#include "ir.h"
+
+// The optimizations that run on the IR, and the pass manager that runs them in order over every function of a module.
+// Every pass leaves the function in valid SSA form, with its dominators up to date
+
+typedef struct IR_pass {
+    const char* name;
+    // Runs the pass on one function and returns how many changes it made
+    unsigned int (*run)(IR_module* module, IR_function* fn);
+} IR_pass;
+
+// What happened during one entry of the pipeline, added up over every function
+typedef struct IR_pass_stats {
+    const char* name;
+    unsigned long long nanoseconds;
+    unsigned int changes;
+    unsigned int instrs_before;
+    unsigned int instrs_after;
+    unsigned int blocks_before;
+    unsigned int blocks_after;
+} IR_pass_stats;
+
+typedef struct IR_pass_manager {
+    // The passes to run, in order (of type IR_pass). The same pass can be in here more than once
+    DynamicArray passes;
+    // One IR_pass_stats for every entry of passes, filled in by pass_manager_run
+    DynamicArray stats;
+    // When set, every function is checked with ir_verify after every pass, and running stops at the first problem
+    bool verify;
+} IR_pass_manager;
+
+// Removes instructions whose values are never used and that have no side effects, then merges blocks that always run
+// one after the other
+unsigned int optimize_dead_code(IR_module* module, IR_function* fn);
+
+// Turns every instruction that computes the same thing as one that dominates it into a copy of that one (global value
+// numbering over the dominator tree)
+unsigned int optimize_value_numbering(IR_module* module, IR_function* fn);
+
+// Replaces every use of a copy with the value that was copied, removes the copies, and turns phis whose operands are all
+// the same into copies
+unsigned int optimize_copy_propagation(IR_module* module, IR_function* fn);
+
+// Sparse conditional constant propagation, from "Constant Propagation with Conditional Branches" by Wegman and Zadeck.
+// Finds the values that are constant while only following edges that can actually be taken, which catches constants
+// that flow around loops. Branches that always go the same way become jumps, and the blocks that can't be reached are removed
+unsigned int optimize_constant_propagation(IR_module* module, IR_function* fn);
+
+static const IR_pass IR_PASS_DEAD_CODE = {.name = "dead code elimination", .run = optimize_dead_code};
+static const IR_pass IR_PASS_VALUE_NUMBERING = {.name = "value numbering", .run = optimize_value_numbering};
+static const IR_pass IR_PASS_COPY_PROPAGATION = {.name = "copy propagation", .run = optimize_copy_propagation};
+static const IR_pass IR_PASS_CONSTANT_PROPAGATION = {.name = "constant propagation", .run = optimize_constant_propagation};
+
+// Registers the types used by this module. Should be called once after ir_module_init
+int optimize_module_init(void);
+
+int pass_manager_init(IR_pass_manager* pm);
+
+int pass_manager_free(IR_pass_manager* pm);
+
+// For use with the type registry
+int pass_manager_deallocator(void* pm);
+
+// Adds a pass to the end of the pipeline
+int pass_manager_add(IR_pass_manager* pm, const IR_pass* pass);
+
+// Adds the passes that are run by default
+int pass_manager_add_defaults(IR_pass_manager* pm);
+
+// Runs every pass over every function of the module, one pass at a time. Returns -1 if verify is on and a pass left
+// a function in a bad state
+int pass_manager_run(IR_pass_manager* pm, IR_module* module);
+
+// Prints how long every pass took, how many changes it made, and how big the IR was before and after it
+int pass_manager_print_stats(IR_pass_manager* pm);
+
+#endif
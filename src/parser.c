@@ -1,46 +1,1406 @@
 #include "parser.h"
 #include "DynamicArray.h"
+#include "DynamicArrayIO.h"
+#include "HashMap.h"
 #include "Strings.h"
 #include "lexer.h"
+#include "ThreadPool.h"
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+extern AST_node* ast_get(AST* ast, unsigned int index);
+extern token* ast_token(AST* ast, unsigned int index);
+extern string* ast_symbol(AST* ast, unsigned int index);
+extern long long ast_int_value(AST* ast, unsigned int index);
+extern double ast_float_value(AST* ast, unsigned int index);
+
+_Static_assert(sizeof(AST_node) == 16, "AST nodes are meant to be 16 bytes");
+
+// A stretch of tokens at the top level of the file that can be parsed on its own: either a single function, or
+// everything between two functions. The rest of the fields are only used for functions that are parsed by a worker thread,
+// and say where in the arena of that worker the results ended up (each as a range from start up to, but not including, end)
+typedef struct ParseItem {
+    unsigned int start;
+    unsigned int end;
+    bool function;
+    bool parsed;
+    // The index of the AST_reusable_function the function is copied from instead of being parsed, or AST_NONE
+    unsigned int reused;
+    uint64_t hash;
+    unsigned int worker;
+    unsigned int nodesStart, nodesEnd;
+    unsigned int intsStart, intsEnd;
+    unsigned int floatsStart, floatsEnd;
+    unsigned int diagnosticsStart, diagnosticsEnd;
+    unsigned int rootsStart, rootsEnd;
+} ParseItem;
+
+// Holds everything needed while parsing, so that nothing about a parse is kept in globals
+typedef struct Parser {
+    AST* ast;
+    token* tokens;
+    unsigned int len;
+    // The index of the next token to be parsed
+    unsigned int pos;
+    string* file;
+    // Where syntax errors are reported to
+    DynamicArray* diagnostics;
+    // Set once an error is found and cleared once the parser has recovered. Any errors in between are almost
+    // always caused by the first one, so they aren't reported
+    bool panicking;
+    // Holds the indices of the children of nodes that have a variable number of children (like blocks) while they are
+    // being parsed. Once the node is done, its children are linked together all at once
+    DynamicArray stack;
+} Parser;
 
 int ast_module_init(void) {
     dynamic_array_registry_type_append(&STRING("AST"), ast_deallocator, sizeof(AST));
+    dynamic_array_registry_type_append(&STRING("AST_node"), NULL, sizeof(AST_node));
+    dynamic_array_registry_type_append(&STRING("Interner"), interner_deallocator, sizeof(Interner));
+    dynamic_array_registry_type_append(&STRING("ParseItem"), NULL, sizeof(ParseItem));
+    dynamic_array_registry_type_append(&STRING("AST_reusable_function"), NULL, sizeof(AST_reusable_function));
+    dynamic_array_registry_type_append(&STRING("AST_function_item"), NULL, sizeof(AST_function_item));
     return 0;
 }
 
 int ast_deallocator(void* ast) {
-    dynamic_array_free(&((AST*)ast)->branches);
-    string_free(&((AST*)ast)->name);
+    ast_free((AST*)ast);
     return 0;
 }
 
 int ast_init(AST* ast) {
-    dynamic_array_init(&ast->branches, &STRING("AST"));
-    string_init(&ast->name);
-    ast->type = AST_ROOT;
+    dynamic_array_init(&ast->nodes, &STRING("AST_node"));
+    dynamic_array_init(&ast->locations, &STRING("unsigned int"));
+    dynamic_array_init(&ast->ints, &STRING("long long"));
+    dynamic_array_init(&ast->floats, &STRING("double"));
+    interner_init(&ast->symbols);
+    ast->tokens = NULL;
     return 0;
 }
 
-// Takes in an array of tokens and the string for the original source file for debugging purposes
-int ast_generate(AST* ast, DynamicArray *tokens, DynamicArray* identifiers, string *file) {
-    // List of general heuristics used to figure out the structure of the AST
-    // Should include things like figuring out variable declaration from a list of tokens like keyword + identifier + keyword + literal
-    for (int i = 0; i < tokens->len; i++) {
-        token curr_token = *(token*)dynamic_array_get(tokens, &INDEX(i));
-        
-        if (curr_token.type == LRES_KEYWORD && i < tokens->len - 1) {
-            token next_token = *(token*)dynamic_array_get(tokens, &INDEX(i + 1));
-            switch (curr_token.type) {
-                case KEY_INT:
-                    break;
+int ast_free(AST* ast) {
+    dynamic_array_free(&ast->nodes);
+    dynamic_array_free(&ast->locations);
+    dynamic_array_free(&ast->ints);
+    dynamic_array_free(&ast->floats);
+    interner_free(&ast->symbols);
+    ast->tokens = NULL;
+    return 0;
+}
+
+int ast_reuse_init(AST_reuse* reuse) {
+    ast_init(&reuse->arena);
+    dynamic_array_init(&reuse->functions, &STRING("AST_reusable_function"));
+    hash_map_init(&reuse->by_hash, &STRING("unsigned long long"), &STRING("unsigned int"));
+    dynamic_array_init(&reuse->items, &STRING("AST_function_item"));
+    reuse->reused = 0;
+    reuse->parsed = 0;
+    return 0;
+}
+
+int ast_reuse_free(AST_reuse* reuse) {
+    ast_free(&reuse->arena);
+    dynamic_array_free(&reuse->functions);
+    hash_map_free(&reuse->by_hash);
+    dynamic_array_free(&reuse->items);
+    return 0;
+}
+
+uint64_t ast_hash_tokens(token* tokens, unsigned int start, unsigned int end) {
+    uint64_t hash = hash_map_hash_int(end - start);
+    for (unsigned int i = start; i < end; i++) {
+        token* tok = &tokens[i];
+        hash = hash_map_hash_int(hash ^ ((uint64_t)tok->type << 32 | tok->id));
+        // Reserved words are already told apart by their type and id, so only names and literals need their text hashed
+        if ((tok->type == LRES_LITERAL || tok->type == LRES_IDENTIFIER) && tok->literal.len > 0) {
+            hash = hash_map_hash_int(hash ^ hash_map_hash_bytes(tok->literal.str, tok->literal.len));
+        }
+    }
+    return hash;
+}
+
+static token* parser_peek(Parser* p, unsigned int ahead) {
+    if (p->pos + ahead >= p->len) {
+        return NULL;
+    }
+    return &p->tokens[p->pos + ahead];
+}
+
+static bool parser_check(Parser* p, unsigned int type, unsigned int id) {
+    token* tok = parser_peek(p, 0);
+    return tok != NULL && tok->type == type && tok->id == id;
+}
+
+// Consumes the next token if it matches
+static bool parser_match(Parser* p, unsigned int type, unsigned int id) {
+    if (parser_check(p, type, id)) {
+        p->pos++;
+        return true;
+    }
+    return false;
+}
+
+static void parser_error(Parser* p, const char* message) {
+    if (p->panicking) {
+        return;
+    }
+    p->panicking = true;
+
+    // The parser might only be looking at part of the file, so the end of its range isn't necessarily the end of the file
+    token* tok = p->pos < p->ast->tokens->len ? &p->tokens[p->pos] : NULL;
+    if (tok == NULL) {
+        diagnostics_add(p->diagnostics, DIAG_ERROR, p->file->len, "%s, but the file ended", message);
+    } else {
+        diagnostics_add(p->diagnostics, DIAG_ERROR, tok->offset, "%s, but found %s", message, tok->literal.str);
+    }
+}
+
+// Consumes the next token if it matches, and reports an error if it doesn't
+static bool parser_expect(Parser* p, unsigned int type, unsigned int id, const char* message) {
+    if (parser_match(p, type, id)) {
+        return true;
+    }
 
-                case KEY_FLOAT:
+    // A missing ; belongs at the end of the line before, not at the start of whatever comes next
+    if (type == LRES_PUNCTUATOR && id == PUNC_SEMICOLON && p->pos > 0 && !p->panicking) {
+        token* prev = &p->tokens[p->pos - 1];
+        // String literals don't include their quotes
+        unsigned int end = prev->offset + prev->literal.len + (prev->type == LRES_LITERAL && prev->id == LIT_STRING ? 2 : 0);
+        p->panicking = true;
+        diagnostics_add(p->diagnostics, DIAG_ERROR, end, "%s", message);
+        return false;
+    }
+    parser_error(p, message);
+    return false;
+}
+
+static bool parser_is_type_keyword(token* tok) {
+    return tok != NULL && tok->type == LRES_KEYWORD && (tok->id == KEY_INT || tok->id == KEY_FLOAT || tok->id == KEY_STRING);
+}
+
+static bool ast_has_symbol(unsigned int type) {
+    return type == AST_VARIABLE || type == AST_CALL || type == AST_DECLARATION || type == AST_FUNCTION || type == AST_STRING_CONSTANT;
+}
+
+// Fills in the payload of a node from the token it came from. Names and strings are interned, and numbers are
+// converted once here so that nothing after the parser has to look at the text of a constant again
+static void parser_set_payload(Parser* p, AST_node* node, token* tok) {
+    if (ast_has_symbol(node->type)) {
+        node->payload.symbol = interner_intern(&p->ast->symbols, &tok->literal);
+        return;
+    }
+
+    switch (node->type) {
+        case AST_INT_CONSTANT: {
+            // The lexer only hands over digits here, so the whole literal has to be read, and anything that doesn't fit
+            // in an int is an error rather than something that quietly wraps around
+            char* end;
+            errno = 0;
+            long long value = strtoll(tok->literal.str, &end, 10);
+            if (*end != '\0' || errno == ERANGE || value > INT32_MAX) {
+                diagnostics_add(p->diagnostics, DIAG_ERROR, tok->offset, "%s is too big to be an int", tok->literal.str);
+                value = 0;
+            }
+            if (value >= INT32_MIN && value <= INT32_MAX) {
+                node->flags |= AST_FLAG_INLINE_INT;
+                node->payload.inline_int = (int32_t)value;
+            } else {
+                node->payload.constant = p->ast->ints.len;
+                dynamic_array_append(&p->ast->ints, &value);
+            }
+            break;
+        }
+        case AST_FLOAT_CONSTANT: {
+            // strtod would happily take 12. as 12, so the period also needs a digit after it. Tiny values that round
+            // to zero are fine, only ones too big for a double are errors
+            char* end;
+            errno = 0;
+            double value = strtod(tok->literal.str, &end);
+            if (*end != '\0' || (errno == ERANGE && value == HUGE_VAL) || tok->literal.str[tok->literal.len - 1] == '.') {
+                diagnostics_add(p->diagnostics, DIAG_ERROR, tok->offset, "%s isn't a valid float", tok->literal.str);
+                value = 0;
+            }
+            node->payload.constant = p->ast->floats.len;
+            dynamic_array_append(&p->ast->floats, &value);
+            break;
+        }
+        default:
+            node->payload.symbol = 0;
+            break;
+    }
+}
+
+static unsigned int parser_add_node(Parser* p, unsigned int type, unsigned int data, unsigned int tok, unsigned int* children, unsigned int count) {
+    AST_node node = {.type = type, .flags = 0, .data = data, .first_child = count > 0 ? children[0] : AST_NONE, .next_sibling = AST_NONE};
+    // Each child is only ever given to one parent, so its sibling link is still free to be set here
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        ast_get(p->ast, children[i])->next_sibling = children[i + 1];
+    }
+    parser_set_payload(p, &node, &p->tokens[tok]);
+
+    dynamic_array_append(&p->ast->nodes, &node);
+    dynamic_array_append(&p->ast->locations, &tok);
+    return p->ast->nodes.len - 1;
+}
+
+// Skips ahead to a point where parsing can safely start again after a syntax error: just past a ;, right before a }
+// (which is left for the block it closes), or right before a keyword that starts a declaration.
+// Any { } block that is run into is skipped as a whole, since the statement with the error owns it. Otherwise
+// a bad if condition would have the } of its body mistaken for the end of the enclosing block.
+// start is where the statement with the error began, and at least one token past it is always skipped, so the
+// parser can never get stuck retrying the same statement
+static void parser_synchronize(Parser* p, unsigned int start, bool inBlock) {
+    unsigned int depth = 0;
+    if (p->pos == start && p->pos < p->len) {
+        depth += parser_check(p, LRES_PUNCTUATOR, PUNC_CURLY_L);
+        p->pos++;
+    }
+
+    while (p->pos < p->len) {
+        token* tok = &p->tokens[p->pos];
+        if (tok->type == LRES_PUNCTUATOR && tok->id == PUNC_CURLY_L) {
+            depth++;
+        } else if (tok->type == LRES_PUNCTUATOR && tok->id == PUNC_CURLY_R) {
+            if (depth > 0) {
+                depth--;
+                // The end of a skipped block is also the end of the statement it belonged to
+                if (depth == 0) {
+                    p->pos++;
                     break;
+                }
+            } else if (inBlock) {
+                break;
+            }
+            // Outside of a block there is nothing for the } to close, so it is skipped instead
+        } else if (depth == 0 && tok->type == LRES_PUNCTUATOR && tok->id == PUNC_SEMICOLON) {
+            p->pos++;
+            break;
+        } else if (depth == 0 && parser_is_type_keyword(tok)) {
+            break;
+        }
+        p->pos++;
+    }
+    p->panicking = false;
+}
+
+// Creates a node whose children are everything on the stack above base, and then removes those children from the stack
+static unsigned int parser_add_node_from_stack(Parser* p, unsigned int type, unsigned int data, unsigned int tok, unsigned int base) {
+    unsigned int node = parser_add_node(p, type, data, tok, (unsigned int*)p->stack.buf + base, p->stack.len - base);
+    // The stack only holds plain integers, so it can be shrunk without going through dynamic_array_pop
+    p->stack.len = base;
+    return node;
+}
+
+static void parser_push(Parser* p, unsigned int node) {
+    dynamic_array_append(&p->stack, &node);
+}
+
+// How tightly an operator binds to the expressions around it. Higher numbers bind tighter, and 0 means the token isn't a binary operator
+static int parser_binding_power(token* tok) {
+    if (tok == NULL || tok->type != LRES_OPERATOR) {
+        return 0;
+    }
+
+    switch (tok->id) {
+        case OP_EQUAL:
+        case OP_PLUS_EQUAL:
+        case OP_MINUS_EQUAL:
+        case OP_MULT_EQUAL:
+        case OP_DIV_EQUAL:
+            return 1;
+        case OP_EQUAL_EQUAL:
+        case OP_NOT_EQUAL:
+            return 2;
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_LESS_EQUAL:
+        case OP_GREATER_EQUAL:
+            return 3;
+        case OP_PLUS:
+        case OP_MINUS:
+            return 4;
+        case OP_MULT:
+        case OP_DIV:
+            return 5;
+    }
+    return 0;
+}
+
+static unsigned int parse_expression(Parser* p, int minPower);
+static unsigned int parse_statement(Parser* p);
+
+static unsigned int parse_primary(Parser* p) {
+    token* tok = parser_peek(p, 0);
+    if (tok == NULL) {
+        parser_error(p, "expected an expression");
+        return AST_NONE;
+    }
+
+    unsigned int index = p->pos;
+    if (tok->type == LRES_LITERAL) {
+        p->pos++;
+        unsigned int type = tok->id == LIT_STRING ? AST_STRING_CONSTANT : (tok->id == LIT_FLOAT ? AST_FLOAT_CONSTANT : AST_INT_CONSTANT);
+        return parser_add_node(p, type, 0, index, NULL, 0);
+    } else if (tok->type == LRES_IDENTIFIER) {
+        p->pos++;
+        if (!parser_match(p, LRES_PUNCTUATOR, PUNC_PAREN_L)) {
+            return parser_add_node(p, AST_VARIABLE, 0, index, NULL, 0);
+        }
+
+        // An identifier followed by ( is a function call
+        unsigned int base = p->stack.len;
+        if (!parser_check(p, LRES_PUNCTUATOR, PUNC_PAREN_R)) {
+            do {
+                unsigned int arg = parse_expression(p, 1);
+                if (arg == AST_NONE) {
+                    return AST_NONE;
+                }
+                parser_push(p, arg);
+            } while (parser_match(p, LRES_PUNCTUATOR, PUNC_COMMA));
+        }
+
+        if (!parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_R, "expected ) after the arguments of the function call")) {
+            return AST_NONE;
+        }
+        return parser_add_node_from_stack(p, AST_CALL, 0, index, base);
+    } else if (parser_match(p, LRES_PUNCTUATOR, PUNC_PAREN_L)) {
+        unsigned int inner = parse_expression(p, 1);
+        if (inner == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_R, "expected )")) {
+            return AST_NONE;
+        }
+        return inner;
+    }
+
+    parser_error(p, "expected an expression");
+    return AST_NONE;
+}
+
+static unsigned int parse_unary(Parser* p) {
+    if (parser_check(p, LRES_OPERATOR, OP_MINUS)) {
+        unsigned int index = p->pos++;
+        unsigned int operand = parse_unary(p);
+        if (operand == AST_NONE) {
+            return AST_NONE;
+        }
+        return parser_add_node(p, AST_UNARY, OP_MINUS, index, &operand, 1);
+    }
+    return parse_primary(p);
+}
 
-                case KEY_STRING:
+// Parses expressions using precedence climbing (Pratt parsing): operators are only consumed while they bind at least as tightly as
+// minPower, which is what makes 1 + 2 * 3 group as 1 + (2 * 3)
+static unsigned int parse_expression(Parser* p, int minPower) {
+    unsigned int lhs = parse_unary(p);
+    if (lhs == AST_NONE) {
+        return AST_NONE;
+    }
+
+    while (true) {
+        token* tok = parser_peek(p, 0);
+        int power = parser_binding_power(tok);
+        if (power == 0 || power < minPower) {
+            break;
+        }
+
+        unsigned int index = p->pos++;
+        unsigned int children[2] = {lhs, AST_NONE};
+
+        if (power == 1) {
+            // Assignments group from the right (x = y = 2 is x = (y = 2)), so the right side is parsed at the same power
+            if (ast_get(p->ast, lhs)->type != AST_VARIABLE) {
+                p->pos--;
+                parser_error(p, "only variables can be assigned to");
+                return AST_NONE;
+            }
+            children[1] = parse_expression(p, power);
+            if (children[1] == AST_NONE) {
+                return AST_NONE;
+            }
+            lhs = parser_add_node(p, AST_ASSIGNMENT, tok->id, index, children, 2);
+        } else {
+            children[1] = parse_expression(p, power + 1);
+            if (children[1] == AST_NONE) {
+                return AST_NONE;
+            }
+            lhs = parser_add_node(p, power <= 3 ? AST_COMPARISON : AST_EXPRESSION, tok->id, index, children, 2);
+        }
+    }
+
+    return lhs;
+}
+
+// Parses something like int x = 2, without the semicolon
+static unsigned int parse_declaration(Parser* p, bool allowInitializer) {
+    token* type = parser_peek(p, 0);
+    p->pos++;
+
+    unsigned int name = p->pos;
+    if (!parser_expect(p, LRES_IDENTIFIER, 0, "expected a name after the type")) {
+        return AST_NONE;
+    }
+
+    if (allowInitializer && parser_match(p, LRES_OPERATOR, OP_EQUAL)) {
+        unsigned int value = parse_expression(p, 1);
+        if (value == AST_NONE) {
+            return AST_NONE;
+        }
+        return parser_add_node(p, AST_DECLARATION, type->id, name, &value, 1);
+    }
+
+    return parser_add_node(p, AST_DECLARATION, type->id, name, NULL, 0);
+}
+
+static unsigned int parse_top_level(Parser* p);
+
+// Parses a statement (or a top level function), and replaces it with an AST_ERROR node if it has a syntax error
+static unsigned int parse_statement_or_recover(Parser* p, bool inBlock) {
+    unsigned int start = p->pos;
+    unsigned int stackLen = p->stack.len;
+    unsigned int statement = inBlock ? parse_statement(p) : parse_top_level(p);
+    if (statement != AST_NONE) {
+        return statement;
+    }
+
+    // Anything that was left on the stack by the statement that failed belongs to nodes that will never be finished
+    p->stack.len = stackLen;
+    parser_synchronize(p, start, inBlock);
+    return parser_add_node(p, AST_ERROR, 0, start, NULL, 0);
+}
+
+static unsigned int parse_block(Parser* p) {
+    unsigned int index = p->pos;
+    if (!parser_expect(p, LRES_PUNCTUATOR, PUNC_CURLY_L, "expected {")) {
+        return AST_NONE;
+    }
+
+    unsigned int base = p->stack.len;
+    while (p->pos < p->len && !parser_check(p, LRES_PUNCTUATOR, PUNC_CURLY_R)) {
+        parser_push(p, parse_statement_or_recover(p, true));
+    }
+
+    // A missing } can only happen at the end of the file, so the block is kept with whatever was in it
+    parser_expect(p, LRES_PUNCTUATOR, PUNC_CURLY_R, "expected } at the end of the block");
+    return parser_add_node_from_stack(p, AST_BLOCK, 0, index, base);
+}
+
+// Parses the (condition) part of if and while statements
+static unsigned int parse_condition(Parser* p) {
+    if (!parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_L, "expected ( before the condition")) {
+        return AST_NONE;
+    }
+    unsigned int condition = parse_expression(p, 1);
+    if (condition == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_R, "expected ) after the condition")) {
+        return AST_NONE;
+    }
+    return condition;
+}
+
+static unsigned int parse_for(Parser* p, unsigned int index) {
+    if (!parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_L, "expected ( after for")) {
+        return AST_NONE;
+    }
+
+    // The initializer, condition, and step are all optional. Missing ones become AST_EMPTY nodes so that
+    // the body is always the fourth child
+    unsigned int children[4];
+    if (parser_check(p, LRES_PUNCTUATOR, PUNC_SEMICOLON)) {
+        children[0] = parser_add_node(p, AST_EMPTY, 0, p->pos, NULL, 0);
+    } else if (parser_is_type_keyword(parser_peek(p, 0))) {
+        children[0] = parse_declaration(p, true);
+    } else {
+        children[0] = parse_expression(p, 1);
+    }
+    if (children[0] == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_SEMICOLON, "expected ; after the initializer of the for loop")) {
+        return AST_NONE;
+    }
+
+    children[1] = parser_check(p, LRES_PUNCTUATOR, PUNC_SEMICOLON) ? parser_add_node(p, AST_EMPTY, 0, p->pos, NULL, 0) : parse_expression(p, 1);
+    if (children[1] == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_SEMICOLON, "expected ; after the condition of the for loop")) {
+        return AST_NONE;
+    }
+
+    children[2] = parser_check(p, LRES_PUNCTUATOR, PUNC_PAREN_R) ? parser_add_node(p, AST_EMPTY, 0, p->pos, NULL, 0) : parse_expression(p, 1);
+    if (children[2] == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_R, "expected ) after the step of the for loop")) {
+        return AST_NONE;
+    }
+
+    children[3] = parse_statement(p);
+    if (children[3] == AST_NONE) {
+        return AST_NONE;
+    }
+    return parser_add_node(p, AST_FOR, 0, index, children, 4);
+}
+
+static unsigned int parse_statement(Parser* p) {
+    token* tok = parser_peek(p, 0);
+    if (tok == NULL) {
+        parser_error(p, "expected a statement");
+        return AST_NONE;
+    }
+
+    unsigned int index = p->pos;
+    if (tok->type == LRES_KEYWORD) {
+        switch (tok->id) {
+            case KEY_INT:
+            case KEY_FLOAT:
+            case KEY_STRING: {
+                unsigned int declaration = parse_declaration(p, true);
+                if (declaration == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_SEMICOLON, "expected ; after the declaration")) {
+                    return AST_NONE;
+                }
+                return declaration;
+            }
+
+            case KEY_IF: {
+                p->pos++;
+                unsigned int children[3];
+                children[0] = parse_condition(p);
+                if (children[0] == AST_NONE) {
+                    return AST_NONE;
+                }
+                children[1] = parse_statement(p);
+                if (children[1] == AST_NONE) {
+                    return AST_NONE;
+                }
+                if (parser_match(p, LRES_KEYWORD, KEY_ELSE)) {
+                    children[2] = parse_statement(p);
+                    if (children[2] == AST_NONE) {
+                        return AST_NONE;
+                    }
+                    return parser_add_node(p, AST_BRANCH, 0, index, children, 3);
+                }
+                return parser_add_node(p, AST_BRANCH, 0, index, children, 2);
+            }
+
+            case KEY_WHILE: {
+                p->pos++;
+                unsigned int children[2];
+                children[0] = parse_condition(p);
+                if (children[0] == AST_NONE) {
+                    return AST_NONE;
+                }
+                children[1] = parse_statement(p);
+                if (children[1] == AST_NONE) {
+                    return AST_NONE;
+                }
+                return parser_add_node(p, AST_WHILE, 0, index, children, 2);
+            }
+
+            case KEY_FOR:
+                p->pos++;
+                return parse_for(p, index);
+
+            case KEY_RETURN: {
+                p->pos++;
+                if (parser_match(p, LRES_PUNCTUATOR, PUNC_SEMICOLON)) {
+                    return parser_add_node(p, AST_RETURN, 0, index, NULL, 0);
+                }
+                unsigned int value = parse_expression(p, 1);
+                if (value == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_SEMICOLON, "expected ; after the return value")) {
+                    return AST_NONE;
+                }
+                return parser_add_node(p, AST_RETURN, 0, index, &value, 1);
+            }
+
+            case KEY_ELSE:
+                parser_error(p, "expected a statement (else needs an if before it)");
+                return AST_NONE;
+        }
+    } else if (tok->type == LRES_PUNCTUATOR && tok->id == PUNC_CURLY_L) {
+        return parse_block(p);
+    } else if (parser_match(p, LRES_PUNCTUATOR, PUNC_SEMICOLON)) {
+        return parser_add_node(p, AST_EMPTY, 0, index, NULL, 0);
+    }
+
+    // Anything else has to be an expression being used as a statement, like x = 2; or f();
+    unsigned int expression = parse_expression(p, 1);
+    if (expression == AST_NONE || !parser_expect(p, LRES_PUNCTUATOR, PUNC_SEMICOLON, "expected ; after the expression")) {
+        return AST_NONE;
+    }
+    return expression;
+}
+
+static unsigned int parse_function(Parser* p) {
+    token* returnType = parser_peek(p, 0);
+    unsigned int name = p->pos + 1;
+    // Skip over the type, name, and the (, which were already checked by parse_top_level
+    p->pos += 3;
+
+    unsigned int base = p->stack.len;
+    if (!parser_check(p, LRES_PUNCTUATOR, PUNC_PAREN_R)) {
+        do {
+            if (!parser_is_type_keyword(parser_peek(p, 0))) {
+                parser_error(p, "expected the type of a parameter");
+                return AST_NONE;
+            }
+            unsigned int parameter = parse_declaration(p, false);
+            if (parameter == AST_NONE) {
+                return AST_NONE;
+            }
+            parser_push(p, parameter);
+        } while (parser_match(p, LRES_PUNCTUATOR, PUNC_COMMA));
+    }
+
+    if (!parser_expect(p, LRES_PUNCTUATOR, PUNC_PAREN_R, "expected ) after the parameters")) {
+        return AST_NONE;
+    }
+
+    unsigned int body = parse_block(p);
+    if (body == AST_NONE) {
+        return AST_NONE;
+    }
+    parser_push(p, body);
+
+    return parser_add_node_from_stack(p, AST_FUNCTION, returnType->id, name, base);
+}
+
+static unsigned int parse_top_level(Parser* p) {
+    // A type, then a name, then a ( can only be the start of a function
+    token* second = parser_peek(p, 1);
+    token* third = parser_peek(p, 2);
+    if (parser_is_type_keyword(parser_peek(p, 0)) && second != NULL && second->type == LRES_IDENTIFIER &&
+        third != NULL && third->type == LRES_PUNCTUATOR && third->id == PUNC_PAREN_L) {
+        return parse_function(p);
+    }
+    return parse_statement(p);
+}
+
+// Finds the functions at the top level of the file and splits the tokens up into ParseItems around them. This only
+// matches up parentheses and braces, which is cheap enough that it is a tiny part of the time it takes to actually parse
+static void parser_split_items(Parser* p, DynamicArray* items) {
+    unsigned int depth = 0;
+    unsigned int gapStart = 0;
+    unsigned int i = 0;
+    while (i < p->len) {
+        token* tok = &p->tokens[i];
+        unsigned int end = i;
+
+        // A type, then a name, then a ( can only be the start of a function (the same check as parse_top_level)
+        if (depth == 0 && parser_is_type_keyword(tok) && i + 2 < p->len && p->tokens[i + 1].type == LRES_IDENTIFIER &&
+            p->tokens[i + 2].type == LRES_PUNCTUATOR && p->tokens[i + 2].id == PUNC_PAREN_L) {
+            // Find the ) that closes the parameters. Running into a brace or ; first means the function is broken, and
+            // it is left to be parsed along with the code around it so that the error is reported there
+            unsigned int j = i + 3;
+            unsigned int parens = 1;
+            for (; j < p->len && parens > 0; j++) {
+                token* inner = &p->tokens[j];
+                if (inner->type != LRES_PUNCTUATOR) {
+                    continue;
+                } else if (inner->id == PUNC_PAREN_L) {
+                    parens++;
+                } else if (inner->id == PUNC_PAREN_R) {
+                    parens--;
+                } else if (inner->id == PUNC_CURLY_L || inner->id == PUNC_CURLY_R || inner->id == PUNC_SEMICOLON) {
                     break;
+                }
+            }
+
+            if (parens == 0 && j < p->len && p->tokens[j].type == LRES_PUNCTUATOR && p->tokens[j].id == PUNC_CURLY_L) {
+                // The body runs until its braces balance out, or the end of the file if they never do
+                unsigned int braces = 0;
+                for (; j < p->len; j++) {
+                    if (p->tokens[j].type == LRES_PUNCTUATOR && p->tokens[j].id == PUNC_CURLY_L) {
+                        braces++;
+                    } else if (p->tokens[j].type == LRES_PUNCTUATOR && p->tokens[j].id == PUNC_CURLY_R && --braces == 0) {
+                        break;
+                    }
+                }
+                end = j < p->len ? j + 1 : p->len;
+            }
+        }
+
+        if (end > i) {
+            if (gapStart < i) {
+                dynamic_array_append(items, &(ParseItem){.start = gapStart, .end = i, .function = false});
+            }
+            dynamic_array_append(items, &(ParseItem){.start = i, .end = end, .function = true});
+            gapStart = end;
+            i = end;
+            continue;
+        }
+
+        // Blocks at the top level are statements, and anything inside of them isn't at the top level anymore
+        if (tok->type == LRES_PUNCTUATOR && tok->id == PUNC_CURLY_L) {
+            depth++;
+        } else if (tok->type == LRES_PUNCTUATOR && tok->id == PUNC_CURLY_R && depth > 0) {
+            depth--;
+        }
+        i++;
+    }
+
+    if (gapStart < p->len) {
+        dynamic_array_append(items, &(ParseItem){.start = gapStart, .end = p->len, .function = false});
+    }
+}
+
+// Parses the tokens of one item, adding the top level nodes that come out of it to roots (an array of unsigned int)
+static void parser_parse_item(Parser* p, ParseItem* item, DynamicArray* roots) {
+    p->pos = item->start;
+    p->len = item->end;
+    p->panicking = false;
+    while (p->pos < p->len) {
+        unsigned int node = parse_statement_or_recover(p, false);
+        dynamic_array_append(roots, &node);
+    }
+}
+
+// Each worker thread parses functions into its own arena, so that no locking is needed while parsing.
+// The arenas are copied into the real tree afterwards
+typedef struct ParseWorker {
+    AST arena;
+    DynamicArray diagnostics;
+    // The top level nodes of every function this worker parsed, as indices into its arena
+    DynamicArray roots;
+    struct ParseJob* job;
+    unsigned int id;
+} ParseWorker;
+
+typedef struct ParseJob {
+    ParseItem* items;
+    // The indices of the items that are functions
+    unsigned int* functions;
+    unsigned int functionCount;
+    // The next function that hasn't been taken by a worker yet. Workers take one function at a time until there
+    // are none left, so a worker that got stuck with a huge function doesn't hold up the others
+    atomic_uint next;
+    DynamicArray* tokens;
+    string* file;
+} ParseJob;
+
+static void parse_worker_run(void* arg) {
+    ParseWorker* worker = (ParseWorker*)arg;
+    ParseJob* job = worker->job;
+    worker->arena.tokens = job->tokens;
+
+    Parser p = {.ast = &worker->arena, .tokens = (token*)job->tokens->buf, .file = job->file, .diagnostics = &worker->diagnostics};
+    dynamic_array_init(&p.stack, &STRING("unsigned int"));
+
+    unsigned int next;
+    while ((next = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->functionCount) {
+        ParseItem* item = &job->items[job->functions[next]];
+        item->worker = worker->id;
+        item->nodesStart = worker->arena.nodes.len;
+        item->intsStart = worker->arena.ints.len;
+        item->floatsStart = worker->arena.floats.len;
+        item->diagnosticsStart = worker->diagnostics.len;
+        item->rootsStart = worker->roots.len;
+
+        parser_parse_item(&p, item, &worker->roots);
+
+        item->nodesEnd = worker->arena.nodes.len;
+        item->intsEnd = worker->arena.ints.len;
+        item->floatsEnd = worker->arena.floats.len;
+        item->diagnosticsEnd = worker->diagnostics.len;
+        item->rootsEnd = worker->roots.len;
+        item->parsed = true;
+    }
+
+    dynamic_array_free(&p.stack);
+}
+
+// Copies the nodes of a function from an arena into the real tree. Every index in the nodes is moved over by the
+// difference between where the nodes were in the arena and where they are now, and names are interned again in the real
+// tree. symbolMap (an array of unsigned int) remembers which names of the arena were already interned, and locationShift
+// is added to the location of every node. Returns how far the nodes were moved
+static unsigned int ast_merge_nodes(AST* ast, AST* arena, ParseItem* item, unsigned int locationShift, DynamicArray* symbolMap) {
+    unsigned int nodeShift = ast->nodes.len - item->nodesStart;
+    unsigned int intShift = ast->ints.len - item->intsStart;
+    unsigned int floatShift = ast->floats.len - item->floatsStart;
+    unsigned int* map = (unsigned int*)symbolMap->buf;
+
+    for (unsigned int i = item->nodesStart; i < item->nodesEnd; i++) {
+        AST_node node = *ast_get(arena, i);
+        node.first_child = node.first_child != AST_NONE ? node.first_child + nodeShift : AST_NONE;
+        node.next_sibling = node.next_sibling != AST_NONE ? node.next_sibling + nodeShift : AST_NONE;
+
+        if (ast_has_symbol(node.type)) {
+            if (map[node.payload.symbol] == AST_NONE) {
+                map[node.payload.symbol] = interner_intern(&ast->symbols, interner_get(&arena->symbols, node.payload.symbol));
+            }
+            node.payload.symbol = map[node.payload.symbol];
+        } else if (node.type == AST_INT_CONSTANT && !(node.flags & AST_FLAG_INLINE_INT)) {
+            node.payload.constant += intShift;
+        } else if (node.type == AST_FLOAT_CONSTANT) {
+            node.payload.constant += floatShift;
+        }
+
+        unsigned int location = ((unsigned int*)arena->locations.buf)[i] + locationShift;
+        dynamic_array_append(&ast->nodes, &node);
+        dynamic_array_append(&ast->locations, &location);
+    }
+
+    for (unsigned int i = item->intsStart; i < item->intsEnd; i++) {
+        dynamic_array_append(&ast->ints, &((long long*)arena->ints.buf)[i]);
+    }
+    for (unsigned int i = item->floatsStart; i < item->floatsEnd; i++) {
+        dynamic_array_append(&ast->floats, &((double*)arena->floats.buf)[i]);
+    }
+    return nodeShift;
+}
+
+// Copies a function that was parsed by a worker into the real tree, along with its diagnostics and top level nodes
+static void ast_merge_item(AST* ast, ParseWorker* worker, ParseItem* item, DynamicArray* symbolMap, DynamicArray* diagnostics, DynamicArray* roots) {
+    unsigned int nodeShift = ast_merge_nodes(ast, &worker->arena, item, 0, symbolMap);
+
+    // The diagnostics are moved rather than copied, so the worker must not free them (see ast_generate)
+    for (unsigned int i = item->diagnosticsStart; i < item->diagnosticsEnd; i++) {
+        dynamic_array_append(diagnostics, &((Diagnostic*)worker->diagnostics.buf)[i]);
+    }
+
+    for (unsigned int i = item->rootsStart; i < item->rootsEnd; i++) {
+        unsigned int root = ((unsigned int*)worker->roots.buf)[i] + nodeShift;
+        dynamic_array_append(roots, &root);
+    }
+}
+
+// Parses every function that isn't in the way of the others on the pool ahead of time. Returns the workers
+// (which the caller has to clean up with parse_workers_free), or NULL if the file isn't worth splitting up
+static ParseWorker* parse_functions_in_parallel(ParseJob* job, DynamicArray* items, ThreadPool* pool, unsigned int* workerCount) {
+    DynamicArray functions;
+    dynamic_array_init(&functions, &STRING("unsigned int"));
+    for (unsigned int i = 0; i < items->len; i++) {
+        if (((ParseItem*)items->buf)[i].function && ((ParseItem*)items->buf)[i].reused == AST_NONE) {
+            dynamic_array_append(&functions, &i);
+        }
+    }
+
+    if (pool == NULL || pool->thread_count < 2 || functions.len < 2 || job->tokens->len < AST_PARALLEL_THRESHOLD) {
+        dynamic_array_free(&functions);
+        return NULL;
+    }
+
+    job->items = (ParseItem*)items->buf;
+    job->functions = (unsigned int*)functions.buf;
+    job->functionCount = functions.len;
+    atomic_init(&job->next, 0);
+
+    // thread_pool_wait has the calling thread help out, so it gets a worker of its own
+    *workerCount = pool->thread_count + 1 < functions.len ? pool->thread_count + 1 : functions.len;
+    ParseWorker* workers = (ParseWorker*)malloc(*workerCount * sizeof(ParseWorker));
+    if (workers == NULL) {
+        printf("Failed to allocate memory in parse_functions_in_parallel\n");
+        exit(-1);
+    }
+
+    for (unsigned int i = 0; i < *workerCount; i++) {
+        ast_init(&workers[i].arena);
+        dynamic_array_init(&workers[i].diagnostics, &STRING("Diagnostic"));
+        dynamic_array_init(&workers[i].roots, &STRING("unsigned int"));
+        workers[i].job = job;
+        workers[i].id = i;
+        thread_pool_submit(pool, parse_worker_run, &workers[i]);
+    }
+    thread_pool_wait(pool);
+
+    // The job still points at the function list, but nothing uses it after the workers are done
+    dynamic_array_free(&functions);
+    job->functions = NULL;
+    return workers;
+}
+
+static void parse_workers_free(ParseWorker* workers, unsigned int workerCount) {
+    for (unsigned int i = 0; i < workerCount; i++) {
+        ast_free(&workers[i].arena);
+        // The diagnostics were all moved into the real array by ast_merge_item
+        workers[i].diagnostics.len = 0;
+        dynamic_array_free(&workers[i].diagnostics);
+        dynamic_array_free(&workers[i].roots);
+    }
+    free(workers);
+}
+
+// Makes a map for ast_merge_nodes with room for every name in the arena, none of which have been interned yet
+static void ast_symbol_map_init(DynamicArray* symbolMap, AST* arena) {
+    dynamic_array_init(symbolMap, &STRING("unsigned int"));
+    unsigned int none = AST_NONE;
+    for (unsigned int i = 0; i < arena->symbols.names.len; i++) {
+        dynamic_array_append(symbolMap, &none);
+    }
+}
+
+// Hashes every function and finds the ones that can be copied from the arena of the reuse instead of being parsed
+static void ast_find_reusable(AST_reuse* reuse, token* tokens, DynamicArray* items) {
+    for (unsigned int i = 0; i < items->len; i++) {
+        ParseItem* item = &((ParseItem*)items->buf)[i];
+        item->reused = AST_NONE;
+        if (reuse == NULL || !item->function) {
+            continue;
+        }
+        item->hash = ast_hash_tokens(tokens, item->start, item->end);
+        unsigned long long key = item->hash;
+        unsigned int* found = hash_map_get(&reuse->by_hash, &key);
+        if (found != NULL) {
+            item->reused = *found;
+        }
+    }
+}
+
+// Takes in an array of tokens and the string for the original source file for debugging purposes
+int ast_generate(AST* ast, DynamicArray* tokens, string* file, DynamicArray* diagnostics, ThreadPool* pool,
+                 AST_reuse* reuse) {
+    // Any tree that was already in the AST is thrown away, but the memory is kept to be reused
+    ast->nodes.len = 0;
+    ast->locations.len = 0;
+    ast->ints.len = 0;
+    ast->floats.len = 0;
+    ast->tokens = tokens;
+
+    Parser p = {.ast = ast, .tokens = (token*)tokens->buf, .len = tokens->len, .pos = 0, .file = file, .diagnostics = diagnostics, .panicking = false};
+    unsigned int errorsBefore = diagnostics_count(diagnostics, DIAG_ERROR);
+    dynamic_array_init(&p.stack, &STRING("unsigned int"));
+
+    // The root is added first so that it is always node 0, and its children are filled in at the end.
+    // An empty file has no token for the root to point at, so it borrows a placeholder
+    if (p.len == 0) {
+        AST_node root = {.type = AST_ROOT, .first_child = AST_NONE, .next_sibling = AST_NONE};
+        unsigned int location = 0;
+        dynamic_array_append(&ast->nodes, &root);
+        dynamic_array_append(&ast->locations, &location);
+    } else {
+        parser_add_node(&p, AST_ROOT, 0, 0, NULL, 0);
+    }
+
+    // Functions can't be nested, so once the top level has been split up around them, every function can be parsed
+    // without knowing anything about the rest of the file
+    DynamicArray items;
+    dynamic_array_init(&items, &STRING("ParseItem"));
+    parser_split_items(&p, &items);
+    ast_find_reusable(reuse, p.tokens, &items);
+
+    ParseJob job = {.tokens = tokens, .file = file};
+    unsigned int workerCount = 0;
+    ParseWorker* workers = parse_functions_in_parallel(&job, &items, pool, &workerCount);
+
+    DynamicArray* symbolMaps = NULL;
+    if (workers != NULL) {
+        symbolMaps = (DynamicArray*)malloc(workerCount * sizeof(DynamicArray));
+        if (symbolMaps == NULL) {
+            printf("Failed to allocate memory in ast_generate\n");
+            exit(-1);
+        }
+        for (unsigned int i = 0; i < workerCount; i++) {
+            ast_symbol_map_init(&symbolMaps[i], &workers[i].arena);
+        }
+    }
+    DynamicArray reuseSymbolMap;
+    if (reuse != NULL) {
+        ast_symbol_map_init(&reuseSymbolMap, &reuse->arena);
+        reuse->items.len = 0;
+        reuse->reused = 0;
+        reuse->parsed = 0;
+    }
+
+    // Everything is put into the tree in the order it appears in the file, so the tree comes out exactly the same
+    // as if the whole file had been parsed on one thread (node numbers and symbol ids included). That goes for the
+    // functions that are reused too, since their names are interned in the same order they were when they were parsed
+    for (unsigned int i = 0; i < items.len; i++) {
+        ParseItem* item = &((ParseItem*)items.buf)[i];
+        unsigned int nodesStart = ast->nodes.len;
+        unsigned int intsStart = ast->ints.len;
+        unsigned int floatsStart = ast->floats.len;
+        unsigned int diagnosticsStart = diagnostics->len;
+        unsigned int rootsStart = p.stack.len;
+
+        if (item->reused != AST_NONE) {
+            AST_reusable_function* function = &((AST_reusable_function*)reuse->functions.buf)[item->reused];
+            ParseItem cached = {.nodesStart = function->nodes_start, .nodesEnd = function->nodes_end,
+                                .intsStart = function->ints_start, .intsEnd = function->ints_end,
+                                .floatsStart = function->floats_start, .floatsEnd = function->floats_end};
+            unsigned int root = function->nodes_end - 1 + ast_merge_nodes(ast, &reuse->arena, &cached, item->start, &reuseSymbolMap);
+            dynamic_array_append(&p.stack, &root);
+        } else if (item->parsed) {
+            ast_merge_item(ast, &workers[item->worker], item, &symbolMaps[item->worker], diagnostics, &p.stack);
+        } else {
+            parser_parse_item(&p, item, &p.stack);
+        }
+
+        if (reuse != NULL && item->function) {
+            unsigned int* roots = (unsigned int*)p.stack.buf;
+            AST_function_item function = {.hash = item->hash, .tokens_start = item->start, .tokens_end = item->end,
+                                          .nodes_start = nodesStart, .nodes_end = ast->nodes.len, .ints_start = intsStart,
+                                          .ints_end = ast->ints.len, .floats_start = floatsStart, .floats_end = ast->floats.len,
+                                          .reused = item->reused,
+                                          .clean = diagnostics->len == diagnosticsStart && p.stack.len == rootsStart + 1 &&
+                                                   roots[rootsStart] == ast->nodes.len - 1 &&
+                                                   ast_get(ast, roots[rootsStart])->type == AST_FUNCTION};
+            dynamic_array_append(&reuse->items, &function);
+            if (item->reused != AST_NONE) {
+                reuse->reused++;
+            } else {
+                reuse->parsed++;
+            }
+        }
+    }
+
+    if (workers != NULL) {
+        for (unsigned int i = 0; i < workerCount; i++) {
+            dynamic_array_free(&symbolMaps[i]);
+        }
+        free(symbolMaps);
+        parse_workers_free(workers, workerCount);
+    }
+    if (reuse != NULL) {
+        dynamic_array_free(&reuseSymbolMap);
+    }
+    dynamic_array_free(&items);
+
+    unsigned int* roots = (unsigned int*)p.stack.buf;
+    ast_get(ast, 0)->first_child = p.stack.len > 0 ? roots[0] : AST_NONE;
+    for (unsigned int i = 0; i + 1 < p.stack.len; i++) {
+        ast_get(ast, roots[i])->next_sibling = roots[i + 1];
+    }
+
+    dynamic_array_free(&p.stack);
+    return diagnostics_count(diagnostics, DIAG_ERROR) > errorsBefore ? -1 : 0;
+}
+
+int ast_extract_functions(AST* arena, AST* ast, DynamicArray* items, DynamicArray* functions) {
+    DynamicArray symbolMap;
+    ast_symbol_map_init(&symbolMap, ast);
+    for (unsigned int i = 0; i < items->len; i++) {
+        AST_function_item* item = &((AST_function_item*)items->buf)[i];
+        AST_reusable_function function = {.hash = item->hash, .nodes_start = arena->nodes.len, .nodes_end = arena->nodes.len,
+                                          .ints_start = arena->ints.len, .ints_end = arena->ints.len,
+                                          .floats_start = arena->floats.len, .floats_end = arena->floats.len};
+        if (item->clean) {
+            // This is the same copy that puts reused functions into the tree, just going the other way. The locations end
+            // up counting from the first token of the function since the shift wraps around
+            ParseItem range = {.nodesStart = item->nodes_start, .nodesEnd = item->nodes_end, .intsStart = item->ints_start,
+                               .intsEnd = item->ints_end, .floatsStart = item->floats_start, .floatsEnd = item->floats_end};
+            ast_merge_nodes(arena, ast, &range, 0u - item->tokens_start, &symbolMap);
+            function.nodes_end = arena->nodes.len;
+            function.ints_end = arena->ints.len;
+            function.floats_end = arena->floats.len;
+            // The function node pointed at whatever came after it at the top level of the file
+            ast_get(arena, function.nodes_end - 1)->next_sibling = AST_NONE;
+        }
+        dynamic_array_append(functions, &function);
+    }
+    dynamic_array_free(&symbolMap);
+    return 0;
+}
+
+static uint64_t ast_file_align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static bool ast_token_has_literal(token* tok) {
+    return tok->type == LRES_LITERAL || tok->type == LRES_IDENTIFIER;
+}
+
+// Every reserved word has an id below this, which is what lets ast_deserialize keep their names in a small table
+#define AST_FILE_RESERVED_IDS 32
+
+// Looking up the name of a reserved word goes through the list of all of them, so ast_deserialize remembers every name
+// it has looked up in names (which has AST_FILE_RESERVED_IDS entries for every type of token). Returns NULL for an
+// unknown word
+static string* ast_file_reserved_word(string** names, unsigned int type, unsigned int id) {
+    if (type > LRES_IDENTIFIER || id >= AST_FILE_RESERVED_IDS) {
+        return NULL;
+    }
+    string** name = &names[type * AST_FILE_RESERVED_IDS + id];
+    if (*name == NULL) {
+        *name = lexer_reserved_word(type, id);
+    }
+    return *name;
+}
+
+int ast_serialize(AST* ast, DynamicArray* data) {
+    DynamicArray* tokens = ast->tokens;
+    unsigned int tokenCount = tokens != NULL ? tokens->len : 0;
+    token* toks = tokens != NULL ? (token*)tokens->buf : NULL;
+
+    // Everything is measured first so that the data only has to be allocated once
+    AST_file_header header;
+    memset(&header, 0, sizeof(header));
+    header.token_count = tokenCount;
+    header.node_count = ast->nodes.len;
+    header.int_count = ast->ints.len;
+    header.float_count = ast->floats.len;
+    header.symbol_count = ast->symbols.names.len;
+    header.string_count = header.symbol_count;
+    for (unsigned int i = 0; i < ast->symbols.names.len; i++) {
+        header.chars_size += ((string*)ast->symbols.names.buf)[i].len;
+    }
+    for (unsigned int i = 0; i < tokenCount; i++) {
+        if (ast_token_has_literal(&toks[i])) {
+            header.string_count++;
+            header.chars_size += toks[i].literal.len;
+        }
+    }
+
+    header.tokens = ast_file_align(sizeof(AST_file_header));
+    header.nodes = ast_file_align(header.tokens + (uint64_t)header.token_count * sizeof(AST_file_token));
+    header.locations = ast_file_align(header.nodes + (uint64_t)header.node_count * sizeof(AST_node));
+    header.ints = ast_file_align(header.locations + (uint64_t)header.node_count * sizeof(unsigned int));
+    header.floats = ast_file_align(header.ints + (uint64_t)header.int_count * sizeof(long long));
+    header.strings = ast_file_align(header.floats + (uint64_t)header.float_count * sizeof(double));
+    header.chars = ast_file_align(header.strings + (uint64_t)header.string_count * sizeof(AST_file_string));
+    uint64_t total = header.chars + header.chars_size;
+    if (total > UINT32_MAX) {
+        return -1;
+    }
+
+    dynamic_array_resize(data, (unsigned int)total, true);
+    char* out = (char*)data->buf;
+    memset(out, 0, total);
+    memcpy(out, &header, sizeof(header));
+    if (header.node_count > 0) {
+        memcpy(out + header.nodes, ast->nodes.buf, header.node_count * sizeof(AST_node));
+        memcpy(out + header.locations, ast->locations.buf, header.node_count * sizeof(unsigned int));
+    }
+    if (header.int_count > 0) {
+        memcpy(out + header.ints, ast->ints.buf, header.int_count * sizeof(long long));
+    }
+    if (header.float_count > 0) {
+        memcpy(out + header.floats, ast->floats.buf, header.float_count * sizeof(double));
+    }
+
+    AST_file_string* strings = (AST_file_string*)(out + header.strings);
+    uint32_t chars = 0;
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < ast->symbols.names.len; i++) {
+        string* name = &((string*)ast->symbols.names.buf)[i];
+        strings[count++] = (AST_file_string){.offset = chars, .len = name->len};
+        if (name->len > 0) {
+            memcpy(out + header.chars + chars, name->str, name->len);
+        }
+        chars += name->len;
+    }
+    AST_file_token* fileTokens = (AST_file_token*)(out + header.tokens);
+    for (unsigned int i = 0; i < tokenCount; i++) {
+        fileTokens[i] = (AST_file_token){.type = toks[i].type, .id = toks[i].id, .offset = toks[i].offset, .literal = UINT32_MAX};
+        if (ast_token_has_literal(&toks[i])) {
+            fileTokens[i].literal = count;
+            strings[count++] = (AST_file_string){.offset = chars, .len = toks[i].literal.len};
+            if (toks[i].literal.len > 0) {
+                memcpy(out + header.chars + chars, toks[i].literal.str, toks[i].literal.len);
             }
+            chars += toks[i].literal.len;
+        }
+    }
+    return 0;
+}
+
+// Copies count elements of the given size from the data into the array
+static void ast_file_copy(DynamicArray* arr, const char* from, unsigned int count) {
+    arr->len = 0;
+    if (count > 0) {
+        dynamic_array_resize(arr, count, true);
+        memcpy(arr->buf, from, (size_t)count * arr->element_size);
+    }
+}
+
+int ast_deserialize(AST* ast, DynamicArray* tokens, const void* data, size_t size) {
+    const char* in = (const char*)data;
+    if (size < sizeof(AST_file_header)) {
+        return -1;
+    }
+    AST_file_header header;
+    memcpy(&header, in, sizeof(header));
+
+    // Everything is checked before anything is built, so that bad data can't leave a half built tree behind
+    if (header.node_count == 0 || header.string_count < header.symbol_count ||
+        !file_section_fits(header.tokens, header.token_count, sizeof(AST_file_token), 1, size) ||
+        !file_section_fits(header.nodes, header.node_count, sizeof(AST_node), 1, size) ||
+        !file_section_fits(header.locations, header.node_count, sizeof(unsigned int), 1, size) ||
+        !file_section_fits(header.ints, header.int_count, sizeof(long long), 1, size) ||
+        !file_section_fits(header.floats, header.float_count, sizeof(double), 1, size) ||
+        !file_section_fits(header.strings, header.string_count, sizeof(AST_file_string), 1, size) ||
+        !file_section_fits(header.chars, header.chars_size, 1, 1, size) ||
+        (header.tokens | header.nodes | header.locations | header.ints | header.floats | header.strings) % 8 != 0) {
+        return -1;
+    }
+    string* reserved[(LRES_IDENTIFIER + 1) * AST_FILE_RESERVED_IDS] = {NULL};
+    const AST_file_token* fileTokens = (const AST_file_token*)(in + header.tokens);
+    const AST_file_string* strings = (const AST_file_string*)(in + header.strings);
+    for (unsigned int i = 0; i < header.string_count; i++) {
+        if ((uint64_t)strings[i].offset + strings[i].len > header.chars_size) {
+            return -1;
         }
     }
+    for (unsigned int i = 0; i < header.token_count; i++) {
+        token tok = {.type = fileTokens[i].type, .id = fileTokens[i].id};
+        bool literal = ast_token_has_literal(&tok);
+        if ((literal && (fileTokens[i].literal < header.symbol_count || fileTokens[i].literal >= header.string_count)) ||
+            (!literal && ast_file_reserved_word(reserved, tok.type, tok.id) == NULL)) {
+            return -1;
+        }
+    }
+    const unsigned int* locations = (const unsigned int*)(in + header.locations);
+    for (unsigned int i = 0; i < header.node_count && header.token_count > 0; i++) {
+        if (locations[i] >= header.token_count) {
+            return -1;
+        }
+    }
+
+    tokens->len = 0;
+    if (header.token_count > 0) {
+        dynamic_array_resize(tokens, header.token_count, true);
+    }
+    for (unsigned int i = 0; i < header.token_count; i++) {
+        token tok = {.type = fileTokens[i].type, .id = fileTokens[i].id, .offset = fileTokens[i].offset};
+        if (ast_token_has_literal(&tok)) {
+            const AST_file_string* literal = &strings[fileTokens[i].literal];
+            string_init(&tok.literal);
+            // Empty literals are left as a NULL string, the same as the lexer makes them
+            if (literal->len > 0) {
+                string_resize(&tok.literal, literal->len);
+                memcpy(tok.literal.str, in + header.chars + literal->offset, literal->len);
+            }
+        } else {
+            tok.literal = *ast_file_reserved_word(reserved, tok.type, tok.id);
+        }
+        ((token*)tokens->buf)[i] = tok;
+    }
+
+    ast_file_copy(&ast->nodes, in + header.nodes, header.node_count);
+    ast_file_copy(&ast->locations, in + header.locations, header.node_count);
+    ast_file_copy(&ast->ints, in + header.ints, header.int_count);
+    ast_file_copy(&ast->floats, in + header.floats, header.float_count);
+    // Ids are handed out in order, so interning the names in order gives every one of them back the same id
+    for (unsigned int i = 0; i < header.symbol_count; i++) {
+        string name = {.str = (char*)in + header.chars + strings[i].offset, .len = strings[i].len, .__memsize = 0};
+        interner_intern(&ast->symbols, &name);
+    }
+    ast->tokens = tokens;
+    return 0;
+}
+
+unsigned int ast_child(AST* ast, unsigned int node, unsigned int n) {
+    unsigned int child = ast_get(ast, node)->first_child;
+    while (n > 0 && child != AST_NONE) {
+        child = ast_get(ast, child)->next_sibling;
+        n--;
+    }
+    return child;
+}
+
+unsigned int ast_child_count(AST* ast, unsigned int node) {
+    unsigned int count = 0;
+    AST_FOR_EACH_CHILD(ast, node, child) {
+        count++;
+    }
+    return count;
+}
+
+// Every node is on the stack of the walk once on the way down and once on the way up. The lowest bit tells them apart,
+// which lets the walk be done with a plain array of integers
+#define AST_VISIT_LEAVING 1u
+
+int ast_visit(AST* ast, unsigned int root, AST_visitor* visitor) {
+    DynamicArray stack;
+    dynamic_array_init(&stack, &STRING("unsigned long long"));
+    unsigned long long entry = (unsigned long long)root << 1;
+    dynamic_array_append(&stack, &entry);
+
+    int result = AST_VISIT_CONTINUE;
+    while (stack.len > 0) {
+        entry = ((unsigned long long*)stack.buf)[--stack.len];
+        unsigned int node = (unsigned int)(entry >> 1);
+
+        if (entry & AST_VISIT_LEAVING) {
+            if (visitor->leave != NULL && visitor->leave(ast, node, visitor->ctx) == AST_VISIT_STOP) {
+                result = AST_VISIT_STOP;
+                break;
+            }
+            continue;
+        }
+
+        int action = visitor->enter != NULL ? visitor->enter(ast, node, visitor->ctx) : AST_VISIT_CONTINUE;
+        if (action == AST_VISIT_STOP) {
+            result = AST_VISIT_STOP;
+            break;
+        }
+
+        entry = ((unsigned long long)node << 1) | AST_VISIT_LEAVING;
+        dynamic_array_append(&stack, &entry);
+        if (action == AST_VISIT_SKIP) {
+            continue;
+        }
+
+        // The children are pushed in reverse so that the first child is visited first. Since the children are a singly
+        // linked list, they are pushed in order and then the part of the stack they take up is flipped
+        unsigned int start = stack.len;
+        AST_FOR_EACH_CHILD(ast, node, child) {
+            entry = (unsigned long long)child << 1;
+            dynamic_array_append(&stack, &entry);
+        }
+        unsigned long long* entries = (unsigned long long*)stack.buf;
+        for (unsigned int i = start, j = stack.len - 1; i < j; i++, j--) {
+            unsigned long long tmp = entries[i];
+            entries[i] = entries[j];
+            entries[j] = tmp;
+        }
+    }
+
+    dynamic_array_free(&stack);
+    return result;
+}
+
+static const char* ast_type_name(unsigned int type) {
+    static const char* names[] = {"VARIABLE", "ASSIGNMENT", "EXPRESSION", "COMPARISON", "INT_CONSTANT", "FLOAT_CONSTANT", "STRING_CONSTANT",
+                                  "BRANCH", "WHILE", "FOR", "ROOT", "DECLARATION", "FUNCTION", "BLOCK", "RETURN", "CALL", "UNARY", "EMPTY", "ERROR"};
+    if (type < sizeof(names) / sizeof(names[0])) {
+        return names[type];
+    }
+    return "UNKNOWN";
+}
+
+static const char* ast_keyword_name(unsigned int keyword) {
+    switch (keyword) {
+        case KEY_INT:
+            return "int";
+        case KEY_FLOAT:
+            return "float";
+        case KEY_STRING:
+            return "string";
+    }
+    return "?";
+}
+
+int ast_print_node(AST* ast, unsigned int index, unsigned int depth) {
+    AST_node* node = ast_get(ast, index);
+    printf("%*s%s", depth * 2, "", ast_type_name(node->type));
+
+    switch (node->type) {
+        case AST_FUNCTION:
+        case AST_DECLARATION:
+            printf(" %s %s", ast_keyword_name(node->data), ast_symbol(ast, index)->str);
+            break;
+        case AST_VARIABLE:
+        case AST_CALL:
+            printf(" %s", ast_symbol(ast, index)->str);
+            break;
+        case AST_INT_CONSTANT:
+            printf(" %lld", ast_int_value(ast, index));
+            break;
+        case AST_FLOAT_CONSTANT:
+            printf(" %g", ast_float_value(ast, index));
+            break;
+        case AST_ASSIGNMENT:
+        case AST_EXPRESSION:
+        case AST_COMPARISON:
+        case AST_UNARY:
+            printf(" %s", ast_token(ast, index)->literal.str);
+            break;
+        case AST_STRING_CONSTANT:
+            printf(" \"%s\"", ast_symbol(ast, index)->str);
+            break;
+    }
+    return 0;
+}
+
+int ast_print(AST* ast, unsigned int index, unsigned int depth) {
+    ast_print_node(ast, index, depth);
+    printf("\n");
+
+    AST_FOR_EACH_CHILD(ast, index, child) {
+        ast_print(ast, child, depth + 1);
+    }
     return 0;
 }
@@ -1,11 +1,15 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "lexer.h"
+#include "Diagnostics.h"
 #include "DynamicArray.h"
+#include "Interner.h"
 #include "Strings.h"
+#include "ThreadPool.h"
 
 // This defines the different possible types for an AST node
 enum AST_types {
@@ -19,21 +23,111 @@ enum AST_types {
     AST_BRANCH,
     AST_WHILE,
     AST_FOR,
-    AST_ROOT
+    AST_ROOT,
+    AST_DECLARATION,
+    AST_FUNCTION,
+    AST_BLOCK,
+    AST_RETURN,
+    AST_CALL,
+    AST_UNARY,
+    // Stands in for an optional part of a statement that was left out, like the condition in for (;;)
+    AST_EMPTY,
+    // Stands in for a statement (or top level function) that had a syntax error, so that the rest of the tree is still usable
+    AST_ERROR
 };
 
-typedef struct AST {
-    // The "branches" of the abstract syntax tree, as in the sub nodes for each node
-    // Specifically, it will be a dynamic array of type AST
-    DynamicArray branches;
+// Used in place of a node index when there is no node, such as when parsing fails
+#define AST_NONE UINT32_MAX
+
+// Files with fewer tokens than this are always parsed on one thread, since there is too little work to split up
+#define AST_PARALLEL_THRESHOLD 4096
+
+// What each type of node holds:
+// AST_ROOT:        children are the top level functions, declarations, and statements
+// AST_FUNCTION:    data is the return type keyword, the payload is the name. Children are the parameters (as declarations), then the body
+// AST_DECLARATION: data is the type keyword, the payload is the name. The only child (if there is one) is the initial value
+// AST_ASSIGNMENT:  data is the operator (=, +=, etc.). Children are the variable and the value
+// AST_EXPRESSION:  data is the arithmetic operator. Children are the left and right side
+// AST_COMPARISON:  data is the comparison operator. Children are the left and right side
+// AST_UNARY:       data is the operator. The only child is the operand
+// AST_CALL:        the payload is the name of the function. Children are the arguments
+// AST_BRANCH:      children are the condition, the body, and then the else body if there is one
+// AST_WHILE:       children are the condition and the body
+// AST_FOR:         children are the initializer, condition, step, and body. Missing parts are AST_EMPTY
+// AST_RETURN:      the only child (if there is one) is the value being returned
+// AST_BLOCK:       children are the statements in the block
+// AST_VARIABLE:    the payload is the name
+// AST_INT_CONSTANT, AST_FLOAT_CONSTANT, and AST_STRING_CONSTANT: the payload is the value (see the flags below)
+
+// Set on integer constants whose value fits in 32 bits, which are stored directly in the payload.
+// Any other integer constant has its value in the ints array of the AST instead
+#define AST_FLAG_INLINE_INT 1
+
+// Nodes are packed into 16 bytes so that four of them fit in a cache line, and the tree for a typical function
+// fits in the L2 cache. Anything that is only needed occasionally (like where a node came from in the source)
+// is kept in separate arrays indexed by the node index rather than in the node itself
+typedef struct AST_node {
     // The type of the specific node: variable, expression, assignment, comparison, constant, etc.
-    unsigned int type;
-    // This is used to store the name of a variable, if applicable. Could also be another identifier
-    string name;
-    // This is used for storing 
-    unsigned int data;
+    uint8_t type;
+    // The AST_FLAG bits
+    uint8_t flags;
+    // Extra information whose meaning depends on the type of the node (see above)
+    uint16_t data;
+    // The children of a node form a linked list: the node points at its first child, and every child points
+    // at the next one. Both are AST_NONE when there is no such node
+    uint32_t first_child;
+    uint32_t next_sibling;
+    union {
+        // The interned id of a name or string constant (see the symbols interner of the AST)
+        uint32_t symbol;
+        // The value of an integer constant with AST_FLAG_INLINE_INT set
+        int32_t inline_int;
+        // The index of the value of a float constant in the floats array, or an integer constant in the ints array
+        uint32_t constant;
+    } payload;
+} AST_node;
+
+typedef struct AST {
+    // Every node of the tree lives in this one array (of type AST_node), and nodes refer to each other by their index in it.
+    // This means building the tree only needs an allocation whenever the array grows, instead of one (or more) per node.
+    // The root is always node 0
+    DynamicArray nodes;
+    // The index of the token that each node came from (of type unsigned int), which is used for error messages
+    DynamicArray locations;
+    // Integer constants that don't fit in the payload of a node (of type long long)
+    DynamicArray ints;
+    // The values of float constants (of type double)
+    DynamicArray floats;
+    // Every name and string constant in the tree, so that they can be compared by id
+    Interner symbols;
+    // The tokens the tree was generated from. The tree doesn't own them, but they have to stay alive for
+    // as long as the tree is used, since the locations refer to them
+    DynamicArray* tokens;
 } AST;
 
+// Loops over every child of a node. Example:
+// AST_FOR_EACH_CHILD(ast, node, child) { ast_print(ast, child, 0); }
+#define AST_FOR_EACH_CHILD(ast, parent, child) \
+    for (unsigned int child = ast_get(ast, parent)->first_child; child != AST_NONE; child = ast_get(ast, child)->next_sibling)
+
+// What the functions of an AST_visitor return to control the rest of the walk
+enum AST_visit_results {
+    AST_VISIT_CONTINUE,
+    // Only meaningful from enter: the children of the node are not visited (leave is still called for the node)
+    AST_VISIT_SKIP,
+    // Ends the walk right away
+    AST_VISIT_STOP
+};
+
+// Used with ast_visit to walk over a tree. Either function can be NULL
+typedef struct AST_visitor {
+    // Called for a node before any of its children are visited
+    int (*enter)(AST* ast, unsigned int node, void* ctx);
+    // Called for a node after all of its children are visited
+    int (*leave)(AST* ast, unsigned int node, void* ctx);
+    void* ctx;
+} AST_visitor;
+
 // Should be called only once in the lifetime of a program before using the parser functions
 // It basically just initializes some critical values for this module to work properly
 int ast_module_init(void);
@@ -44,7 +138,164 @@ int ast_deallocator(void* ast);
 // Should be called before using any functions that involve an abstract syntax tree
 int ast_init(AST* ast);
 
-// Generates the actual abstract syntax tree 
-int ast_generate(AST* ast, DynamicArray* tokens, DynamicArray* identifiers, string* file);
+// Frees all of the nodes of the tree
+int ast_free(AST* ast);
+
+// A function that was parsed during an earlier run, which ast_generate can copy into the tree instead of parsing it again
+typedef struct AST_reusable_function {
+    // The hash of the tokens of the function (see ast_hash_tokens)
+    uint64_t hash;
+    // Where the nodes, ints, and floats of the function are in the arena of the AST_reuse, each as a range from start up to,
+    // but not including, end. The function node is the last of its nodes
+    uint32_t nodes_start, nodes_end;
+    uint32_t ints_start, ints_end;
+    uint32_t floats_start, floats_end;
+} AST_reusable_function;
+
+// What ast_generate found out about one of the functions at the top level of the file
+typedef struct AST_function_item {
+    uint64_t hash;
+    // The tokens, nodes, ints, and floats of the function, each as a range from start up to, but not including, end.
+    // The function node is the last of its nodes
+    unsigned int tokens_start, tokens_end;
+    unsigned int nodes_start, nodes_end;
+    unsigned int ints_start, ints_end;
+    unsigned int floats_start, floats_end;
+    // The index of the AST_reusable_function that was copied into the tree, or AST_NONE if the function was parsed
+    unsigned int reused;
+    // Whether the function came out as a single AST_FUNCTION without any syntax errors, which is the only kind of
+    // function that is worth keeping for a later run
+    bool clean;
+} AST_function_item;
+
+// Lets ast_generate skip parsing the functions that haven't changed since an earlier run (see incremental.h)
+typedef struct AST_reuse {
+    // Every function that can be reused, one after another in the same tree. The locations of their nodes count from
+    // the first token of the function rather than the start of the file, so they don't depend on where the function is
+    AST arena;
+    // Of type AST_reusable_function
+    DynamicArray functions;
+    // Maps the hash of a function (unsigned long long) to its index in functions (unsigned int)
+    HashMap by_hash;
+    // Filled in by ast_generate with an AST_function_item for every function at the top level of the file, in order
+    DynamicArray items;
+    // How many functions were copied from the arena, and how many had to be parsed
+    unsigned int reused;
+    unsigned int parsed;
+} AST_reuse;
+
+int ast_reuse_init(AST_reuse* reuse);
+
+int ast_reuse_free(AST_reuse* reuse);
+
+// Copies every clean function in items (an array of AST_function_item) out of the tree and onto the end of arena, in the
+// form that AST_reuse expects. An AST_reusable_function is added to functions for every item (in the same order), which
+// for functions that aren't clean has no nodes
+int ast_extract_functions(AST* arena, AST* ast, DynamicArray* items, DynamicArray* functions);
+
+// Returns a hash of the tokens from start up to, but not including, end. Only what the tokens are counts, not where
+// they are in the file, so a function hashes the same after lines are added above it
+uint64_t ast_hash_tokens(token* tokens, unsigned int start, unsigned int end);
+
+// Generates the actual abstract syntax tree from the tokens produced by the lexer.
+// Syntax errors don't stop the parser: each one is added to diagnostics (an array of Diagnostics), the statement it is in
+// becomes an AST_ERROR node, and parsing picks back up at the next ;, }, or declaration. That way a single run finds
+// every syntax error in the file and still produces a tree for everything else.
+// When a pool is given (it can be NULL), the bodies of functions are parsed on it at the same time. When reuse is given
+// (it can also be NULL), functions whose tokens hash the same as one of its functions are copied from it instead of being
+// parsed, and its items are filled in. The tree that comes out is exactly the same either way.
+// Returns -1 if there were any syntax errors
+int ast_generate(AST* ast, DynamicArray* tokens, string* file, DynamicArray* diagnostics, ThreadPool* pool,
+                 AST_reuse* reuse);
+
+// A tree is serialized (see ast_serialize) as an AST_file_header followed by its sections, each of which starts at an
+// offset from the start of the data that is a multiple of 8, so that it can be used straight from a mapped file
+typedef struct AST_file_header {
+    uint32_t token_count;
+    uint32_t node_count;
+    uint32_t int_count;
+    uint32_t float_count;
+    uint32_t symbol_count;
+    // The number of entries in the string table, which is every symbol followed by the literal of every literal
+    // and identifier token
+    uint32_t string_count;
+    // Where each section begins, counted from the start of the data
+    uint64_t tokens;
+    uint64_t nodes;
+    uint64_t locations;
+    uint64_t ints;
+    uint64_t floats;
+    uint64_t strings;
+    uint64_t chars;
+    uint64_t chars_size;
+} AST_file_header;
+
+typedef struct AST_file_token {
+    uint32_t type;
+    uint32_t id;
+    uint32_t offset;
+    // The index of the literal in the string table for literal and identifier tokens. The literal of any other token is
+    // the name of the reserved word, so it isn't stored
+    uint32_t literal;
+} AST_file_token;
+
+typedef struct AST_file_string {
+    // Where the characters begin, counted from the start of the characters section
+    uint32_t offset;
+    uint32_t len;
+} AST_file_string;
+
+// Turns the tree and the tokens it was made from into one flat block of bytes that can be written to a file.
+// data should be an initialized array of char, and anything already in it is replaced
+int ast_serialize(AST* ast, DynamicArray* data);
+
+// Rebuilds a tree and its tokens from the bytes made by ast_serialize. The tree should be initialized and tokens
+// should be an empty array of tokens. Nothing is changed if the data isn't a valid tree, in which case -1 is returned
+int ast_deserialize(AST* ast, DynamicArray* tokens, const void* data, size_t size);
+
+// Returns the node at the given index
+inline AST_node* ast_get(AST* ast, unsigned int index) {
+    return &((AST_node*)ast->nodes.buf)[index];
+}
+
+// Returns the index of the nth child of the node, or AST_NONE if it doesn't have that many children
+unsigned int ast_child(AST* ast, unsigned int node, unsigned int n);
+
+unsigned int ast_child_count(AST* ast, unsigned int node);
+
+// Returns the token that the node came from
+inline token* ast_token(AST* ast, unsigned int index) {
+    return &((token*)ast->tokens->buf)[((unsigned int*)ast->locations.buf)[index]];
+}
+
+// Returns the name (or the contents of the string constant) that the payload of the node refers to
+inline string* ast_symbol(AST* ast, unsigned int index) {
+    return interner_get(&ast->symbols, ast_get(ast, index)->payload.symbol);
+}
+
+// Returns the value of an integer constant node
+inline long long ast_int_value(AST* ast, unsigned int index) {
+    AST_node* node = ast_get(ast, index);
+    if (node->flags & AST_FLAG_INLINE_INT) {
+        return node->payload.inline_int;
+    }
+    return ((long long*)ast->ints.buf)[node->payload.constant];
+}
+
+// Returns the value of a float constant node
+inline double ast_float_value(AST* ast, unsigned int index) {
+    return ((double*)ast->floats.buf)[ast_get(ast, index)->payload.constant];
+}
+
+// Walks over the tree starting at the given node in depth first order, calling the functions of the visitor on each node.
+// This doesn't use recursion, so it works no matter how deep the tree is.
+// Returns AST_VISIT_STOP if the walk was ended early
+int ast_visit(AST* ast, unsigned int root, AST_visitor* visitor);
+
+// Prints the tree starting at the given node, with every level of depth indented a bit further
+int ast_print(AST* ast, unsigned int node, unsigned int depth);
+
+// Prints a single node (indented for the given depth) without a newline, so that more can be added to the line
+int ast_print_node(AST* ast, unsigned int node, unsigned int depth);
 
 #endif
@@ -0,0 +1,629 @@
+#include "semantic.h"
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "HashMap.h"
+#include "Strings.h"
+#include "lexer.h"
+#include "parser.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern SemanticInfo* semantic_get(Semantic* sem, unsigned int node);
+
+// A name that has been declared. When a name is declared again in an inner scope, the new binding remembers the one it
+// hides, so that the old one can be put back once the inner scope ends
+typedef struct SemanticBinding {
+    unsigned int symbol;
+    unsigned int kind;
+    unsigned int type;
+    unsigned int slot;
+    // How many scopes deep the declaration was, where the top level of the file is 0
+    unsigned int depth;
+    // The binding this one hides, or AST_NONE if it doesn't hide anything
+    unsigned int previous;
+} SemanticBinding;
+
+typedef struct SemanticScope {
+    // The length of the bindings array when the scope started. Everything past that was declared in the scope
+    unsigned int bindings_start;
+    // The next free slot when the scope started, which is where the slots go back to once the scope ends
+    unsigned int slots_start;
+} SemanticScope;
+
+typedef struct Analyzer {
+    AST* ast;
+    Semantic* sem;
+    DynamicArray* diagnostics;
+    // Maps every name (by its symbol id) to the binding that is currently visible for it. Since there is only ever one
+    // map no matter how deeply the scopes are nested, finding a name takes the same time anywhere
+    HashMap visible;
+    // Every binding that is currently in scope (of type SemanticBinding), with the innermost ones at the end
+    DynamicArray bindings;
+    // The scopes that are currently open (of type SemanticScope)
+    DynamicArray scopes;
+    unsigned int next_slot;
+    // Where the number of slots needed by the current function (or the top level) is kept track of
+    unsigned int* slot_count;
+    // The return type of the function being analyzed, or SEM_TYPE_NONE at the top level
+    unsigned int return_type;
+    // The first function of sem->reuse that hasn't been reached yet. Functions are analyzed in the same order
+    // they are in the reuse, so this only ever moves forward
+    unsigned int next_reusable;
+} Analyzer;
+
+int semantic_module_init(void) {
+    dynamic_array_registry_type_append(&STRING("SemanticInfo"), NULL, sizeof(SemanticInfo));
+    dynamic_array_registry_type_append(&STRING("SemanticFunction"), NULL, sizeof(SemanticFunction));
+    dynamic_array_registry_type_append(&STRING("SemanticBinding"), NULL, sizeof(SemanticBinding));
+    dynamic_array_registry_type_append(&STRING("SemanticScope"), NULL, sizeof(SemanticScope));
+    dynamic_array_registry_type_append(&STRING("SemanticDependency"), NULL, sizeof(SemanticDependency));
+    dynamic_array_registry_type_append(&STRING("SemanticReusable"), NULL, sizeof(SemanticReusable));
+    dynamic_array_registry_type_append(&STRING("Semantic"), semantic_deallocator, sizeof(Semantic));
+    return 0;
+}
+
+int semantic_init(Semantic* sem) {
+    dynamic_array_init(&sem->info, &STRING("SemanticInfo"));
+    dynamic_array_init(&sem->functions, &STRING("SemanticFunction"));
+    sem->global_count = 0;
+    sem->script_local_count = 0;
+    sem->reuse = NULL;
+    return 0;
+}
+
+int semantic_free(Semantic* sem) {
+    dynamic_array_free(&sem->info);
+    dynamic_array_free(&sem->functions);
+    return 0;
+}
+
+int semantic_deallocator(void* sem) {
+    semantic_free((Semantic*)sem);
+    return 0;
+}
+
+int semantic_reuse_init(SemanticReuse* reuse) {
+    dynamic_array_init(&reuse->functions, &STRING("SemanticReusable"));
+    dynamic_array_init(&reuse->info, &STRING("SemanticInfo"));
+    dynamic_array_init(&reuse->dependencies, &STRING("SemanticDependency"));
+    reuse->reused = 0;
+    reuse->analyzed = 0;
+    return 0;
+}
+
+int semantic_reuse_free(SemanticReuse* reuse) {
+    dynamic_array_free(&reuse->functions);
+    dynamic_array_free(&reuse->info);
+    dynamic_array_free(&reuse->dependencies);
+    return 0;
+}
+
+const char* semantic_type_name(unsigned int type) {
+    switch (type) {
+        case SEM_TYPE_INT:
+            return "int";
+        case SEM_TYPE_FLOAT:
+            return "float";
+        case SEM_TYPE_STRING:
+            return "string";
+        case SEM_TYPE_ERROR:
+            return "error";
+    }
+    return "none";
+}
+
+static unsigned int semantic_keyword_type(unsigned int keyword) {
+    switch (keyword) {
+        case KEY_INT:
+            return SEM_TYPE_INT;
+        case KEY_FLOAT:
+            return SEM_TYPE_FLOAT;
+        case KEY_STRING:
+            return SEM_TYPE_STRING;
+    }
+    return SEM_TYPE_ERROR;
+}
+
+static bool semantic_is_number(unsigned int type) {
+    return type == SEM_TYPE_INT || type == SEM_TYPE_FLOAT;
+}
+
+// Whether a value of one type can be stored somewhere that holds the other. Ints and floats are converted into each other
+// automatically (a float stored in an int is truncated, like in C), but strings and numbers never mix
+static bool semantic_convertible(unsigned int from, unsigned int to) {
+    if (from == SEM_TYPE_ERROR || to == SEM_TYPE_ERROR) {
+        return true;
+    }
+    return from == to || (semantic_is_number(from) && semantic_is_number(to));
+}
+
+// Reports an error at the token the node came from. The message is formatted like printf
+static void analyzer_error(Analyzer* a, unsigned int node, const char* format, ...) {
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    diagnostics_add(a->diagnostics, DIAG_ERROR, ast_token(a->ast, node)->offset, "%s", message);
+}
+
+static SemanticBinding* analyzer_lookup(Analyzer* a, unsigned int symbol) {
+    unsigned int* binding = hash_map_get(&a->visible, &symbol);
+    return binding != NULL ? &((SemanticBinding*)a->bindings.buf)[*binding] : NULL;
+}
+
+static void analyzer_push_scope(Analyzer* a) {
+    SemanticScope scope = {.bindings_start = a->bindings.len, .slots_start = a->next_slot};
+    dynamic_array_append(&a->scopes, &scope);
+}
+
+static void analyzer_pop_scope(Analyzer* a) {
+    SemanticScope scope = ((SemanticScope*)a->scopes.buf)[--a->scopes.len];
+
+    // Bindings are undone newest first, so each name goes back to whatever it was before the scope started
+    while (a->bindings.len > scope.bindings_start) {
+        SemanticBinding* binding = &((SemanticBinding*)a->bindings.buf)[--a->bindings.len];
+        if (binding->previous == AST_NONE) {
+            hash_map_remove(&a->visible, &binding->symbol);
+        } else {
+            hash_map_insert(&a->visible, &binding->symbol, &binding->previous);
+        }
+    }
+    a->next_slot = scope.slots_start;
+}
+
+// Declares a name in the innermost scope, reporting an error if it was already declared in that same scope.
+// Returns the slot given to the name
+static unsigned int analyzer_declare(Analyzer* a, unsigned int node, unsigned int kind, unsigned int type, unsigned int slot) {
+    unsigned int symbol = ast_get(a->ast, node)->payload.symbol;
+    unsigned int depth = a->scopes.len;
+    SemanticBinding* existing = analyzer_lookup(a, symbol);
+    if (existing != NULL && existing->depth == depth) {
+        analyzer_error(a, node, "%s is already declared in this scope", ast_symbol(a->ast, node)->str);
+    }
+
+    if (kind == SEM_KIND_LOCAL) {
+        slot = a->next_slot++;
+        if (a->next_slot > *a->slot_count) {
+            *a->slot_count = a->next_slot;
+        }
+    } else if (kind == SEM_KIND_GLOBAL) {
+        slot = a->sem->global_count++;
+    }
+
+    unsigned int* previous = hash_map_get(&a->visible, &symbol);
+    SemanticBinding binding = {.symbol = symbol, .kind = kind, .type = type, .slot = slot, .depth = depth,
+                               .previous = previous != NULL ? *previous : AST_NONE};
+    unsigned int index = a->bindings.len;
+    dynamic_array_append(&a->bindings, &binding);
+    hash_map_insert(&a->visible, &symbol, &index);
+    return slot;
+}
+
+static unsigned int analyze(Analyzer* a, unsigned int node);
+
+// Analyzes a node whose value is going to be stored somewhere of the given type, and reports an error if it doesn't fit.
+// what is added to the error message to say where the value was going, like " for the return value"
+static void analyze_value(Analyzer* a, unsigned int node, unsigned int type, const char* what) {
+    unsigned int valueType = analyze(a, node);
+    if (!semantic_convertible(valueType, type)) {
+        analyzer_error(a, node, "expected %s%s, but found %s", semantic_type_name(type), what, semantic_type_name(valueType));
+    }
+}
+
+static void analyze_condition(Analyzer* a, unsigned int node) {
+    unsigned int type = analyze(a, node);
+    if (type == SEM_TYPE_STRING) {
+        analyzer_error(a, node, "a condition has to be a number, not a string");
+    }
+}
+
+static unsigned int analyze_binary(Analyzer* a, AST_node* node, unsigned int index) {
+    unsigned int left = analyze(a, node->first_child);
+    unsigned int right = analyze(a, ast_get(a->ast, node->first_child)->next_sibling);
+    const char* op = ast_token(a->ast, index)->literal.str;
+    if (left == SEM_TYPE_ERROR || right == SEM_TYPE_ERROR) {
+        return SEM_TYPE_ERROR;
+    }
+
+    if (left == SEM_TYPE_STRING || right == SEM_TYPE_STRING) {
+        if (left != right) {
+            analyzer_error(a, index, "can't use %s on a string and a number", op);
+            return SEM_TYPE_ERROR;
+        } else if (node->type == AST_EXPRESSION && node->data == OP_PLUS) {
+            return SEM_TYPE_STRING;
+        } else if (node->type == AST_COMPARISON && (node->data == OP_EQUAL_EQUAL || node->data == OP_NOT_EQUAL)) {
+            return SEM_TYPE_INT;
+        }
+        analyzer_error(a, index, "can't use %s on strings", op);
+        return SEM_TYPE_ERROR;
+    }
+
+    // Comparisons are 1 or 0, and arithmetic is done on floats if either side is one
+    if (node->type == AST_COMPARISON) {
+        return SEM_TYPE_INT;
+    }
+    return left == SEM_TYPE_FLOAT || right == SEM_TYPE_FLOAT ? SEM_TYPE_FLOAT : SEM_TYPE_INT;
+}
+
+static unsigned int analyze_variable(Analyzer* a, unsigned int index) {
+    SemanticBinding* binding = analyzer_lookup(a, ast_get(a->ast, index)->payload.symbol);
+    if (binding == NULL) {
+        analyzer_error(a, index, "%s is not declared", ast_symbol(a->ast, index)->str);
+        return SEM_TYPE_ERROR;
+    } else if (binding->kind == SEM_KIND_FUNCTION) {
+        analyzer_error(a, index, "%s is a function, so it has to be called", ast_symbol(a->ast, index)->str);
+        return SEM_TYPE_ERROR;
+    }
+
+    SemanticInfo* info = semantic_get(a->sem, index);
+    info->kind = binding->kind;
+    info->slot = binding->slot;
+    return binding->type;
+}
+
+static unsigned int analyze_assignment(Analyzer* a, AST_node* node, unsigned int index) {
+    unsigned int target = analyze(a, node->first_child);
+    unsigned int value = ast_get(a->ast, node->first_child)->next_sibling;
+    if (node->data == OP_EQUAL) {
+        analyze_value(a, value, target, "");
+        return target;
+    }
+
+    // For compound assignments like +=, the value has to work with the operator as well as fit in the variable
+    unsigned int valueType = analyze(a, value);
+    if (target == SEM_TYPE_ERROR || valueType == SEM_TYPE_ERROR) {
+        return target;
+    } else if (target == SEM_TYPE_STRING || valueType == SEM_TYPE_STRING) {
+        if (target != valueType || node->data != OP_PLUS_EQUAL) {
+            analyzer_error(a, index, "can't use %s with %s", ast_token(a->ast, index)->literal.str,
+                           target != valueType ? "a string and a number" : "strings");
+        }
+    }
+    return target;
+}
+
+static unsigned int analyze_call(Analyzer* a, AST_node* node, unsigned int index) {
+    SemanticBinding* binding = analyzer_lookup(a, node->payload.symbol);
+    if (binding == NULL || binding->kind != SEM_KIND_FUNCTION) {
+        analyzer_error(a, index, binding == NULL ? "%s is not declared" : "%s is not a function", ast_symbol(a->ast, index)->str);
+        // The arguments are still checked, since they could have problems of their own
+        AST_FOR_EACH_CHILD(a->ast, index, arg) {
+            analyze(a, arg);
+        }
+        return SEM_TYPE_ERROR;
+    }
+
+    SemanticInfo* info = semantic_get(a->sem, index);
+    info->kind = SEM_KIND_FUNCTION;
+    info->slot = binding->slot;
+
+    SemanticFunction* function = &((SemanticFunction*)a->sem->functions.buf)[binding->slot];
+    unsigned int returnType = function->return_type;
+    unsigned int param = ast_get(a->ast, function->node)->first_child;
+    unsigned int count = 0;
+    AST_FOR_EACH_CHILD(a->ast, index, arg) {
+        if (count < function->param_count) {
+            analyze_value(a, arg, semantic_keyword_type(ast_get(a->ast, param)->data), " for the argument");
+            param = ast_get(a->ast, param)->next_sibling;
+        } else {
+            analyze(a, arg);
+        }
+        count++;
+    }
+
+    if (count != function->param_count) {
+        analyzer_error(a, index, "%s takes %u argument%s, not %u", ast_symbol(a->ast, index)->str, function->param_count,
+                       function->param_count == 1 ? "" : "s", count);
+    }
+    return returnType;
+}
+
+static void analyze_function(Analyzer* a, unsigned int index) {
+    unsigned int functionIndex = semantic_get(a->sem, index)->slot;
+    SemanticFunction* function = &((SemanticFunction*)a->sem->functions.buf)[functionIndex];
+    unsigned int* outerSlotCount = a->slot_count;
+    unsigned int outerSlot = a->next_slot;
+
+    a->slot_count = &function->local_count;
+    a->next_slot = 0;
+    a->return_type = function->return_type;
+
+    // The parameters and the top of the body share a scope, so a parameter can't be declared again in the body
+    analyzer_push_scope(a);
+    AST_FOR_EACH_CHILD(a->ast, index, child) {
+        if (ast_get(a->ast, child)->type == AST_BLOCK) {
+            semantic_get(a->sem, child)->type = SEM_TYPE_NONE;
+            AST_FOR_EACH_CHILD(a->ast, child, statement) {
+                analyze(a, statement);
+            }
+        } else {
+            analyze(a, child);
+        }
+    }
+    analyzer_pop_scope(a);
+
+    // The functions array isn't added to while analyzing, so function still points at the right place
+    a->slot_count = outerSlotCount;
+    a->next_slot = outerSlot;
+    a->return_type = SEM_TYPE_NONE;
+}
+
+// Uses the results from an earlier run for the function node if the reuse has them, and everything the function depends
+// on still means the same thing. Returns false if the function has to be analyzed
+static bool analyzer_reuse_function(Analyzer* a, unsigned int index) {
+    SemanticReuse* reuse = a->sem->reuse;
+    SemanticReusable* functions = (SemanticReusable*)reuse->functions.buf;
+    while (a->next_reusable < reuse->functions.len && functions[a->next_reusable].node < index) {
+        a->next_reusable++;
+    }
+    if (a->next_reusable == reuse->functions.len || functions[a->next_reusable].node != index) {
+        return false;
+    }
+
+    SemanticReusable* function = &functions[a->next_reusable];
+    SemanticDependency* dependencies = (SemanticDependency*)reuse->dependencies.buf;
+    for (unsigned int i = function->dependencies_start; i < function->dependencies_end; i++) {
+        SemanticBinding* binding = analyzer_lookup(a, dependencies[i].symbol);
+        if (binding == NULL || binding->kind != dependencies[i].kind || binding->type != dependencies[i].type ||
+            (binding->kind == SEM_KIND_FUNCTION && semantic_signature(a->sem, a->ast, binding->slot) != dependencies[i].signature)) {
+            return false;
+        }
+    }
+
+    // The function node itself keeps what analyzer_declare_functions gave it, since its index among the functions
+    // can be different from last time. For the same reason, everything that uses a global or calls a function gets
+    // its slot from what the name refers to now
+    SemanticInfo* info = (SemanticInfo*)reuse->info.buf + function->info_start;
+    memcpy(semantic_get(a->sem, function->nodes_start), info, (size_t)(function->node - function->nodes_start) * sizeof(SemanticInfo));
+    for (unsigned int i = function->nodes_start; i < function->node; i++) {
+        SemanticInfo* nodeInfo = semantic_get(a->sem, i);
+        unsigned int type = ast_get(a->ast, i)->type;
+        if ((type == AST_VARIABLE || type == AST_CALL) && (nodeInfo->kind == SEM_KIND_GLOBAL || nodeInfo->kind == SEM_KIND_FUNCTION)) {
+            nodeInfo->slot = analyzer_lookup(a, ast_get(a->ast, i)->payload.symbol)->slot;
+        }
+    }
+    ((SemanticFunction*)a->sem->functions.buf)[semantic_get(a->sem, index)->slot].local_count = function->local_count;
+    return true;
+}
+
+// Every function is declared before anything else is analyzed, so functions can be called before the point where they are
+// written (including from themselves)
+static void analyzer_declare_functions(Analyzer* a) {
+    AST_FOR_EACH_CHILD(a->ast, 0, item) {
+        AST_node* node = ast_get(a->ast, item);
+        if (node->type != AST_FUNCTION) {
+            continue;
+        }
+
+        SemanticFunction function = {.node = item, .symbol = node->payload.symbol, .return_type = semantic_keyword_type(node->data),
+                                     .param_count = 0, .local_count = 0};
+        AST_FOR_EACH_CHILD(a->ast, item, child) {
+            function.param_count += ast_get(a->ast, child)->type == AST_DECLARATION;
+        }
+
+        unsigned int functionIndex = a->sem->functions.len;
+        dynamic_array_append(&a->sem->functions, &function);
+        analyzer_declare(a, item, SEM_KIND_FUNCTION, function.return_type, functionIndex);
+
+        SemanticInfo* info = semantic_get(a->sem, item);
+        info->kind = SEM_KIND_FUNCTION;
+        info->slot = functionIndex;
+        info->type = function.return_type;
+    }
+}
+
+// Analyzes the node and everything under it, and returns the type of its value
+static unsigned int analyze(Analyzer* a, unsigned int index) {
+    AST_node* node = ast_get(a->ast, index);
+    unsigned int type = SEM_TYPE_NONE;
+
+    switch (node->type) {
+        case AST_INT_CONSTANT:
+            type = SEM_TYPE_INT;
+            break;
+        case AST_FLOAT_CONSTANT:
+            type = SEM_TYPE_FLOAT;
+            break;
+        case AST_STRING_CONSTANT:
+            type = SEM_TYPE_STRING;
+            break;
+        case AST_VARIABLE:
+            type = analyze_variable(a, index);
+            break;
+        case AST_EXPRESSION:
+        case AST_COMPARISON:
+            type = analyze_binary(a, node, index);
+            break;
+        case AST_UNARY:
+            type = analyze(a, node->first_child);
+            if (type == SEM_TYPE_STRING) {
+                analyzer_error(a, index, "can't use %s on a string", ast_token(a->ast, index)->literal.str);
+                type = SEM_TYPE_ERROR;
+            }
+            break;
+        case AST_ASSIGNMENT:
+            type = analyze_assignment(a, node, index);
+            break;
+        case AST_CALL:
+            type = analyze_call(a, node, index);
+            break;
+
+        case AST_DECLARATION: {
+            type = semantic_keyword_type(node->data);
+            // The initial value is analyzed before the name is declared, so int x = x; uses the x from outside
+            if (node->first_child != AST_NONE) {
+                analyze_value(a, node->first_child, type, "");
+            }
+            unsigned int kind = a->scopes.len == 0 ? SEM_KIND_GLOBAL : SEM_KIND_LOCAL;
+            SemanticInfo* info = semantic_get(a->sem, index);
+            info->kind = kind;
+            info->slot = analyzer_declare(a, index, kind, type, 0);
+            break;
+        }
+
+        case AST_BLOCK:
+            analyzer_push_scope(a);
+            AST_FOR_EACH_CHILD(a->ast, index, child) {
+                analyze(a, child);
+            }
+            analyzer_pop_scope(a);
+            break;
+
+        case AST_BRANCH:
+        case AST_WHILE: {
+            analyze_condition(a, node->first_child);
+            for (unsigned int child = ast_get(a->ast, node->first_child)->next_sibling; child != AST_NONE; child = ast_get(a->ast, child)->next_sibling) {
+                analyze(a, child);
+            }
+            break;
+        }
+
+        case AST_FOR: {
+            // A variable declared in the initializer only exists for the loop
+            analyzer_push_scope(a);
+            unsigned int child = node->first_child;
+            analyze(a, child);
+            child = ast_get(a->ast, child)->next_sibling;
+            analyze_condition(a, child);
+            child = ast_get(a->ast, child)->next_sibling;
+            analyze(a, child);
+            analyze(a, ast_get(a->ast, child)->next_sibling);
+            analyzer_pop_scope(a);
+            break;
+        }
+
+        case AST_RETURN:
+            if (a->return_type == SEM_TYPE_NONE) {
+                analyzer_error(a, index, "return can only be used inside of a function");
+                if (node->first_child != AST_NONE) {
+                    analyze(a, node->first_child);
+                }
+            } else if (node->first_child == AST_NONE) {
+                analyzer_error(a, index, "this function returns %s, so it has to return a value", semantic_type_name(a->return_type));
+            } else {
+                analyze_value(a, node->first_child, a->return_type, " for the return value");
+            }
+            break;
+
+        case AST_FUNCTION:
+            if (a->sem->reuse == NULL) {
+                analyze_function(a, index);
+            } else if (analyzer_reuse_function(a, index)) {
+                a->sem->reuse->reused++;
+            } else {
+                analyze_function(a, index);
+                a->sem->reuse->analyzed++;
+            }
+            type = semantic_get(a->sem, index)->type;
+            break;
+
+        case AST_ERROR:
+            type = SEM_TYPE_ERROR;
+            break;
+    }
+
+    semantic_get(a->sem, index)->type = type;
+    return type;
+}
+
+int semantic_analyze(Semantic* sem, AST* ast, DynamicArray* diagnostics) {
+    sem->functions.len = 0;
+    sem->global_count = 0;
+    sem->script_local_count = 0;
+    dynamic_array_resize(&sem->info, ast->nodes.len, true);
+    for (unsigned int i = 0; i < ast->nodes.len; i++) {
+        *semantic_get(sem, i) = (SemanticInfo){.type = SEM_TYPE_NONE, .kind = SEM_KIND_NONE, .slot = AST_NONE};
+    }
+
+    Analyzer a = {.ast = ast, .sem = sem, .diagnostics = diagnostics, .next_slot = 0, .slot_count = &sem->script_local_count,
+                  .return_type = SEM_TYPE_NONE, .next_reusable = 0};
+    hash_map_init(&a.visible, &STRING("unsigned int"), &STRING("unsigned int"));
+    dynamic_array_init(&a.bindings, &STRING("SemanticBinding"));
+    dynamic_array_init(&a.scopes, &STRING("SemanticScope"));
+    if (sem->reuse != NULL) {
+        sem->reuse->reused = 0;
+        sem->reuse->analyzed = 0;
+    }
+    unsigned int errorsBefore = diagnostics_count(diagnostics, DIAG_ERROR);
+
+    analyzer_declare_functions(&a);
+    AST_FOR_EACH_CHILD(ast, 0, item) {
+        analyze(&a, item);
+    }
+
+    hash_map_free(&a.visible);
+    dynamic_array_free(&a.bindings);
+    dynamic_array_free(&a.scopes);
+    return diagnostics_count(diagnostics, DIAG_ERROR) > errorsBefore ? -1 : 0;
+}
+
+uint64_t semantic_signature(Semantic* sem, AST* ast, unsigned int function) {
+    SemanticFunction* fn = &((SemanticFunction*)sem->functions.buf)[function];
+    uint64_t hash = hash_map_hash_int(fn->return_type + 1);
+    AST_FOR_EACH_CHILD(ast, fn->node, child) {
+        AST_node* node = ast_get(ast, child);
+        if (node->type == AST_DECLARATION) {
+            hash = hash_map_hash_int(hash ^ (semantic_keyword_type(node->data) + 1));
+        }
+    }
+    // 0 is left for things that aren't functions
+    return hash != 0 ? hash : 1;
+}
+
+typedef struct SemanticDependencyWalk {
+    Semantic* sem;
+    DynamicArray* dependencies;
+    // Where the dependencies of this function start in the array
+    unsigned int start;
+} SemanticDependencyWalk;
+
+static int semantic_dependency_enter(AST* ast, unsigned int index, void* ctx) {
+    SemanticDependencyWalk* walk = (SemanticDependencyWalk*)ctx;
+    AST_node* node = ast_get(ast, index);
+    SemanticInfo* info = semantic_get(walk->sem, index);
+    if (!((node->type == AST_VARIABLE && info->kind == SEM_KIND_GLOBAL) || (node->type == AST_CALL && info->kind == SEM_KIND_FUNCTION))) {
+        return AST_VISIT_CONTINUE;
+    }
+
+    // A function rarely uses more than a handful of different globals and functions, so a scan is enough to skip repeats
+    SemanticDependency* dependencies = (SemanticDependency*)walk->dependencies->buf;
+    for (unsigned int i = walk->start; i < walk->dependencies->len; i++) {
+        if (dependencies[i].symbol == node->payload.symbol) {
+            return AST_VISIT_CONTINUE;
+        }
+    }
+
+    // Uses of a global have the type of the global, and calls have the return type of the function
+    SemanticDependency dependency = {.symbol = node->payload.symbol, .kind = info->kind, .type = info->type, .__padding = 0,
+                                     .signature = info->kind == SEM_KIND_FUNCTION ? semantic_signature(walk->sem, ast, info->slot) : 0};
+    dynamic_array_append(walk->dependencies, &dependency);
+    return AST_VISIT_CONTINUE;
+}
+
+int semantic_dependencies(Semantic* sem, AST* ast, unsigned int node, DynamicArray* dependencies) {
+    SemanticDependencyWalk walk = {.sem = sem, .dependencies = dependencies, .start = dependencies->len};
+    AST_visitor visitor = {.enter = semantic_dependency_enter, .leave = NULL, .ctx = &walk};
+    ast_visit(ast, node, &visitor);
+    return 0;
+}
+
+int semantic_print(Semantic* sem, AST* ast, unsigned int index, unsigned int depth) {
+    ast_print_node(ast, index, depth);
+    SemanticInfo* info = semantic_get(sem, index);
+    if (info->type != SEM_TYPE_NONE) {
+        printf(" : %s", semantic_type_name(info->type));
+    }
+    if (info->kind == SEM_KIND_LOCAL || info->kind == SEM_KIND_GLOBAL) {
+        printf(" [%s %u]", info->kind == SEM_KIND_LOCAL ? "local" : "global", info->slot);
+    }
+    printf("\n");
+
+    AST_FOR_EACH_CHILD(ast, index, child) {
+        semantic_print(sem, ast, child, depth + 1);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#ifndef SEMANTIC_H
+#define SEMANTIC_H
+
+#include <stdint.h>
+#include "Diagnostics.h"
+#include "DynamicArray.h"
+#include "parser.h"
+
+// The semantic pass runs over the tree made by the parser. It works out what every name refers to, checks that
+// the types of everything line up, and records both for each node so later passes don't have to work them out again
+
+// The types of values in the language
+enum SemanticTypes {
+    // For nodes that don't have a value, like statements
+    SEM_TYPE_NONE,
+    SEM_TYPE_INT,
+    SEM_TYPE_FLOAT,
+    SEM_TYPE_STRING,
+    // For nodes whose type couldn't be worked out because of an error. Nothing is reported about these,
+    // since the error that caused it was already reported
+    SEM_TYPE_ERROR
+};
+
+// What a name refers to
+enum SemanticKinds {
+    SEM_KIND_NONE,
+    // A variable (or parameter) inside of a function, or inside of a block at the top level of the file
+    SEM_KIND_LOCAL,
+    // A variable declared at the top level of the file
+    SEM_KIND_GLOBAL,
+    SEM_KIND_FUNCTION
+};
+
+// What the semantic pass found out about a single node
+typedef struct SemanticInfo {
+    // The type of the value of the node (one of the SEM_TYPEs). For declarations, this is the type of the variable
+    uint8_t type;
+    // For nodes that use or declare a name, what kind of thing the name refers to (one of the SEM_KINDs)
+    uint8_t kind;
+    uint16_t __padding;
+    // For variables and declarations, the slot the variable is stored in. Locals are numbered from 0 within each function
+    // (parameters first), and globals are numbered from 0 across the whole file. Variables in blocks that have ended
+    // give up their slots, so a slot can be shared by variables that are never alive at the same time.
+    // For calls and functions, the index of the function in the functions array. Otherwise it is AST_NONE
+    uint32_t slot;
+} SemanticInfo;
+
+typedef struct SemanticFunction {
+    // The AST_FUNCTION node of the function
+    unsigned int node;
+    // The interned name of the function
+    unsigned int symbol;
+    unsigned int return_type;
+    unsigned int param_count;
+    // The number of slots needed for the locals of the function, parameters included
+    unsigned int local_count;
+} SemanticFunction;
+
+// Something declared outside of a function that the function uses, and what it was when the function was analyzed.
+// Its slot isn't part of it, since the slots can just be filled in again when the function is reused
+typedef struct SemanticDependency {
+    // The interned name
+    uint32_t symbol;
+    uint32_t kind;
+    uint32_t type;
+    uint32_t __padding;
+    // For functions, a hash of the types of their return value and parameters (see semantic_signature). 0 otherwise
+    uint64_t signature;
+} SemanticDependency;
+
+// A function whose results from an earlier run can be used again, as long as everything it depends on is still the same
+typedef struct SemanticReusable {
+    // The nodes of the function, from the first one up to and including the function node itself
+    unsigned int nodes_start;
+    unsigned int node;
+    unsigned int local_count;
+    // Where the SemanticInfo for the first node of the function is in the info array of the SemanticReuse
+    unsigned int info_start;
+    // The range of its SemanticDependencies in the dependencies array of the SemanticReuse, from start up to, but not including, end
+    unsigned int dependencies_start, dependencies_end;
+} SemanticReusable;
+
+// Lets semantic_analyze skip over functions that haven't changed since an earlier run (see incremental.h). Only functions
+// whose dependencies changed (or who changed themselves) are analyzed again
+typedef struct SemanticReuse {
+    // Of type SemanticReusable, in the same order as the functions are in the tree
+    DynamicArray functions;
+    // Of type SemanticInfo
+    DynamicArray info;
+    // Of type SemanticDependency
+    DynamicArray dependencies;
+    // How many functions had their results reused, and how many had to be analyzed
+    unsigned int reused;
+    unsigned int analyzed;
+} SemanticReuse;
+
+typedef struct Semantic {
+    // A SemanticInfo for every node in the tree, indexed the same way as the nodes
+    DynamicArray info;
+    // Every function in the file (of type SemanticFunction), in the order they appear
+    DynamicArray functions;
+    unsigned int global_count;
+    // The number of slots needed for variables declared in blocks at the top level of the file
+    unsigned int script_local_count;
+    // Can be set before calling semantic_analyze to reuse the results for functions from an earlier run. NULL by default
+    SemanticReuse* reuse;
+} Semantic;
+
+// Registers the types used by this module. Should be called once after ast_module_init
+int semantic_module_init(void);
+
+int semantic_init(Semantic* sem);
+
+int semantic_free(Semantic* sem);
+
+// For use with the type registry
+int semantic_deallocator(void* sem);
+
+// Runs the semantic pass over the whole tree, adding an error to diagnostics (an array of Diagnostics) for everything
+// that is wrong. Nodes that the parser replaced with AST_ERROR are skipped over, so this can be run on a tree that had
+// syntax errors to find the rest of the problems in one go.
+// Returns -1 if there were any errors
+int semantic_analyze(Semantic* sem, AST* ast, DynamicArray* diagnostics);
+
+int semantic_reuse_init(SemanticReuse* reuse);
+
+int semantic_reuse_free(SemanticReuse* reuse);
+
+// Returns a hash of the return type and the types of the parameters of the function with the given index. Calls to the
+// function only have to be checked again when this changes
+uint64_t semantic_signature(Semantic* sem, AST* ast, unsigned int function);
+
+// Adds a SemanticDependency to dependencies for every function and global that the function node uses (each only once).
+// Has to be called after semantic_analyze, before anything changes the tree
+int semantic_dependencies(Semantic* sem, AST* ast, unsigned int node, DynamicArray* dependencies);
+
+// Returns the SemanticInfo for a node
+inline SemanticInfo* semantic_get(Semantic* sem, unsigned int node) {
+    return &((SemanticInfo*)sem->info.buf)[node];
+}
+
+// Returns the name of the type, like "int"
+const char* semantic_type_name(unsigned int type);
+
+// Prints the tree like ast_print, along with the type and slot of every node
+int semantic_print(Semantic* sem, AST* ast, unsigned int node, unsigned int depth);
+
+#endif
@@ -0,0 +1,23 @@
+# Runs a file with one function through the cache, edits it, and runs it again. Loading the entry for the old version
+# used to copy its one function into an array with no buffer yet, which crashed every run after the edit
+#
+# Takes MAIN (the compiler) and DIR (a scratch directory, which is emptied first)
+
+file(REMOVE_RECURSE "${DIR}")
+file(MAKE_DIRECTORY "${DIR}")
+
+function(run_expecting source expected)
+    file(WRITE "${DIR}/one.txt" "${source}\n")
+    execute_process(COMMAND "${MAIN}" one.txt --cache cache --run
+                    WORKING_DIRECTORY "${DIR}"
+                    RESULT_VARIABLE status
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output)
+    if(NOT status EQUAL 0 OR NOT output MATCHES "main returned ${expected}")
+        message(FATAL_ERROR "Expected main to return ${expected}, but the run ended with ${status}:\n${output}")
+    endif()
+endfunction()
+
+run_expecting("int main(){return 1;}" 1)
+run_expecting("int main(){return 2;}" 2)
+run_expecting("int main(){return 2;}" 2)